@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#include "ffaudiocore.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Decodes the first audio stream of each file with the decode core of FfmpegAudioDecoder,
+ * once with 16-bit and once with float output, and prints one line per output format:
+ *
+ * - rt: media duration divided by the decode wall time.
+ * - p50/p99/max: decodePacket latency in microseconds, p50 and p99 at bucket resolution.
+ *   With -b, the latency of a decodePackets call for a batch of that many packets.
+ * - swr%: share of the decode time spent in swr_convert.
+ * - alloc/pkt: allocations counted by the core plus output buffer growths, per packet.
+ * - heap: peak of the heap in use above the level before the run, in KiB.
+ *
+ * With -d, output with more channels is mixed down to that many channels. With -r, the output
+ * is converted to that sample rate with the resampler preset given by -q, 0 (fast) to 2 (high).
+ *
+ * With -S, the output is fed to a spectrum analyzer of kSpectrumFftSize points and
+ * kSpectrumBandCount bands analysing every that many milliseconds, as a visualizer would, so
+ * that its share of the decode time shows in rt and p50.
+ *
+ * With -e, a gain and a ten band equalizer are applied to the output, and their time is
+ * included in swr%.
+ *
+ * With -i, the file is also decoded to 32-bit and packed 24-bit output, as the renderer does
+ * for lossless formats when integer output is enabled.
+ *
+ * Packets are read into memory first so that demuxing is not measured.
+ */
+
+namespace {
+    // Starting size of the output buffer, as allocated by FfmpegAudioDecoder.
+    const int kInitialOutputSize = 8 * 1024;
+    // Spectrum analysis of -S, as set up by a typical bar visualizer.
+    const int kSpectrumFftSize = 2048;
+    const int kSpectrumBandCount = 64;
+
+    struct Options {
+        int iterations = 1;
+        int batchSize = 1;
+        int downmixChannelCount = 0;
+        int targetSampleRate = 0;
+        int resampleQuality = RESAMPLE_QUALITY_DEFAULT;
+        int spectrumIntervalMs = 0;
+        bool effects = false;
+        bool integerOutput = false;
+    };
+
+    struct OutputFormat {
+        const char *name;
+        int encoding;
+        int bytesPerSample;
+    };
+
+    const OutputFormat kOutputFormats[] = {
+            {"s16", OUTPUT_ENCODING_PCM_16BIT, 2},
+            {"flt", OUTPUT_ENCODING_PCM_FLOAT, 4},
+            {"s32", OUTPUT_ENCODING_PCM_32BIT, 4},
+            {"s24", OUTPUT_ENCODING_PCM_24BIT, 3},
+    };
+
+    struct Run {
+        AudioContext audioContext{};
+        LatencyHistogram packetLatency;
+        int64_t packets = 0;
+        int64_t errors = 0;
+        int64_t outputBytes = 0;
+        int64_t decodeUs = 0;
+        int64_t bufferGrowths = 0;
+        size_t peakHeapBytes = 0;
+    };
+
+    size_t heapInUse() {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+        return mallinfo2().uordblks;
+#else
+        return (size_t) mallinfo().uordblks;
+#endif
+    }
+
+    /**
+     * Returns the upper bound of the bucket of a serialized LatencyHistogram in which the
+     * quantile falls, or its maximum for the last bucket.
+     */
+    int64_t quantileUs(const int64_t *histogram, double quantile) {
+        int64_t count = histogram[0];
+        const int64_t *buckets = histogram + 3;
+        auto rank = (int64_t) (quantile * (double) count);
+        int64_t seen = 0;
+        for (int i = 0; i < LatencyHistogram::kBucketCount - 1; i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                return std::min(int64_t{2} << i, histogram[2]);
+            }
+        }
+        return histogram[2];
+    }
+
+    bool readPackets(const char *file, AVFormatContext **formatContext, int *streamIndex,
+                     std::vector<AVPacket *> *packets) {
+        int result = avformat_open_input(formatContext, file, nullptr, nullptr);
+        if (result < 0) {
+            logError("avformat_open_input", result);
+            return false;
+        }
+        result = avformat_find_stream_info(*formatContext, nullptr);
+        if (result < 0) {
+            logError("avformat_find_stream_info", result);
+            return false;
+        }
+        *streamIndex = av_find_best_stream(*formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        if (*streamIndex < 0) {
+            fprintf(stderr, "%s: no audio stream\n", file);
+            return false;
+        }
+        AVPacket *packet = av_packet_alloc();
+        while (av_read_frame(*formatContext, packet) >= 0) {
+            if (packet->stream_index == *streamIndex) {
+                packets->push_back(av_packet_clone(packet));
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        return true;
+    }
+
+    void recordCall(Run *run, int64_t durationUs, size_t baseHeap) {
+        run->packetLatency.record(durationUs);
+        run->decodeUs += durationUs;
+        size_t heap = heapInUse();
+        if (heap > baseHeap) {
+            run->peakHeapBytes = std::max(run->peakHeapBytes, heap - baseHeap);
+        }
+    }
+
+    /**
+     * Decodes the packets in batches of batchSize with decodePackets, as FfmpegAudioBatchDecoder
+     * does.
+     */
+    void decodeBatches(const std::vector<AVPacket *> &packets, int batchSize, Run *run) {
+        std::vector<uint8_t> input;
+        std::vector<int> sizes;
+        std::vector<int64_t> timesUs;
+        std::vector<int> ends(batchSize);
+        size_t baseHeap = heapInUse();
+        for (size_t first = 0; first < packets.size(); first += batchSize) {
+            size_t last = std::min(packets.size(), first + batchSize);
+            input.clear();
+            sizes.clear();
+            timesUs.clear();
+            for (size_t i = first; i < last; i++) {
+                input.insert(input.end(), packets[i]->data, packets[i]->data + packets[i]->size);
+                sizes.push_back(packets[i]->size);
+                timesUs.push_back(packets[i]->pts);
+            }
+            input.resize(input.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            int64_t startUs = av_gettime_relative();
+            int size = decodePackets(&run->audioContext, input.data(), sizes.data(),
+                                     timesUs.data(), (int) sizes.size(), ends.data());
+            recordCall(run, av_gettime_relative() - startUs, baseHeap);
+            run->packets += (int64_t) sizes.size();
+            if (size < 0) {
+                run->errors++;
+            } else {
+                run->outputBytes += size;
+            }
+        }
+    }
+
+    /**
+     * Decodes all packets with a new codec context, adding the measurements to run.
+     */
+    bool decodeAll(const AVCodec *codec, const AVCodecParameters *parameters,
+                   const OutputFormat &format, const std::vector<AVPacket *> &packets,
+                   const Options &options, Run *run) {
+        AudioContext &audioContext = run->audioContext;
+        audioContext.codecContext = createContext(
+                codec, parameters->extradata, parameters->extradata_size, format.encoding,
+                parameters->sample_rate, parameters->ch_layout.nb_channels);
+        if (!audioContext.codecContext) {
+            return false;
+        }
+        if (options.batchSize > 1) {
+            decodeBatches(packets, options.batchSize, run);
+            releaseContext(&audioContext.codecContext);
+            return true;
+        }
+        std::vector<uint8_t> output(kInitialOutputSize);
+        GrowOutputBuffer growBuffer = [&output, run](int requiredSize) {
+            output.resize(requiredSize);
+            run->bufferGrowths++;
+            return output.data();
+        };
+        size_t baseHeap = heapInUse();
+        for (AVPacket *packet : packets) {
+            int64_t startUs = av_gettime_relative();
+            int size = decodePacket(&audioContext, packet, output.data(), (int) output.size(),
+                                    growBuffer);
+            recordCall(run, av_gettime_relative() - startUs, baseHeap);
+            run->packets++;
+            if (size < 0) {
+                run->errors++;
+            } else {
+                run->outputBytes += size;
+            }
+        }
+        releaseContext(&audioContext.codecContext);
+        return true;
+    }
+
+    void benchmark(const char *file, const AVCodec *codec, const AVCodecParameters *parameters,
+                   const OutputFormat &format, const std::vector<AVPacket *> &packets,
+                   const Options &options) {
+        Run run;
+        run.audioContext.packS24Output = format.encoding == OUTPUT_ENCODING_PCM_24BIT;
+        run.audioContext.downmixChannelCount = options.downmixChannelCount;
+        run.audioContext.targetSampleRate = options.targetSampleRate;
+        run.audioContext.resampleQuality = options.resampleQuality;
+        if (options.effects) {
+            DspParameters parameters;
+            parameters.gainDb = -3;
+            parameters.eqBandCount = DSP_MAX_EQ_BANDS;
+            for (int i = 0; i < DSP_MAX_EQ_BANDS; i++) {
+                // Octave bands from 31 Hz, alternately boosted and cut.
+                parameters.eqBands[i] = {DSP_FILTER_PEAKING, 31.25f * (float) (1 << i),
+                                         i % 2 ? -3.0f : 3.0f, 1.41f};
+            }
+            run.audioContext.effects = std::make_shared<AudioEffects>();
+            run.audioContext.effects->setParameters(parameters);
+        }
+        if (options.spectrumIntervalMs > 0) {
+            auto analyzer = std::make_shared<SpectrumAnalyzer>();
+            if (!analyzer->configure(kSpectrumFftSize, kSpectrumBandCount,
+                                     options.spectrumIntervalMs)) {
+                return;
+            }
+            run.audioContext.spectrum = analyzer;
+        }
+        for (int i = 0; i < options.iterations; i++) {
+            if (!decodeAll(codec, parameters, format, packets, options, &run)) {
+                fprintf(stderr, "%s: failed to open %s\n", file, codec->name);
+                return;
+            }
+        }
+        int64_t stats[DecoderStats::kSerializedSize];
+        run.audioContext.stats.writeTo(stats);
+        const int64_t *counters = stats + DecoderStats::kHeaderSize;
+        const int64_t *resample = counters + COUNTER_COUNT
+                                  + TIMER_RESAMPLE * LatencyHistogram::kSerializedSize;
+        int64_t latency[LatencyHistogram::kSerializedSize];
+        run.packetLatency.writeTo(latency);
+
+        int bytesPerFrame = run.audioContext.outputChannelCount * format.bytesPerSample;
+        int sampleRate = run.audioContext.outputSampleRate;
+        double mediaSeconds = sampleRate > 0 && bytesPerFrame > 0
+                              ? (double) run.outputBytes / bytesPerFrame / sampleRate
+                              : 0;
+        double decodeSeconds = (double) run.decodeUs / 1e6;
+        double packetCount = (double) std::max<int64_t>(run.packets, 1);
+        printf("%-32s %-10s %-5s %8" PRId64 " %6" PRId64 " %9.1f %7" PRId64 " %7" PRId64
+               " %7" PRId64 " %6.1f %9.2f %8zu",
+               file, codec->name, format.name, run.packets, run.errors,
+               decodeSeconds > 0 ? mediaSeconds / decodeSeconds : 0,
+               quantileUs(latency, 0.5), quantileUs(latency, 0.99), latency[2],
+               run.decodeUs > 0 ? 100.0 * (double) resample[1] / (double) run.decodeUs : 0,
+               (double) (counters[COUNTER_ALLOCATIONS] + run.bufferGrowths) / packetCount,
+               run.peakHeapBytes / 1024);
+        printf("\n");
+    }
+
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-n iterations] [-b batch size] [-d channels] [-r rate] "
+                        "[-q quality] [-S interval] [-e] [-i] file...\n",
+                program);
+        exit(2);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    int option;
+    while ((option = getopt(argc, argv, "n:b:d:r:q:S:ei")) != -1) {
+        if (option == 'n' && atoi(optarg) > 0) {
+            options.iterations = atoi(optarg);
+        } else if (option == 'b' && atoi(optarg) > 0) {
+            options.batchSize = atoi(optarg);
+        } else if (option == 'd' && atoi(optarg) > 0) {
+            options.downmixChannelCount = atoi(optarg);
+        } else if (option == 'r' && atoi(optarg) > 0) {
+            options.targetSampleRate = atoi(optarg);
+        } else if (option == 'q' && atoi(optarg) >= RESAMPLE_QUALITY_FAST
+                   && atoi(optarg) <= RESAMPLE_QUALITY_HIGH) {
+            options.resampleQuality = atoi(optarg);
+        } else if (option == 'S' && atoi(optarg) > 0) {
+            options.spectrumIntervalMs = atoi(optarg);
+        } else if (option == 'e') {
+            options.effects = true;
+        } else if (option == 'i') {
+            options.integerOutput = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-32s %-10s %-5s %8s %6s %9s %7s %7s %7s %6s %9s %8s",
+           "file", "codec", "out", "packets", "errors", "rt", "p50", "p99", "max", "swr%",
+           "alloc/pkt", "heap");
+    printf("\n");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        const char *file = argv[i];
+        AVFormatContext *formatContext = nullptr;
+        int streamIndex = -1;
+        std::vector<AVPacket *> packets;
+        if (readPackets(file, &formatContext, &streamIndex, &packets)) {
+            const AVCodecParameters *parameters = formatContext->streams[streamIndex]->codecpar;
+            const AVCodec *codec = avcodec_find_decoder(parameters->codec_id);
+            if (codec) {
+                int formatCount = options.integerOutput ? 4 : 2;
+                for (int j = 0; j < formatCount; j++) {
+                    benchmark(file, codec, parameters, kOutputFormats[j], packets, options);
+                }
+            } else {
+                fprintf(stderr, "%s: no decoder for %s\n", file,
+                        avcodec_get_name(parameters->codec_id));
+                status = 1;
+            }
+        } else {
+            status = 1;
+        }
+        for (AVPacket *packet : packets) {
+            av_packet_free(&packet);
+        }
+        avformat_close_input(&formatContext);
+    }
+
+    struct rusage resourceUsage{};
+    getrusage(RUSAGE_SELF, &resourceUsage);
+    printf("max rss: %ld KiB\n", resourceUsage.ru_maxrss);
+    return status;
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "ffdeinterlace.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Times Deinterlacer::process on synthetic interlaced frames, 1920x1080 yuv420p by default,
+ * in the two modes of FfmpegVideoDecoder. Auto mode processes each frame once, double-rate
+ * mode processes each frame once per field. Prints, per mode, the median and 95th percentile
+ * cost of a call and of a whole frame, and the share of the frame interval that a frame costs
+ * at 1080i50 (25 frames per second) and 1080i60 (30 frames per second). The deinterlacer
+ * splits rows over up to 3 workers plus the calling thread, so the result depends on the
+ * number of cores.
+ */
+
+namespace {
+    const int kRingSize = 8;
+    const int kWarmupFrames = 10;
+    const int64_t kFrameDurationUs50 = 40000;
+    const int64_t kFrameDurationUs60 = 33367;
+
+    struct Options {
+        int frames = 600;
+        int width = 1920;
+        int height = 1080;
+        AVPixelFormat format = AV_PIX_FMT_YUV420P;
+    };
+
+    /**
+     * Fills frame with noise, and with a bar that moves by step pixels per frame and combs
+     * between the fields, so that both the weave and the interpolation paths are taken.
+     */
+    void fillFrame(AVFrame *frame, int index, std::mt19937 *random) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(
+                static_cast<AVPixelFormat>(frame->format));
+        std::uniform_int_distribution<int> noise(0, 7);
+        const int barWidth = frame->width / 8;
+        const int step = frame->width / 64;
+        for (int plane = 0; plane < 3; plane++) {
+            int width = plane ? AV_CEIL_RSHIFT(frame->width, desc->log2_chroma_w) : frame->width;
+            int height = plane ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                               : frame->height;
+            int shift = plane ? desc->log2_chroma_w : 0;
+            for (int y = 0; y < height; y++) {
+                uint8_t *line = frame->data[plane] + (ptrdiff_t) y * frame->linesize[plane];
+                // The bottom field is half a frame ahead of the top field.
+                int barStart = ((index * 2 + (y & 1)) * step / 2 % frame->width) >> shift;
+                for (int x = 0; x < width; x++) {
+                    bool bar = x >= barStart && x < barStart + (barWidth >> shift);
+                    line[x] = static_cast<uint8_t>((bar ? 200 : 64) + noise(*random));
+                }
+            }
+        }
+        frame->flags |= AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST;
+    }
+
+    int64_t percentile(std::vector<int64_t> values, int percent) {
+        if (values.empty()) {
+            return 0;
+        }
+        size_t index = std::min(values.size() - 1, values.size() * percent / 100);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    void run(const Options &options, const std::vector<AVFrame *> &ring, bool doubleRate) {
+        Deinterlacer deinterlacer;
+        std::vector<int64_t> callTimes;
+        std::vector<int64_t> frameTimes;
+        uint8_t *data[4];
+        int linesize[4];
+        for (int i = 0; i < kWarmupFrames + options.frames; i++) {
+            AVFrame *frame = ring[i % ring.size()];
+            frame->pts = i;
+            int64_t frameUs = 0;
+            for (int field = 0; field < (doubleRate ? 2 : 1); field++) {
+                int64_t startUs = av_gettime_relative();
+                if (!deinterlacer.process(frame, field, data, linesize)) {
+                    fprintf(stderr, "Failed to deinterlace frame %d.\n", i);
+                    return;
+                }
+                int64_t callUs = av_gettime_relative() - startUs;
+                frameUs += callUs;
+                if (i >= kWarmupFrames) {
+                    callTimes.push_back(callUs);
+                }
+            }
+            if (i >= kWarmupFrames) {
+                frameTimes.push_back(frameUs);
+            }
+        }
+        int64_t frameMedian = percentile(frameTimes, 50);
+        printf("%-12s %9lld %9lld %10lld %10lld %10.1f %10.1f\n",
+               doubleRate ? "double-rate" : "auto",
+               (long long) percentile(callTimes, 50), (long long) percentile(callTimes, 95),
+               (long long) frameMedian, (long long) percentile(frameTimes, 95),
+               100.0 * frameMedian / kFrameDurationUs50, 100.0 * frameMedian / kFrameDurationUs60);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:h:f:")) != -1) {
+        switch (opt) {
+            case 'n':
+                options.frames = std::max(atoi(optarg), 1);
+                break;
+            case 'w':
+                options.width = std::max(atoi(optarg), 16);
+                break;
+            case 'h':
+                options.height = std::max(atoi(optarg), 16);
+                break;
+            case 'f':
+                options.format = av_get_pix_fmt(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n frames] [-w width] [-h height] [-f pixel format]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (!Deinterlacer::supportsFormat(options.format)) {
+        fprintf(stderr, "Unsupported pixel format.\n");
+        return 1;
+    }
+
+    std::mt19937 random(1);
+    std::vector<AVFrame *> ring;
+    for (int i = 0; i < kRingSize; i++) {
+        AVFrame *frame = av_frame_alloc();
+        frame->width = options.width;
+        frame->height = options.height;
+        frame->format = options.format;
+        if (av_frame_get_buffer(frame, 32) < 0) {
+            fprintf(stderr, "Failed to allocate frame.\n");
+            return 1;
+        }
+        fillFrame(frame, i, &random);
+        ring.push_back(frame);
+    }
+
+    printf("%dx%d %s, %d frames, %u cores\n", options.width, options.height,
+           av_get_pix_fmt_name(options.format), options.frames,
+           std::thread::hardware_concurrency());
+    printf("%-12s %9s %9s %10s %10s %10s %10s\n", "mode", "call us", "call p95", "frame us",
+           "frame p95", "i50 load%", "i60 load%");
+    run(options, ring, false);
+    run(options, ring, true);
+
+    for (AVFrame *frame : ring) {
+        av_frame_free(&frame);
+    }
+    return 0;
+}
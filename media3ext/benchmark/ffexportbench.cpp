@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "ffaudiocore.h"
+#include "ffexport.h"
+
+extern "C" {
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Exports each file to raw PCM in one pass and with -p segments in parallel, one per CPU by
+ * default, and prints the wall time of both, the speedup, whether both wrote the same number
+ * of frames and the largest difference between the samples, in units of the last bit for the
+ * integer encodings. Segments that join exactly give the same frame count and, for decoders
+ * that settle within the preroll, a difference of 0.
+ */
+
+namespace {
+    struct Encoding {
+        const char *name;
+        int encoding;
+        int bytesPerSample;
+    };
+
+    const Encoding kEncodings[] = {
+            {"s16", OUTPUT_ENCODING_PCM_16BIT, 2},
+            {"s24", OUTPUT_ENCODING_PCM_24BIT, 3},
+            {"s32", OUTPUT_ENCODING_PCM_32BIT, 4},
+            {"flt", OUTPUT_ENCODING_PCM_FLOAT, 4},
+    };
+
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-p parallelism] [-c channels] [-e s16|s24|s32|flt] file...\n",
+                program);
+        exit(2);
+    }
+
+    double sampleAt(const uint8_t *data, const Encoding &encoding) {
+        switch (encoding.encoding) {
+            case OUTPUT_ENCODING_PCM_16BIT: {
+                int16_t value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+            case OUTPUT_ENCODING_PCM_24BIT:
+                return (int32_t) ((uint32_t) data[0] << 8 | (uint32_t) data[1] << 16
+                                  | (uint32_t) data[2] << 24) >> 8;
+            case OUTPUT_ENCODING_PCM_32BIT: {
+                int32_t value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+            default: {
+                float value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+        }
+    }
+
+    /**
+     * Returns the largest difference between the samples both files have.
+     */
+    double maxDifference(int serialFd, int parallelFd, const Encoding &encoding) {
+        struct stat serialStat{};
+        struct stat parallelStat{};
+        fstat(serialFd, &serialStat);
+        fstat(parallelFd, &parallelStat);
+        size_t size = (size_t) std::min(serialStat.st_size, parallelStat.st_size);
+        if (size == 0) {
+            return 0;
+        }
+        auto *serial = (const uint8_t *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, serialFd, 0);
+        auto *parallel = (const uint8_t *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+                                                parallelFd, 0);
+        double difference = -1;
+        if (serial != MAP_FAILED && parallel != MAP_FAILED) {
+            difference = 0;
+            for (size_t i = 0; i + encoding.bytesPerSample <= size; i += encoding.bytesPerSample) {
+                difference = std::max(difference, std::abs(sampleAt(serial + i, encoding)
+                                                           - sampleAt(parallel + i, encoding)));
+            }
+        }
+        if (serial != MAP_FAILED) {
+            munmap((void *) serial, size);
+        }
+        if (parallel != MAP_FAILED) {
+            munmap((void *) parallel, size);
+        }
+        return difference;
+    }
+
+    /**
+     * Exports url to a new temporary file and returns its descriptor, or -1.
+     */
+    int exportToTemporaryFile(const char *url, const Encoding &encoding, int channelCount,
+                              int parallelism, ExportInfo *info, int64_t *elapsedUs) {
+        char path[] = "/tmp/ffexportbenchXXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            perror("mkstemp");
+            return -1;
+        }
+        unlink(path);
+        int64_t startUs = av_gettime_relative();
+        int result = exportPcm(url, fd, EXPORT_CONTAINER_RAW, encoding.encoding, channelCount,
+                               parallelism, info);
+        *elapsedUs = av_gettime_relative() - startUs;
+        if (result < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+int main(int argc, char **argv) {
+    auto parallelism = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    int channelCount = 0;
+    const Encoding *encoding = &kEncodings[0];
+    int option;
+    while ((option = getopt(argc, argv, "p:c:e:")) != -1) {
+        if (option == 'p' && atoi(optarg) > 0) {
+            parallelism = atoi(optarg);
+        } else if (option == 'c' && atoi(optarg) >= 0) {
+            channelCount = atoi(optarg);
+        } else if (option == 'e') {
+            encoding = nullptr;
+            for (const Encoding &candidate : kEncodings) {
+                if (strcmp(optarg, candidate.name) == 0) {
+                    encoding = &candidate;
+                }
+            }
+            if (!encoding) {
+                usage(argv[0]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-32s %3s %6s %10s %10s %11s %8s %6s %9s\n", "file", "ch", "rate", "frames",
+           "serial ms", "parallel ms", "speedup", "joins", "max diff");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        ExportInfo serialInfo;
+        ExportInfo parallelInfo;
+        int64_t serialUs;
+        int64_t parallelUs;
+        int serialFd = exportToTemporaryFile(argv[i], *encoding, channelCount, 1, &serialInfo,
+                                             &serialUs);
+        int parallelFd = exportToTemporaryFile(argv[i], *encoding, channelCount, parallelism,
+                                               &parallelInfo, &parallelUs);
+        if (serialFd < 0 || parallelFd < 0) {
+            fprintf(stderr, "%s: failed to export\n", argv[i]);
+            status = 1;
+        } else {
+            bool joined = serialInfo.frameCount == parallelInfo.frameCount;
+            printf("%-32s %3d %6d %10lld %10.1f %11.1f %7.1fx %6s %9.4g\n", argv[i],
+                   serialInfo.channelCount, serialInfo.sampleRate,
+                   (long long) serialInfo.frameCount, (double) serialUs / 1000,
+                   (double) parallelUs / 1000,
+                   parallelUs > 0 ? (double) serialUs / (double) parallelUs : 0,
+                   joined ? "exact" : "FAIL", maxDifference(serialFd, parallelFd, *encoding));
+            status = joined ? status : 1;
+        }
+        if (serialFd >= 0) {
+            close(serialFd);
+        }
+        if (parallelFd >= 0) {
+            close(parallelFd);
+        }
+    }
+    return status;
+}
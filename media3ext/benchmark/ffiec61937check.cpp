@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "ffiec61937.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Packs the first AC-3, E-AC-3, DTS or TrueHD stream of each file with Iec61937Packer, then
+ * parses the bursts back as a receiver would and checks that they carry the frames of the
+ * stream unchanged:
+ *
+ * - every burst starts with the preamble exactly one burst period after the previous one and
+ *   is padded with zeros,
+ * - DTS-HD bursts start with the DTS-HD prefix and frame size,
+ * - MAT frames have their codes in place and hold the TrueHD access units in order, with
+ *   only zero padding between them.
+ *
+ * Frames buffered for a burst that the stream does not complete are not checked. With -r,
+ * DTS-HD frames are sent at that rate, or as their DTS core with -r 0.
+ */
+
+namespace {
+    const uint8_t kDtsHdStartCode[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE,
+                                       0xFE};
+    const uint8_t kMatStartCode[] = {0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
+                                     0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0};
+    const uint8_t kMatMiddleCode[] = {0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80,
+                                      0x77, 0xE0};
+    const uint8_t kMatEndCode[] = {0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                   0x00, 0x00, 0x97, 0x11, 0x00, 0x00};
+
+    struct Stream {
+        // Frames as the packer should send them, in order.
+        std::vector<std::vector<uint8_t>> frames;
+        // The payloads of the parsed bursts, concatenated, without MAT codes.
+        std::vector<uint8_t> received;
+        int64_t bursts = 0;
+        int64_t packUs = 0;
+    };
+
+    bool readPackets(const char *file, AVFormatContext **formatContext, AVCodecID *codecId,
+                     std::vector<AVPacket *> *packets) {
+        int result = avformat_open_input(formatContext, file, nullptr, nullptr);
+        if (result < 0) {
+            logError("avformat_open_input", result);
+            return false;
+        }
+        result = avformat_find_stream_info(*formatContext, nullptr);
+        if (result < 0) {
+            logError("avformat_find_stream_info", result);
+            return false;
+        }
+        int streamIndex = -1;
+        for (unsigned int i = 0; i < (*formatContext)->nb_streams && streamIndex < 0; i++) {
+            AVCodecID id = (*formatContext)->streams[i]->codecpar->codec_id;
+            if (id == AV_CODEC_ID_AC3 || id == AV_CODEC_ID_EAC3 || id == AV_CODEC_ID_DTS
+                || id == AV_CODEC_ID_TRUEHD) {
+                streamIndex = (int) i;
+                *codecId = id;
+            }
+        }
+        if (streamIndex < 0) {
+            fprintf(stderr, "%s: no AC-3, E-AC-3, DTS or TrueHD stream\n", file);
+            return false;
+        }
+        AVPacket *packet = av_packet_alloc();
+        while (av_read_frame(*formatContext, packet) >= 0) {
+            if (packet->stream_index == streamIndex) {
+                packets->push_back(av_packet_clone(packet));
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        return true;
+    }
+
+    /**
+     * Adds the frames of packet that the packer is expected to send to stream.
+     */
+    void addExpectedFrames(AVCodecID codecId, int dtsHdRate, const AVPacket *packet,
+                           bool *trueHdSynced, Stream *stream) {
+        const uint8_t *data = packet->data;
+        int size = packet->size;
+        if (codecId == AV_CODEC_ID_TRUEHD) {
+            for (int offset = 0; offset + 4 <= size;) {
+                int unitSize = ((data[offset] & 0x0F) << 8 | data[offset + 1]) * 2;
+                if (unitSize < 4 || offset + unitSize > size) {
+                    return;
+                }
+                if (unitSize >= 10 && AV_RB24(data + offset + 4) == 0xF8726F) {
+                    *trueHdSynced = true;
+                }
+                if (*trueHdSynced) {
+                    stream->frames.emplace_back(data + offset, data + offset + unitSize);
+                }
+                offset += unitSize;
+            }
+        } else if (codecId == AV_CODEC_ID_DTS && size >= 10) {
+            int coreSize = ((data[5] & 0x03) << 12 | data[6] << 4 | data[7] >> 4) + 1;
+            if (dtsHdRate == 0 || size <= coreSize) {
+                size = std::min(size, coreSize);
+            }
+            stream->frames.emplace_back(data, data + size);
+        } else {
+            stream->frames.emplace_back(data, data + size);
+        }
+    }
+
+    /**
+     * Returns the size of a burst of the data type in Pc, or 0 if it is not known.
+     */
+    int burstSize(int pc) {
+        switch (pc & 0x7F) {
+            case IEC61937_AC3:
+                return 1536 * 4;
+            case IEC61937_EAC3:
+                return 1536 * 16;
+            case IEC61937_DTS1:
+                return 512 * 4;
+            case IEC61937_DTS2:
+                return 1024 * 4;
+            case IEC61937_DTS3:
+                return 2048 * 4;
+            case IEC61937_DTSHD:
+                return (512 << ((pc >> 8) & 0x07)) * 4;
+            case IEC61937_TRUEHD:
+                return 61440;
+            default:
+                return 0;
+        }
+    }
+
+    /**
+     * Parses the bursts in output, adding their payloads to stream. Returns false with a
+     * message if the bursts are malformed.
+     */
+    bool parseBursts(const uint8_t *output, int size, Stream *stream, const char *file) {
+        for (int offset = 0; offset < size;) {
+            const uint8_t *burst = output + offset;
+            int pc = size - offset >= IEC61937_BURST_HEADER_SIZE ? AV_RL16(burst + 4) : 0;
+            int period = burstSize(pc);
+            if (!period || period > size - offset || AV_RL16(burst) != IEC61937_SYNC_WORD_1
+                || AV_RL16(burst + 2) != IEC61937_SYNC_WORD_2) {
+                fprintf(stderr, "%s: no burst after burst %" PRId64 "\n", file,
+                        stream->bursts);
+                return false;
+            }
+            int pd = AV_RL16(burst + 6);
+            int type = pc & 0x7F;
+            bool lengthInBytes = type == IEC61937_EAC3 || type == IEC61937_TRUEHD
+                                 || type == IEC61937_DTSHD;
+            int payloadSize = lengthInBytes ? pd : pd / 8;
+            if (payloadSize > period - IEC61937_BURST_HEADER_SIZE) {
+                fprintf(stderr, "%s: burst %" PRId64 " overflows\n", file, stream->bursts);
+                return false;
+            }
+            std::vector<uint8_t> payload(payloadSize);
+            const uint8_t *words = burst + IEC61937_BURST_HEADER_SIZE;
+            for (int i = 0; i < payloadSize; i++) {
+                payload[i] = words[i ^ 1];
+            }
+            for (int i = FFALIGN(payloadSize, 2); i < period - IEC61937_BURST_HEADER_SIZE; i++) {
+                if (words[i]) {
+                    fprintf(stderr, "%s: burst %" PRId64 " has data after its payload\n", file,
+                            stream->bursts);
+                    return false;
+                }
+            }
+
+            std::vector<uint8_t> &received = stream->received;
+            if (type == IEC61937_DTSHD) {
+                if (payloadSize < (int) sizeof(kDtsHdStartCode) + 2
+                    || memcmp(payload.data(), kDtsHdStartCode, sizeof(kDtsHdStartCode)) != 0) {
+                    fprintf(stderr, "%s: burst %" PRId64 " has no DTS-HD prefix\n", file,
+                            stream->bursts);
+                    return false;
+                }
+                int frameSize = AV_RB16(payload.data() + sizeof(kDtsHdStartCode));
+                auto frame = payload.begin() + sizeof(kDtsHdStartCode) + 2;
+                received.insert(received.end(), frame, frame + std::min<int>(
+                        frameSize, payload.end() - frame));
+            } else if (type == IEC61937_TRUEHD) {
+                int middle = IEC61937_MAT_MIDDLE_CODE_OFFSET;
+                int end = IEC61937_MAT_FRAME_SIZE - (int) sizeof(kMatEndCode);
+                if (payloadSize != IEC61937_MAT_FRAME_SIZE
+                    || memcmp(payload.data(), kMatStartCode, sizeof(kMatStartCode)) != 0
+                    || memcmp(payload.data() + middle, kMatMiddleCode, sizeof(kMatMiddleCode))
+                       != 0
+                    || memcmp(payload.data() + end, kMatEndCode, sizeof(kMatEndCode)) != 0) {
+                    fprintf(stderr, "%s: MAT frame %" PRId64 " has no codes in place\n", file,
+                            stream->bursts);
+                    return false;
+                }
+                received.insert(received.end(), payload.begin() + sizeof(kMatStartCode),
+                                payload.begin() + middle);
+                received.insert(received.end(),
+                                payload.begin() + middle + sizeof(kMatMiddleCode),
+                                payload.begin() + end);
+            } else if (type >= IEC61937_DTS1 && type <= IEC61937_DTS3 && payloadSize >= 8) {
+                // The length is rounded up to whole words, the frame size is exact.
+                int coreSize = ((payload[5] & 0x03) << 12 | payload[6] << 4 | payload[7] >> 4) + 1;
+                received.insert(received.end(), payload.begin(),
+                                payload.begin() + std::min(coreSize, payloadSize));
+            } else {
+                received.insert(received.end(), payload.begin(), payload.end());
+            }
+            stream->bursts++;
+            offset += period;
+        }
+        return true;
+    }
+
+    /**
+     * Checks that the received payloads hold the expected frames in order, with only zero
+     * padding between them for TrueHD. Returns the number of frames found.
+     */
+    int64_t matchFrames(AVCodecID codecId, const Stream &stream, const char *file) {
+        const std::vector<uint8_t> &received = stream.received;
+        size_t position = 0;
+        int64_t found = 0;
+        for (const std::vector<uint8_t> &frame : stream.frames) {
+            if (codecId == AV_CODEC_ID_TRUEHD) {
+                while (position + frame.size() <= received.size()
+                       && memcmp(received.data() + position, frame.data(), frame.size()) != 0) {
+                    if (received[position]) {
+                        fprintf(stderr, "%s: access unit %" PRId64 " not found\n", file, found);
+                        return -1;
+                    }
+                    position++;
+                }
+            }
+            if (position + frame.size() > received.size()) {
+                // Buffered for a burst that was never completed.
+                break;
+            }
+            if (memcmp(received.data() + position, frame.data(), frame.size()) != 0) {
+                fprintf(stderr, "%s: frame %" PRId64 " differs\n", file, found);
+                return -1;
+            }
+            position += frame.size();
+            found++;
+        }
+        for (; position < received.size(); position++) {
+            if (received[position]) {
+                fprintf(stderr, "%s: unexpected data after frame %" PRId64 "\n", file, found);
+                return -1;
+            }
+        }
+        return found;
+    }
+
+    bool check(const char *file, int dtsHdRate) {
+        AVFormatContext *formatContext = nullptr;
+        AVCodecID codecId = AV_CODEC_ID_NONE;
+        std::vector<AVPacket *> packets;
+        bool ok = readPackets(file, &formatContext, &codecId, &packets);
+        Iec61937Packer packer;
+        if (ok && !packer.configure(codecId, dtsHdRate)) {
+            fprintf(stderr, "%s: cannot pack %s\n", file, avcodec_get_name(codecId));
+            ok = false;
+        }
+        Stream stream;
+        bool trueHdSynced = false;
+        int64_t errors = 0;
+        for (size_t i = 0; ok && i < packets.size(); i++) {
+            int64_t startUs = av_gettime_relative();
+            int size = packer.pack(packets[i]->data, packets[i]->size);
+            stream.packUs += av_gettime_relative() - startUs;
+            if (size < 0) {
+                errors++;
+                continue;
+            }
+            addExpectedFrames(codecId, dtsHdRate, packets[i], &trueHdSynced, &stream);
+            ok = parseBursts(packer.getOutput(), size, &stream, file);
+        }
+        int64_t found = ok ? matchFrames(codecId, stream, file) : -1;
+        if (found >= 0) {
+            printf("%-32s %-7s %8zu %6" PRId64 " %8" PRId64 " %8" PRId64 " %7d %3d %9.1f\n",
+                   file, avcodec_get_name(codecId), packets.size(), errors, found,
+                   stream.bursts, packer.getSampleRate(), packer.getChannelCount(),
+                   (double) stream.packUs / 1000);
+        }
+        for (AVPacket *packet : packets) {
+            av_packet_free(&packet);
+        }
+        avformat_close_input(&formatContext);
+        return found >= 0;
+    }
+
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-r DTS-HD rate] file...\n", program);
+        exit(2);
+    }
+}
+
+int main(int argc, char **argv) {
+    int dtsHdRate = 768000;
+    int option;
+    while ((option = getopt(argc, argv, "r:")) != -1) {
+        if (option == 'r' && atoi(optarg) >= 0) {
+            dtsHdRate = atoi(optarg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-32s %-7s %8s %6s %8s %8s %7s %3s %9s\n", "file", "codec", "packets", "errors",
+           "frames", "bursts", "rate", "ch", "pack ms");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!check(argv[i], dtsHdRate)) {
+            status = 1;
+        }
+    }
+    return status;
+}
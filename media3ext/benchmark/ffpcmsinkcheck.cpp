@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "ffaudiocore.h"
+#include "ffpcmsink.h"
+
+/**
+ * Drives PcmSink as AAudioOutput does, with a thread standing in for the AAudio data callback,
+ * and checks its output and playback position against what the simulated device presents:
+ *
+ * - every frame the device renders is either the next written frame or silence,
+ * - the position is within a tolerance of the media frames the device has presented,
+ * - it holds while paused, restarts at 0 after a flush and reaches the written frames once
+ *   the end of stream has played out,
+ * - a producer stall is counted as an underrun and draining at the end is not.
+ *
+ * The device presents frames at its sample rate from a queue that the callback tops up to
+ * -l bursts of -b frames, and reports the frame it presents at each callback as a timestamp.
+ * Frames carry their index, so the check needs no reference audio. With -s, the random
+ * chunk sizes of the writer are seeded with that value.
+ */
+
+namespace {
+    const int kChannelCount = 2;
+    const int kSampleRate = 48000;
+    // Ring of the sink, as AAudioSink sizes it by default.
+    const int kBufferFrames = kSampleRate / 4;
+    const int kMaxChunkFrames = 2048;
+    // Allowed position error in frames, for scheduling jitter between reading the device
+    // state and the sink.
+    const int kTolerance = kSampleRate / 1000;
+
+    int64_t nowNs() {
+        timespec time{};
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    void sleepMs(int ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+    /**
+     * Stand-in for an AAudio stream in callback mode.
+     */
+    class Device {
+    public:
+        Device(PcmSink *sink, int burstFrames, int latencyBursts)
+                : sink(sink), burstFrames(burstFrames), latencyFrames(burstFrames * latencyBursts),
+                  burst((size_t) burstFrames * kChannelCount) {}
+
+        ~Device() { pause(); }
+
+        void start() {
+            std::lock_guard<std::mutex> lock(mutex);
+            startFrame = presentedFrame;
+            startNs = nowNs();
+            running = true;
+            thread = std::thread(&Device::loop, this);
+        }
+
+        /**
+         * Stops the callback. Frames in flight stay queued, as with AAudioStream_requestPause.
+         */
+        void pause() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!running) {
+                    return;
+                }
+                running = false;
+            }
+            thread.join();
+            std::lock_guard<std::mutex> lock(mutex);
+            presentedFrame = presentedAt(nowNs());
+        }
+
+        /**
+         * Drops the frames in flight, as AAudioStream_requestFlush. Returns the frames read.
+         */
+        int64_t flush() {
+            std::lock_guard<std::mutex> lock(mutex);
+            presentedFrame = renderedFrames;
+            // No timestamp until the stream runs again.
+            timestampNs = 0;
+            bursts.clear();
+            expectedIndex = 0;
+            return renderedFrames;
+        }
+
+        /**
+         * Returns the last timestamp, as AAudioStream_getTimestamp.
+         */
+        bool getTimestamp(int64_t *frame, int64_t *timeNs) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (timestampNs == 0) {
+                return false;
+            }
+            *frame = timestampFrame;
+            *timeNs = timestampNs;
+            return true;
+        }
+
+        /**
+         * Returns the number of media frames presented at timeNs since the last flush.
+         */
+        int64_t getPresentedMediaFrames(int64_t timeNs) {
+            std::lock_guard<std::mutex> lock(mutex);
+            int64_t presented = running ? presentedAt(timeNs) : presentedFrame;
+            int64_t mediaFrames = 0;
+            for (const Burst &entry : bursts) {
+                if (entry.deviceFrame >= presented) {
+                    break;
+                }
+                mediaFrames += std::min<int64_t>(entry.mediaFrames, presented - entry.deviceFrame);
+            }
+            return mediaFrames;
+        }
+
+        int64_t getErrors() const { return errors.load(); }
+
+    private:
+        struct Burst {
+            int64_t deviceFrame;
+            int mediaFrames;
+        };
+
+        int64_t presentedAt(int64_t timeNs) const {
+            int64_t frame = startFrame + (timeNs - startNs) * kSampleRate / 1000000000;
+            return std::min(frame, renderedFrames);
+        }
+
+        void loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (running) {
+                int64_t time = nowNs();
+                while (renderedFrames - presentedAt(time) < latencyFrames) {
+                    timestampFrame = presentedAt(time);
+                    timestampNs = time;
+                    int64_t deviceFrame = renderedFrames;
+                    // The callback runs unlocked, as render() must not wait for the player.
+                    lock.unlock();
+                    sink->render((uint8_t *) burst.data(), burstFrames);
+                    int mediaFrames = verify();
+                    lock.lock();
+                    renderedFrames += burstFrames;
+                    bursts.push_back({deviceFrame, mediaFrames});
+                }
+                lock.unlock();
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                lock.lock();
+            }
+        }
+
+        /**
+         * Checks that the burst holds the next frames followed by silence, and returns the
+         * number of frames before the silence.
+         */
+        int verify() {
+            int mediaFrames = 0;
+            for (int i = 0; i < burstFrames; i++) {
+                int32_t index = burst[i * kChannelCount];
+                int32_t check = burst[i * kChannelCount + 1];
+                if (check == 0 && index == 0) {
+                    continue;
+                }
+                if (mediaFrames != i || index != expectedIndex || check != ~index) {
+                    if (errors++ == 0) {
+                        fprintf(stderr, "frame %d: got %d/%d, expected %d\n", i, index, check,
+                                expectedIndex);
+                    }
+                }
+                expectedIndex = index + 1;
+                mediaFrames++;
+            }
+            return mediaFrames;
+        }
+
+        PcmSink *sink;
+        const int burstFrames;
+        const int latencyFrames;
+        std::vector<int32_t> burst;
+        std::mutex mutex;
+        std::thread thread;
+        bool running = false;
+        int64_t startFrame = 0;
+        int64_t startNs = 0;
+        int64_t renderedFrames = 0;
+        int64_t presentedFrame = 0;
+        int64_t timestampFrame = 0;
+        int64_t timestampNs = 0;
+        std::vector<Burst> bursts;
+        int32_t expectedIndex = 0;
+        std::atomic<int64_t> errors{0};
+    };
+
+    /**
+     * The player side: writes numbered frames and checks the position, as AAudioOutput and
+     * AAudioSink do.
+     */
+    class Player {
+    public:
+        Player(PcmSink *sink, Device *device, unsigned int seed)
+                : sink(sink), device(device), random(seed),
+                  chunk((size_t) kMaxChunkFrames * kChannelCount) {}
+
+        void play() {
+            device->start();
+            sink->setPlaying(true, nowNs());
+        }
+
+        void pause() {
+            device->pause();
+            sink->setPlaying(false, nowNs());
+        }
+
+        void flush() {
+            flushedFrames = device->flush();
+            sink->flush(nowNs());
+            nextIndex = 0;
+        }
+
+        /**
+         * Writes for durationMs, keeping the ring full, and checks the position as it goes.
+         */
+        void stream(int durationMs) {
+            int64_t endNs = nowNs() + durationMs * 1000000LL;
+            while (nowNs() < endNs) {
+                int frames = std::uniform_int_distribution<int>(1, kMaxChunkFrames)(random);
+                for (int i = 0; i < frames; i++) {
+                    chunk[i * kChannelCount] = nextIndex + i;
+                    chunk[i * kChannelCount + 1] = ~(nextIndex + i);
+                }
+                int size = frames * sink->getFrameSize();
+                auto *data = (const uint8_t *) chunk.data();
+                int written = 0;
+                while (written < size && nowNs() < endNs) {
+                    written += sink->write(data + written, size - written);
+                    if (written < size) {
+                        wait(1);
+                    }
+                }
+                nextIndex += written / sink->getFrameSize();
+            }
+        }
+
+        /**
+         * Checks the position while waiting for durationMs.
+         */
+        void wait(int durationMs) {
+            int64_t endNs = nowNs() + durationMs * 1000000LL;
+            do {
+                checkPosition();
+                sleepMs(1);
+            } while (nowNs() < endNs);
+        }
+
+        /**
+         * Returns the position, after passing the device timestamp to the sink.
+         */
+        int64_t getPosition() {
+            int64_t frame;
+            int64_t timeNs;
+            if (device->getTimestamp(&frame, &timeNs)) {
+                sink->onTimestamp(frame - flushedFrames, timeNs);
+            }
+            return sink->getPositionFrames(nowNs());
+        }
+
+        void checkPosition() {
+            int64_t position = getPosition();
+            int64_t presented = device->getPresentedMediaFrames(nowNs());
+            maxError = std::max(maxError, std::abs(position - presented));
+            checks++;
+        }
+
+        void resetStats() {
+            maxError = 0;
+            checks = 0;
+        }
+
+        int64_t maxError = 0;
+        int64_t checks = 0;
+
+    private:
+        PcmSink *sink;
+        Device *device;
+        std::mt19937 random;
+        std::vector<int32_t> chunk;
+        int32_t nextIndex = 0;
+        int64_t flushedFrames = 0;
+    };
+
+    bool report(const char *phase, bool passed, const char *format, ...)
+            __attribute__((format(printf, 3, 4)));
+
+    bool report(const char *phase, bool passed, const char *format, ...) {
+        printf("%-10s %-4s ", phase, passed ? "ok" : "FAIL");
+        va_list arguments;
+        va_start(arguments, format);
+        vprintf(format, arguments);
+        va_end(arguments);
+        printf("\n");
+        return passed;
+    }
+
+    bool reportPosition(const char *phase, Player *player) {
+        bool passed = player->maxError <= kTolerance;
+        report(phase, passed, "max position error %" PRId64 " frames over %" PRId64 " checks",
+               player->maxError, player->checks);
+        player->resetStats();
+        return passed;
+    }
+
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-b burst frames] [-l latency bursts] [-s seed]\n", program);
+        exit(2);
+    }
+}
+
+int main(int argc, char **argv) {
+    int burstFrames = 192;
+    int latencyBursts = 2;
+    unsigned int seed = 1;
+    int option;
+    while ((option = getopt(argc, argv, "b:l:s:")) != -1) {
+        if (option == 'b' && atoi(optarg) > 0) {
+            burstFrames = atoi(optarg);
+        } else if (option == 'l' && atoi(optarg) > 0) {
+            latencyBursts = atoi(optarg);
+        } else if (option == 's') {
+            seed = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    PcmSink sink;
+    if (!sink.configure(kChannelCount, kSampleRate, OUTPUT_ENCODING_PCM_32BIT, kBufferFrames)) {
+        return 1;
+    }
+    Device device(&sink, burstFrames, latencyBursts);
+    Player player(&sink, &device, seed);
+    bool passed = true;
+
+    player.stream(10);
+    player.play();
+    player.stream(500);
+    passed &= reportPosition("play", &player);
+
+    int64_t underruns = sink.getUnderrunCount();
+    // Starve the device for longer than the ring lasts.
+    player.wait(kBufferFrames * 1000 / kSampleRate + 50);
+    passed &= report("underrun", sink.getUnderrunCount() > underruns, "%" PRId64 " underruns",
+                     sink.getUnderrunCount() - underruns);
+    player.stream(300);
+    passed &= reportPosition("recover", &player);
+
+    player.pause();
+    int64_t pausedPosition = player.getPosition();
+    player.wait(100);
+    int64_t heldPosition = player.getPosition();
+    passed &= report("pause", heldPosition == pausedPosition,
+                     "position %" PRId64 " held at %" PRId64, pausedPosition, heldPosition);
+    passed &= reportPosition("paused", &player);
+    player.play();
+    player.stream(300);
+    passed &= reportPosition("resume", &player);
+
+    player.pause();
+    player.flush();
+    int64_t flushedPosition = player.getPosition();
+    passed &= report("flush", flushedPosition == 0, "position %" PRId64 " after flush",
+                     flushedPosition);
+    player.stream(10);
+    player.play();
+    player.stream(300);
+    passed &= reportPosition("refill", &player);
+
+    underruns = sink.getUnderrunCount();
+    sink.setEndOfStream();
+    int64_t deadlineNs = nowNs() + 2000000000LL;
+    while (player.getPosition() < sink.getWrittenFrames() && nowNs() < deadlineNs) {
+        player.wait(1);
+    }
+    int64_t endPosition = player.getPosition();
+    passed &= report("drain", endPosition == sink.getWrittenFrames()
+                              && sink.getUnderrunCount() == underruns,
+                     "position %" PRId64 " of %" PRId64 " written, %" PRId64 " underruns",
+                     endPosition, sink.getWrittenFrames(), sink.getUnderrunCount() - underruns);
+    passed &= reportPosition("ended", &player);
+    player.pause();
+
+    passed &= report("frames", device.getErrors() == 0, "%" PRId64 " frames out of order",
+                     device.getErrors());
+    return passed ? 0 : 1;
+}
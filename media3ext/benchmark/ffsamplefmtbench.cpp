@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "ffsamplefmt.h"
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/time.h>
+#include <libswresample/swresample.h>
+}
+
+/**
+ * Compares the interleave kernels of ffsamplefmt with swr_convert on random frames of
+ * 1024 samples and prints, per conversion and channel count, the time per frame of both,
+ * the speedup and the largest difference between their outputs in output units.
+ */
+
+namespace {
+    const int kFrameSamples = 1024;
+    const int kSampleRate = 48000;
+
+    struct Conversion {
+        AVSampleFormat inFormat;
+        AVSampleFormat outFormat;
+    };
+
+    const Conversion kConversions[] = {
+            {AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT},
+            {AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16},
+            {AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16},
+            {AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_S16},
+            {AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLT},
+    };
+
+    void fillRandom(AVSampleFormat format, std::vector<uint8_t> *plane, std::mt19937 *random) {
+        std::uniform_real_distribution<float> floats(-1.1f, 1.1f);
+        std::uniform_int_distribution<int32_t> ints(INT32_MIN, INT32_MAX);
+        for (int i = 0; i < kFrameSamples; i++) {
+            if (format == AV_SAMPLE_FMT_FLTP) {
+                reinterpret_cast<float *>(plane->data())[i] = floats(*random);
+            } else if (format == AV_SAMPLE_FMT_S16P) {
+                reinterpret_cast<int16_t *>(plane->data())[i] = (int16_t) ints(*random);
+            } else {
+                reinterpret_cast<int32_t *>(plane->data())[i] = ints(*random);
+            }
+        }
+    }
+
+    double maxDifference(AVSampleFormat format, const std::vector<uint8_t> &a,
+                         const std::vector<uint8_t> &b) {
+        double difference = 0;
+        size_t count = a.size() / av_get_bytes_per_sample(format);
+        for (size_t i = 0; i < count; i++) {
+            double x = format == AV_SAMPLE_FMT_FLT
+                       ? reinterpret_cast<const float *>(a.data())[i] * 32768.0
+                       : reinterpret_cast<const int16_t *>(a.data())[i];
+            double y = format == AV_SAMPLE_FMT_FLT
+                       ? reinterpret_cast<const float *>(b.data())[i] * 32768.0
+                       : reinterpret_cast<const int16_t *>(b.data())[i];
+            difference = std::max(difference, std::fabs(x - y));
+        }
+        return difference;
+    }
+
+    void run(const Conversion &conversion, int channelCount, int iterations) {
+        InterleaveFunction interleave =
+                findInterleaveFunction(conversion.inFormat, conversion.outFormat, channelCount);
+        if (!interleave) {
+            return;
+        }
+        std::mt19937 random(channelCount);
+        std::vector<std::vector<uint8_t>> planes(channelCount);
+        std::vector<const uint8_t *> planePointers(channelCount);
+        for (int channel = 0; channel < channelCount; channel++) {
+            planes[channel].resize(kFrameSamples * av_get_bytes_per_sample(conversion.inFormat));
+            fillRandom(conversion.inFormat, &planes[channel], &random);
+            planePointers[channel] = planes[channel].data();
+        }
+        size_t outSize = (size_t) kFrameSamples * channelCount
+                         * av_get_bytes_per_sample(conversion.outFormat);
+        std::vector<uint8_t> kernelOutput(outSize);
+        std::vector<uint8_t> swrOutput(outSize);
+
+        AVChannelLayout layout;
+        av_channel_layout_default(&layout, channelCount);
+        SwrContext *swrContext = nullptr;
+        int result = swr_alloc_set_opts2(&swrContext, &layout, conversion.outFormat, kSampleRate,
+                                         &layout, conversion.inFormat, kSampleRate, 0, nullptr);
+        av_channel_layout_uninit(&layout);
+        if (result < 0 || swr_init(swrContext) < 0) {
+            fprintf(stderr, "Failed to set up swr for %d channels\n", channelCount);
+            swr_free(&swrContext);
+            return;
+        }
+
+        int64_t startUs = av_gettime_relative();
+        for (int i = 0; i < iterations; i++) {
+            interleave(planePointers.data(), kFrameSamples, kernelOutput.data());
+        }
+        double kernelUs = (double) (av_gettime_relative() - startUs) / iterations;
+
+        uint8_t *swrData = swrOutput.data();
+        startUs = av_gettime_relative();
+        for (int i = 0; i < iterations; i++) {
+            swr_convert(swrContext, &swrData, kFrameSamples, planePointers.data(), kFrameSamples);
+        }
+        double swrUs = (double) (av_gettime_relative() - startUs) / iterations;
+        swr_free(&swrContext);
+
+        printf("%-5s -> %-4s %2d %10.2f %10.2f %8.1fx %8.0f\n",
+               av_get_sample_fmt_name(conversion.inFormat),
+               av_get_sample_fmt_name(conversion.outFormat), channelCount, kernelUs, swrUs,
+               kernelUs > 0 ? swrUs / kernelUs : 0,
+               maxDifference(conversion.outFormat, kernelOutput, swrOutput));
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(atoi(argv[1]), 1) : 20000;
+    printf("%-13s %2s %10s %10s %9s %8s\n", "conversion", "ch", "kernel us", "swr us",
+           "speedup", "max diff");
+    for (const Conversion &conversion : kConversions) {
+        for (int channelCount = 1; channelCount <= 8; channelCount++) {
+            run(conversion, channelCount, iterations);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "ffwaveform.h"
+
+extern "C" {
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Computes the waveform of each file with one segment and with -p segments in parallel, one
+ * per CPU by default, and prints the wall time of both, the speedup and the largest
+ * difference between the two results.
+ */
+
+namespace {
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-n buckets] [-c channels] [-p parallelism] file...\n",
+                program);
+        exit(2);
+    }
+
+    double maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+        if (a.size() != b.size()) {
+            return -1;
+        }
+        double difference = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            difference = std::max(difference, (double) std::abs(a[i] - b[i]));
+        }
+        return difference;
+    }
+}
+
+int main(int argc, char **argv) {
+    int bucketCount = 1000;
+    int channelCount = 0;
+    auto parallelism = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    int option;
+    while ((option = getopt(argc, argv, "n:c:p:")) != -1) {
+        if (option == 'n' && atoi(optarg) > 0) {
+            bucketCount = atoi(optarg);
+        } else if (option == 'c' && atoi(optarg) >= 0) {
+            channelCount = atoi(optarg);
+        } else if (option == 'p' && atoi(optarg) > 0) {
+            parallelism = atoi(optarg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-32s %3s %10s %10s %8s %9s\n", "file", "ch", "serial ms", "parallel ms", "speedup",
+           "max diff");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        std::vector<float> serial;
+        std::vector<float> parallel;
+        int64_t startUs = av_gettime_relative();
+        int channels = computeWaveform(argv[i], bucketCount, channelCount, 1, &serial);
+        int64_t serialUs = av_gettime_relative() - startUs;
+        startUs = av_gettime_relative();
+        int result = computeWaveform(argv[i], bucketCount, channelCount, parallelism, &parallel);
+        int64_t parallelUs = av_gettime_relative() - startUs;
+        if (channels < 0 || result < 0) {
+            fprintf(stderr, "%s: failed to compute the waveform\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        printf("%-32s %3d %10.1f %10.1f %7.1fx %9.4f\n", argv[i], channels,
+               (double) serialUs / 1000, (double) parallelUs / 1000,
+               parallelUs > 0 ? (double) serialUs / (double) parallelUs : 0,
+               maxDifference(serial, parallel));
+    }
+    return status;
+}
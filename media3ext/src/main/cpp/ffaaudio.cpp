@@ -0,0 +1,296 @@
+#include <dlfcn.h>
+#include <ctime>
+#include "ffaaudio.h"
+#include "ffaudiocore.h"
+#include "ffutil.h"
+
+namespace {
+    // Longest wait for the stream to leave a transient state such as pausing.
+    const int64_t kStateChangeTimeoutNs = 200 * 1000000LL;
+    // Low latency streams keep this many bursts queued in the device, as the AAudio guide
+    // recommends, so that a late callback does not glitch.
+    const int kLowLatencyBursts = 2;
+
+    /**
+     * The libaaudio functions used, resolved at runtime.
+     */
+    struct AAudioApi {
+        aaudio_result_t (*createStreamBuilder)(AAudioStreamBuilder **builder);
+        void (*setFormat)(AAudioStreamBuilder *builder, aaudio_format_t format);
+        void (*setChannelCount)(AAudioStreamBuilder *builder, int32_t channelCount);
+        void (*setSampleRate)(AAudioStreamBuilder *builder, int32_t sampleRate);
+        void (*setPerformanceMode)(AAudioStreamBuilder *builder, aaudio_performance_mode_t mode);
+        void (*setSharingMode)(AAudioStreamBuilder *builder, aaudio_sharing_mode_t mode);
+        void (*setDataCallback)(AAudioStreamBuilder *builder, AAudioStream_dataCallback callback,
+                                void *userData);
+        void (*setErrorCallback)(AAudioStreamBuilder *builder,
+                                 AAudioStream_errorCallback callback, void *userData);
+        aaudio_result_t (*openStream)(AAudioStreamBuilder *builder, AAudioStream **stream);
+        aaudio_result_t (*deleteBuilder)(AAudioStreamBuilder *builder);
+        aaudio_result_t (*requestStart)(AAudioStream *stream);
+        aaudio_result_t (*requestPause)(AAudioStream *stream);
+        aaudio_result_t (*requestFlush)(AAudioStream *stream);
+        aaudio_result_t (*waitForStateChange)(AAudioStream *stream,
+                                              aaudio_stream_state_t inputState,
+                                              aaudio_stream_state_t *nextState,
+                                              int64_t timeoutNanoseconds);
+        aaudio_result_t (*close)(AAudioStream *stream);
+        aaudio_result_t (*getTimestamp)(AAudioStream *stream, clockid_t clockid,
+                                        int64_t *framePosition, int64_t *timeNanoseconds);
+        int64_t (*getFramesRead)(AAudioStream *stream);
+        int32_t (*getFramesPerBurst)(AAudioStream *stream);
+        aaudio_result_t (*setBufferSizeInFrames)(AAudioStream *stream, int32_t numFrames);
+        const char *(*convertResultToText)(aaudio_result_t result);
+    };
+
+    template<typename T>
+    bool resolve(void *library, const char *name, T *function) {
+        *function = reinterpret_cast<T>(dlsym(library, name));
+        return *function != nullptr;
+    }
+
+    const AAudioApi *loadApi() {
+        static const AAudioApi *api = []() -> const AAudioApi * {
+            void *library = dlopen("libaaudio.so", RTLD_NOW);
+            if (!library) {
+                return nullptr;
+            }
+            static AAudioApi functions;
+            bool loaded =
+                    resolve(library, "AAudio_createStreamBuilder", &functions.createStreamBuilder)
+                    && resolve(library, "AAudioStreamBuilder_setFormat", &functions.setFormat)
+                    && resolve(library, "AAudioStreamBuilder_setChannelCount",
+                               &functions.setChannelCount)
+                    && resolve(library, "AAudioStreamBuilder_setSampleRate",
+                               &functions.setSampleRate)
+                    && resolve(library, "AAudioStreamBuilder_setPerformanceMode",
+                               &functions.setPerformanceMode)
+                    && resolve(library, "AAudioStreamBuilder_setSharingMode",
+                               &functions.setSharingMode)
+                    && resolve(library, "AAudioStreamBuilder_setDataCallback",
+                               &functions.setDataCallback)
+                    && resolve(library, "AAudioStreamBuilder_setErrorCallback",
+                               &functions.setErrorCallback)
+                    && resolve(library, "AAudioStreamBuilder_openStream", &functions.openStream)
+                    && resolve(library, "AAudioStreamBuilder_delete", &functions.deleteBuilder)
+                    && resolve(library, "AAudioStream_requestStart", &functions.requestStart)
+                    && resolve(library, "AAudioStream_requestPause", &functions.requestPause)
+                    && resolve(library, "AAudioStream_requestFlush", &functions.requestFlush)
+                    && resolve(library, "AAudioStream_waitForStateChange",
+                               &functions.waitForStateChange)
+                    && resolve(library, "AAudioStream_close", &functions.close)
+                    && resolve(library, "AAudioStream_getTimestamp", &functions.getTimestamp)
+                    && resolve(library, "AAudioStream_getFramesRead", &functions.getFramesRead)
+                    && resolve(library, "AAudioStream_getFramesPerBurst",
+                               &functions.getFramesPerBurst)
+                    && resolve(library, "AAudioStream_setBufferSizeInFrames",
+                               &functions.setBufferSizeInFrames)
+                    && resolve(library, "AAudio_convertResultToText",
+                               &functions.convertResultToText);
+            if (!loaded) {
+                LOGE("libaaudio is missing functions.");
+                dlclose(library);
+                return nullptr;
+            }
+            return &functions;
+        }();
+        return api;
+    }
+
+    int64_t nowNs() {
+        timespec time{};
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    void logResult(const char *functionName, aaudio_result_t result) {
+        LOGE("%s failed: %s", functionName, loadApi()->convertResultToText(result));
+    }
+}
+
+AAudioOutput::~AAudioOutput() {
+    closeStream();
+}
+
+bool AAudioOutput::isAvailable() {
+    return loadApi() != nullptr;
+}
+
+bool AAudioOutput::open(int channelCount, int sampleRate, int encoding, int bufferFrames,
+                        int performanceMode) {
+    close();
+    switch (encoding) {
+        case OUTPUT_ENCODING_PCM_16BIT:
+            format = AAUDIO_FORMAT_PCM_I16;
+            break;
+        case OUTPUT_ENCODING_PCM_FLOAT:
+            format = AAUDIO_FORMAT_PCM_FLOAT;
+            break;
+        case OUTPUT_ENCODING_PCM_24BIT:
+            format = AAUDIO_FORMAT_PCM_I24_PACKED;
+            break;
+        case OUTPUT_ENCODING_PCM_32BIT:
+            format = AAUDIO_FORMAT_PCM_I32;
+            break;
+        default:
+            LOGE("Unsupported AAudio encoding %d.", encoding);
+            return false;
+    }
+    if (!isAvailable() || !sink.configure(channelCount, sampleRate, encoding, bufferFrames)) {
+        return false;
+    }
+    this->channelCount = channelCount;
+    this->sampleRate = sampleRate;
+    this->performanceMode = performanceMode;
+    return openStream() == AAUDIO_OK;
+}
+
+void AAudioOutput::close() {
+    closeStream();
+    started = false;
+}
+
+int AAudioOutput::write(const uint8_t *data, int size) {
+    if (!stream) {
+        return AAUDIO_ERROR_INVALID_STATE;
+    }
+    if (disconnected.load(std::memory_order_acquire)) {
+        // The callback has stopped for good, so the ring is safe to keep across streams.
+        closeStream();
+        aaudio_result_t result = openStream();
+        if (result != AAUDIO_OK) {
+            return result;
+        }
+        sink.onDeviceRestarted(nowNs());
+        if (started) {
+            result = loadApi()->requestStart(stream);
+            if (result != AAUDIO_OK) {
+                logResult("AAudioStream_requestStart", result);
+                return result;
+            }
+        }
+    }
+    return sink.write(data, size);
+}
+
+bool AAudioOutput::start() {
+    if (!stream) {
+        return false;
+    }
+    aaudio_result_t result = loadApi()->requestStart(stream);
+    if (result != AAUDIO_OK) {
+        logResult("AAudioStream_requestStart", result);
+        return false;
+    }
+    started = true;
+    sink.setPlaying(true, nowNs());
+    return true;
+}
+
+bool AAudioOutput::pause() {
+    if (!stream) {
+        return false;
+    }
+    aaudio_result_t result = loadApi()->requestPause(stream);
+    if (result != AAUDIO_OK) {
+        logResult("AAudioStream_requestPause", result);
+        return false;
+    }
+    waitForStateChange(AAUDIO_STREAM_STATE_PAUSING);
+    started = false;
+    sink.setPlaying(false, nowNs());
+    return true;
+}
+
+bool AAudioOutput::flush() {
+    if (!stream || (started && !pause())) {
+        return false;
+    }
+    const AAudioApi *api = loadApi();
+    aaudio_result_t result = api->requestFlush(stream);
+    if (result != AAUDIO_OK) {
+        logResult("AAudioStream_requestFlush", result);
+        return false;
+    }
+    waitForStateChange(AAUDIO_STREAM_STATE_FLUSHING);
+    flushedFrames = api->getFramesRead(stream);
+    sink.flush(nowNs());
+    return true;
+}
+
+int64_t AAudioOutput::getPositionFrames() {
+    int64_t now = nowNs();
+    if (stream && started) {
+        int64_t framePosition;
+        int64_t timeNs;
+        // Fails until the stream has been running for a moment, which leaves the position
+        // extrapolated from the start.
+        if (loadApi()->getTimestamp(stream, CLOCK_MONOTONIC, &framePosition, &timeNs)
+            == AAUDIO_OK) {
+            sink.onTimestamp(framePosition - flushedFrames, timeNs);
+        }
+    }
+    return sink.getPositionFrames(now);
+}
+
+aaudio_data_callback_result_t AAudioOutput::onData(AAudioStream *stream, void *userData,
+                                                   void *audioData, int32_t numFrames) {
+    ((AAudioOutput *) userData)->sink.render((uint8_t *) audioData, numFrames);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+void AAudioOutput::onError(AAudioStream *stream, void *userData, aaudio_result_t error) {
+    // Any error stops the stream. It must not be closed from this thread, so write() reopens
+    // it on the player thread.
+    LOGE("AAudio stream error: %s", loadApi()->convertResultToText(error));
+    ((AAudioOutput *) userData)->disconnected.store(true, std::memory_order_release);
+}
+
+aaudio_result_t AAudioOutput::openStream() {
+    const AAudioApi *api = loadApi();
+    AAudioStreamBuilder *builder;
+    aaudio_result_t result = api->createStreamBuilder(&builder);
+    if (result != AAUDIO_OK) {
+        logResult("AAudio_createStreamBuilder", result);
+        return result;
+    }
+    api->setFormat(builder, format);
+    api->setChannelCount(builder, channelCount);
+    api->setSampleRate(builder, sampleRate);
+    api->setPerformanceMode(builder, performanceMode);
+    api->setSharingMode(builder, AAUDIO_SHARING_MODE_SHARED);
+    api->setDataCallback(builder, onData, this);
+    api->setErrorCallback(builder, onError, this);
+    result = api->openStream(builder, &stream);
+    api->deleteBuilder(builder);
+    if (result != AAUDIO_OK) {
+        logResult("AAudioStreamBuilder_openStream", result);
+        stream = nullptr;
+        return result;
+    }
+    if (performanceMode == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY) {
+        api->setBufferSizeInFrames(stream, api->getFramesPerBurst(stream) * kLowLatencyBursts);
+    }
+    disconnected.store(false, std::memory_order_release);
+    flushedFrames = 0;
+    return AAUDIO_OK;
+}
+
+void AAudioOutput::closeStream() {
+    if (stream) {
+        loadApi()->close(stream);
+        stream = nullptr;
+    }
+}
+
+void AAudioOutput::waitForStateChange(aaudio_stream_state_t transientState) {
+    aaudio_stream_state_t state = transientState;
+    while (state == transientState) {
+        aaudio_result_t result = loadApi()->waitForStateChange(stream, transientState, &state,
+                                                               kStateChangeTimeoutNs);
+        if (result != AAUDIO_OK) {
+            logResult("AAudioStream_waitForStateChange", result);
+            return;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef NEXTPLAYER_FFAAUDIO_H
+#define NEXTPLAYER_FFAAUDIO_H
+
+#include <aaudio/AAudio.h>
+#include <atomic>
+#include <cstdint>
+#include "ffpcmsink.h"
+
+/**
+ * AAudio output stream that pulls from a PcmSink in its data callback, for AAudioSink.
+ *
+ * libaaudio is loaded with dlopen, as it only exists from API 26 and the library supports
+ * older releases. When the stream is disconnected, e.g. because headphones were unplugged,
+ * it is reopened on the default device by the next write(). All methods are called on the
+ * player thread.
+ */
+class AAudioOutput {
+public:
+    ~AAudioOutput();
+
+    /**
+     * Returns whether libaaudio could be loaded.
+     */
+    static bool isAvailable();
+
+    /**
+     * Opens a stream for interleaved samples in one of the OUTPUT_ENCODING constants of
+     * ffaudiocore.h, fed from a ring of bufferFrames frames, with one of the
+     * AAUDIO_PERFORMANCE_MODE constants, closing the previous stream. It is not started.
+     */
+    bool open(int channelCount, int sampleRate, int encoding, int bufferFrames,
+              int performanceMode);
+
+    void close();
+
+    /**
+     * Queues size bytes of whole frames. Returns the number of bytes taken, fewer if the ring
+     * is full, or a negative AAudio error if the stream could not be reopened.
+     */
+    int write(const uint8_t *data, int size);
+
+    bool start();
+
+    /**
+     * Pauses the stream and waits until the callback has stopped.
+     */
+    bool pause();
+
+    /**
+     * Drops the queued frames and those in flight, leaving the stream paused.
+     */
+    bool flush();
+
+    /**
+     * Returns the number of frames presented since open() or flush().
+     */
+    int64_t getPositionFrames();
+
+    PcmSink &getSink() { return sink; }
+
+private:
+    static aaudio_data_callback_result_t onData(AAudioStream *stream, void *userData,
+                                                void *audioData, int32_t numFrames);
+
+    static void onError(AAudioStream *stream, void *userData, aaudio_result_t error);
+
+    aaudio_result_t openStream();
+
+    void closeStream();
+
+    /**
+     * Waits while the stream is in transientState, e.g. AAUDIO_STREAM_STATE_PAUSING.
+     */
+    void waitForStateChange(aaudio_stream_state_t transientState);
+
+    PcmSink sink;
+    AAudioStream *stream = nullptr;
+    int channelCount = 0;
+    int sampleRate = 0;
+    aaudio_format_t format = AAUDIO_FORMAT_UNSPECIFIED;
+    int performanceMode = AAUDIO_PERFORMANCE_MODE_NONE;
+    bool started = false;
+    // Frames the stream had read at its last flush, which its timestamps count from.
+    int64_t flushedFrames = 0;
+    std::atomic<bool> disconnected{false};
+};
+
+#endif //NEXTPLAYER_FFAAUDIO_H
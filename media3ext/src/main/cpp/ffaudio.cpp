@@ -4,7 +4,18 @@
 #include <cstdlib>
 #include <android/native_window_jni.h>
 #include <algorithm>
+#include <cinttypes>
+#include <vector>
+#include "ffaaudio.h"
+#include "ffaudiocore.h"
 #include "ffcommon.h"
+#include "ffdiag.h"
+#include "ffdsp.h"
+#include "ffexport.h"
+#include "ffiec61937.h"
+#include "ffspectrum.h"
+#include "ffstats.h"
+#include "ffwaveform.h"
 
 extern "C" {
 #ifdef __cplusplus
@@ -21,41 +32,8 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-# define LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-
-// Output format corresponding to AudioFormat.ENCODING_PCM_16BIT.
-static const AVSampleFormat OUTPUT_FORMAT_PCM_16BIT = AV_SAMPLE_FMT_S16;
-// Output format corresponding to AudioFormat.ENCODING_PCM_FLOAT.
-static const AVSampleFormat OUTPUT_FORMAT_PCM_FLOAT = AV_SAMPLE_FMT_FLT;
-
-static const int AUDIO_DECODER_ERROR_INVALID_DATA = -1;
-static const int AUDIO_DECODER_ERROR_OTHER = -2;
-
 static jmethodID growOutputBufferMethod;
 
-
-/**
- * Allocates and opens a new AVCodecContext for the specified codec, passing the
- * provided extraData as initialization data for the decoder if it is non-NULL.
- * Returns the created context.
- */
-AVCodecContext *createContext(JNIEnv *env, AVCodec *codec, jbyteArray extraData,
-                              jboolean outputFloat, jint rawSampleRate,
-                              jint rawChannelCount);
-
-/**
- * Decodes the packet into the output buffer, returning the number of bytes
- * written, or a negative AUDIO_DECODER_ERROR constant value in the case of an
- * error.
- */
-int decodePacket(AVCodecContext *context, AVPacket *packet,
-                 uint8_t *outputBuffer, int outputSize);
-
-/**
- * Transforms ffmpeg AVERROR into a negative AUDIO_DECODER_ERROR constant value.
- */
-int transformError(int errorNumber);
-
 struct GrowOutputBufferCallback {
     uint8_t *operator()(int requiredSize) const;
 
@@ -74,166 +52,20 @@ uint8_t *GrowOutputBufferCallback::operator()(int requiredSize) const {
     return static_cast<uint8_t *>(env->GetDirectBufferAddress(newOutputData));
 }
 
-AVCodecContext *createContext(JNIEnv *env, AVCodec *codec, jbyteArray extraData,
-                              jboolean outputFloat, jint rawSampleRate,
-                              jint rawChannelCount) {
-    AVCodecContext *context = avcodec_alloc_context3(codec);
-    if (!context) {
-        LOGE("Failed to allocate context.");
-        return nullptr;
-    }
-    context->request_sample_fmt =
-            outputFloat ? OUTPUT_FORMAT_PCM_FLOAT : OUTPUT_FORMAT_PCM_16BIT;
+/**
+ * Creates a context with the initialization data held by extraData, which may be null.
+ */
+static AVCodecContext *createContext(JNIEnv *env, const AVCodec *codec, jbyteArray extraData,
+                                     jint outputEncoding, jint rawSampleRate,
+                                     jint rawChannelCount) {
+    std::vector<uint8_t> data;
     if (extraData) {
-        jsize size = env->GetArrayLength(extraData);
-        context->extradata_size = size;
-        context->extradata =
-                (uint8_t *) av_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
-        if (!context->extradata) {
-            LOGE("Failed to allocate extra data.");
-            releaseContext(&context);
-            return nullptr;
-        }
-        env->GetByteArrayRegion(extraData, 0, size, (jbyte *) context->extradata);
+        data.resize(env->GetArrayLength(extraData));
+        env->GetByteArrayRegion(extraData, 0, static_cast<jsize>(data.size()),
+                                reinterpret_cast<jbyte *>(data.data()));
     }
-    if (context->codec_id == AV_CODEC_ID_PCM_MULAW ||
-        context->codec_id == AV_CODEC_ID_PCM_ALAW) {
-        context->sample_rate = rawSampleRate;
-        av_channel_layout_default(&context->ch_layout, rawChannelCount);
-    }
-    context->err_recognition = AV_EF_IGNORE_ERR;
-    int result = avcodec_open2(context, codec, nullptr);
-    if (result < 0) {
-        logError("avcodec_open2", result);
-        releaseContext(&context);
-        return nullptr;
-    }
-    return context;
-}
-
-int decodePacket(AVCodecContext *context, AVPacket *packet,
-                 uint8_t *outputBuffer, int outputSize, GrowOutputBufferCallback growBuffer) {
-    int result = 0;
-    // Queue input data.
-    result = avcodec_send_packet(context, packet);
-    if (result) {
-        logError("avcodec_send_packet", result);
-        return transformError(result);
-    }
-
-    // Dequeue output data until it runs out.
-    int outSize = 0;
-    while (true) {
-        AVFrame *frame = av_frame_alloc();
-        if (!frame) {
-            LOGE("Failed to allocate output frame.");
-            return AUDIO_DECODER_ERROR_INVALID_DATA;
-        }
-        result = avcodec_receive_frame(context, frame);
-        if (result) {
-            av_frame_free(&frame);
-            if (result == AVERROR(EAGAIN)) {
-                break;
-            }
-            logError("avcodec_receive_frame", result);
-            return transformError(result);
-        }
-
-        // Resample output.
-        AVSampleFormat sampleFormat = context->sample_fmt;
-        int channelCount = context->ch_layout.nb_channels;
-//        int channelLayout = (int) context->ch_layout.u.mask;
-        int sampleRate = context->sample_rate;
-        int sampleCount = frame->nb_samples;
-        int dataSize = av_samples_get_buffer_size(nullptr, channelCount, sampleCount,
-                                                  sampleFormat, 1);
-        SwrContext *resampleContext;
-        if (context->opaque) {
-            resampleContext = (SwrContext *) context->opaque;
-        } else {
-            resampleContext = swr_alloc();
-            av_opt_set_chlayout(resampleContext, "in_chlayout", &context->ch_layout, 0);
-            av_opt_set_chlayout(resampleContext, "out_chlayout", &context->ch_layout, 0);
-//            av_opt_set_int(resampleContext, "in_channel_layout", channelLayout, 0);
-//            av_opt_set_int(resampleContext, "out_channel_layout", channelLayout, 0);
-            av_opt_set_int(resampleContext, "in_sample_rate", sampleRate, 0);
-            av_opt_set_int(resampleContext, "out_sample_rate", sampleRate, 0);
-            av_opt_set_sample_fmt(resampleContext, "in_sample_fmt", sampleFormat, 0);
-            // The output format is always the requested format.
-            av_opt_set_sample_fmt(resampleContext, "out_sample_fmt",
-                           context->request_sample_fmt, 0);
-            result = swr_init(resampleContext);
-            if (result < 0) {
-                logError("swr_init", result);
-                av_frame_free(&frame);
-                swr_free(&resampleContext);
-                return transformError(result);
-            }
-//            resampleContext = swr_alloc();
-//
-//            AVChannelLayout outLayout;
-//            av_channel_layout_copy(&outLayout, &context->ch_layout);
-//
-//            result = swr_alloc_set_opts2(&resampleContext,
-//                                         &outLayout, context->request_sample_fmt, sampleRate,
-//                                         &context->ch_layout, sampleFormat, sampleRate,
-//                                         0, nullptr);
-//
-//            if (result < 0) {
-//                logError("swr_alloc_set_opts2", result);
-//                av_channel_layout_uninit(&outLayout);
-//                av_frame_free(&frame);
-//                return transformError(result);
-//            }
-//            result = swr_init(resampleContext);
-//            if (result < 0) {
-//                logError("swr_init", result);
-//                av_channel_layout_uninit(&outLayout);
-//                av_frame_free(&frame);
-//                return transformError(result);
-//            }
-//            av_channel_layout_uninit(&outLayout);
-            context->opaque = resampleContext;
-        }
-        int inSampleSize = av_get_bytes_per_sample(sampleFormat);
-        int outSampleSize = av_get_bytes_per_sample(context->request_sample_fmt);
-        int outSamples = swr_get_out_samples(resampleContext, sampleCount);
-        int bufferOutSize = outSampleSize * channelCount * outSamples;
-        if (outSize + bufferOutSize > outputSize) {
-            LOGD(
-                    "Output buffer size (%d) too small for output data (%d), "
-                    "reallocating buffer.",
-                    outputSize, outSize + bufferOutSize);
-            outputSize = outSize + bufferOutSize;
-            outputBuffer = growBuffer(outputSize);
-            if (!outputBuffer) {
-                LOGE("Failed to reallocate output buffer.");
-                av_frame_free(&frame);
-                return AUDIO_DECODER_ERROR_OTHER;
-            }
-        }
-        result = swr_convert(resampleContext, &outputBuffer, bufferOutSize,
-                             (const uint8_t **) frame->data, frame->nb_samples);
-        av_frame_free(&frame);
-        if (result < 0) {
-            logError("swr_convert", result);
-            return AUDIO_DECODER_ERROR_INVALID_DATA;
-        }
-        int available = swr_get_out_samples(resampleContext, 0);
-        if (available != 0) {
-            LOGE("Expected no samples remaining after resampling, but found %d.",
-                 available);
-            return AUDIO_DECODER_ERROR_INVALID_DATA;
-        }
-        outputBuffer += bufferOutSize;
-        outSize += bufferOutSize;
-    }
-    return outSize;
-}
-
-int transformError(int errorNumber) {
-    return errorNumber == AVERROR_INVALIDDATA ? AUDIO_DECODER_ERROR_INVALID_DATA
-                                              : AUDIO_DECODER_ERROR_OTHER;
+    return createContext(codec, extraData ? data.data() : nullptr, static_cast<int>(data.size()),
+                         outputEncoding, rawSampleRate, rawChannelCount);
 }
 
 extern "C"
@@ -242,9 +74,15 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
                                                                         jobject thiz,
                                                                         jstring codec_name,
                                                                         jbyteArray extra_data,
-                                                                        jboolean output_float,
+                                                                        jint output_encoding,
                                                                         jint raw_sample_rate,
-                                                                        jint raw_channel_count) {
+                                                                        jint raw_channel_count,
+                                                                        jint downmix_channel_count,
+                                                                        jint downmix_mode,
+                                                                        jint target_sample_rate,
+                                                                        jint resample_quality,
+                                                                        jlong audio_effects,
+                                                                        jlong spectrum_analyzer) {
     AVCodec *codec = getCodecByName(env, codec_name);
     if (!codec) {
         LOGE("Codec not found.");
@@ -252,8 +90,24 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
     }
     jclass clazz = env->FindClass("io/github/anilbeesetti/nextlib/media3ext/ffdecoder/FfmpegAudioDecoder");
     growOutputBufferMethod = env->GetMethodID(clazz, "growOutputBuffer","(Landroidx/media3/decoder/SimpleDecoderOutputBuffer;I)Ljava/nio/ByteBuffer;");
-    return (jlong) createContext(env, codec, extra_data, output_float, raw_sample_rate,
-                                 raw_channel_count);
+    AVCodecContext *codecContext = createContext(env, codec, extra_data, output_encoding,
+                                                 raw_sample_rate, raw_channel_count);
+    if (!codecContext) {
+        return 0L;
+    }
+    auto *audioContext = new AudioContext(codecContext);
+    audioContext->packS24Output = output_encoding == OUTPUT_ENCODING_PCM_24BIT;
+    audioContext->downmixChannelCount = downmix_channel_count;
+    audioContext->downmixMode = downmix_mode;
+    audioContext->targetSampleRate = target_sample_rate;
+    audioContext->resampleQuality = resample_quality;
+    if (audio_effects) {
+        audioContext->effects = *(std::shared_ptr<AudioEffects> *) audio_effects;
+    }
+    if (spectrum_analyzer) {
+        audioContext->spectrum = *(std::shared_ptr<SpectrumAnalyzer> *) spectrum_analyzer;
+    }
+    return (jlong) audioContext;
 }
 
 extern "C"
@@ -284,9 +138,8 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
     }
     auto *inputBuffer = (uint8_t *) env->GetDirectBufferAddress(input_data);
     auto *outputBuffer = (uint8_t *) env->GetDirectBufferAddress(output_data);
-    AVPacket *packet;
-    packet = av_packet_alloc();
-
+    auto *audioContext = (AudioContext *) context;
+    AVPacket *packet = obtainPacket(audioContext);
     if (packet == nullptr) {
         LOGE("audio_decoder_decode_frame: av_packet_alloc failed");
         return -1;
@@ -294,9 +147,8 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
 
     packet->data = inputBuffer;
     packet->size = input_size;
-    int decodedPacket = decodePacket((AVCodecContext *) context, packet, outputBuffer,
+    int decodedPacket = decodePacket(audioContext, packet, outputBuffer,
                                      output_size, GrowOutputBufferCallback{env, thiz, decoderOutputBuffer});
-    av_packet_free(&packet);
     return decodedPacket;
 }
 
@@ -308,7 +160,7 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
         LOGE("Context must be non-NULL.");
         return -1;
     }
-    return ((AVCodecContext *) context)->ch_layout.nb_channels;
+    return getOutputChannelCount((AudioContext *) context);
 }
 
 extern "C"
@@ -320,7 +172,44 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
         LOGE("Context must be non-NULL.");
         return -1;
     }
-    return ((AVCodecContext *) context)->sample_rate;
+    return getOutputSampleRate((AudioContext *) context);
+}
+
+/**
+ * Flushes the decoder of audioContext. Returns false, after releasing audioContext, if the
+ * decoder had to be recreated and that failed.
+ */
+static bool resetContext(JNIEnv *env, AudioContext *audioContext, jbyteArray extraData) {
+    // Also resets the effect filters and the spectrum, which a new context does not.
+    flushContext(audioContext);
+    AVCodecContext *context = audioContext->codecContext;
+
+    AVCodecID codecId = context->codec_id;
+    if (codecId != AV_CODEC_ID_TRUEHD) {
+        return true;
+    }
+    // Release and recreate the context if the codec is TrueHD.
+    // TODO: Figure out why flushing doesn't work for this codec.
+    // 24-bit output is also decoded to S32 and only differs in packS24Output, which is kept.
+    int outputEncoding = context->request_sample_fmt == OUTPUT_FORMAT_PCM_FLOAT
+                         ? OUTPUT_ENCODING_PCM_FLOAT
+                         : context->request_sample_fmt == OUTPUT_FORMAT_PCM_32BIT
+                           ? OUTPUT_ENCODING_PCM_32BIT : OUTPUT_ENCODING_PCM_16BIT;
+    releaseContext(&audioContext->codecContext);
+    auto *codec = const_cast<AVCodec *>(avcodec_find_decoder(codecId));
+    if (!codec) {
+        LOGE("Unexpected error finding codec %d.", codecId);
+        delete audioContext;
+        return false;
+    }
+    audioContext->codecContext = createContext(env, codec, extraData, outputEncoding,
+                                               /* rawSampleRate= */ -1,
+                                               /* rawChannelCount= */ -1);
+    if (!audioContext->codecContext) {
+        delete audioContext;
+        return false;
+    }
+    return true;
 }
 
 extern "C"
@@ -329,39 +218,430 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpe
                                                                    jobject thiz,
                                                                    jlong jContext,
                                                                    jbyteArray extra_data) {
-    auto *context = (AVCodecContext *) jContext;
-    if (!context) {
+    auto *audioContext = (AudioContext *) jContext;
+    if (!audioContext) {
         LOGE("Tried to reset without a context.");
         return 0L;
     }
+    return resetContext(env, audioContext, extra_data) ? (jlong) audioContext : 0L;
+}
 
-    AVCodecID codecId = context->codec_id;
-    if (codecId == AV_CODEC_ID_TRUEHD) {
-        // Release and recreate the context if the codec is TrueHD.
-        // TODO: Figure out why flushing doesn't work for this codec.
-        auto outputFloat =
-                (jboolean) (context->request_sample_fmt == OUTPUT_FORMAT_PCM_FLOAT);
-        releaseContext(&context);
-        auto *codec = const_cast<AVCodec *>(avcodec_find_decoder(codecId));
-        if (!codec) {
-            LOGE("Unexpected error finding codec %d.", codecId);
-            return 0L;
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpegRelease(JNIEnv *env,
+                                                                     jobject thiz,
+                                                                     jlong context) {
+    if (context) {
+        delete (AudioContext *) context;
+    }
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpegGetStats(JNIEnv *env,
+                                                                      jobject thiz,
+                                                                      jlong context) {
+    if (!context) {
+        return nullptr;
+    }
+    return statsToJava(env, ((AudioContext *) context)->stats);
+}
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegInitialize(
+        JNIEnv *env, jobject thiz, jstring codec_name, jbyteArray extra_data,
+        jboolean output_float, jint raw_sample_rate, jint raw_channel_count) {
+    AVCodec *codec = getCodecByName(env, codec_name);
+    if (!codec) {
+        LOGE("Codec not found.");
+        return 0L;
+    }
+    AVCodecContext *codecContext = createContext(
+            env, codec, extra_data,
+            output_float ? OUTPUT_ENCODING_PCM_FLOAT : OUTPUT_ENCODING_PCM_16BIT,
+            raw_sample_rate, raw_channel_count);
+    if (!codecContext) {
+        return 0L;
+    }
+    return (jlong) new AudioContext(codecContext);
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegDecode(
+        JNIEnv *env, jobject thiz, jlong context, jobject input_data, jintArray packet_sizes,
+        jlongArray times_us, jint packet_count, jintArray output_ends) {
+    auto *audioContext = (AudioContext *) context;
+    if (!audioContext || !input_data) {
+        LOGE("Context and input buffer must be non-NULL.");
+        return nullptr;
+    }
+    if (packet_count < 0 || env->GetArrayLength(packet_sizes) < packet_count
+        || env->GetArrayLength(times_us) < packet_count
+        || env->GetArrayLength(output_ends) < packet_count) {
+        LOGE("Invalid packet count: %d.", packet_count);
+        return nullptr;
+    }
+    auto *inputBuffer = (const uint8_t *) env->GetDirectBufferAddress(input_data);
+    jlong inputCapacity = env->GetDirectBufferCapacity(input_data);
+    std::vector<int> sizes(packet_count);
+    std::vector<int64_t> timesUs(packet_count);
+    std::vector<int> ends(packet_count);
+    env->GetIntArrayRegion(packet_sizes, 0, packet_count, sizes.data());
+    env->GetLongArrayRegion(times_us, 0, packet_count,
+                            reinterpret_cast<jlong *>(timesUs.data()));
+    int64_t inputSize = 0;
+    for (int size : sizes) {
+        if (size < 0) {
+            LOGE("Invalid packet size: %d.", size);
+            return nullptr;
         }
-        return (jlong) createContext(env, codec, extra_data, outputFloat,
-                /* rawSampleRate= */ -1,
-                /* rawChannelCount= */ -1);
+        inputSize += size;
+    }
+    if (!inputBuffer || inputSize > inputCapacity) {
+        LOGE("Packets of %" PRId64 " bytes exceed the input buffer.", inputSize);
+        return nullptr;
     }
+    int result = decodePackets(audioContext, inputBuffer, sizes.data(), timesUs.data(),
+                               packet_count, ends.data());
+    if (result < 0) {
+        return nullptr;
+    }
+    env->SetIntArrayRegion(output_ends, 0, packet_count, ends.data());
+    return env->NewDirectByteBuffer(audioContext->batchOutput.data(), result);
+}
 
-    avcodec_flush_buffers(context);
-    return (jlong) context;
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegGetChannelCount(
+        JNIEnv *env, jobject thiz, jlong context) {
+    if (!context) {
+        LOGE("Context must be non-NULL.");
+        return -1;
+    }
+    return getOutputChannelCount((AudioContext *) context);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegGetSampleRate(
+        JNIEnv *env, jobject thiz, jlong context) {
+    if (!context) {
+        LOGE("Context must be non-NULL.");
+        return -1;
+    }
+    return getOutputSampleRate((AudioContext *) context);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegReset(
+        JNIEnv *env, jobject thiz, jlong context, jbyteArray extra_data) {
+    auto *audioContext = (AudioContext *) context;
+    if (!audioContext) {
+        LOGE("Tried to reset without a context.");
+        return 0L;
+    }
+    return resetContext(env, audioContext, extra_data) ? (jlong) audioContext : 0L;
 }
 
 extern "C"
 JNIEXPORT void JNICALL
-Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioDecoder_ffmpegRelease(JNIEnv *env,
-                                                                     jobject thiz,
-                                                                     jlong context) {
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioBatchDecoder_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong context) {
     if (context) {
-        releaseContext((AVCodecContext **)& context);
+        delete (AudioContext *) context;
+    }
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegInitialize(
+        JNIEnv *env, jobject thiz, jstring codec_name, jint dts_hd_rate) {
+    AVCodec *codec = getCodecByName(env, codec_name);
+    if (!codec) {
+        LOGE("Codec not found.");
+        return 0L;
+    }
+    auto *packer = new Iec61937Packer();
+    if (!packer->configure(codec->id, dts_hd_rate)) {
+        LOGE("Cannot pack %s for IEC 61937.", codec->name);
+        delete packer;
+        return 0L;
     }
-}
\ No newline at end of file
+    return (jlong) packer;
+}
+
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegPack(
+        JNIEnv *env, jobject thiz, jlong context, jobject input_data, jint input_size) {
+    auto *packer = (Iec61937Packer *) context;
+    if (!packer || !input_data) {
+        LOGE("Context and input buffer must be non-NULL.");
+        return nullptr;
+    }
+    auto *inputBuffer = (const uint8_t *) env->GetDirectBufferAddress(input_data);
+    if (!inputBuffer || input_size < 0 || input_size > env->GetDirectBufferCapacity(input_data)) {
+        LOGE("Invalid input size: %d.", input_size);
+        return nullptr;
+    }
+    int result = packer->pack(inputBuffer, input_size);
+    if (result < 0) {
+        // Like undecodable packets in the decoders, frames that cannot be parsed are dropped.
+        logError("pack", result);
+        result = 0;
+    }
+    return env->NewDirectByteBuffer((void *) packer->getOutput(), result);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegGetChannelCount(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((Iec61937Packer *) context)->getChannelCount();
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegGetSampleRate(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((Iec61937Packer *) context)->getSampleRate();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegReset(
+        JNIEnv *env, jobject thiz, jlong context) {
+    ((Iec61937Packer *) context)->reset();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegIec61937Packer_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong context) {
+    delete (Iec61937Packer *) context;
+}
+
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegWaveform_ffmpegCompute(
+        JNIEnv *env, jclass clazz, jstring url, jint bucket_count, jint channel_count,
+        jint parallelism) {
+    const char *urlChars = env->GetStringUTFChars(url, nullptr);
+    std::vector<float> values;
+    int result = computeWaveform(urlChars, bucket_count, channel_count, parallelism, &values);
+    env->ReleaseStringUTFChars(url, urlChars);
+    if (result < 0) {
+        logError("computeWaveform", result);
+        return nullptr;
+    }
+    auto size = (jsize) values.size();
+    jfloatArray array = env->NewFloatArray(size);
+    if (array) {
+        env->SetFloatArrayRegion(array, 0, size, values.data());
+    }
+    return array;
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegPcmExport_ffmpegExport(
+        JNIEnv *env, jclass clazz, jstring url, jint fd, jint container, jint encoding,
+        jint channel_count, jint parallelism) {
+    const char *urlChars = env->GetStringUTFChars(url, nullptr);
+    ExportInfo info;
+    int result = exportPcm(urlChars, fd, container, encoding, channel_count, parallelism,
+                           &info);
+    env->ReleaseStringUTFChars(url, urlChars);
+    if (result < 0) {
+        logError("exportPcm", result);
+        return nullptr;
+    }
+    jlong values[] = {info.channelCount, info.sampleRate, info.frameCount};
+    jlongArray array = env->NewLongArray(3);
+    if (array) {
+        env->SetLongArrayRegion(array, 0, 3, values);
+    }
+    return array;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSpectrumAnalyzer_ffmpegInitialize(
+        JNIEnv *env, jobject thiz, jint fft_size, jint band_count, jint interval_ms) {
+    auto analyzer = std::make_shared<SpectrumAnalyzer>();
+    if (!analyzer->configure(fft_size, band_count, interval_ms)) {
+        return 0L;
+    }
+    // The handle holds a reference of its own, decoders take another one.
+    return (jlong) new std::shared_ptr<SpectrumAnalyzer>(std::move(analyzer));
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSpectrumAnalyzer_ffmpegRead(
+        JNIEnv *env, jobject thiz, jlong context, jfloatArray bands) {
+    SpectrumAnalyzer &analyzer = **(std::shared_ptr<SpectrumAnalyzer> *) context;
+    if (env->GetArrayLength(bands) < analyzer.getBandCount()) {
+        LOGE("Band array too short: %d.", env->GetArrayLength(bands));
+        return 0L;
+    }
+    auto *values = (float *) env->GetPrimitiveArrayCritical(bands, nullptr);
+    if (!values) {
+        return 0L;
+    }
+    int64_t sequence = analyzer.read(values);
+    env->ReleasePrimitiveArrayCritical(bands, values, sequence ? 0 : JNI_ABORT);
+    return sequence;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSpectrumAnalyzer_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong context) {
+    delete (std::shared_ptr<SpectrumAnalyzer> *) context;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioEffects_ffmpegInitialize(
+        JNIEnv *env, jobject thiz) {
+    // The handle holds a reference of its own, decoders take another one.
+    return (jlong) new std::shared_ptr<AudioEffects>(std::make_shared<AudioEffects>());
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioEffects_ffmpegSetParameters(
+        JNIEnv *env, jobject thiz, jlong context, jfloat gain_db, jfloat replay_gain_db,
+        jfloat replay_gain_peak, jintArray eq_types, jfloatArray eq_values, jint eq_band_count) {
+    if (eq_band_count < 0 || eq_band_count > DSP_MAX_EQ_BANDS
+        || env->GetArrayLength(eq_types) < eq_band_count
+        || env->GetArrayLength(eq_values) < eq_band_count * 3) {
+        LOGE("Invalid equalizer band count: %d.", eq_band_count);
+        return;
+    }
+    DspParameters parameters;
+    parameters.gainDb = gain_db;
+    parameters.replayGainDb = replay_gain_db;
+    parameters.replayGainPeak = replay_gain_peak;
+    parameters.eqBandCount = eq_band_count;
+    int types[DSP_MAX_EQ_BANDS];
+    float values[DSP_MAX_EQ_BANDS * 3];
+    env->GetIntArrayRegion(eq_types, 0, eq_band_count, types);
+    env->GetFloatArrayRegion(eq_values, 0, eq_band_count * 3, values);
+    for (int i = 0; i < eq_band_count; i++) {
+        parameters.eqBands[i] = {types[i], values[i * 3], values[i * 3 + 1], values[i * 3 + 2]};
+    }
+    (*(std::shared_ptr<AudioEffects> *) context)->setParameters(parameters);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegAudioEffects_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong context) {
+    delete (std::shared_ptr<AudioEffects> *) context;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegIsAvailable(
+        JNIEnv *env, jclass clazz) {
+    return AAudioOutput::isAvailable();
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegInitialize(
+        JNIEnv *env, jobject thiz) {
+    return (jlong) new AAudioOutput();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegOpen(
+        JNIEnv *env, jobject thiz, jlong context, jint channel_count, jint sample_rate,
+        jint encoding, jint buffer_frames, jint performance_mode, jfloat volume) {
+    auto *output = (AAudioOutput *) context;
+    if (!output->open(channel_count, sample_rate, encoding, buffer_frames, performance_mode)) {
+        return false;
+    }
+    output->getSink().setVolume(volume);
+    return true;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegWrite(
+        JNIEnv *env, jobject thiz, jlong context, jobject buffer, jint offset, jint size) {
+    auto *data = (uint8_t *) env->GetDirectBufferAddress(buffer);
+    if (!data) {
+        LOGE("Buffer must be direct.");
+        return -1;
+    }
+    return ((AAudioOutput *) context)->write(data + offset, size);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegStart(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((AAudioOutput *) context)->start();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegPause(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((AAudioOutput *) context)->pause();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegFlush(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((AAudioOutput *) context)->flush();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegSetEndOfStream(
+        JNIEnv *env, jobject thiz, jlong context) {
+    ((AAudioOutput *) context)->getSink().setEndOfStream();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegSetVolume(
+        JNIEnv *env, jobject thiz, jlong context, jfloat volume) {
+    ((AAudioOutput *) context)->getSink().setVolume(volume);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegGetPositionFrames(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((AAudioOutput *) context)->getPositionFrames();
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegGetUnderrunCount(
+        JNIEnv *env, jobject thiz, jlong context) {
+    return ((AAudioOutput *) context)->getSink().getUnderrunCount();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegClose(
+        JNIEnv *env, jobject thiz, jlong context) {
+    ((AAudioOutput *) context)->close();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_AAudioSink_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong context) {
+    delete (AAudioOutput *) context;
+}
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <cstring>
+#include "ffaudiocore.h"
+#include "ffdiag.h"
+#include "ffsamplefmt.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+}
+
+// Output reserved per packet by decodePackets before any packet has been decoded.
+static const int kMinPacketOutputSize = 8 * 1024;
+
+AVCodecContext *createContext(const AVCodec *codec, const uint8_t *extraData, int extraDataSize,
+                              int outputEncoding, int rawSampleRate, int rawChannelCount) {
+    AVSampleFormat outputFormat;
+    switch (outputEncoding) {
+        case OUTPUT_ENCODING_PCM_16BIT:
+            outputFormat = OUTPUT_FORMAT_PCM_16BIT;
+            break;
+        case OUTPUT_ENCODING_PCM_FLOAT:
+            outputFormat = OUTPUT_FORMAT_PCM_FLOAT;
+            break;
+        case OUTPUT_ENCODING_PCM_24BIT:
+        case OUTPUT_ENCODING_PCM_32BIT:
+            outputFormat = OUTPUT_FORMAT_PCM_32BIT;
+            break;
+        default:
+            LOGE("Unsupported output encoding: %d.", outputEncoding);
+            return nullptr;
+    }
+    AVCodecContext *context = avcodec_alloc_context3(codec);
+    if (!context) {
+        LOGE("Failed to allocate context.");
+        return nullptr;
+    }
+    // Also makes FLAC, ALAC and TrueHD decode to S32 for 32-bit output, which is passed
+    // through or interleaved without conversion.
+    context->request_sample_fmt = outputFormat;
+    if (extraData) {
+        context->extradata_size = extraDataSize;
+        context->extradata =
+                (uint8_t *) av_mallocz(extraDataSize + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!context->extradata) {
+            LOGE("Failed to allocate extra data.");
+            releaseContext(&context);
+            return nullptr;
+        }
+        memcpy(context->extradata, extraData, extraDataSize);
+    }
+    if (context->codec_id == AV_CODEC_ID_PCM_MULAW ||
+        context->codec_id == AV_CODEC_ID_PCM_ALAW) {
+        context->sample_rate = rawSampleRate;
+        av_channel_layout_default(&context->ch_layout, rawChannelCount);
+    }
+    context->err_recognition = AV_EF_IGNORE_ERR;
+    int result = avcodec_open2(context, codec, nullptr);
+    if (result < 0) {
+        logError("avcodec_open2", result);
+        releaseContext(&context);
+        return nullptr;
+    }
+    return context;
+}
+
+AudioContext::~AudioContext() {
+    releaseContext(&codecContext);
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    av_channel_layout_uninit(&resampleInLayout);
+    av_channel_layout_uninit(&downmixFallbackLayout);
+}
+
+int getOutputChannelCount(const AudioContext *audioContext) {
+    if (audioContext->outputChannelCount > 0) {
+        return audioContext->outputChannelCount;
+    }
+    return audioContext->codecContext->ch_layout.nb_channels;
+}
+
+int getOutputSampleRate(const AudioContext *audioContext) {
+    if (audioContext->outputSampleRate > 0) {
+        return audioContext->outputSampleRate;
+    }
+    if (audioContext->targetSampleRate > 0) {
+        return audioContext->targetSampleRate;
+    }
+    return audioContext->codecContext->sample_rate;
+}
+
+void flushResampler(AudioContext *audioContext) {
+    AVCodecContext *context = audioContext->codecContext;
+    if (context && context->opaque) {
+        auto *resampleContext = (SwrContext *) context->opaque;
+        swr_free(&resampleContext);
+        context->opaque = nullptr;
+    }
+}
+
+void flushContext(AudioContext *audioContext) {
+    avcodec_flush_buffers(audioContext->codecContext);
+    flushResampler(audioContext);
+    audioContext->dsp.reset();
+    if (audioContext->spectrum) {
+        audioContext->spectrum->reset();
+    }
+}
+
+/**
+ * Sets the filter options of a RESAMPLE_QUALITY preset. FAST uses a short filter with linear
+ * interpolation between phases, DEFAULT the swresample defaults and HIGH a longer filter with
+ * a steeper cutoff.
+ */
+static void setResampleQuality(SwrContext *resampleContext, int quality) {
+    switch (quality) {
+        case RESAMPLE_QUALITY_FAST:
+            av_opt_set_int(resampleContext, "filter_size", 8, 0);
+            av_opt_set_int(resampleContext, "phase_shift", 6, 0);
+            av_opt_set_int(resampleContext, "linear_interp", 1, 0);
+            break;
+        case RESAMPLE_QUALITY_HIGH:
+            av_opt_set_int(resampleContext, "filter_size", 64, 0);
+            av_opt_set_int(resampleContext, "phase_shift", 12, 0);
+            av_opt_set_double(resampleContext, "cutoff", 0.97, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Returns whether frame has to be mixed down, configuring the Downmixer for its layout if
+ * needed. Layouts the Downmixer has no matrix for are mixed down by swr with its default
+ * matrix, leaving the Downmixer unconfigured.
+ */
+static bool prepareDownmix(AudioContext *audioContext, const AVFrame *frame) {
+    if (audioContext->downmixChannelCount <= 0
+        || frame->ch_layout.nb_channels <= audioContext->downmixChannelCount) {
+        return false;
+    }
+    Downmixer &downmixer = audioContext->downmixer;
+    if (downmixer.isConfiguredFor(&frame->ch_layout)
+        || !av_channel_layout_compare(&audioContext->downmixFallbackLayout, &frame->ch_layout)) {
+        return true;
+    }
+    if (!downmixer.configure(&frame->ch_layout, audioContext->downmixChannelCount,
+                             audioContext->downmixMode)) {
+        LOGE("No downmix from %d to %d channels, using the default matrix.",
+             frame->ch_layout.nb_channels, audioContext->downmixChannelCount);
+        av_channel_layout_uninit(&audioContext->downmixFallbackLayout);
+        av_channel_layout_copy(&audioContext->downmixFallbackLayout, &frame->ch_layout);
+    }
+    return true;
+}
+
+AVPacket *obtainPacket(AudioContext *audioContext) {
+    if (!audioContext->packet) {
+        audioContext->packet = av_packet_alloc();
+        audioContext->stats.add(COUNTER_ALLOCATIONS);
+    } else {
+        av_packet_unref(audioContext->packet);
+    }
+    return audioContext->packet;
+}
+
+/**
+ * Returns the SwrContext that converts the frame to the requested output format, mixing it
+ * down if downmix is set and converting it to the target sample rate if resample is set.
+ * It is rebuilt if the frame parameters differ from those it was built for. Returns nullptr on
+ * failure.
+ */
+static SwrContext *obtainResampleContext(AudioContext *audioContext, const AVFrame *frame,
+                                         bool downmix, bool resample) {
+    AVCodecContext *context = audioContext->codecContext;
+    auto *resampleContext = (SwrContext *) context->opaque;
+    if (resampleContext
+        && audioContext->resampleInFormat == frame->format
+        && audioContext->resampleInRate == frame->sample_rate
+        && !av_channel_layout_compare(&audioContext->resampleInLayout, &frame->ch_layout)) {
+        return resampleContext;
+    }
+    if (resampleContext) {
+        LOGI("Decoder output changed, rebuilding the resampler.");
+        swr_free(&resampleContext);
+        context->opaque = nullptr;
+    }
+    resampleContext = swr_alloc();
+    audioContext->stats.add(COUNTER_ALLOCATIONS);
+    if (!resampleContext) {
+        LOGE("Failed to allocate the resampler.");
+        return nullptr;
+    }
+    av_opt_set_chlayout(resampleContext, "in_chlayout", &frame->ch_layout, 0);
+    av_opt_set_chlayout(resampleContext, "out_chlayout", &frame->ch_layout, 0);
+    av_opt_set_int(resampleContext, "in_sample_rate", frame->sample_rate, 0);
+    av_opt_set_int(resampleContext, "out_sample_rate",
+                   resample ? audioContext->targetSampleRate : frame->sample_rate, 0);
+    if (resample) {
+        setResampleQuality(resampleContext, audioContext->resampleQuality);
+    }
+    av_opt_set_sample_fmt(resampleContext, "in_sample_fmt", (AVSampleFormat) frame->format, 0);
+    // The output format is always the requested format.
+    av_opt_set_sample_fmt(resampleContext, "out_sample_fmt", context->request_sample_fmt, 0);
+    int result = 0;
+    if (downmix && audioContext->downmixer.isConfiguredFor(&frame->ch_layout)) {
+        result = audioContext->downmixer.applyTo(resampleContext);
+    } else if (downmix) {
+        // No matrix for the layout, swr rematrixes to the default layout on its own.
+        AVChannelLayout layout{};
+        if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+            av_channel_layout_default(&layout, frame->ch_layout.nb_channels);
+            av_opt_set_chlayout(resampleContext, "in_chlayout", &layout, 0);
+        }
+        av_channel_layout_default(&layout, audioContext->downmixChannelCount);
+        av_opt_set_chlayout(resampleContext, "out_chlayout", &layout, 0);
+    }
+    if (result < 0) {
+        logError("swr_set_matrix", result);
+        swr_free(&resampleContext);
+        return nullptr;
+    }
+    result = swr_init(resampleContext);
+    if (result < 0) {
+        logError("swr_init", result);
+        swr_free(&resampleContext);
+        return nullptr;
+    }
+    audioContext->resampleInFormat = frame->format;
+    audioContext->resampleInRate = frame->sample_rate;
+    av_channel_layout_uninit(&audioContext->resampleInLayout);
+    av_channel_layout_copy(&audioContext->resampleInLayout, &frame->ch_layout);
+    context->opaque = resampleContext;
+    return resampleContext;
+}
+
+/**
+ * Applies the effects and the spectrum to frameCount converted frames at outputBuffer and packs
+ * them to 24 bits if needed and not already packed. Returns their final size in bytes.
+ */
+static int finishOutput(AudioContext *audioContext, uint8_t *outputBuffer, int frameCount,
+                        int channelCount, bool packed) {
+    DecoderStats &stats = audioContext->stats;
+    AVSampleFormat outFormat = audioContext->codecContext->request_sample_fmt;
+    int bufferOutSize = av_get_bytes_per_sample(outFormat) * channelCount * frameCount;
+    if (audioContext->effects) {
+        // Part of the conversion pass: the frame is still in cache.
+        ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "effects");
+        if (outFormat == AV_SAMPLE_FMT_FLT) {
+            audioContext->dsp.process(*audioContext->effects, (float *) outputBuffer,
+                                      frameCount, channelCount,
+                                      audioContext->outputSampleRate);
+        } else if (outFormat == AV_SAMPLE_FMT_S32) {
+            audioContext->dsp.process(*audioContext->effects, (int32_t *) outputBuffer,
+                                      frameCount, channelCount,
+                                      audioContext->outputSampleRate);
+        } else {
+            audioContext->dsp.process(*audioContext->effects, (int16_t *) outputBuffer,
+                                      frameCount, channelCount,
+                                      audioContext->outputSampleRate);
+        }
+    }
+    if (audioContext->spectrum) {
+        audioContext->spectrum->feed(outputBuffer, frameCount, channelCount,
+                                     audioContext->outputSampleRate, outFormat);
+    }
+    if (audioContext->packS24Output) {
+        if (!packed) {
+            ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "pack");
+            packS24((const int32_t *) outputBuffer, outputBuffer, bufferOutSize / 4);
+        }
+        bufferOutSize = bufferOutSize / 4 * 3;
+    }
+    return bufferOutSize;
+}
+
+/**
+ * Writes the samples that rate conversion holds back for its filter delay at the end of the
+ * stream to outputBuffer, after the outSize bytes already there. Returns the number of bytes
+ * written, or a negative AUDIO_DECODER_ERROR constant value.
+ */
+static int drainResampler(AudioContext *audioContext, uint8_t *outputBuffer, int outputSize,
+                          int outSize, const GrowOutputBuffer &growBuffer) {
+    auto *resampleContext = (SwrContext *) audioContext->codecContext->opaque;
+    if (!resampleContext || audioContext->targetSampleRate <= 0
+        || audioContext->resampleInRate == audioContext->targetSampleRate) {
+        return 0;
+    }
+    int outSamples = swr_get_out_samples(resampleContext, 0);
+    if (outSamples <= 0) {
+        return 0;
+    }
+    int channelCount = audioContext->outputChannelCount;
+    int outSampleSize = av_get_bytes_per_sample(audioContext->codecContext->request_sample_fmt);
+    int bufferOutSize = outSampleSize * channelCount * outSamples;
+    if (outSize + bufferOutSize > outputSize) {
+        outputBuffer = growBuffer(outSize + bufferOutSize);
+        if (!outputBuffer) {
+            LOGE("Failed to reallocate output buffer.");
+            return AUDIO_DECODER_ERROR_OTHER;
+        }
+    }
+    outputBuffer += outSize;
+    int result;
+    {
+        ScopedTimer timer(audioContext->stats.timer(TIMER_RESAMPLE), "swr_convert");
+        result = swr_convert(resampleContext, &outputBuffer, outSamples, nullptr, 0);
+    }
+    if (result < 0) {
+        logError("swr_convert", result);
+        return AUDIO_DECODER_ERROR_INVALID_DATA;
+    }
+    return finishOutput(audioContext, outputBuffer, result, channelCount, false);
+}
+
+int decodePacket(AudioContext *audioContext, AVPacket *packet,
+                 uint8_t *outputBuffer, int outputSize, const GrowOutputBuffer &growBuffer) {
+    AVCodecContext *context = audioContext->codecContext;
+    DecoderStats &stats = audioContext->stats;
+    int result = 0;
+    // Queue input data.
+    {
+        ScopedTimer timer(stats.timer(TIMER_SEND_PACKET), "avcodec_send_packet");
+        result = avcodec_send_packet(context, packet);
+    }
+    // A decoder that is already draining has nothing more to give.
+    if (result && !(result == AVERROR_EOF && !packet)) {
+        logError("avcodec_send_packet", result);
+        return transformError(result);
+    }
+    stats.add(COUNTER_PACKETS_SENT);
+    stats.add(COUNTER_BYTES_SENT, packet ? packet->size : 0);
+
+    if (!audioContext->frame) {
+        audioContext->frame = av_frame_alloc();
+        stats.add(COUNTER_ALLOCATIONS);
+        if (!audioContext->frame) {
+            LOGE("Failed to allocate output frame.");
+            return AUDIO_DECODER_ERROR_INVALID_DATA;
+        }
+    }
+    AVFrame *frame = audioContext->frame;
+
+    // Dequeue output data until it runs out.
+    int outSize = 0;
+    while (true) {
+        {
+            ScopedTimer timer(stats.timer(TIMER_RECEIVE_FRAME), "avcodec_receive_frame");
+            result = avcodec_receive_frame(context, frame);
+        }
+        if (result) {
+            if (result == AVERROR(EAGAIN)) {
+                break;
+            }
+            if (result == AVERROR_EOF && !packet) {
+                result = drainResampler(audioContext, outputBuffer - outSize, outputSize,
+                                        outSize, growBuffer);
+                return result < 0 ? result : outSize + result;
+            }
+            logError("avcodec_receive_frame", result);
+            return transformError(result);
+        }
+        stats.add(COUNTER_FRAMES_DECODED);
+
+        // Packed output in the requested format is copied as is, the common planar formats
+        // are interleaved by the kernels of ffsamplefmt and anything else goes through swr.
+        // Planar float is mixed down by the Downmixer, other formats by swr. Sample rate
+        // conversion always goes through swr, together with the format conversion and mix.
+        // 24-bit output is converted to S32 and packed in place at the end, unless S32 and
+        // S32P decoder output can be packed directly because nothing else reads the S32.
+        AVSampleFormat outFormat = context->request_sample_fmt;
+        bool packS24Output = audioContext->packS24Output;
+        bool packDirectly = packS24Output && !audioContext->effects && !audioContext->spectrum;
+        bool downmix = prepareDownmix(audioContext, frame);
+        bool resample = audioContext->targetSampleRate > 0
+                        && frame->sample_rate != audioContext->targetSampleRate;
+        int channelCount = downmix ? audioContext->downmixChannelCount
+                                   : frame->ch_layout.nb_channels;
+        audioContext->outputChannelCount = channelCount;
+        audioContext->outputSampleRate =
+                resample ? audioContext->targetSampleRate : frame->sample_rate;
+        int outSampleSize = av_get_bytes_per_sample(outFormat);
+        bool downmixKernel = downmix && !resample
+                             && audioContext->downmixer.isConfiguredFor(&frame->ch_layout)
+                             && Downmixer::supportsFormats(frame->format, outFormat);
+        bool passThrough = !downmix && !resample && frame->format == outFormat;
+        InterleaveFunction interleave = nullptr;
+        if (!downmix && !resample && !passThrough) {
+            interleave = packDirectly
+                         ? findPackedS24InterleaveFunction((AVSampleFormat) frame->format,
+                                                           channelCount)
+                         : findInterleaveFunction((AVSampleFormat) frame->format, outFormat,
+                                                  channelCount);
+        }
+        bool packed = packDirectly && (passThrough || interleave);
+        SwrContext *resampleContext = nullptr;
+        int outSamples = frame->nb_samples;
+        if (!passThrough && !interleave && !downmixKernel) {
+            resampleContext = obtainResampleContext(audioContext, frame, downmix, resample);
+            if (!resampleContext) {
+                av_frame_unref(frame);
+                return AUDIO_DECODER_ERROR_OTHER;
+            }
+            outSamples = swr_get_out_samples(resampleContext, frame->nb_samples);
+        }
+        int bufferOutSize = outSampleSize * channelCount * outSamples;
+        if (outSize + bufferOutSize > outputSize) {
+            DIAGI(DIAG_OUTPUT_BUFFER_GROWN, outputSize, outSize + bufferOutSize);
+            outputSize = outSize + bufferOutSize;
+            outputBuffer = growBuffer(outputSize);
+            if (!outputBuffer) {
+                LOGE("Failed to reallocate output buffer.");
+                av_frame_unref(frame);
+                return AUDIO_DECODER_ERROR_OTHER;
+            }
+            // The buffer may have moved, continue after the data written so far.
+            outputBuffer += outSize;
+        }
+        if (passThrough && packed) {
+            ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "pack");
+            packS24((const int32_t *) frame->data[0], outputBuffer,
+                    channelCount * frame->nb_samples);
+        } else if (passThrough) {
+            memcpy(outputBuffer, frame->data[0], bufferOutSize);
+        } else if (downmixKernel) {
+            ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "downmix");
+            audioContext->downmixer.process(frame->extended_data, frame->nb_samples, outFormat,
+                                            outputBuffer);
+        } else if (interleave) {
+            ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "interleave");
+            interleave(frame->extended_data, frame->nb_samples, outputBuffer);
+        } else {
+            {
+                ScopedTimer timer(stats.timer(TIMER_RESAMPLE), "swr_convert");
+                result = swr_convert(resampleContext, &outputBuffer, outSamples,
+                                     (const uint8_t **) frame->extended_data, frame->nb_samples);
+            }
+            if (result < 0) {
+                av_frame_unref(frame);
+                logError("swr_convert", result);
+                return AUDIO_DECODER_ERROR_INVALID_DATA;
+            }
+            // Rate conversion keeps the samples of its filter delay for the next frame.
+            int available = resample ? 0 : swr_get_out_samples(resampleContext, 0);
+            if (available != 0) {
+                av_frame_unref(frame);
+                LOGE("Expected no samples remaining after resampling, but found %d.",
+                     available);
+                return AUDIO_DECODER_ERROR_INVALID_DATA;
+            }
+            bufferOutSize = outSampleSize * channelCount * result;
+        }
+        int frameCount = bufferOutSize / (outSampleSize * channelCount);
+        bufferOutSize = finishOutput(audioContext, outputBuffer, frameCount, channelCount,
+                                     packed);
+        av_frame_unref(frame);
+        outputBuffer += bufferOutSize;
+        outSize += bufferOutSize;
+        stats.add(COUNTER_BYTES_COPIED, bufferOutSize);
+    }
+    return outSize;
+}
+
+int decodePackets(AudioContext *audioContext, const uint8_t *input, const int *packetSizes,
+                  const int64_t *timesUs, int packetCount, int *outputEnds) {
+    AVPacket *packet = obtainPacket(audioContext);
+    if (!packet) {
+        LOGE("Failed to allocate packet.");
+        return AUDIO_DECODER_ERROR_OTHER;
+    }
+    std::vector<uint8_t> &output = audioContext->batchOutput;
+    int outputOffset = 0;
+    int inputOffset = 0;
+    for (int i = 0; i < packetCount; i++) {
+        // Reserve as much as the largest packet so far needed, so that the buffer is normally
+        // only grown during the first batches.
+        size_t reserved = (size_t) outputOffset
+                          + std::max(audioContext->maxPacketOutputSize, kMinPacketOutputSize);
+        if (output.size() < reserved) {
+            output.resize(reserved);
+            audioContext->stats.add(COUNTER_ALLOCATIONS);
+        }
+        packet->data = const_cast<uint8_t *>(input + inputOffset);
+        packet->size = packetSizes[i];
+        packet->pts = timesUs[i];
+        inputOffset += packetSizes[i];
+        GrowOutputBuffer growBuffer = [&output, audioContext, outputOffset](int requiredSize) {
+            output.resize((size_t) outputOffset + requiredSize);
+            audioContext->stats.add(COUNTER_ALLOCATIONS);
+            return output.data() + outputOffset;
+        };
+        int result = decodePacket(audioContext, packet, output.data() + outputOffset,
+                                  (int) output.size() - outputOffset, growBuffer);
+        if (result == AUDIO_DECODER_ERROR_OTHER) {
+            return result;
+        }
+        if (result > 0) {
+            outputOffset += result;
+            audioContext->maxPacketOutputSize =
+                    std::max(audioContext->maxPacketOutputSize, result);
+        }
+        outputEnds[i] = outputOffset;
+    }
+    av_packet_unref(packet);
+    return outputOffset;
+}
+
+int transformError(int errorNumber) {
+    return errorNumber == AVERROR_INVALIDDATA ? AUDIO_DECODER_ERROR_INVALID_DATA
+                                              : AUDIO_DECODER_ERROR_OTHER;
+}
@@ -0,0 +1,164 @@
+#ifndef NEXTPLAYER_FFAUDIOCORE_H
+#define NEXTPLAYER_FFAUDIOCORE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ffdownmix.h"
+#include "ffdsp.h"
+#include "ffspectrum.h"
+#include "ffstats.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * Audio decoding without JNI: used by FfmpegAudioDecoder through ffaudio.cpp and by the
+ * host benchmark.
+ */
+
+// Output format corresponding to AudioFormat.ENCODING_PCM_16BIT.
+static const AVSampleFormat OUTPUT_FORMAT_PCM_16BIT = AV_SAMPLE_FMT_S16;
+// Output format corresponding to AudioFormat.ENCODING_PCM_FLOAT.
+static const AVSampleFormat OUTPUT_FORMAT_PCM_FLOAT = AV_SAMPLE_FMT_FLT;
+// Output format corresponding to AudioFormat.ENCODING_PCM_32BIT, and the format 24-bit output
+// is converted to before it is packed.
+static const AVSampleFormat OUTPUT_FORMAT_PCM_32BIT = AV_SAMPLE_FMT_S32;
+
+// Output encodings, the values of the AudioFormat and C.ENCODING_PCM constants.
+static const int OUTPUT_ENCODING_PCM_16BIT = 2;
+static const int OUTPUT_ENCODING_PCM_FLOAT = 4;
+static const int OUTPUT_ENCODING_PCM_24BIT = 21;
+static const int OUTPUT_ENCODING_PCM_32BIT = 22;
+
+// Resampler presets for a target output rate. Must match FfmpegAudioRenderer.
+static const int RESAMPLE_QUALITY_FAST = 0;
+static const int RESAMPLE_QUALITY_DEFAULT = 1;
+static const int RESAMPLE_QUALITY_HIGH = 2;
+
+static const int AUDIO_DECODER_ERROR_INVALID_DATA = -1;
+static const int AUDIO_DECODER_ERROR_OTHER = -2;
+
+/**
+ * Native state of an FfmpegAudioDecoder. The SwrContext used for the output format is kept
+ * in codecContext->opaque and is only created when the decoder output needs converting.
+ */
+struct AudioContext {
+    explicit AudioContext(AVCodecContext *codecContext = nullptr) : codecContext(codecContext) {}
+
+    /** Releases the codec context and everything allocated for decoding. */
+    ~AudioContext();
+
+    AudioContext(const AudioContext &) = delete;
+
+    AudioContext &operator=(const AudioContext &) = delete;
+
+    AVCodecContext *codecContext;
+    DecoderStats stats;
+    // Reused for every packet and decoded frame, allocated on first use.
+    AVPacket *packet = nullptr;
+    AVFrame *frame = nullptr;
+    // Input parameters the SwrContext in codecContext->opaque was built for.
+    int resampleInFormat = AV_SAMPLE_FMT_NONE;
+    int resampleInRate = 0;
+    AVChannelLayout resampleInLayout{};
+    // Channel count to mix down to if the decoder outputs more channels, or 0, and one of the
+    // DOWNMIX_MODE constants.
+    int downmixChannelCount = 0;
+    int downmixMode = DOWNMIX_MODE_STANDARD;
+    Downmixer downmixer;
+    // Input layout the Downmixer has no matrix for, mixed down by the default rematrixing of
+    // swr instead. Kept so that the failure is logged once per layout change.
+    AVChannelLayout downmixFallbackLayout{};
+    // Sample rate to convert to if the decoder outputs another rate, or 0, and one of the
+    // RESAMPLE_QUALITY constants.
+    int targetSampleRate = 0;
+    int resampleQuality = RESAMPLE_QUALITY_DEFAULT;
+    // Channel count and sample rate of the output written last, 0 before the first frame.
+    int outputChannelCount = 0;
+    int outputSampleRate = 0;
+    // Whether the S32 output is packed to three bytes per sample, for
+    // OUTPUT_ENCODING_PCM_24BIT.
+    bool packS24Output = false;
+    // Output of decodePackets and the most bytes one packet has produced so far.
+    std::vector<uint8_t> batchOutput;
+    int maxPacketOutputSize = 0;
+    // Effects applied to the output, if any, shared with the FfmpegAudioEffects that sets them,
+    // and the state of applying them.
+    std::shared_ptr<AudioEffects> effects;
+    DspChain dsp;
+    // Analyzer the output is fed to, if any, shared with the FfmpegSpectrumAnalyzer that owns
+    // it so that either may be released first.
+    std::shared_ptr<SpectrumAnalyzer> spectrum;
+};
+
+/**
+ * Returns a buffer of at least requiredSize bytes that starts with the data written so far,
+ * or nullptr if it cannot be grown.
+ */
+using GrowOutputBuffer = std::function<uint8_t *(int requiredSize)>;
+
+/**
+ * Allocates and opens a new AVCodecContext for the specified codec, passing the
+ * provided extraData as initialization data for the decoder if it is non-NULL.
+ * Output is requested in the format of outputEncoding, one of the OUTPUT_ENCODING constants;
+ * for OUTPUT_ENCODING_PCM_24BIT the AudioContext must also set packS24Output.
+ * Returns the created context.
+ */
+AVCodecContext *createContext(const AVCodec *codec, const uint8_t *extraData, int extraDataSize,
+                              int outputEncoding, int rawSampleRate, int rawChannelCount);
+
+/**
+ * Returns the channel count of the output: the one of the last decoded frame after any
+ * downmix, or that of the decoder before the first frame.
+ */
+int getOutputChannelCount(const AudioContext *audioContext);
+
+/**
+ * Returns the sample rate of the output, see getOutputChannelCount().
+ */
+int getOutputSampleRate(const AudioContext *audioContext);
+
+/**
+ * Drops the samples buffered for sample rate conversion, e.g. when the decoder is flushed.
+ */
+void flushResampler(AudioContext *audioContext);
+
+/**
+ * Flushes the decoder, the resampler, the effect filters and the spectrum analyzer, e.g. after
+ * a seek.
+ */
+void flushContext(AudioContext *audioContext);
+
+/**
+ * Returns the packet of the context, emptied, or nullptr if it cannot be allocated.
+ */
+AVPacket *obtainPacket(AudioContext *audioContext);
+
+/**
+ * Decodes the packet into the output buffer, returning the number of bytes
+ * written, or a negative AUDIO_DECODER_ERROR constant value in the case of an
+ * error. A null packet drains the decoder and the resampler at the end of the
+ * stream; the context needs flushContext before it decodes again.
+ */
+int decodePacket(AudioContext *audioContext, AVPacket *packet,
+                 uint8_t *outputBuffer, int outputSize, const GrowOutputBuffer &growBuffer);
+
+/**
+ * Decodes packetCount packets stored back to back in input, with their sizes in packetSizes
+ * and their timestamps in timesUs, into audioContext->batchOutput. The output stays valid
+ * until the next call. The end offset of the output of each packet is written to outputEnds;
+ * packets with invalid data produce no output. Returns the total number of bytes written, or
+ * AUDIO_DECODER_ERROR_OTHER.
+ */
+int decodePackets(AudioContext *audioContext, const uint8_t *input, const int *packetSizes,
+                  const int64_t *timesUs, int packetCount, int *outputEnds);
+
+/**
+ * Transforms ffmpeg AVERROR into a negative AUDIO_DECODER_ERROR constant value.
+ */
+int transformError(int errorNumber);
+
+#endif //NEXTPLAYER_FFAUDIOCORE_H
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "ffdeinterlace.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FF_DEINTERLACE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_DEINTERLACE_SSE2 1
+#endif
+
+namespace {
+    // A missing line is interpolated only when it differs from the average of its
+    // neighbours (combing) and the area changed since the previous frame (motion).
+    const int kCombThreshold = 10;
+    const int kMotionThreshold = 12;
+    // Upper bound for the slice workers; the render thread takes a slice as well.
+    const int kMaxWorkers = 3;
+
+    /**
+     * Writes one missing line. above and below are the neighbouring lines of the kept
+     * field, weave is the line of the other field and the prev* lines are the same
+     * lines of the previous frame. Without a previous frame every pixel counts as
+     * moving and only the comb test applies.
+     */
+    template<bool kHasPrevious>
+    void filterLine(uint8_t *dst, const uint8_t *above, const uint8_t *weave,
+                    const uint8_t *below, const uint8_t *prevAbove,
+                    const uint8_t *prevWeave, const uint8_t *prevBelow, int width) {
+        int x = 0;
+#if FF_DEINTERLACE_NEON
+        const uint8x16_t combThreshold = vdupq_n_u8(kCombThreshold);
+        const uint8x16_t motionThreshold = vdupq_n_u8(kMotionThreshold);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t a = vld1q_u8(above + x);
+            uint8x16_t w = vld1q_u8(weave + x);
+            uint8x16_t b = vld1q_u8(below + x);
+            uint8x16_t spatial = vrhaddq_u8(a, b);
+            uint8x16_t interpolate = vcgtq_u8(vabdq_u8(w, spatial), combThreshold);
+            if (kHasPrevious) {
+                uint8x16_t motion = vmaxq_u8(
+                        vmaxq_u8(vabdq_u8(a, vld1q_u8(prevAbove + x)),
+                                 vabdq_u8(b, vld1q_u8(prevBelow + x))),
+                        vabdq_u8(w, vld1q_u8(prevWeave + x)));
+                interpolate = vandq_u8(interpolate, vcgtq_u8(motion, motionThreshold));
+            }
+            vst1q_u8(dst + x, vbslq_u8(interpolate, spatial, w));
+        }
+#elif FF_DEINTERLACE_SSE2
+        const __m128i combThreshold = _mm_set1_epi8(kCombThreshold);
+        const __m128i motionThreshold = _mm_set1_epi8(kMotionThreshold);
+        const __m128i zero = _mm_setzero_si128();
+        auto absDiff = [](__m128i l, __m128i r) {
+            return _mm_or_si128(_mm_subs_epu8(l, r), _mm_subs_epu8(r, l));
+        };
+        // Unsigned l > r, as a byte mask.
+        auto greater = [&](__m128i l, __m128i r) {
+            return _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(l, r), zero),
+                                    _mm_cmpeq_epi8(zero, zero));
+        };
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+            __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weave + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x));
+            __m128i spatial = _mm_avg_epu8(a, b);
+            __m128i interpolate = greater(absDiff(w, spatial), combThreshold);
+            if (kHasPrevious) {
+                __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prevAbove + x));
+                __m128i pw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prevWeave + x));
+                __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prevBelow + x));
+                __m128i motion = _mm_max_epu8(_mm_max_epu8(absDiff(a, pa), absDiff(b, pb)),
+                                              absDiff(w, pw));
+                interpolate = _mm_and_si128(interpolate, greater(motion, motionThreshold));
+            }
+            __m128i result = _mm_or_si128(_mm_and_si128(interpolate, spatial),
+                                          _mm_andnot_si128(interpolate, w));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), result);
+        }
+#endif
+        for (; x < width; x++) {
+            int spatial = (above[x] + below[x] + 1) >> 1;
+            bool interpolate = std::abs(weave[x] - spatial) > kCombThreshold;
+            if (kHasPrevious) {
+                int motion = std::max({std::abs(above[x] - prevAbove[x]),
+                                       std::abs(below[x] - prevBelow[x]),
+                                       std::abs(weave[x] - prevWeave[x])});
+                interpolate = interpolate && motion > kMotionThreshold;
+            }
+            dst[x] = interpolate ? spatial : weave[x];
+        }
+    }
+}
+
+Deinterlacer::Deinterlacer() : current(av_frame_alloc()), previous(av_frame_alloc()) {}
+
+Deinterlacer::~Deinterlacer() {
+    av_frame_free(&current);
+    av_frame_free(&previous);
+    av_freep(&output[0]);
+}
+
+bool Deinterlacer::supportsFormat(int pixelFormat) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pixelFormat));
+    if (!desc) {
+        return false;
+    }
+    const uint64_t unsupportedFlags = AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                                      AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB;
+    return (desc->flags & AV_PIX_FMT_FLAG_PLANAR) && !(desc->flags & unsupportedFlags) &&
+           desc->nb_components >= 3 && desc->comp[0].depth == 8 &&
+           av_pix_fmt_count_planes(static_cast<AVPixelFormat>(pixelFormat)) == desc->nb_components;
+}
+
+void Deinterlacer::reset() {
+    av_frame_unref(current);
+    av_frame_unref(previous);
+}
+
+bool Deinterlacer::ensureOutput(const AVFrame *frame) {
+    if (output[0] && outputWidth == frame->width && outputHeight == frame->height &&
+        outputFormat == frame->format) {
+        return true;
+    }
+    av_freep(&output[0]);
+    if (av_image_alloc(output, outputLinesize, frame->width, frame->height,
+                       static_cast<AVPixelFormat>(frame->format), 32) < 0) {
+        outputWidth = outputHeight = 0;
+        return false;
+    }
+    outputWidth = frame->width;
+    outputHeight = frame->height;
+    outputFormat = frame->format;
+    return true;
+}
+
+bool Deinterlacer::process(const AVFrame *frame, int field, uint8_t *data[4], int linesize[4]) {
+    if (!supportsFormat(frame->format) || frame->width <= 0 || frame->height <= 0) {
+        return false;
+    }
+    int64_t startUs = av_gettime_relative();
+    // The second field of a double-rate frame shares its buffers with the first one.
+    if (current->data[0] != frame->data[0]) {
+        bool continuous = current->data[0] && current->width == frame->width &&
+                          current->height == frame->height && current->format == frame->format &&
+                          (frame->pts == AV_NOPTS_VALUE || current->pts == AV_NOPTS_VALUE ||
+                           frame->pts > current->pts);
+        av_frame_unref(previous);
+        if (continuous) {
+            av_frame_move_ref(previous, current);
+        } else {
+            av_frame_unref(current);
+        }
+        if (av_frame_ref(current, frame) < 0) {
+            return false;
+        }
+    }
+    if (!ensureOutput(frame)) {
+        return false;
+    }
+
+    if (!threadPool) {
+        int workers = std::min(kMaxWorkers, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+        threadPool.reset(new SliceThreadPool(std::max(workers, 0)));
+    }
+    int sliceCount = threadPool->concurrency();
+    threadPool->run(sliceCount, [this, sliceCount, field](int slice) {
+        processSlice(slice, sliceCount, field);
+    });
+
+    for (int i = 0; i < 4; i++) {
+        data[i] = output[i];
+        linesize[i] = outputLinesize[i];
+    }
+    processedFrames++;
+    totalCostUs += av_gettime_relative() - startUs;
+    return true;
+}
+
+void Deinterlacer::processSlice(int slice, int sliceCount, int field) {
+    auto format = static_cast<AVPixelFormat>(current->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    const int planeCount = av_pix_fmt_count_planes(format);
+    const bool hasPrevious = previous->data[0] != nullptr;
+    // Slice borders are aligned so that chroma rows split cleanly between slices.
+    const int align = 2 << desc->log2_chroma_h;
+    const int height = current->height;
+    const bool lastSlice = slice == sliceCount - 1;
+    const int sliceStart = static_cast<int>((int64_t) height * slice / sliceCount) & ~(align - 1);
+    const int sliceEnd = lastSlice ? height
+                                   : static_cast<int>((int64_t) height * (slice + 1) / sliceCount) & ~(align - 1);
+
+    for (int plane = 0; plane < planeCount; plane++) {
+        const bool chroma = plane == 1 || plane == 2;
+        const int shiftW = chroma ? desc->log2_chroma_w : 0;
+        const int shiftH = chroma ? desc->log2_chroma_h : 0;
+        const int planeWidth = AV_CEIL_RSHIFT(current->width, shiftW);
+        const int planeHeight = AV_CEIL_RSHIFT(height, shiftH);
+        const int rowStart = AV_CEIL_RSHIFT(sliceStart, shiftH);
+        const int rowEnd = lastSlice ? planeHeight : AV_CEIL_RSHIFT(sliceEnd, shiftH);
+
+        const uint8_t *src = current->data[plane];
+        const ptrdiff_t srcStride = current->linesize[plane];
+        const uint8_t *prev = previous->data[plane];
+        const ptrdiff_t prevStride = previous->linesize[plane];
+        uint8_t *dst = output[plane];
+        const ptrdiff_t dstStride = outputLinesize[plane];
+
+        for (int y = rowStart; y < rowEnd; y++) {
+            if ((y & 1) == field || planeHeight < 2) {
+                memcpy(dst + y * dstStride, src + y * srcStride, planeWidth);
+                continue;
+            }
+            int above = y > 0 ? y - 1 : y + 1;
+            int below = y + 1 < planeHeight ? y + 1 : y - 1;
+            if (hasPrevious) {
+                filterLine<true>(dst + y * dstStride,
+                                 src + above * srcStride, src + y * srcStride, src + below * srcStride,
+                                 prev + above * prevStride, prev + y * prevStride, prev + below * prevStride,
+                                 planeWidth);
+            } else {
+                filterLine<false>(dst + y * dstStride,
+                                  src + above * srcStride, src + y * srcStride, src + below * srcStride,
+                                  nullptr, nullptr, nullptr, planeWidth);
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef NEXTPLAYER_FFDEINTERLACE_H
+#define NEXTPLAYER_FFDEINTERLACE_H
+
+#include <cstdint>
+#include <memory>
+#include "ffthreadpool.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Deinterlace modes. Must match FfmpegVideoDecoder.
+static const int DEINTERLACE_MODE_OFF = 0;
+static const int DEINTERLACE_MODE_AUTO = 1;
+static const int DEINTERLACE_MODE_DOUBLE_RATE = 2;
+
+/**
+ * Motion-adaptive deinterlacer for 8-bit planar YUV frames.
+ *
+ * The lines of the kept field are copied as they are. Each line of the other field
+ * is woven back in where the picture is static, and replaced by the average of its
+ * neighbours where it moved since the previous frame and would otherwise comb.
+ * Rows are processed in slices on a small thread pool with NEON/SSE2 kernels.
+ */
+class Deinterlacer {
+public:
+    Deinterlacer();
+
+    ~Deinterlacer();
+
+    /**
+     * Returns whether frames in the given AVPixelFormat can be deinterlaced.
+     */
+    static bool supportsFormat(int pixelFormat);
+
+    /**
+     * Rebuilds the lines of frame that don't belong to field (0 for the top field,
+     * 1 for the bottom field) and returns the progressive picture through data and
+     * linesize. The returned planes stay valid until the next call. Returns false if
+     * the frame could not be processed.
+     */
+    bool process(const AVFrame *frame, int field, uint8_t *data[4], int linesize[4]);
+
+    /**
+     * Forgets the previous frame, e.g. after a seek.
+     */
+    void reset();
+
+    /**
+     * Returns the average wall time spent in process() per frame, in microseconds.
+     */
+    int64_t averageCostUs() const { return processedFrames ? totalCostUs / processedFrames : 0; }
+
+    int64_t frameCount() const { return processedFrames; }
+
+private:
+    bool ensureOutput(const AVFrame *frame);
+
+    void processSlice(int slice, int sliceCount, int field);
+
+    std::unique_ptr<SliceThreadPool> threadPool;
+    // The frame being deinterlaced and the distinct frame before it.
+    AVFrame *current;
+    AVFrame *previous;
+    uint8_t *output[4] = {};
+    int outputLinesize[4] = {};
+    int outputWidth = 0;
+    int outputHeight = 0;
+    int outputFormat = -1;
+    int64_t processedFrames = 0;
+    int64_t totalCostUs = 0;
+};
+
+#endif //NEXTPLAYER_FFDEINTERLACE_H
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+#include "ffdiag.h"
+
+namespace {
+    // Per thread; a power of two so that indices wrap with a mask.
+    const uint64_t kRingCapacity = 1024;
+    // Rings are handed back when their thread exits, so this bounds concurrent threads only.
+    const int kMaxRings = 32;
+
+    const char *const kEventNames[DIAG_EVENT_COUNT] = {
+            "av_error",
+            "frame_received",
+            "receive_done",
+            "window_geometry",
+            "deinterlace_cost",
+            "output_buffer_grown",
+            "subtitle_decoded",
+            "decoder_trimmed",
+            "resync",
+    };
+
+    /**
+     * One event. The fields are written by the owning thread and read by the drainer, the
+     * sequence number tells the drainer whether it read a complete event: it is odd while
+     * the slot is being written and 2 * (index + 1) once event index is in it.
+     */
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int64_t> timeNs{0};
+        std::atomic<int32_t> threadId{0};
+        std::atomic<int32_t> event{0};
+        std::atomic<const char *> label{nullptr};
+        std::atomic<int64_t> a{0};
+        std::atomic<int64_t> b{0};
+    };
+
+    struct Ring {
+        std::atomic<bool> owned{true};
+        // Number of events ever written. Only the owning thread stores it.
+        std::atomic<uint64_t> head{0};
+        // Number of events already drained. Guarded by drainMutex.
+        uint64_t drained = 0;
+        Slot slots[kRingCapacity];
+    };
+
+    struct Event {
+        int64_t timeNs;
+        int32_t threadId;
+        int32_t event;
+        const char *label;
+        int64_t a;
+        int64_t b;
+    };
+
+    // Rings are never freed, so the drainer can read them without synchronizing with
+    // thread exit.
+    std::atomic<Ring *> rings[kMaxRings];
+    std::atomic<int64_t> unrecordedEvents{0};
+    std::mutex drainMutex;
+
+    Ring *claimRing() {
+        for (std::atomic<Ring *> &entry : rings) {
+            Ring *ring = entry.load(std::memory_order_acquire);
+            if (!ring) {
+                auto *created = new Ring();
+                if (entry.compare_exchange_strong(ring, created, std::memory_order_acq_rel)) {
+                    return created;
+                }
+                delete created;
+            }
+            bool owned = false;
+            if (ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                return ring;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Claims a ring on first use and hands it back when the thread exits. The decoder
+     * threads are recreated with every decoder, so rings have to be reused.
+     */
+    struct ThreadRing {
+        ~ThreadRing() {
+            if (ring) {
+                ring->owned.store(false, std::memory_order_release);
+            }
+        }
+
+        Ring *get() {
+            if (!claimed) {
+                claimed = true;
+                ring = claimRing();
+                threadId = gettid();
+            }
+            return ring;
+        }
+
+        Ring *ring = nullptr;
+        int32_t threadId = 0;
+        bool claimed = false;
+    };
+
+    thread_local ThreadRing threadRing;
+
+    int64_t nowNs() {
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    bool readSlot(const Slot &slot, uint64_t index, Event *out) {
+        const uint64_t expected = 2 * (index + 1);
+        if (slot.sequence.load(std::memory_order_acquire) != expected) {
+            return false;
+        }
+        out->timeNs = slot.timeNs.load(std::memory_order_relaxed);
+        out->threadId = slot.threadId.load(std::memory_order_relaxed);
+        out->event = slot.event.load(std::memory_order_relaxed);
+        out->label = slot.label.load(std::memory_order_relaxed);
+        out->a = slot.a.load(std::memory_order_relaxed);
+        out->b = slot.b.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+}
+
+void ffdiag::record(DiagEvent event, const char *label, int64_t a, int64_t b) {
+    Ring *ring = threadRing.get();
+    if (!ring) {
+        unrecordedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t index = ring->head.load(std::memory_order_relaxed);
+    Slot &slot = ring->slots[index & (kRingCapacity - 1)];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timeNs.store(nowNs(), std::memory_order_relaxed);
+    slot.threadId.store(threadRing.threadId, std::memory_order_relaxed);
+    slot.event.store(event, std::memory_order_relaxed);
+    slot.label.store(label, std::memory_order_relaxed);
+    slot.a.store(a, std::memory_order_relaxed);
+    slot.b.store(b, std::memory_order_relaxed);
+    slot.sequence.store(2 * (index + 1), std::memory_order_release);
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+std::string ffdiag::drain() {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    std::vector<Event> events;
+    uint64_t overwritten = 0;
+    for (std::atomic<Ring *> &entry : rings) {
+        Ring *ring = entry.load(std::memory_order_acquire);
+        if (!ring) {
+            break;
+        }
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t start = std::max(ring->drained, head > kRingCapacity ? head - kRingCapacity : 0);
+        overwritten += start - ring->drained;
+        for (uint64_t index = start; index < head; index++) {
+            Event event{};
+            if (readSlot(ring->slots[index & (kRingCapacity - 1)], index, &event)) {
+                events.push_back(event);
+            } else {
+                overwritten++;
+            }
+        }
+        ring->drained = head;
+    }
+    std::sort(events.begin(), events.end(), [](const Event &l, const Event &r) {
+        return l.timeNs < r.timeNs;
+    });
+
+    std::string text;
+    char line[160];
+    int64_t unrecorded = unrecordedEvents.exchange(0, std::memory_order_relaxed);
+    if (overwritten || unrecorded) {
+        snprintf(line, sizeof(line), "lost %" PRIu64 " overwritten and %" PRId64 " unrecorded events\n",
+                 overwritten, unrecorded);
+        text += line;
+    }
+    for (const Event &event : events) {
+        const char *name = event.event >= 0 && event.event < DIAG_EVENT_COUNT
+                           ? kEventNames[event.event] : "unknown";
+        snprintf(line, sizeof(line), "%" PRId64 ".%06" PRId64 " %d %s%s%s %" PRId64 " %" PRId64 "\n",
+                 event.timeNs / 1000000000, (event.timeNs / 1000) % 1000000, event.threadId, name,
+                 event.label ? " " : "", event.label ? event.label : "", event.a, event.b);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,87 @@
+#ifndef NEXTPLAYER_FFDIAG_H
+#define NEXTPLAYER_FFDIAG_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * In-memory diagnostics for the decode hot paths.
+ *
+ * Every thread records into its own fixed size ring of binary events (timestamp, event
+ * code, optional static label and two integer payloads), which costs a few relaxed atomic
+ * stores instead of a logcat write. The rings are only turned into text when drained.
+ *
+ * Events below FF_DIAG_LEVEL are compiled out. Release builds keep errors only, debug
+ * builds keep everything; pass -DFF_DIAG_LEVEL=3 to CMake to profile a release build.
+ */
+#define DIAG_LEVEL_OFF 0
+#define DIAG_LEVEL_ERROR 1
+#define DIAG_LEVEL_INFO 2
+#define DIAG_LEVEL_VERBOSE 3
+
+#ifndef FF_DIAG_LEVEL
+#ifdef NDEBUG
+#define FF_DIAG_LEVEL DIAG_LEVEL_ERROR
+#else
+#define FF_DIAG_LEVEL DIAG_LEVEL_VERBOSE
+#endif
+#endif
+
+// Must match kEventNames in ffdiag.cpp.
+enum DiagEvent {
+    // label: failing function, a: AVERROR.
+    DIAG_AV_ERROR,
+    // a: frame pts, b: whether the frame is kept.
+    DIAG_FRAME_RECEIVED,
+    // a: frames read, b: frames dropped.
+    DIAG_RECEIVE_DONE,
+    // a: width, b: height.
+    DIAG_WINDOW_GEOMETRY,
+    // a: deinterlaced frames, b: average microseconds per frame.
+    DIAG_DEINTERLACE_COST,
+    // a: previous size, b: new size.
+    DIAG_OUTPUT_BUFFER_GROWN,
+    // a: rects, b: rects expanded into the subtitle canvas.
+    DIAG_SUBTITLE_DECODED,
+    // a: heap bytes freed.
+    DIAG_DECODER_TRIMMED,
+    // a: packets discarded while waiting for the keyframe, b: its pts.
+    DIAG_RESYNC,
+    DIAG_EVENT_COUNT
+};
+
+namespace ffdiag {
+    /**
+     * Appends an event to the ring of the calling thread. label must be a string with static
+     * storage duration or nullptr. Use the DIAG* macros so the call is compiled out below
+     * FF_DIAG_LEVEL.
+     */
+    void record(DiagEvent event, const char *label, int64_t a, int64_t b);
+
+    /**
+     * Returns the events recorded since the previous drain as text, one event per line,
+     * ordered by time. Can be called from any thread.
+     */
+    std::string drain();
+}
+
+#if FF_DIAG_LEVEL >= DIAG_LEVEL_ERROR
+#define DIAGE(event, label, a, b) \
+  ffdiag::record(event, label, (int64_t) (a), (int64_t) (b))
+#else
+#define DIAGE(event, label, a, b) ((void)0)
+#endif
+
+#if FF_DIAG_LEVEL >= DIAG_LEVEL_INFO
+#define DIAGI(event, a, b) ffdiag::record(event, nullptr, (int64_t) (a), (int64_t) (b))
+#else
+#define DIAGI(event, a, b) ((void)0)
+#endif
+
+#if FF_DIAG_LEVEL >= DIAG_LEVEL_VERBOSE
+#define DIAGV(event, a, b) ffdiag::record(event, nullptr, (int64_t) (a), (int64_t) (b))
+#else
+#define DIAGV(event, a, b) ((void)0)
+#endif
+
+#endif //NEXTPLAYER_FFDIAG_H
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+#include "ffdownmix.h"
+#include "ffsamplefmt.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FF_DOWNMIX_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_DOWNMIX_SSE2 1
+#endif
+
+namespace {
+    // Samples mixed per chunk before the chunk is interleaved, see ffsamplefmt.
+    const int kChunkSamples = 256;
+    const int kMaxChannels = 8;
+
+    /**
+     * Sets out to coefficient * in.
+     */
+    void scale(const float *in, float coefficient, float *out, int count) {
+        int i = 0;
+#if FF_DOWNMIX_NEON
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), coefficient));
+        }
+#elif FF_DOWNMIX_SSE2
+        const __m128 factor = _mm_set1_ps(coefficient);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), factor));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = in[i] * coefficient;
+        }
+    }
+
+    /**
+     * Adds coefficient * in to out.
+     */
+    void accumulate(const float *in, float coefficient, float *out, int count) {
+        int i = 0;
+#if FF_DOWNMIX_NEON
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(out + i, vmlaq_n_f32(vld1q_f32(out + i), vld1q_f32(in + i), coefficient));
+        }
+#elif FF_DOWNMIX_SSE2
+        const __m128 factor = _mm_set1_ps(coefficient);
+        for (; i + 4 <= count; i += 4) {
+            __m128 sum = _mm_add_ps(_mm_loadu_ps(out + i),
+                                    _mm_mul_ps(_mm_loadu_ps(in + i), factor));
+            _mm_storeu_ps(out + i, sum);
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] += in[i] * coefficient;
+        }
+    }
+}
+
+Downmixer::~Downmixer() {
+    av_channel_layout_uninit(&inLayout);
+    av_channel_layout_uninit(&outLayout);
+}
+
+bool Downmixer::configure(const AVChannelLayout *layout, int channelCount, int mode) {
+    av_channel_layout_uninit(&inLayout);
+    av_channel_layout_uninit(&outLayout);
+    inChannelCount = 0;
+    matrix.clear();
+    taps.clear();
+    if (layout->nb_channels > kMaxChannels || channelCount < 1 || channelCount > kMaxChannels) {
+        return false;
+    }
+    av_channel_layout_copy(&inLayout, layout);
+    // Decoders without a channel map still have to be mixed as if they had one.
+    AVChannelLayout matrixInLayout{};
+    if (layout->order == AV_CHANNEL_ORDER_UNSPEC) {
+        av_channel_layout_default(&matrixInLayout, layout->nb_channels);
+    } else {
+        av_channel_layout_copy(&matrixInLayout, layout);
+    }
+    av_channel_layout_default(&outLayout, channelCount);
+
+    double lfeLevel = mode == DOWNMIX_MODE_WITH_LFE ? M_SQRT1_2 : 0;
+    AVMatrixEncoding encoding = AV_MATRIX_ENCODING_NONE;
+    if (channelCount == 2 && mode == DOWNMIX_MODE_DOLBY) {
+        encoding = AV_MATRIX_ENCODING_DOLBY;
+    } else if (channelCount == 2 && mode == DOWNMIX_MODE_DPLII) {
+        encoding = AV_MATRIX_ENCODING_DPLII;
+    }
+    std::vector<double> built((size_t) channelCount * layout->nb_channels);
+    // maxval 1 normalises the rows so that the mix cannot clip.
+    int result = swr_build_matrix2(&matrixInLayout, &outLayout, M_SQRT1_2, M_SQRT1_2, lfeLevel,
+                                   /* maxval= */ 1.0, /* rematrix_volume= */ 1.0, built.data(),
+                                   layout->nb_channels, encoding, nullptr);
+    av_channel_layout_uninit(&matrixInLayout);
+    if (result < 0) {
+        logError("swr_build_matrix2", result);
+        return false;
+    }
+    inChannelCount = layout->nb_channels;
+    outChannelCount = channelCount;
+    matrix = std::move(built);
+    taps.resize(outChannelCount);
+    for (int out = 0; out < outChannelCount; out++) {
+        for (int in = 0; in < inChannelCount; in++) {
+            double coefficient = matrix[out * inChannelCount + in];
+            if (coefficient != 0) {
+                taps[out].emplace_back(in, (float) coefficient);
+            }
+        }
+    }
+    return true;
+}
+
+bool Downmixer::isConfiguredFor(const AVChannelLayout *layout) const {
+    return inChannelCount > 0 && !av_channel_layout_compare(&inLayout, layout);
+}
+
+int Downmixer::applyTo(SwrContext *swrContext) const {
+    int result = av_opt_set_chlayout(swrContext, "out_chlayout", &outLayout, 0);
+    if (result < 0) {
+        return result;
+    }
+    return swr_set_matrix(swrContext, matrix.data(), inChannelCount);
+}
+
+bool Downmixer::supportsFormats(int inFormat, AVSampleFormat outFormat) {
+    return inFormat == AV_SAMPLE_FMT_FLTP
+           && (outFormat == AV_SAMPLE_FMT_FLT || outFormat == AV_SAMPLE_FMT_S16);
+}
+
+void Downmixer::process(const uint8_t *const *planes, int sampleCount, AVSampleFormat outFormat,
+                        uint8_t *output) const {
+    InterleaveFunction interleave =
+            findInterleaveFunction(AV_SAMPLE_FMT_FLTP, outFormat, outChannelCount);
+    int outSampleSize = av_get_bytes_per_sample(outFormat) * outChannelCount;
+    float mixed[kMaxChannels][kChunkSamples];
+    const uint8_t *mixedPlanes[kMaxChannels];
+    for (int out = 0; out < outChannelCount; out++) {
+        mixedPlanes[out] = reinterpret_cast<const uint8_t *>(mixed[out]);
+    }
+    for (int start = 0; start < sampleCount; start += kChunkSamples) {
+        int count = std::min(kChunkSamples, sampleCount - start);
+        for (int out = 0; out < outChannelCount; out++) {
+            const std::vector<std::pair<int, float>> &outTaps = taps[out];
+            if (outTaps.empty()) {
+                std::fill(mixed[out], mixed[out] + count, 0.0f);
+                continue;
+            }
+            scale(reinterpret_cast<const float *>(planes[outTaps[0].first]) + start,
+                  outTaps[0].second, mixed[out], count);
+            for (size_t tap = 1; tap < outTaps.size(); tap++) {
+                accumulate(reinterpret_cast<const float *>(planes[outTaps[tap].first]) + start,
+                           outTaps[tap].second, mixed[out], count);
+            }
+        }
+        interleave(mixedPlanes, count, output + (size_t) start * outSampleSize);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef NEXTPLAYER_FFDOWNMIX_H
+#define NEXTPLAYER_FFDOWNMIX_H
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+// Downmix modes. Must match FfmpegAudioRenderer.
+// ITU-R BS.775 levels: centre and surrounds at -3 dB, LFE dropped.
+static const int DOWNMIX_MODE_STANDARD = 0;
+// As DOWNMIX_MODE_STANDARD, with the LFE mixed in at -3 dB.
+static const int DOWNMIX_MODE_WITH_LFE = 1;
+// Dolby Surround and Dolby Pro Logic II compatible stereo. Other channel counts fall back to
+// DOWNMIX_MODE_STANDARD.
+static const int DOWNMIX_MODE_DOLBY = 2;
+static const int DOWNMIX_MODE_DPLII = 3;
+
+/**
+ * Mixes decoded audio down to fewer channels with a standard matrix built by swresample, and
+ * interleaves the result in the output sample format in the same pass.
+ *
+ * Planar float input, which most multichannel decoders produce, is mixed with NEON/SSE2 kernels.
+ * Other formats go through swresample with the same matrix, see applyTo().
+ */
+class Downmixer {
+public:
+    Downmixer() = default;
+
+    ~Downmixer();
+
+    Downmixer(const Downmixer &) = delete;
+
+    Downmixer &operator=(const Downmixer &) = delete;
+
+    /**
+     * Builds the matrix from layout to the default layout of channelCount channels, in one of
+     * the DOWNMIX_MODE constants. Returns false if there is no matrix for these layouts.
+     */
+    bool configure(const AVChannelLayout *layout, int channelCount, int mode);
+
+    /**
+     * Returns whether the matrix was built for layout.
+     */
+    bool isConfiguredFor(const AVChannelLayout *layout) const;
+
+    const AVChannelLayout *getOutLayout() const { return &outLayout; }
+
+    /**
+     * Sets the output layout and the matrix on a SwrContext that is not initialized yet.
+     * Returns a negative AVERROR on failure.
+     */
+    int applyTo(SwrContext *swrContext) const;
+
+    /**
+     * Returns whether process() supports input in the given format and output in outFormat.
+     */
+    static bool supportsFormats(int inFormat, AVSampleFormat outFormat);
+
+    /**
+     * Mixes sampleCount samples of the planar float planes into interleaved outFormat samples.
+     */
+    void process(const uint8_t *const *planes, int sampleCount, AVSampleFormat outFormat,
+                 uint8_t *output) const;
+
+private:
+    AVChannelLayout inLayout{};
+    AVChannelLayout outLayout{};
+    int inChannelCount = 0;
+    int outChannelCount = 0;
+    // outChannelCount rows of inChannelCount coefficients, as swr_set_matrix takes them.
+    std::vector<double> matrix;
+    // The non-zero coefficients of each output channel and their input channels.
+    std::vector<std::vector<std::pair<int, float>>> taps;
+};
+
+#endif //NEXTPLAYER_FFDOWNMIX_H
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cmath>
+#include "ffdsp.h"
+#include "ffsamplefmt.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FF_DSP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_DSP_SSE2 1
+#endif
+
+namespace {
+    // Integer output is processed in float chunks of this many samples, which stay in L1.
+    const int kChunkSamples = 1024;
+    // Duration over which gain changes are ramped.
+    const int kGainRampMs = 20;
+    // Filter state below this is flushed to zero at the end of each buffer, so that decaying
+    // state does not turn into denormals, which are slow on the scalar FPU.
+    const float kDenormalThreshold = 1e-15f;
+
+    float dbToLinear(float db) {
+        return powf(10.0f, db / 20.0f);
+    }
+
+    void scale(float *samples, int count, float gain) {
+        int i = 0;
+#if FF_DSP_NEON
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(samples + i, vmulq_n_f32(vld1q_f32(samples + i), gain));
+        }
+#elif FF_DSP_SSE2
+        const __m128 factor = _mm_set1_ps(gain);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), factor));
+        }
+#endif
+        for (; i < count; i++) {
+            samples[i] *= gain;
+        }
+    }
+
+    /**
+     * Returns the normalised coefficients of an Audio EQ Cookbook filter, b0, b1, b2, a1 and
+     * a2 in that order.
+     */
+    void computeCoefficients(const DspParameters::EqBand &band, int sampleRate,
+                             double coefficients[5]) {
+        double a = pow(10.0, band.gainDb / 40.0);
+        double w0 = 2 * M_PI * band.frequency / sampleRate;
+        double cosW0 = cos(w0);
+        double alpha = sin(w0) / (2 * band.q);
+        double b0, b1, b2, a0, a1, a2;
+        if (band.type == DSP_FILTER_LOW_SHELF || band.type == DSP_FILTER_HIGH_SHELF) {
+            // The high shelf is the low shelf with the sign of cos(w0) flipped.
+            double sign = band.type == DSP_FILTER_LOW_SHELF ? 1 : -1;
+            double c = sign * cosW0;
+            double shelf = 2 * sqrt(a) * alpha;
+            b0 = a * ((a + 1) - (a - 1) * c + shelf);
+            b1 = sign * 2 * a * ((a - 1) - (a + 1) * c);
+            b2 = a * ((a + 1) - (a - 1) * c - shelf);
+            a0 = (a + 1) + (a - 1) * c + shelf;
+            a1 = sign * -2 * ((a - 1) + (a + 1) * c);
+            a2 = (a + 1) + (a - 1) * c - shelf;
+        } else {
+            b0 = 1 + alpha * a;
+            b1 = -2 * cosW0;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * cosW0;
+            a2 = 1 - alpha / a;
+        }
+        coefficients[0] = b0 / a0;
+        coefficients[1] = b1 / a0;
+        coefficients[2] = b2 / a0;
+        coefficients[3] = a1 / a0;
+        coefficients[4] = a2 / a0;
+    }
+}
+
+void AudioEffects::setParameters(const DspParameters &parameters) {
+    auto replacement = std::make_shared<const DspParameters>(parameters);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->parameters.swap(replacement);
+    }
+    // The old parameters are released outside the lock.
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const DspParameters> AudioEffects::obtainIfChanged(uint32_t *generation) const {
+    uint32_t current = this->generation.load(std::memory_order_acquire);
+    if (current == *generation) {
+        return nullptr;
+    }
+    *generation = current;
+    std::lock_guard<std::mutex> lock(mutex);
+    return parameters;
+}
+
+bool DspChain::update(const AudioEffects &effects, int channelCount, int sampleRate) {
+    std::shared_ptr<const DspParameters> changed = effects.obtainIfChanged(&generation);
+    bool formatChanged = channelCount != this->channelCount || sampleRate != this->sampleRate;
+    if (changed) {
+        parameters = std::move(changed);
+    } else if (!formatChanged) {
+        return !filters.empty() || gain != 1 || rampFrames > 0;
+    }
+    if (!parameters) {
+        return false;
+    }
+    bool first = this->sampleRate == 0;
+    this->channelCount = channelCount;
+    this->sampleRate = sampleRate;
+
+    size_t filterCount = filters.size();
+    filters.clear();
+    for (int i = 0; i < parameters->eqBandCount; i++) {
+        const DspParameters::EqBand &band = parameters->eqBands[i];
+        // A band at 0 dB is transparent, and one at or above Nyquist cannot be realised.
+        if (band.gainDb == 0 || band.frequency <= 0 || band.frequency >= sampleRate / 2.0f
+            || band.q <= 0) {
+            continue;
+        }
+        double coefficients[5];
+        computeCoefficients(band, sampleRate, coefficients);
+        filters.push_back({(float) coefficients[0], (float) coefficients[1],
+                           (float) coefficients[2], (float) coefficients[3],
+                           (float) coefficients[4]});
+    }
+    // Band settings change smoothly enough with the state kept, but it only fits filters
+    // of the same layout.
+    if (formatChanged || filters.size() != filterCount) {
+        filterState.assign(filters.size() * channelCount * 2, 0);
+    }
+
+    float replayGain = dbToLinear(parameters->replayGainDb);
+    if (parameters->replayGainPeak > 0) {
+        replayGain = std::min(replayGain, 1 / parameters->replayGainPeak);
+    }
+    float newGain = dbToLinear(parameters->gainDb) * replayGain;
+    if (first) {
+        gain = newGain;
+        targetGain = newGain;
+        rampFrames = 0;
+    } else if (newGain != targetGain) {
+        targetGain = newGain;
+        rampFrames = std::max(1, sampleRate * kGainRampMs / 1000);
+        gainStep = (targetGain - gain) / (float) rampFrames;
+    }
+    return !filters.empty() || gain != 1 || rampFrames > 0;
+}
+
+void DspChain::process(const AudioEffects &effects, float *samples, int frameCount,
+                       int channelCount, int sampleRate) {
+    if (update(effects, channelCount, sampleRate)) {
+        processFloat(samples, frameCount);
+    }
+}
+
+void DspChain::process(const AudioEffects &effects, int16_t *samples, int frameCount,
+                       int channelCount, int sampleRate) {
+    if (channelCount <= kChunkSamples && update(effects, channelCount, sampleRate)) {
+        processChunks(samples, frameCount, convertS16ToFloat, convertFloatToS16);
+    }
+}
+
+void DspChain::process(const AudioEffects &effects, int32_t *samples, int frameCount,
+                       int channelCount, int sampleRate) {
+    if (channelCount <= kChunkSamples && update(effects, channelCount, sampleRate)) {
+        processChunks(samples, frameCount, convertS32ToFloat, convertFloatToS32);
+    }
+}
+
+template<typename T>
+void DspChain::processChunks(T *samples, int frameCount, void (*toFloat)(const T *, float *, int),
+                             void (*fromFloat)(const float *, T *, int)) {
+    // Processed in float so that the filters and the gain have headroom, and saturated once.
+    float chunk[kChunkSamples];
+    int chunkFrames = kChunkSamples / channelCount;
+    for (int start = 0; start < frameCount; start += chunkFrames) {
+        int count = std::min(chunkFrames, frameCount - start) * channelCount;
+        T *chunkSamples = samples + start * channelCount;
+        toFloat(chunkSamples, chunk, count);
+        processFloat(chunk, count / channelCount);
+        fromFloat(chunk, chunkSamples, count);
+    }
+}
+
+void DspChain::processFloat(float *samples, int frameCount) {
+    int sampleCount = frameCount * channelCount;
+    for (size_t i = 0; i < filters.size(); i++) {
+        const Biquad &filter = filters[i];
+        for (int channel = 0; channel < channelCount; channel++) {
+            float *state = filterState.data() + (i * channelCount + channel) * 2;
+            float z1 = state[0];
+            float z2 = state[1];
+            // Transposed direct form II.
+            for (int j = channel; j < sampleCount; j += channelCount) {
+                float x = samples[j];
+                float y = filter.b0 * x + z1;
+                z1 = filter.b1 * x - filter.a1 * y + z2;
+                z2 = filter.b2 * x - filter.a2 * y;
+                samples[j] = y;
+            }
+            state[0] = fabsf(z1) < kDenormalThreshold ? 0 : z1;
+            state[1] = fabsf(z2) < kDenormalThreshold ? 0 : z2;
+        }
+    }
+    applyGain(samples, frameCount);
+}
+
+void DspChain::applyGain(float *samples, int frameCount) {
+    int frame = 0;
+    for (; rampFrames > 0 && frame < frameCount; frame++, rampFrames--) {
+        gain += gainStep;
+        for (int channel = 0; channel < channelCount; channel++) {
+            samples[frame * channelCount + channel] *= gain;
+        }
+    }
+    if (rampFrames == 0) {
+        gain = targetGain;
+    }
+    if (gain != 1) {
+        scale(samples + frame * channelCount, (frameCount - frame) * channelCount, gain);
+    }
+}
+
+void DspChain::reset() {
+    std::fill(filterState.begin(), filterState.end(), 0.0f);
+    gain = targetGain;
+    rampFrames = 0;
+}
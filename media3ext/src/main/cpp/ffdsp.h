@@ -0,0 +1,126 @@
+#ifndef NEXTPLAYER_FFDSP_H
+#define NEXTPLAYER_FFDSP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Equalizer filter types. Must match FfmpegAudioEffects.
+static const int DSP_FILTER_PEAKING = 0;
+static const int DSP_FILTER_LOW_SHELF = 1;
+static const int DSP_FILTER_HIGH_SHELF = 2;
+
+static const int DSP_MAX_EQ_BANDS = 10;
+
+/**
+ * Settings of the post-processing applied to the decoder output: a gain, e.g. for volume
+ * normalisation, a ReplayGain gain limited by the track or album peak so that it does not clip,
+ * and up to DSP_MAX_EQ_BANDS biquad equalizer bands from the Audio EQ Cookbook.
+ */
+struct DspParameters {
+    struct EqBand {
+        int type = DSP_FILTER_PEAKING;
+        float frequency = 1000;
+        float gainDb = 0;
+        float q = 0.707f;
+    };
+
+    float gainDb = 0;
+    float replayGainDb = 0;
+    // Linear peak the ReplayGain gain applies to, or 0 to not limit the gain.
+    float replayGainPeak = 0;
+    int eqBandCount = 0;
+    EqBand eqBands[DSP_MAX_EQ_BANDS];
+};
+
+/**
+ * Parameters shared by an FfmpegAudioEffects and the decoders that apply them. They are set
+ * as a whole from any thread and picked up by each decoder at its next output buffer.
+ */
+class AudioEffects {
+public:
+    /**
+     * Replaces the parameters. Calls must not overlap, FfmpegAudioEffects serialises them.
+     */
+    void setParameters(const DspParameters &parameters);
+
+    /**
+     * Returns the parameters if they were set since generation, which is updated, or nullptr.
+     * Costs an atomic load when nothing changed.
+     */
+    std::shared_ptr<const DspParameters> obtainIfChanged(uint32_t *generation) const;
+
+private:
+    // Guards the swap of parameters, which decoders only read after generation moved.
+    mutable std::mutex mutex;
+    std::shared_ptr<const DspParameters> parameters;
+    std::atomic<uint32_t> generation{0};
+};
+
+/**
+ * Post-processing state of one decoder: the filter memory and the current gain. Applies the
+ * parameters of an AudioEffects in place on interleaved output, right after the frame has
+ * been converted and while it is still in cache, and does nothing while they are neutral.
+ *
+ * The filters are recursive and run per channel; the gain, which is ramped over a few
+ * milliseconds on changes so that they do not click, and the integer conversions are
+ * vectorized.
+ */
+class DspChain {
+public:
+    /**
+     * Processes frameCount frames of FLT, S16 or S32 samples.
+     */
+    void process(const AudioEffects &effects, float *samples, int frameCount, int channelCount,
+                 int sampleRate);
+
+    void process(const AudioEffects &effects, int16_t *samples, int frameCount, int channelCount,
+                 int sampleRate);
+
+    void process(const AudioEffects &effects, int32_t *samples, int frameCount, int channelCount,
+                 int sampleRate);
+
+    /**
+     * Clears the filter memory, e.g. after a seek.
+     */
+    void reset();
+
+private:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+    };
+
+    /**
+     * Takes new parameters and recomputes the coefficients if they or the format changed.
+     * Returns whether the samples need processing.
+     */
+    bool update(const AudioEffects &effects, int channelCount, int sampleRate);
+
+    /**
+     * Processes integer samples in float chunks, converting them with toFloat and back with
+     * fromFloat.
+     */
+    template<typename T>
+    void processChunks(T *samples, int frameCount, void (*toFloat)(const T *, float *, int),
+                       void (*fromFloat)(const float *, T *, int));
+
+    void processFloat(float *samples, int frameCount);
+
+    void applyGain(float *samples, int frameCount);
+
+    uint32_t generation = 0;
+    std::shared_ptr<const DspParameters> parameters;
+    int channelCount = 0;
+    int sampleRate = 0;
+    std::vector<Biquad> filters;
+    // Two state variables per filter and channel.
+    std::vector<float> filterState;
+    float gain = 1;
+    float targetGain = 1;
+    float gainStep = 0;
+    int rampFrames = 0;
+};
+
+#endif //NEXTPLAYER_FFDSP_H
@@ -0,0 +1,549 @@
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include "ffaudiocore.h"
+#include "ffexport.h"
+#include "ffthreadpool.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/avstring.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace {
+    // Shorter segments are not worth a seek.
+    const int64_t kMinSegmentUs = 10 * (int64_t) AV_TIME_BASE;
+    // Decoded before each segment and discarded, so that decoders that carry state between
+    // packets have settled when the segment starts. Doubled after a seek that lands too late.
+    const int64_t kSegmentPrerollUs = AV_TIME_BASE / 2;
+    // Seeks before the start of a segment, after which it is decoded from the start of the
+    // input instead.
+    const int kMaxSeekAttempts = 3;
+    // Segments that may be decoding or waiting to be written per thread, and the PCM they may
+    // hold together, which bounds the duration of a segment.
+    const int kSegmentsPerThread = 2;
+    const int64_t kMaxBufferedBytes = 64 * 1024 * 1024;
+    const int kInitialOutputSize = 64 * 1024;
+    // Demuxers of raw elementary streams, which estimate the timestamps after a seek from the
+    // byte position, so that two segments would not agree on the packet they join at.
+    const char *const kRawFormats = "aac,ac3,dts,dtshd,eac3,loas,mlp,mp3,truehd";
+
+    // Size written to the RIFF header while it is unknown.
+    const uint32_t kUnknownSize = 0xFFFFFFFF;
+    const int kWavHeaderSize = 44;
+    const int kWavExtensibleHeaderSize = 68;
+    const uint16_t kWaveFormatPcm = 1;
+    const uint16_t kWaveFormatIeeeFloat = 3;
+    const uint16_t kWaveFormatExtensible = 0xFFFE;
+    // The KSDATAFORMAT_SUBTYPE GUIDs after the format tag they start with.
+    const uint8_t kSubFormatGuidTail[12] = {0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                            0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+    int getBytesPerSample(int encoding) {
+        switch (encoding) {
+            case OUTPUT_ENCODING_PCM_16BIT:
+                return 2;
+            case OUTPUT_ENCODING_PCM_24BIT:
+                return 3;
+            case OUTPUT_ENCODING_PCM_FLOAT:
+            case OUTPUT_ENCODING_PCM_32BIT:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    uint8_t *putLe16(uint8_t *data, uint32_t value) {
+        data[0] = (uint8_t) value;
+        data[1] = (uint8_t) (value >> 8);
+        return data + 2;
+    }
+
+    uint8_t *putLe32(uint8_t *data, uint32_t value) {
+        return putLe16(putLe16(data, value & 0xFFFF), value >> 16);
+    }
+
+    uint8_t *putTag(uint8_t *data, const char *tag) {
+        memcpy(data, tag, 4);
+        return data + 4;
+    }
+
+    struct Input {
+        int streamIndex = 0;
+        AVRational timeBase{};
+        int64_t startTime = 0;
+        int64_t durationUs = 0;
+        int channelCount = 0;
+        int sampleRate = 0;
+        int outputEncoding = 0;
+        int frameSize = 0;
+    };
+
+    /**
+     * An input with a decoder of its own, reused by the segments that a thread decodes in
+     * turn.
+     */
+    struct Decoder {
+        ~Decoder() {
+            avformat_close_input(&formatContext);
+        }
+
+        AVFormatContext *formatContext = nullptr;
+        const AVStream *stream = nullptr;
+        std::unique_ptr<AudioContext> audioContext;
+        std::vector<uint8_t> output;
+        // Whether packets have been read since the input was opened.
+        bool used = false;
+    };
+
+    /**
+     * The packets with timestamps from start until end, in the time base of the stream, and
+     * the PCM decoded from them.
+     */
+    struct Segment {
+        int64_t start = INT64_MIN;
+        int64_t end = INT64_MAX;
+        std::vector<uint8_t> data;
+        // Timestamps of the first packet kept and of the packet that ended the segment, or
+        // AV_NOPTS_VALUE. Consecutive segments join if these are the same packet.
+        int64_t firstTimestamp = AV_NOPTS_VALUE;
+        int64_t endTimestamp = AV_NOPTS_VALUE;
+        bool done = false;
+    };
+
+    /**
+     * Opens url with a decoder for its default audio stream, with the other streams discarded.
+     * Returns 0 or a negative AVERROR.
+     */
+    int openDecoder(const char *url, int channelCount, int outputEncoding, Decoder *decoder) {
+        int result = avformat_open_input(&decoder->formatContext, url, nullptr, nullptr);
+        if (result < 0) {
+            logError("avformat_open_input", result);
+            return result;
+        }
+        AVFormatContext *formatContext = decoder->formatContext;
+        result = avformat_find_stream_info(formatContext, nullptr);
+        if (result < 0) {
+            logError("avformat_find_stream_info", result);
+            return result;
+        }
+        int streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1,
+                                              nullptr, 0);
+        if (streamIndex < 0) {
+            logError("av_find_best_stream", streamIndex);
+            return streamIndex;
+        }
+        for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+            if ((int) i != streamIndex) {
+                formatContext->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        decoder->stream = formatContext->streams[streamIndex];
+        const AVCodecParameters *parameters = decoder->stream->codecpar;
+        const AVCodec *codec = avcodec_find_decoder(parameters->codec_id);
+        AVCodecContext *codecContext = codec ? createContext(
+                codec, parameters->extradata, parameters->extradata_size, outputEncoding,
+                parameters->sample_rate, parameters->ch_layout.nb_channels) : nullptr;
+        if (!codecContext) {
+            return AVERROR_DECODER_NOT_FOUND;
+        }
+        decoder->audioContext = std::make_unique<AudioContext>(codecContext);
+        AudioContext *audioContext = decoder->audioContext.get();
+        audioContext->packS24Output = outputEncoding == OUTPUT_ENCODING_PCM_24BIT;
+        // Set even without a downmix, so that a stream that adds channels midway keeps the
+        // channel count of the output, and likewise the sample rate.
+        int streamChannels = parameters->ch_layout.nb_channels;
+        audioContext->downmixChannelCount = channelCount > 0
+                                            ? std::min(channelCount, streamChannels)
+                                            : streamChannels;
+        audioContext->targetSampleRate = parameters->sample_rate;
+        decoder->output.resize(kInitialOutputSize);
+        return 0;
+    }
+
+    void seek(const Input &input, Decoder *decoder, int64_t timestamp) {
+        int result = avformat_seek_file(decoder->formatContext, input.streamIndex, INT64_MIN,
+                                        timestamp, timestamp, 0);
+        if (result < 0) {
+            // The joint check catches a segment that was decoded from the wrong place.
+            logError("avformat_seek_file", result);
+        }
+        flushContext(decoder->audioContext.get());
+    }
+
+    /**
+     * Decodes the packets of the segment, from a seek point before its start, into its data,
+     * or to writer if it is not null. Returns 0 or a negative AVERROR.
+     */
+    int decodeSegment(const Input &input, Decoder *decoder, Segment *segment,
+                      PcmWriter *writer) {
+        AudioContext *audioContext = decoder->audioContext.get();
+        AVPacket *packet = obtainPacket(audioContext);
+        if (!packet) {
+            return AVERROR(ENOMEM);
+        }
+        std::vector<uint8_t> &output = decoder->output;
+        GrowOutputBuffer growBuffer = [&output](int requiredSize) {
+            output.resize(requiredSize);
+            return output.data();
+        };
+        bool firstSegment = segment->start == INT64_MIN;
+        int64_t prerollUs = kSegmentPrerollUs;
+        int seekAttempts = 0;
+        auto seekBeforeStart = [&]() {
+            seekAttempts++;
+            seek(input, decoder, seekAttempts <= kMaxSeekAttempts
+                                 ? segment->start - av_rescale_q(prerollUs, AV_TIME_BASE_Q,
+                                                                 input.timeBase)
+                                 : input.startTime);
+            prerollUs *= 2;
+        };
+        if (!firstSegment) {
+            seekBeforeStart();
+        } else if (decoder->used) {
+            seek(input, decoder, input.startTime);
+        }
+        decoder->used = true;
+        // Whether the packets are in the segment, and whether a timestamp was read since the
+        // last seek.
+        bool started = firstSegment;
+        bool timestampRead = false;
+        bool endOfInput = false;
+        while (!endOfInput) {
+            if (av_read_frame(decoder->formatContext, packet) < 0) {
+                // Drains the frames that the decoder and the resampler still hold.
+                endOfInput = true;
+            } else if (packet->stream_index != input.streamIndex) {
+                av_packet_unref(packet);
+                continue;
+            }
+            // Packets without a timestamp go with the packet before them. The packet is
+            // blank at the end of the input.
+            int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (timestamp != AV_NOPTS_VALUE) {
+                if (!started && !timestampRead && timestamp >= segment->start
+                    && seekAttempts <= kMaxSeekAttempts) {
+                    // The seek landed too late to settle the decoder, if not past packets of
+                    // the segment.
+                    av_packet_unref(packet);
+                    seekBeforeStart();
+                    continue;
+                }
+                timestampRead = true;
+                if (timestamp >= segment->end) {
+                    segment->endTimestamp = timestamp;
+                    av_packet_unref(packet);
+                    break;
+                }
+                if (!started && timestamp >= segment->start) {
+                    started = true;
+                    segment->firstTimestamp = timestamp;
+                }
+            }
+            int size = decodePacket(audioContext, endOfInput ? nullptr : packet, output.data(),
+                                    (int) output.size(), growBuffer);
+            av_packet_unref(packet);
+            if (size == AUDIO_DECODER_ERROR_INVALID_DATA || size == 0 || !started) {
+                continue;
+            }
+            if (size < 0) {
+                return AVERROR_EXTERNAL;
+            }
+            if (audioContext->outputChannelCount != input.channelCount) {
+                LOGE("Output channel count changed from %d to %d.", input.channelCount,
+                     audioContext->outputChannelCount);
+                return AVERROR_INVALIDDATA;
+            }
+            if (writer) {
+                int result = writer->write(output.data(), size);
+                if (result < 0) {
+                    return result;
+                }
+            } else {
+                segment->data.insert(segment->data.end(), output.data(), output.data() + size);
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Decodes the input in segmentCount segments on up to parallelism threads, writing each
+     * segment once the ones before it have been written. Returns 0 or a negative AVERROR.
+     */
+    int decodeInParallel(const char *url, const Input &input, std::unique_ptr<Decoder> decoder,
+                         int segmentCount, int parallelism, PcmWriter *writer) {
+        std::vector<Segment> segments(segmentCount);
+        for (int i = 1; i < segmentCount; i++) {
+            int64_t timestamp = input.startTime + av_rescale_q(
+                    input.durationUs * i / segmentCount, AV_TIME_BASE_Q, input.timeBase);
+            segments[i - 1].end = timestamp;
+            segments[i].start = timestamp;
+        }
+        int64_t segmentSize = av_rescale(input.durationUs / segmentCount,
+                                         (int64_t) input.frameSize * input.sampleRate,
+                                         AV_TIME_BASE);
+
+        std::mutex mutex;
+        std::condition_variable windowMoved;
+        std::vector<std::unique_ptr<Decoder>> decoders;
+        decoders.push_back(std::move(decoder));
+        int nextToWrite = 0;
+        bool writing = false;
+        int error = 0;
+        SliceThreadPool pool(std::min(parallelism, segmentCount) - 1);
+        int window = pool.concurrency() * kSegmentsPerThread;
+        // Slices are taken in order, so the segment next to write is never the one waiting.
+        pool.run(segmentCount, [&](int i) {
+            Segment &segment = segments[i];
+            std::unique_ptr<Decoder> segmentDecoder;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                windowMoved.wait(lock, [&] { return error < 0 || i < nextToWrite + window; });
+                if (error < 0) {
+                    return;
+                }
+                if (!decoders.empty()) {
+                    segmentDecoder = std::move(decoders.back());
+                    decoders.pop_back();
+                }
+            }
+            int result = 0;
+            if (!segmentDecoder) {
+                segmentDecoder = std::make_unique<Decoder>();
+                result = openDecoder(url, input.channelCount, input.outputEncoding,
+                                     segmentDecoder.get());
+            }
+            if (result >= 0) {
+                // With some room, as the duration of the segments is an estimate.
+                segment.data.reserve((size_t) (segmentSize + segmentSize / 16));
+                result = decodeSegment(input, segmentDecoder.get(), &segment, nullptr);
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            segment.done = true;
+            if (result < 0) {
+                error = error < 0 ? error : result;
+                windowMoved.notify_all();
+                return;
+            }
+            decoders.push_back(std::move(segmentDecoder));
+            if (writing) {
+                // The writing thread takes the segment when it gets to it.
+                return;
+            }
+            writing = true;
+            while (error == 0 && nextToWrite < segmentCount && segments[nextToWrite].done) {
+                Segment &next = segments[nextToWrite];
+                const Segment *previous = nextToWrite > 0 ? &segments[nextToWrite - 1] : nullptr;
+                lock.unlock();
+                if (previous && previous->endTimestamp != next.firstTimestamp) {
+                    LOGE("Export segments do not join: %" PRId64 " and %" PRId64 ".",
+                         previous->endTimestamp, next.firstTimestamp);
+                    result = AVERROR_INVALIDDATA;
+                } else {
+                    result = writer->write(next.data.data(), next.data.size());
+                }
+                std::vector<uint8_t>().swap(next.data);
+                lock.lock();
+                error = error < 0 ? error : result;
+                nextToWrite++;
+                windowMoved.notify_all();
+            }
+            writing = false;
+        });
+        return error;
+    }
+}
+
+int PcmWriter::begin(int channelCount, int sampleRate, int encoding, uint64_t channelMask) {
+    int sampleSize = getBytesPerSample(encoding);
+    if (sampleSize == 0 || channelCount <= 0 || sampleRate <= 0) {
+        return AVERROR(EINVAL);
+    }
+    if (container == EXPORT_CONTAINER_RAW) {
+        return 0;
+    }
+    // WAVE_FORMAT_EXTENSIBLE is required for more than two channels or 16 bits.
+    int bits = sampleSize * 8;
+    bool extensible = channelCount > 2 || bits > 16;
+    uint16_t formatTag = encoding == OUTPUT_ENCODING_PCM_FLOAT ? kWaveFormatIeeeFloat
+                                                               : kWaveFormatPcm;
+    headerSize = extensible ? kWavExtensibleHeaderSize : kWavHeaderSize;
+    uint8_t header[kWavExtensibleHeaderSize];
+    uint8_t *data = putTag(header, "RIFF");
+    data = putLe32(data, kUnknownSize);
+    data = putTag(data, "WAVE");
+    data = putTag(data, "fmt ");
+    // The format chunk is what the RIFF, format and data chunk headers leave.
+    data = putLe32(data, headerSize - 28);
+    data = putLe16(data, extensible ? kWaveFormatExtensible : formatTag);
+    data = putLe16(data, channelCount);
+    data = putLe32(data, sampleRate);
+    data = putLe32(data, sampleRate * channelCount * sampleSize);
+    data = putLe16(data, channelCount * sampleSize);
+    data = putLe16(data, bits);
+    if (extensible) {
+        data = putLe16(data, 22);
+        data = putLe16(data, bits);
+        data = putLe32(data, (uint32_t) channelMask);
+        data = putLe32(data, formatTag);
+        memcpy(data, kSubFormatGuidTail, sizeof(kSubFormatGuidTail));
+        data += sizeof(kSubFormatGuidTail);
+    }
+    data = putTag(data, "data");
+    putLe32(data, kUnknownSize);
+    headerOffset = lseek(fd, 0, SEEK_CUR);
+    return writeFully(header, headerSize);
+}
+
+int PcmWriter::write(const uint8_t *data, size_t size) {
+    int result = writeFully(data, size);
+    if (result == 0) {
+        dataSize += (int64_t) size;
+    }
+    return result;
+}
+
+int PcmWriter::finish() {
+    if (container == EXPORT_CONTAINER_RAW) {
+        return 0;
+    }
+    int padding = (int) (dataSize % 2);
+    if (padding) {
+        // Chunks are padded to an even size.
+        const uint8_t zero = 0;
+        int result = writeFully(&zero, 1);
+        if (result < 0) {
+            return result;
+        }
+    }
+    int64_t riffSize = headerSize - 8 + dataSize + padding;
+    if (headerOffset < 0 || riffSize >= kUnknownSize) {
+        return 0;
+    }
+    uint8_t size[4];
+    putLe32(size, (uint32_t) riffSize);
+    if (pwrite(fd, size, sizeof(size), headerOffset + 4) != sizeof(size)) {
+        int result = AVERROR(errno);
+        logError("pwrite", result);
+        return result;
+    }
+    putLe32(size, (uint32_t) dataSize);
+    if (pwrite(fd, size, sizeof(size), headerOffset + headerSize - 4) != sizeof(size)) {
+        int result = AVERROR(errno);
+        logError("pwrite", result);
+        return result;
+    }
+    return 0;
+}
+
+int PcmWriter::writeFully(const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int result = AVERROR(errno);
+            logError("write", result);
+            return result;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return 0;
+}
+
+int exportPcm(const char *url, int fd, int container, int outputEncoding, int channelCount,
+              int parallelism, ExportInfo *info) {
+    int sampleSize = getBytesPerSample(outputEncoding);
+    if ((container != EXPORT_CONTAINER_RAW && container != EXPORT_CONTAINER_WAV)
+        || sampleSize == 0 || channelCount < 0) {
+        return AVERROR(EINVAL);
+    }
+    auto decoder = std::make_unique<Decoder>();
+    int result = openDecoder(url, channelCount, outputEncoding, decoder.get());
+    if (result < 0) {
+        return result;
+    }
+    const AVFormatContext *formatContext = decoder->formatContext;
+    const AVStream *stream = decoder->stream;
+    const AVCodecParameters *parameters = stream->codecpar;
+    Input input;
+    input.streamIndex = stream->index;
+    input.timeBase = stream->time_base;
+    input.startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    if (stream->duration != AV_NOPTS_VALUE) {
+        input.durationUs = av_rescale_q(stream->duration, stream->time_base, AV_TIME_BASE_Q);
+    } else if (formatContext->duration != AV_NOPTS_VALUE) {
+        input.durationUs = formatContext->duration;
+    }
+    input.channelCount = decoder->audioContext->downmixChannelCount;
+    input.sampleRate = parameters->sample_rate;
+    input.outputEncoding = outputEncoding;
+    input.frameSize = input.channelCount * sampleSize;
+    if (input.channelCount <= 0 || input.sampleRate <= 0) {
+        LOGE("Cannot export audio without channel count and sample rate.");
+        return AVERROR_INVALIDDATA;
+    }
+    // Mixed down channels are in the default order.
+    uint64_t channelMask = 0;
+    if (parameters->ch_layout.nb_channels == input.channelCount
+        && parameters->ch_layout.order == AV_CHANNEL_ORDER_NATIVE) {
+        channelMask = parameters->ch_layout.u.mask;
+    } else {
+        AVChannelLayout layout{};
+        av_channel_layout_default(&layout, input.channelCount);
+        channelMask = layout.order == AV_CHANNEL_ORDER_NATIVE ? layout.u.mask : 0;
+    }
+
+    if (parallelism <= 0) {
+        parallelism = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    bool splittable = formatContext->pb && (formatContext->pb->seekable & AVIO_SEEKABLE_NORMAL)
+                      && !(formatContext->iformat->flags & AVFMT_NOTIMESTAMPS)
+                      && !av_match_name(formatContext->iformat->name, kRawFormats)
+                      && input.durationUs > 0;
+    int segmentCount = 1;
+    if (parallelism > 1 && splittable) {
+        int64_t bytesPerSecond = (int64_t) input.frameSize * input.sampleRate;
+        int64_t maxSegmentUs = std::max(kMinSegmentUs, av_rescale(
+                kMaxBufferedBytes / (parallelism * kSegmentsPerThread), AV_TIME_BASE,
+                bytesPerSecond));
+        int64_t segmentUs = std::clamp(input.durationUs / parallelism, kMinSegmentUs,
+                                       maxSegmentUs);
+        segmentCount = (int) std::max<int64_t>(input.durationUs / segmentUs, 1);
+    }
+
+    PcmWriter writer(fd, container);
+    result = writer.begin(input.channelCount, input.sampleRate, outputEncoding, channelMask);
+    if (result < 0) {
+        return result;
+    }
+    if (segmentCount == 1) {
+        Segment segment;
+        result = decodeSegment(input, decoder.get(), &segment, &writer);
+    } else {
+        result = decodeInParallel(url, input, std::move(decoder), segmentCount, parallelism,
+                                  &writer);
+    }
+    if (result >= 0) {
+        result = writer.finish();
+    }
+    if (result < 0) {
+        return result;
+    }
+    info->channelCount = input.channelCount;
+    info->sampleRate = input.sampleRate;
+    info->frameCount = writer.getDataSize() / input.frameSize;
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef NEXTPLAYER_FFEXPORT_H
+#define NEXTPLAYER_FFEXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Containers of the PCM written by PcmWriter and exportPcm(). Must match FfmpegPcmExport.
+static const int EXPORT_CONTAINER_RAW = 0;
+static const int EXPORT_CONTAINER_WAV = 1;
+
+/**
+ * Streams interleaved PCM to a file descriptor, raw or as a WAV file.
+ *
+ * The WAV header is written first with unknown sizes, which readers take as "until the end
+ * of the file", and patched by finish() if the descriptor can seek. Data larger than the
+ * 4 GiB a WAV file can describe keeps the unknown sizes.
+ */
+class PcmWriter {
+public:
+    PcmWriter(int fd, int container) : fd(fd), container(container) {}
+
+    /**
+     * Writes the header for samples in one of the OUTPUT_ENCODING constants of ffaudiocore.h,
+     * with the channel positions of channelMask, an AV_CH mask, or 0 if not known. Returns 0
+     * or a negative AVERROR.
+     */
+    int begin(int channelCount, int sampleRate, int encoding, uint64_t channelMask);
+
+    /**
+     * Writes size bytes of whole frames. Returns 0 or a negative AVERROR.
+     */
+    int write(const uint8_t *data, size_t size);
+
+    /**
+     * Patches the sizes in the header. Returns 0 or a negative AVERROR.
+     */
+    int finish();
+
+    int64_t getDataSize() const { return dataSize; }
+
+private:
+    int writeFully(const uint8_t *data, size_t size);
+
+    int fd;
+    int container;
+    // Offset of the header in the file, or -1 if the descriptor cannot seek.
+    int64_t headerOffset = -1;
+    int headerSize = 0;
+    int64_t dataSize = 0;
+};
+
+/**
+ * Format and length of the PCM written by exportPcm().
+ */
+struct ExportInfo {
+    int channelCount = 0;
+    int sampleRate = 0;
+    int64_t frameCount = 0;
+};
+
+/**
+ * Decodes the default audio stream of url, which may be any input libavformat opens including
+ * video files, to PCM in outputEncoding, one of the OUTPUT_ENCODING constants of
+ * ffaudiocore.h, written to fd in container, one of the EXPORT_CONTAINER constants. Audio with
+ * more than channelCount channels is mixed down first, 0 keeps the channels of the stream. The
+ * sample rate is the one of the stream.
+ *
+ * Seekable inputs are split into segments of equal duration that are decoded by up to
+ * parallelism threads, 0 for one per CPU, each from a seek point before its start. A segment
+ * keeps the output of the packets whose timestamps fall in it, so consecutive segments join at
+ * the same packet without gaps or overlap whatever the resolution of the timestamps, and is
+ * written as soon as the ones before it are. Raw elementary streams, whose timestamps after a
+ * seek are estimates, are decoded in one pass. Returns 0 and fills info, or a negative
+ * AVERROR.
+ */
+int exportPcm(const char *url, int fd, int container, int outputEncoding, int channelCount,
+              int parallelism, ExportInfo *info);
+
+#endif //NEXTPLAYER_FFEXPORT_H
@@ -0,0 +1,493 @@
+#include <jni.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "ffcommon.h"
+#include "ffdiag.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/display.h>
+#include <libavutil/intreadwrite.h>
+}
+
+// Must match FfmpegExtractor.
+static const int EXTRACTOR_RESULT_END_OF_INPUT = -1;
+static const int EXTRACTOR_RESULT_ERROR = -2;
+static const int STREAM_PARAM_COUNT = 11;
+static const int PACKET_INFO_COUNT = 5;
+
+namespace {
+    const int kIoBufferSize = 64 * 1024;
+    const int kAnnexBStartCodeSize = 4;
+    const int kAdtsHeaderSize = 7;
+    const int kAacSampleRates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+                                   16000, 12000, 11025, 8000, 7350};
+
+    /**
+     * Reads a file through pread, so that the demuxer never shares a file position with the
+     * application and seeking is free.
+     */
+    struct ExtractorContext {
+        int fd = -1;
+        int64_t position = 0;
+        int64_t size = 0;
+        AVFormatContext *formatContext = nullptr;
+        AVPacket *packet = nullptr;
+        // Per stream. Length field size of length prefixed H.264/HEVC packets, which are
+        // rewritten to Annex-B, or 0.
+        std::vector<int> nalLengthSizes;
+        // Per stream. Whether AAC packets carry ADTS headers, which are stripped.
+        std::vector<bool> hasAdtsHeaders;
+        // Per stream. Last timestamp, used for packets without one.
+        std::vector<int64_t> lastTimesUs;
+        int64_t startTimeUs = 0;
+    };
+
+    int ReadFile(void *opaque, uint8_t *buffer, int size) {
+        auto *context = static_cast<ExtractorContext *>(opaque);
+        ssize_t result;
+        do {
+            result = pread(context->fd, buffer, size, context->position);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            return AVERROR(errno);
+        }
+        if (result == 0) {
+            return AVERROR_EOF;
+        }
+        context->position += result;
+        return static_cast<int>(result);
+    }
+
+    int64_t SeekFile(void *opaque, int64_t offset, int whence) {
+        auto *context = static_cast<ExtractorContext *>(opaque);
+        int64_t position;
+        switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE:
+                return context->size;
+            case SEEK_SET:
+                position = offset;
+                break;
+            case SEEK_CUR:
+                position = context->position + offset;
+                break;
+            case SEEK_END:
+                position = context->size + offset;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+        if (position < 0) {
+            return AVERROR(EINVAL);
+        }
+        context->position = position;
+        return position;
+    }
+
+    void FreeContext(ExtractorContext *context) {
+        if (context->formatContext) {
+            AVIOContext *ioContext = context->formatContext->pb;
+            avformat_close_input(&context->formatContext);
+            if (ioContext) {
+                av_freep(&ioContext->buffer);
+                avio_context_free(&ioContext);
+            }
+        }
+        av_packet_free(&context->packet);
+        if (context->fd >= 0) {
+            close(context->fd);
+        }
+        delete context;
+    }
+
+    /**
+     * Returns the NAL unit length field size of an avcC or hvcC record, or 0 if extradata is
+     * not one and packets are already Annex-B.
+     */
+    int GetNalLengthSize(const AVCodecParameters *codecpar) {
+        const uint8_t *extradata = codecpar->extradata;
+        if (!extradata || extradata[0] != 1) {
+            return 0;
+        }
+        if (codecpar->codec_id == AV_CODEC_ID_H264 && codecpar->extradata_size >= 7) {
+            return (extradata[4] & 3) + 1;
+        }
+        if (codecpar->codec_id == AV_CODEC_ID_HEVC && codecpar->extradata_size >= 23) {
+            return (extradata[21] & 3) + 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Replaces the length fields of a length prefixed packet with Annex-B start codes, in place
+     * when they are four bytes long.
+     */
+    bool ConvertToAnnexB(AVPacket *packet, int nalLengthSize) {
+        if (nalLengthSize == kAnnexBStartCodeSize) {
+            if (av_packet_make_writable(packet) < 0) {
+                return false;
+            }
+            for (int offset = 0; offset + kAnnexBStartCodeSize <= packet->size;) {
+                uint32_t nalSize = AV_RB32(packet->data + offset);
+                if (nalSize > static_cast<uint32_t>(packet->size - offset - kAnnexBStartCodeSize)) {
+                    return false;
+                }
+                AV_WB32(packet->data + offset, 1);
+                offset += kAnnexBStartCodeSize + static_cast<int>(nalSize);
+            }
+            return true;
+        }
+        // Shorter length fields need the packet to grow.
+        int outputSize = 0;
+        for (int offset = 0; offset + nalLengthSize <= packet->size;) {
+            uint32_t nalSize = 0;
+            for (int i = 0; i < nalLengthSize; i++) {
+                nalSize = (nalSize << 8) | packet->data[offset + i];
+            }
+            offset += nalLengthSize;
+            if (nalSize > static_cast<uint32_t>(packet->size - offset)) {
+                return false;
+            }
+            offset += static_cast<int>(nalSize);
+            outputSize += kAnnexBStartCodeSize + static_cast<int>(nalSize);
+        }
+        AVBufferRef *buffer = av_buffer_alloc(outputSize + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!buffer) {
+            return false;
+        }
+        uint8_t *output = buffer->data;
+        for (int offset = 0; offset + nalLengthSize <= packet->size;) {
+            uint32_t nalSize = 0;
+            for (int i = 0; i < nalLengthSize; i++) {
+                nalSize = (nalSize << 8) | packet->data[offset + i];
+            }
+            offset += nalLengthSize;
+            AV_WB32(output, 1);
+            memcpy(output + kAnnexBStartCodeSize, packet->data + offset, nalSize);
+            output += kAnnexBStartCodeSize + nalSize;
+            offset += static_cast<int>(nalSize);
+        }
+        memset(buffer->data + outputSize, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        av_buffer_unref(&packet->buf);
+        packet->buf = buffer;
+        packet->data = buffer->data;
+        packet->size = outputSize;
+        return true;
+    }
+
+    void StripAdtsHeader(AVPacket *packet) {
+        const uint8_t *data = packet->data;
+        if (packet->size < kAdtsHeaderSize || data[0] != 0xFF || (data[1] & 0xF6) != 0xF0) {
+            return;
+        }
+        // Two more bytes of CRC unless protection_absent is set.
+        int headerSize = (data[1] & 1) ? kAdtsHeaderSize : kAdtsHeaderSize + 2;
+        if (packet->size > headerSize) {
+            packet->data += headerSize;
+            packet->size -= headerSize;
+        }
+    }
+
+    /**
+     * Returns the clockwise rotation of the stream in degrees, one of 0, 90, 180 and 270.
+     */
+    int GetRotationDegrees(const AVCodecParameters *codecpar) {
+        const AVPacketSideData *sideData = av_packet_side_data_get(
+                codecpar->coded_side_data, codecpar->nb_coded_side_data, AV_PKT_DATA_DISPLAYMATRIX);
+        if (!sideData || sideData->size < 9 * sizeof(int32_t)) {
+            return 0;
+        }
+        double rotation = -av_display_rotation_get(reinterpret_cast<const int32_t *>(sideData->data));
+        if (std::isnan(rotation)) {
+            return 0;
+        }
+        int degrees = static_cast<int>(std::lround(rotation / 90) * 90) % 360;
+        return degrees < 0 ? degrees + 360 : degrees;
+    }
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegProbe(JNIEnv *env,
+                                                                   jclass clazz,
+                                                                   jbyteArray data,
+                                                                   jint length) {
+    std::vector<uint8_t> buffer(length + AVPROBE_PADDING_SIZE, 0);
+    env->GetByteArrayRegion(data, 0, length, reinterpret_cast<jbyte *>(buffer.data()));
+    AVProbeData probeData{};
+    probeData.filename = "";
+    probeData.buf = buffer.data();
+    probeData.buf_size = length;
+    const AVInputFormat *format = av_probe_input_format(&probeData, 1);
+    return format ? env->NewStringUTF(format->name) : nullptr;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegOpen(JNIEnv *env,
+                                                                  jobject thiz,
+                                                                  jint fd) {
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) || !S_ISREG(fileStat.st_mode)) {
+        LOGE("Extractor input is not a regular file.");
+        return 0L;
+    }
+    auto *context = new ExtractorContext();
+    context->fd = dup(fd);
+    context->size = fileStat.st_size;
+    context->packet = av_packet_alloc();
+    if (context->fd < 0 || !context->packet) {
+        LOGE("Failed to set up extractor.");
+        FreeContext(context);
+        return 0L;
+    }
+
+    auto *ioBuffer = static_cast<uint8_t *>(av_malloc(kIoBufferSize));
+    AVIOContext *ioContext = ioBuffer ? avio_alloc_context(ioBuffer, kIoBufferSize, 0, context,
+                                                           ReadFile, nullptr, SeekFile)
+                                      : nullptr;
+    AVFormatContext *formatContext = ioContext ? avformat_alloc_context() : nullptr;
+    if (!formatContext) {
+        LOGE("Failed to allocate demuxer.");
+        if (ioContext) {
+            av_freep(&ioContext->buffer);
+            avio_context_free(&ioContext);
+        } else {
+            av_free(ioBuffer);
+        }
+        FreeContext(context);
+        return 0L;
+    }
+    formatContext->pb = ioContext;
+    formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    int result = avformat_open_input(&formatContext, nullptr, nullptr, nullptr);
+    if (result < 0) {
+        // The custom IO context is left to the caller.
+        logError("avformat_open_input", result);
+        av_freep(&ioContext->buffer);
+        avio_context_free(&ioContext);
+        FreeContext(context);
+        return 0L;
+    }
+    context->formatContext = formatContext;
+    result = avformat_find_stream_info(formatContext, nullptr);
+    if (result < 0) {
+        logError("avformat_find_stream_info", result);
+        FreeContext(context);
+        return 0L;
+    }
+
+    context->startTimeUs = formatContext->start_time != AV_NOPTS_VALUE ? formatContext->start_time : 0;
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+        const AVCodecParameters *codecpar = formatContext->streams[i]->codecpar;
+        context->nalLengthSizes.push_back(GetNalLengthSize(codecpar));
+        context->hasAdtsHeaders.push_back(codecpar->codec_id == AV_CODEC_ID_AAC &&
+                                          codecpar->extradata_size == 0);
+        context->lastTimesUs.push_back(0);
+    }
+    return reinterpret_cast<jlong>(context);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegClose(JNIEnv *env,
+                                                                   jobject thiz,
+                                                                   jlong jContext) {
+    if (jContext) {
+        FreeContext(reinterpret_cast<ExtractorContext *>(jContext));
+    }
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetStreamCount(
+        JNIEnv *env, jobject thiz, jlong jContext) {
+    return static_cast<jint>(reinterpret_cast<ExtractorContext *>(jContext)->formatContext->nb_streams);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetDurationUs(
+        JNIEnv *env, jobject thiz, jlong jContext) {
+    AVFormatContext *formatContext = reinterpret_cast<ExtractorContext *>(jContext)->formatContext;
+    return formatContext->duration != AV_NOPTS_VALUE ? formatContext->duration : -1;
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetStreamCodecName(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index) {
+    AVStream *stream = reinterpret_cast<ExtractorContext *>(jContext)->formatContext->streams[index];
+    return env->NewStringUTF(avcodec_get_name(stream->codecpar->codec_id));
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetStreamLanguage(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index) {
+    AVStream *stream = reinterpret_cast<ExtractorContext *>(jContext)->formatContext->streams[index];
+    AVDictionaryEntry *language = av_dict_get(stream->metadata, "language", nullptr, 0);
+    return language ? env->NewStringUTF(language->value) : nullptr;
+}
+
+/**
+ * Fills params with STREAM_PARAM_COUNT values: media type, width, height, rotation, sample
+ * rate, channel count, frame rate numerator and denominator, bit rate and pixel aspect ratio
+ * numerator and denominator.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetStreamParams(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index, jintArray params) {
+    AVStream *stream = reinterpret_cast<ExtractorContext *>(jContext)->formatContext->streams[index];
+    const AVCodecParameters *codecpar = stream->codecpar;
+    AVRational frameRate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate
+                                                          : stream->r_frame_rate;
+    AVRational aspectRatio = stream->sample_aspect_ratio.num > 0 ? stream->sample_aspect_ratio
+                                                                 : codecpar->sample_aspect_ratio;
+    jint values[STREAM_PARAM_COUNT] = {
+            codecpar->codec_type,
+            codecpar->width,
+            codecpar->height,
+            GetRotationDegrees(codecpar),
+            codecpar->sample_rate,
+            codecpar->ch_layout.nb_channels,
+            frameRate.num,
+            frameRate.den,
+            static_cast<jint>(FFMIN(codecpar->bit_rate, INT32_MAX)),
+            aspectRatio.num,
+            aspectRatio.den,
+    };
+    env->SetIntArrayRegion(params, 0, STREAM_PARAM_COUNT, values);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegGetStreamExtraData(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index) {
+    auto *context = reinterpret_cast<ExtractorContext *>(jContext);
+    const AVCodecParameters *codecpar = context->formatContext->streams[index]->codecpar;
+    if (context->hasAdtsHeaders[index]) {
+        // The headers are stripped from the packets, so describe the stream with an
+        // AudioSpecificConfig instead. ADTS only carries the core object types; SBR and PS,
+        // which FFmpeg reports as the HE profiles with the output sample rate and channel
+        // count, are left to the implicit signalling in the payload.
+        bool sbr = codecpar->profile == AV_PROFILE_AAC_HE
+                   || codecpar->profile == AV_PROFILE_AAC_HE_V2;
+        int coreSampleRate = sbr ? codecpar->sample_rate / 2 : codecpar->sample_rate;
+        int sampleRateIndex = 4;
+        for (int i = 0; i < static_cast<int>(sizeof(kAacSampleRates) / sizeof(int)); i++) {
+            if (kAacSampleRates[i] == coreSampleRate) {
+                sampleRateIndex = i;
+                break;
+            }
+        }
+        int objectType = codecpar->profile >= AV_PROFILE_AAC_MAIN
+                         && codecpar->profile <= AV_PROFILE_AAC_LTP ? codecpar->profile + 1 : 2;
+        int channelCount = codecpar->profile == AV_PROFILE_AAC_HE_V2
+                           ? 1 : codecpar->ch_layout.nb_channels;
+        int channelConfig = channelCount == 8 ? 7 : channelCount;
+        jbyte config[2] = {
+                static_cast<jbyte>((objectType << 3) | (sampleRateIndex >> 1)),
+                static_cast<jbyte>(((sampleRateIndex & 1) << 7) | (channelConfig << 3)),
+        };
+        jbyteArray result = env->NewByteArray(2);
+        env->SetByteArrayRegion(result, 0, 2, config);
+        return result;
+    }
+    if (!codecpar->extradata || codecpar->extradata_size <= 0) {
+        return nullptr;
+    }
+    jbyteArray result = env->NewByteArray(codecpar->extradata_size);
+    env->SetByteArrayRegion(result, 0, codecpar->extradata_size,
+                            reinterpret_cast<const jbyte *>(codecpar->extradata));
+    return result;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegSetStreamEnabled(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index, jboolean enabled) {
+    AVStream *stream = reinterpret_cast<ExtractorContext *>(jContext)->formatContext->streams[index];
+    stream->discard = enabled ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+}
+
+/**
+ * Reads the next packet and returns its stream index, or a negative EXTRACTOR_RESULT value.
+ * info receives the timestamp in microseconds, whether it is a key frame, the size, the input
+ * position after the packet and the duration in microseconds, or -1 if it is unknown.
+ */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegReadPacket(
+        JNIEnv *env, jobject thiz, jlong jContext, jlongArray info) {
+    auto *context = reinterpret_cast<ExtractorContext *>(jContext);
+    AVPacket *packet = context->packet;
+    // Demuxers without a header, such as MPEG-TS, can add streams after the open. Their
+    // packets have no track and are skipped.
+    do {
+        av_packet_unref(packet);
+        int result = av_read_frame(context->formatContext, packet);
+        if (result == AVERROR_EOF) {
+            return EXTRACTOR_RESULT_END_OF_INPUT;
+        }
+        if (result < 0) {
+            logError("av_read_frame", result);
+            return EXTRACTOR_RESULT_ERROR;
+        }
+    } while (packet->stream_index < 0
+             || packet->stream_index >= static_cast<int>(context->lastTimesUs.size()));
+
+    const int index = packet->stream_index;
+    AVStream *stream = context->formatContext->streams[index];
+    if (context->nalLengthSizes[index] && !ConvertToAnnexB(packet, context->nalLengthSizes[index])) {
+        DIAGE(DIAG_AV_ERROR, "ConvertToAnnexB", AVERROR_INVALIDDATA, packet->size);
+    }
+    if (context->hasAdtsHeaders[index]) {
+        StripAdtsHeader(packet);
+    }
+    int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (timestamp != AV_NOPTS_VALUE) {
+        context->lastTimesUs[index] =
+                av_rescale_q(timestamp, stream->time_base, AV_TIME_BASE_Q) - context->startTimeUs;
+    }
+    jlong values[PACKET_INFO_COUNT] = {
+            context->lastTimesUs[index],
+            (packet->flags & AV_PKT_FLAG_KEY) ? 1 : 0,
+            packet->size,
+            avio_tell(context->formatContext->pb),
+            packet->duration > 0 ? av_rescale_q(packet->duration, stream->time_base, AV_TIME_BASE_Q)
+                                 : -1,
+    };
+    env->SetLongArrayRegion(info, 0, PACKET_INFO_COUNT, values);
+    return index;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegCopyPacketData(
+        JNIEnv *env, jobject thiz, jlong jContext, jint packetOffset, jbyteArray target,
+        jint targetOffset, jint length) {
+    AVPacket *packet = reinterpret_cast<ExtractorContext *>(jContext)->packet;
+    env->SetByteArrayRegion(target, targetOffset, length,
+                            reinterpret_cast<const jbyte *>(packet->data + packetOffset));
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffextractor_FfmpegExtractor_ffmpegSeek(
+        JNIEnv *env, jobject thiz, jlong jContext, jlong timeUs) {
+    auto *context = reinterpret_cast<ExtractorContext *>(jContext);
+    av_packet_unref(context->packet);
+    int result = av_seek_frame(context->formatContext, -1, timeUs + context->startTimeUs,
+                               AVSEEK_FLAG_BACKWARD);
+    if (result < 0) {
+        logError("av_seek_frame", result);
+        return false;
+    }
+    return true;
+}
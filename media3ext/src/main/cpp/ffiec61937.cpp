@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cstring>
+#include "ffiec61937.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/macros.h>
+}
+
+namespace {
+    // Burst sizes, four bytes per sample of the frames they carry. E-AC-3 is sent at four
+    // times the AC-3 rate.
+    const int kAc3BurstSize = 1536 * 4;
+    const int kEac3BurstSize = kAc3BurstSize * 4;
+    const int kMatBurstSize = 61440;
+
+    const int kAc3SampleRates[] = {48000, 44100, 32000, 0};
+    const int kEac3ReducedSampleRates[] = {24000, 22050, 16000, 0};
+    const int kEac3Blocks[] = {1, 2, 3, 6};
+    const int kDtsSampleRates[] = {0, 8000, 16000, 32000, 0, 0, 11025, 22050, 44100, 0, 0,
+                                   12000, 24000, 48000, 0, 0};
+
+    // Prefix of the DTS-HD payload, followed by the size of the frame.
+    const uint8_t kDtsHdStartCode[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE,
+                                       0xFE};
+
+    const uint8_t kMatStartCode[] = {0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
+                                     0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0};
+    const uint8_t kMatMiddleCode[] = {0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80,
+                                      0x77, 0xE0};
+    const uint8_t kMatEndCode[] = {0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                   0x00, 0x00, 0x97, 0x11, 0x00, 0x00};
+
+    struct MatCode {
+        int offset;
+        const uint8_t *data;
+        int size;
+    };
+
+    const MatCode kMatCodes[] = {
+            {0, kMatStartCode, sizeof(kMatStartCode)},
+            {IEC61937_MAT_MIDDLE_CODE_OFFSET, kMatMiddleCode, sizeof(kMatMiddleCode)},
+            {IEC61937_MAT_FRAME_SIZE - (int) sizeof(kMatEndCode), kMatEndCode,
+             sizeof(kMatEndCode)},
+    };
+    const int kMatCodeCount = sizeof(kMatCodes) / sizeof(kMatCodes[0]);
+}
+
+bool Iec61937Packer::configure(AVCodecID codecId, int dtsHdRate) {
+    if ((codecId != AV_CODEC_ID_AC3 && codecId != AV_CODEC_ID_EAC3
+         && codecId != AV_CODEC_ID_DTS && codecId != AV_CODEC_ID_TRUEHD) || dtsHdRate < 0) {
+        return false;
+    }
+    this->codecId = codecId;
+    this->dtsHdRate = dtsHdRate;
+    linkSampleRate = 0;
+    linkChannelCount = 0;
+    trueHdUnitSamples = 0;
+    // Keeps getOutput() non-null when nothing has been packed.
+    output.reserve(kMatBurstSize);
+    reset();
+    return true;
+}
+
+void Iec61937Packer::reset() {
+    output.clear();
+    pending.clear();
+    if (codecId == AV_CODEC_ID_TRUEHD) {
+        pending.resize(IEC61937_MAT_FRAME_SIZE);
+    }
+    pendingFilled = 0;
+    eac3BlockCount = 0;
+    trueHdUnitSamples = 0;
+    trueHdPreviousSize = 0;
+    trueHdPreviousTiming = 0;
+}
+
+int Iec61937Packer::pack(const uint8_t *data, int size) {
+    output.clear();
+    int result;
+    switch (codecId) {
+        case AV_CODEC_ID_AC3:
+            result = packAc3(data, size);
+            break;
+        case AV_CODEC_ID_EAC3:
+            result = packEac3(data, size);
+            break;
+        case AV_CODEC_ID_DTS:
+            result = packDts(data, size);
+            break;
+        case AV_CODEC_ID_TRUEHD:
+            result = packTrueHd(data, size);
+            break;
+        default:
+            result = AVERROR(EINVAL);
+            break;
+    }
+    return result < 0 ? result : (int) output.size();
+}
+
+int Iec61937Packer::packAc3(const uint8_t *data, int size) {
+    if (size < 6 || AV_RB16(data) != 0x0B77 || size > kAc3BurstSize - IEC61937_BURST_HEADER_SIZE) {
+        return AVERROR_INVALIDDATA;
+    }
+    int sampleRate = kAc3SampleRates[data[4] >> 6];
+    if (!sampleRate) {
+        return AVERROR_INVALIDDATA;
+    }
+    linkSampleRate = sampleRate;
+    linkChannelCount = 2;
+    int bitstreamMode = data[5] & 0x07;
+    writeBurst(IEC61937_AC3 | bitstreamMode << 8, FFALIGN(size, 2) * 8, data, size,
+               kAc3BurstSize);
+    return 0;
+}
+
+int Iec61937Packer::packEac3(const uint8_t *data, int size) {
+    // An input buffer holds an independent frame and the dependent frames that extend it, and
+    // they go into the same burst.
+    for (int offset = 0; offset < size;) {
+        const uint8_t *frame = data + offset;
+        int available = size - offset;
+        if (available < 6 || AV_RB16(frame) != 0x0B77) {
+            pending.clear();
+            eac3BlockCount = 0;
+            return AVERROR_INVALIDDATA;
+        }
+        int frameSize = available;
+        int blocks = 6;
+        bool independent = true;
+        int sampleRate;
+        int bitstreamId = frame[5] >> 3;
+        if (bitstreamId > 10) {
+            frameSize = std::min(available, (((frame[2] & 0x07) << 8 | frame[3]) + 1) * 2);
+            int streamType = frame[2] >> 6;
+            int substreamId = (frame[2] >> 3) & 0x07;
+            independent = streamType != 1 && substreamId == 0;
+            int sampleRateCode = frame[4] >> 6;
+            if (sampleRateCode == 3) {
+                sampleRate = kEac3ReducedSampleRates[(frame[4] >> 4) & 0x03];
+            } else {
+                sampleRate = kAc3SampleRates[sampleRateCode];
+                blocks = kEac3Blocks[(frame[4] >> 4) & 0x03];
+            }
+        } else {
+            // AC-3 frames in an E-AC-3 stream come one per buffer.
+            sampleRate = kAc3SampleRates[frame[4] >> 6];
+        }
+        if (!sampleRate || pending.size() + frameSize
+                           > (size_t) (kEac3BurstSize - IEC61937_BURST_HEADER_SIZE)) {
+            pending.clear();
+            eac3BlockCount = 0;
+            return AVERROR_INVALIDDATA;
+        }
+        if (independent) {
+            linkSampleRate = sampleRate * 4;
+            linkChannelCount = 2;
+            eac3BlockCount += blocks;
+        }
+        pending.insert(pending.end(), frame, frame + frameSize);
+        offset += frameSize;
+    }
+    if (eac3BlockCount >= 6) {
+        int pendingSize = (int) pending.size();
+        writeBurst(IEC61937_EAC3, pendingSize, pending.data(), pendingSize, kEac3BurstSize);
+        pending.clear();
+        eac3BlockCount = 0;
+    }
+    return 0;
+}
+
+int Iec61937Packer::packDts(const uint8_t *data, int size) {
+    // Only the 16-bit big endian core syncword is supported, which is what discs and
+    // broadcasts carry.
+    if (size < 10 || AV_RB32(data) != 0x7FFE8001) {
+        return AVERROR_INVALIDDATA;
+    }
+    int samples = (((data[4] & 0x01) << 6 | data[5] >> 2) + 1) * 32;
+    int coreSize = ((data[5] & 0x03) << 12 | data[6] << 4 | data[7] >> 4) + 1;
+    int sampleRate = kDtsSampleRates[(data[8] >> 2) & 0x0F];
+    if (!sampleRate || coreSize > size) {
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (dtsHdRate > 0 && size > coreSize) {
+        // The core and its extension substream, at the DTS-HD rate.
+        int period = (int) ((int64_t) dtsHdRate * samples / sampleRate);
+        int subtype = 0;
+        while ((512 << subtype) < period && subtype < 5) {
+            subtype++;
+        }
+        if ((512 << subtype) != period) {
+            return AVERROR_INVALIDDATA;
+        }
+        int burstSize = period * 4;
+        int maxPayloadSize = burstSize - IEC61937_BURST_HEADER_SIZE;
+        if ((int) sizeof(kDtsHdStartCode) + 2 + size > maxPayloadSize) {
+            // Like spdifenc, send the core alone in the DTS-HD burst rather than a gap.
+            size = coreSize;
+        }
+        int payloadSize = (int) sizeof(kDtsHdStartCode) + 2 + size;
+        if (payloadSize > maxPayloadSize) {
+            return AVERROR_INVALIDDATA;
+        }
+        pending.resize(payloadSize);
+        memcpy(pending.data(), kDtsHdStartCode, sizeof(kDtsHdStartCode));
+        AV_WB16(pending.data() + sizeof(kDtsHdStartCode), size);
+        memcpy(pending.data() + sizeof(kDtsHdStartCode) + 2, data, size);
+        linkChannelCount = dtsHdRate > 192000 ? 8 : 2;
+        linkSampleRate = dtsHdRate * 2 / linkChannelCount;
+        writeBurst(IEC61937_DTSHD | subtype << 8,
+                   FFALIGN(payloadSize + IEC61937_BURST_HEADER_SIZE, 16)
+                   - IEC61937_BURST_HEADER_SIZE,
+                   pending.data(), payloadSize, burstSize);
+        return 0;
+    }
+
+    int dataType;
+    switch (samples) {
+        case 512:
+            dataType = IEC61937_DTS1;
+            break;
+        case 1024:
+            dataType = IEC61937_DTS2;
+            break;
+        case 2048:
+            dataType = IEC61937_DTS3;
+            break;
+        default:
+            return AVERROR_INVALIDDATA;
+    }
+    int burstSize = samples * 4;
+    if (coreSize > burstSize - IEC61937_BURST_HEADER_SIZE) {
+        return AVERROR_INVALIDDATA;
+    }
+    linkSampleRate = sampleRate;
+    linkChannelCount = 2;
+    writeBurst(dataType, FFALIGN(coreSize, 2) * 8, data, coreSize, burstSize);
+    return 0;
+}
+
+int Iec61937Packer::packTrueHd(const uint8_t *data, int size) {
+    // Extractors may group several access units in one buffer.
+    for (int offset = 0; offset < size;) {
+        const uint8_t *unit = data + offset;
+        int available = size - offset;
+        if (available < 4) {
+            return AVERROR_INVALIDDATA;
+        }
+        int unitSize = ((unit[0] & 0x0F) << 8 | unit[1]) * 2;
+        if (unitSize < 4 || unitSize > available) {
+            return AVERROR_INVALIDDATA;
+        }
+        if (unitSize >= 10 && AV_RB24(unit + 4) == 0xF8726F) {
+            int rateBits;
+            if (unit[7] == 0xBA) {
+                rateBits = unit[8] >> 4;
+            } else if (unit[7] == 0xBB) {
+                rateBits = unit[9] >> 4;
+            } else {
+                return AVERROR_INVALIDDATA;
+            }
+            trueHdUnitSamples = 40 << (rateBits & 0x03);
+            linkSampleRate = rateBits & 0x08 ? 176400 : 192000;
+            linkChannelCount = 8;
+        }
+        // Receivers cannot start before a major sync, so units before the first one are
+        // dropped.
+        if (trueHdUnitSamples) {
+            appendTrueHdUnit(unit, unitSize, AV_RB16(unit + 2));
+        }
+        offset += unitSize;
+    }
+    return 0;
+}
+
+void Iec61937Packer::appendTrueHdUnit(const uint8_t *unit, int size, uint16_t inputTiming) {
+    // Each access unit is placed at the link time given by its input timing. A unit of the
+    // 48 kHz family lasts 1/1200 s, which is 2560 bytes at 768 kHz, and likewise for the
+    // 44.1 kHz family at 705.6 kHz.
+    int padding = 0;
+    if (trueHdPreviousSize) {
+        auto deltaSamples = (uint16_t) (inputTiming - trueHdPreviousTiming);
+        padding = deltaSamples * 2560 / trueHdUnitSamples - trueHdPreviousSize;
+        if (padding < 0 || padding >= IEC61937_MAT_FRAME_SIZE / 2) {
+            LOGW("Unexpected TrueHD input timing %d after %d.", inputTiming,
+                 trueHdPreviousTiming);
+            padding = 0;
+        }
+    }
+
+    int codeIndex = 0;
+    while (kMatCodes[codeIndex].offset < pendingFilled) {
+        codeIndex++;
+    }
+    // The link time taken by this unit, including the MAT codes that are not padding.
+    int unitLinkSize = size;
+    uint8_t *frame = pending.data();
+    while (padding || size || kMatCodes[codeIndex].offset == pendingFilled) {
+        if (kMatCodes[codeIndex].offset == pendingFilled) {
+            const MatCode &code = kMatCodes[codeIndex];
+            memcpy(frame + pendingFilled, code.data, code.size);
+            pendingFilled += code.size;
+            int codeLinkSize = code.size;
+            if (++codeIndex == kMatCodeCount) {
+                writeBurst(IEC61937_TRUEHD, IEC61937_MAT_FRAME_SIZE, frame,
+                           IEC61937_MAT_FRAME_SIZE, kMatBurstSize);
+                codeIndex = 0;
+                pendingFilled = 0;
+                // The gap to the next MAT frame takes link time too.
+                codeLinkSize += kMatBurstSize - IEC61937_MAT_FRAME_SIZE;
+            }
+            int codePadding = std::min(padding, codeLinkSize);
+            padding -= codePadding;
+            unitLinkSize += codeLinkSize - codePadding;
+        }
+        int space = kMatCodes[codeIndex].offset - pendingFilled;
+        if (padding) {
+            int count = std::min(space, padding);
+            memset(frame + pendingFilled, 0, count);
+            pendingFilled += count;
+            padding -= count;
+            if (padding) {
+                continue;
+            }
+            space -= count;
+        }
+        if (size) {
+            int count = std::min(space, size);
+            memcpy(frame + pendingFilled, unit, count);
+            pendingFilled += count;
+            unit += count;
+            size -= count;
+        }
+    }
+    trueHdPreviousSize = unitLinkSize;
+    trueHdPreviousTiming = inputTiming;
+}
+
+void Iec61937Packer::writeBurst(int dataType, int lengthCode, const uint8_t *payload,
+                                int payloadSize, int burstSize) {
+    size_t start = output.size();
+    output.resize(start + burstSize, 0);
+    uint8_t *burst = output.data() + start;
+    AV_WL16(burst, IEC61937_SYNC_WORD_1);
+    AV_WL16(burst + 2, IEC61937_SYNC_WORD_2);
+    AV_WL16(burst + 4, dataType);
+    AV_WL16(burst + 6, lengthCode);
+    // The payload is a big endian bitstream sent in little endian words. An odd last byte
+    // goes in the high byte of the last word.
+    uint8_t *out = burst + IEC61937_BURST_HEADER_SIZE;
+    int i = 0;
+    for (; i + 1 < payloadSize; i += 2) {
+        out[i] = payload[i + 1];
+        out[i + 1] = payload[i];
+    }
+    if (i < payloadSize) {
+        out[i + 1] = payload[i];
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef NEXTPLAYER_FFIEC61937_H
+#define NEXTPLAYER_FFIEC61937_H
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/codec_id.h>
+}
+
+// Burst preamble words Pa and Pb, and the size of the preamble Pa to Pd.
+static const uint16_t IEC61937_SYNC_WORD_1 = 0xF872;
+static const uint16_t IEC61937_SYNC_WORD_2 = 0x4E1F;
+static const int IEC61937_BURST_HEADER_SIZE = 8;
+
+// Data types of the bursts, carried in the low bits of Pc.
+static const int IEC61937_AC3 = 0x01;
+static const int IEC61937_DTS1 = 0x0B;
+static const int IEC61937_DTS2 = 0x0C;
+static const int IEC61937_DTS3 = 0x0D;
+static const int IEC61937_DTSHD = 0x11;
+static const int IEC61937_EAC3 = 0x15;
+static const int IEC61937_TRUEHD = 0x16;
+
+// TrueHD is carried in MAT frames of IEC61937_MAT_FRAME_SIZE bytes, one per burst, with fixed
+// codes at the start, in the middle and at the end of each frame.
+static const int IEC61937_MAT_FRAME_SIZE = 61424;
+static const int IEC61937_MAT_MIDDLE_CODE_OFFSET = 30708;
+
+/**
+ * Packs AC-3, E-AC-3, DTS, DTS-HD and TrueHD frames into IEC 61937 bursts without decoding
+ * them, for an output that passes the bitstream to an HDMI or S/PDIF receiver.
+ *
+ * Bursts are written as 16-bit little endian words, as AudioTrack takes them with
+ * ENCODING_IEC61937, and each burst is padded with zeros to the duration of its audio.
+ * E-AC-3 frames are collected until they hold six audio blocks and TrueHD access units are
+ * laid out in MAT frames by their input timing, so these produce a burst every few inputs.
+ */
+class Iec61937Packer {
+public:
+    /**
+     * Prepares packing frames of codecId. DTS-HD frames are sent whole in bursts at an
+     * IEC 60958 frame rate of dtsHdRate, e.g. 768000 for 8 channels at 192 kHz, or reduced to
+     * their DTS core if dtsHdRate is 0. Returns false if the codec cannot be packed.
+     */
+    bool configure(AVCodecID codecId, int dtsHdRate);
+
+    /**
+     * Packs the frames of one input buffer, which may hold several E-AC-3 frames or TrueHD
+     * access units. Returns the size of the bursts completed by this buffer, which are
+     * available from getOutput() until the next call, 0 if the frames were buffered for a
+     * later burst, or AVERROR_INVALIDDATA if a frame could not be parsed.
+     */
+    int pack(const uint8_t *data, int size);
+
+    const uint8_t *getOutput() const { return output.data(); }
+
+    /**
+     * Drops buffered frames, e.g. after a seek.
+     */
+    void reset();
+
+    /**
+     * Returns the sample rate and channel count of the PCM link that carries the bursts, which
+     * are known once the first frame has been packed, or 0 before.
+     */
+    int getSampleRate() const { return linkSampleRate; }
+
+    int getChannelCount() const { return linkChannelCount; }
+
+private:
+    int packAc3(const uint8_t *data, int size);
+
+    int packEac3(const uint8_t *data, int size);
+
+    int packDts(const uint8_t *data, int size);
+
+    int packTrueHd(const uint8_t *data, int size);
+
+    /**
+     * Lays out one TrueHD access unit in the MAT frame, writing the frame when it is full.
+     */
+    void appendTrueHdUnit(const uint8_t *unit, int size, uint16_t inputTiming);
+
+    /**
+     * Appends a burst of burstSize bytes carrying payloadSize bytes of payload to the output.
+     */
+    void writeBurst(int dataType, int lengthCode, const uint8_t *payload, int payloadSize,
+                    int burstSize);
+
+    AVCodecID codecId = AV_CODEC_ID_NONE;
+    int dtsHdRate = 0;
+    int linkSampleRate = 0;
+    int linkChannelCount = 0;
+    std::vector<uint8_t> output;
+    // E-AC-3 frames or the MAT frame being filled.
+    std::vector<uint8_t> pending;
+    int pendingFilled = 0;
+    int eac3BlockCount = 0;
+    // Samples per TrueHD access unit, 0 until the first major sync, and the size and input
+    // timing of the previous access unit including the MAT codes counted towards it.
+    int trueHdUnitSamples = 0;
+    int trueHdPreviousSize = 0;
+    uint16_t trueHdPreviousTiming = 0;
+};
+
+#endif //NEXTPLAYER_FFIEC61937_H
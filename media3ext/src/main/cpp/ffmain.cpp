@@ -2,6 +2,7 @@
 #include "libavcodec/version.h"
 #include "libavcodec/defs.h"
 #include "ffcommon.h"
+#include "ffdiag.h"
 
 
 jint JNI_OnLoad(JavaVM *vm, void *reserved) {
@@ -32,4 +33,11 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegLibrary_ffmpegHasD
                                                                    jclass clazz,
                                                                    jstring codec_name) {
     return getCodecByName(env, codec_name) != nullptr;
-}
\ No newline at end of file
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegLibrary_ffmpegDrainDiagnostics(JNIEnv *env,
+                                                                         jclass clazz) {
+    return env->NewStringUTF(ffdiag::drain().c_str());
+}
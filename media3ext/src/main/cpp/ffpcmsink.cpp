@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ffaudiocore.h"
+#include "ffpcmsink.h"
+
+void PcmRing::allocate(int capacity, int frameSize) {
+    buffer.assign((size_t) capacity * frameSize, 0);
+    this->capacity = capacity;
+    this->frameSize = frameSize;
+    clear();
+}
+
+int PcmRing::write(const uint8_t *data, int frameCount) {
+    int64_t write = writePosition.load(std::memory_order_relaxed);
+    int64_t read = readPosition.load(std::memory_order_acquire);
+    int count = std::min(frameCount, capacity - (int) (write - read));
+    if (count <= 0) {
+        return 0;
+    }
+    copy(write, const_cast<uint8_t *>(data), count, true);
+    writePosition.store(write + count, std::memory_order_release);
+    return count;
+}
+
+int PcmRing::read(uint8_t *data, int frameCount) {
+    int64_t read = readPosition.load(std::memory_order_relaxed);
+    int64_t write = writePosition.load(std::memory_order_acquire);
+    int count = std::min(frameCount, (int) (write - read));
+    if (count <= 0) {
+        return 0;
+    }
+    copy(read, data, count, false);
+    readPosition.store(read + count, std::memory_order_release);
+    return count;
+}
+
+void PcmRing::clear() {
+    writePosition.store(0, std::memory_order_relaxed);
+    readPosition.store(0, std::memory_order_relaxed);
+}
+
+void PcmRing::copy(int64_t position, uint8_t *data, int count, bool toRing) {
+    int offset = (int) (position % capacity);
+    int first = std::min(count, capacity - offset);
+    uint8_t *ring = buffer.data() + (size_t) offset * frameSize;
+    size_t firstSize = (size_t) first * frameSize;
+    size_t secondSize = (size_t) (count - first) * frameSize;
+    if (toRing) {
+        memcpy(ring, data, firstSize);
+        memcpy(buffer.data(), data + firstSize, secondSize);
+    } else {
+        memcpy(data, ring, firstSize);
+        memcpy(data + firstSize, buffer.data(), secondSize);
+    }
+}
+
+bool PcmSink::configure(int channelCount, int sampleRate, int encoding, int bufferFrames) {
+    int sampleSize;
+    switch (encoding) {
+        case OUTPUT_ENCODING_PCM_16BIT:
+            sampleSize = 2;
+            break;
+        case OUTPUT_ENCODING_PCM_24BIT:
+            sampleSize = 3;
+            break;
+        case OUTPUT_ENCODING_PCM_32BIT:
+        case OUTPUT_ENCODING_PCM_FLOAT:
+            sampleSize = 4;
+            break;
+        default:
+            return false;
+    }
+    if (channelCount <= 0 || sampleRate <= 0 || bufferFrames <= 0) {
+        return false;
+    }
+    this->channelCount = channelCount;
+    this->sampleRate = sampleRate;
+    this->encoding = encoding;
+    frameSize = channelCount * sampleSize;
+    ring.allocate(bufferFrames, frameSize);
+    deviceFrames.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    gapCount.store(0, std::memory_order_relaxed);
+    endOfStream.store(false, std::memory_order_relaxed);
+    deviceBase = 0;
+    playing = false;
+    setAnchor(0, 0, false);
+    return true;
+}
+
+int PcmSink::write(const uint8_t *data, int size) {
+    endOfStream.store(false, std::memory_order_relaxed);
+    return ring.write(data, size / frameSize) * frameSize;
+}
+
+void PcmSink::render(uint8_t *output, int frameCount) {
+    // Counted before the frames are taken from the ring, so that a position computed between
+    // the two sees them in flight rather than presented.
+    int64_t deviceFrame = deviceFrames.fetch_add(frameCount, std::memory_order_release);
+    int count = ring.read(output, frameCount);
+    if (count < frameCount) {
+        memset(output + (size_t) count * frameSize, 0, (size_t) (frameCount - count) * frameSize);
+        int64_t index = gapCount.load(std::memory_order_relaxed);
+        Gap &gap = gaps[index % kGapCount];
+        gap.start.store(deviceFrame + count, std::memory_order_relaxed);
+        gap.length.store(frameCount - count, std::memory_order_relaxed);
+        gapCount.store(index + 1, std::memory_order_release);
+        if (!endOfStream.load(std::memory_order_relaxed)) {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    float gain = volume.load(std::memory_order_relaxed);
+    if (gain != 1 && count > 0) {
+        applyVolume(output, count * channelCount, gain);
+    }
+}
+
+void PcmSink::setPlaying(bool playing, int64_t nowNs) {
+    setAnchor(getPresentedDeviceFrame(nowNs), nowNs, playing);
+    this->playing = playing;
+}
+
+void PcmSink::onTimestamp(int64_t deviceFrame, int64_t timeNs) {
+    // A timestamp from before the last start or flush may still be reported.
+    if (playing && timeNs >= anchorTimeNs) {
+        setAnchor(deviceBase + deviceFrame, timeNs, true);
+    }
+}
+
+void PcmSink::onDeviceRestarted(int64_t nowNs) {
+    deviceBase = deviceFrames.load(std::memory_order_acquire);
+    setAnchor(deviceBase, nowNs, playing);
+}
+
+void PcmSink::flush(int64_t nowNs) {
+    ring.clear();
+    endOfStream.store(false, std::memory_order_relaxed);
+    deviceBase = deviceFrames.load(std::memory_order_acquire);
+    setAnchor(deviceBase, nowNs, playing);
+}
+
+int64_t PcmSink::getPositionFrames(int64_t nowNs) const {
+    // The media frames are loaded first: render() counts the device frames before it reads
+    // and logs gaps after, so any mismatch counts media as in flight, never as presented.
+    int64_t mediaFrames = ring.getReadPosition();
+    int64_t renderedFrames = deviceFrames.load(std::memory_order_acquire);
+    int64_t presentedFrame = getPresentedDeviceFrame(nowNs);
+    int64_t mediaInFlight = renderedFrames - presentedFrame
+                            - getSilentFrames(presentedFrame, renderedFrames);
+    return std::max<int64_t>(0, mediaFrames - mediaInFlight);
+}
+
+int64_t PcmSink::getSilentFrames(int64_t start, int64_t end) const {
+    int64_t count = gapCount.load(std::memory_order_acquire);
+    int64_t silentFrames = 0;
+    // Gaps are logged in device order, so the walk stops at the first one before start.
+    for (int64_t i = count - 1; i >= 0 && i >= count - kGapCount; i--) {
+        const Gap &gap = gaps[i % kGapCount];
+        int64_t gapStart = gap.start.load(std::memory_order_relaxed);
+        int64_t gapEnd = gapStart + gap.length.load(std::memory_order_relaxed);
+        if (gapEnd <= start) {
+            break;
+        }
+        silentFrames += std::max<int64_t>(0, std::min(gapEnd, end) - std::max(gapStart, start));
+    }
+    return silentFrames;
+}
+
+int64_t PcmSink::getPresentedDeviceFrame(int64_t nowNs) const {
+    int64_t frame = anchorFrame;
+    if (anchorRunning && nowNs > anchorTimeNs) {
+        frame += (nowNs - anchorTimeNs) * sampleRate / 1000000000;
+    }
+    return std::min(frame, deviceFrames.load(std::memory_order_acquire));
+}
+
+void PcmSink::setAnchor(int64_t deviceFrame, int64_t timeNs, bool running) {
+    anchorFrame = deviceFrame;
+    anchorTimeNs = timeNs;
+    anchorRunning = running;
+}
+
+void PcmSink::applyVolume(uint8_t *samples, int sampleCount, float gain) const {
+    switch (encoding) {
+        case OUTPUT_ENCODING_PCM_FLOAT: {
+            auto *data = (float *) samples;
+            for (int i = 0; i < sampleCount; i++) {
+                data[i] *= gain;
+            }
+            break;
+        }
+        case OUTPUT_ENCODING_PCM_16BIT: {
+            auto *data = (int16_t *) samples;
+            for (int i = 0; i < sampleCount; i++) {
+                data[i] = (int16_t) lrintf(data[i] * gain);
+            }
+            break;
+        }
+        case OUTPUT_ENCODING_PCM_24BIT:
+            for (int i = 0; i < sampleCount; i++) {
+                uint8_t *sample = samples + i * 3;
+                auto value = (int32_t) ((uint32_t) sample[0] << 8 | (uint32_t) sample[1] << 16
+                                        | (uint32_t) sample[2] << 24) >> 8;
+                value = (int32_t) lrintf((float) value * gain);
+                sample[0] = (uint8_t) value;
+                sample[1] = (uint8_t) (value >> 8);
+                sample[2] = (uint8_t) (value >> 16);
+            }
+            break;
+        case OUTPUT_ENCODING_PCM_32BIT: {
+            auto *data = (int32_t *) samples;
+            for (int i = 0; i < sampleCount; i++) {
+                data[i] = (int32_t) lrint(data[i] * (double) gain);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef NEXTPLAYER_FFPCMSINK_H
+#define NEXTPLAYER_FFPCMSINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Single producer, single consumer ring of PCM frames. write() and read() never block or
+ * lock, so the consumer can be a real-time audio callback. Positions count the frames
+ * written and read since the last clear().
+ */
+class PcmRing {
+public:
+    /**
+     * Allocates room for capacity frames of frameSize bytes and empties the ring. Neither
+     * side may be running.
+     */
+    void allocate(int capacity, int frameSize);
+
+    /**
+     * Copies up to frameCount frames into the ring. Returns how many were copied, which is
+     * fewer if the ring is full. Producer only.
+     */
+    int write(const uint8_t *data, int frameCount);
+
+    /**
+     * Copies up to frameCount frames out of the ring. Returns how many were copied, which is
+     * fewer if the ring runs empty. Consumer only.
+     */
+    int read(uint8_t *data, int frameCount);
+
+    /**
+     * Empties the ring and restarts the positions at 0. Neither side may be running.
+     */
+    void clear();
+
+    int64_t getWritePosition() const { return writePosition.load(std::memory_order_acquire); }
+
+    int64_t getReadPosition() const { return readPosition.load(std::memory_order_acquire); }
+
+    int getCapacity() const { return capacity; }
+
+private:
+    /**
+     * Copies count frames between data and the ring at position, wrapping at the end.
+     */
+    void copy(int64_t position, uint8_t *data, int count, bool toRing);
+
+    std::vector<uint8_t> buffer;
+    int capacity = 0;
+    int frameSize = 0;
+    // On separate cache lines, as each is written by one side and polled by the other.
+    alignas(64) std::atomic<int64_t> writePosition{0};
+    alignas(64) std::atomic<int64_t> readPosition{0};
+};
+
+/**
+ * Output side of a native audio sink, independent of the audio API that pulls from it.
+ *
+ * The player thread writes decoded PCM into a PcmRing and the device callback renders from
+ * it, padding with silence when it runs empty. The playback position is the number of media
+ * frames rendered minus those still in flight in the device, which follow from the device
+ * timestamps (the frame it presents at a time) and a log of the silence rendered. Between
+ * timestamps the position is extrapolated at the sample rate while playing and held while
+ * paused.
+ *
+ * Apart from render(), which is the consumer, all methods are called on the player thread.
+ */
+class PcmSink {
+public:
+    /**
+     * Prepares for interleaved samples in one of the OUTPUT_ENCODING constants of
+     * ffaudiocore.h, with a ring of bufferFrames frames. Returns false for unsupported
+     * parameters. The consumer may not be running.
+     */
+    bool configure(int channelCount, int sampleRate, int encoding, int bufferFrames);
+
+    /**
+     * Copies as many whole frames of data as fit. Returns the number of bytes taken.
+     */
+    int write(const uint8_t *data, int size);
+
+    /**
+     * Fills output with frameCount frames. Called by the device, possibly on a real-time
+     * thread, so it does not block, allocate or log.
+     */
+    void render(uint8_t *output, int frameCount);
+
+    /**
+     * Sets the linear volume applied in render(), from 0 to 1.
+     */
+    void setVolume(float volume) { this->volume.store(volume, std::memory_order_relaxed); }
+
+    /**
+     * Records that the device started or paused at nowNs on CLOCK_MONOTONIC.
+     */
+    void setPlaying(bool playing, int64_t nowNs);
+
+    /**
+     * Records that no more frames will be written before the next flush(), so that running
+     * empty from then on is not an underrun.
+     */
+    void setEndOfStream() { endOfStream.store(true, std::memory_order_relaxed); }
+
+    /**
+     * Records that the device presented its frame deviceFrame, counted from its start, last
+     * restart or last flush(), at timeNs on CLOCK_MONOTONIC. Timestamps taken before the
+     * last start are ignored.
+     */
+    void onTimestamp(int64_t deviceFrame, int64_t timeNs);
+
+    /**
+     * Records that the device was replaced by a new one, whose frames count from 0 again,
+     * e.g. after it was disconnected. Frames in flight in the old device are lost.
+     */
+    void onDeviceRestarted(int64_t nowNs);
+
+    /**
+     * Drops the frames in the ring and restarts the positions at 0. The device must be
+     * paused and have dropped the frames in flight.
+     */
+    void flush(int64_t nowNs);
+
+    /**
+     * Returns the number of written frames the device has presented at nowNs.
+     */
+    int64_t getPositionFrames(int64_t nowNs) const;
+
+    int64_t getWrittenFrames() const { return ring.getWritePosition(); }
+
+    int64_t getUnderrunCount() const { return underruns.load(std::memory_order_relaxed); }
+
+    int getSampleRate() const { return sampleRate; }
+
+    int getFrameSize() const { return frameSize; }
+
+    int getBufferFrames() const { return ring.getCapacity(); }
+
+private:
+    /**
+     * Returns the device frame presented at nowNs, extrapolated from the last anchor.
+     */
+    int64_t getPresentedDeviceFrame(int64_t nowNs) const;
+
+    void setAnchor(int64_t deviceFrame, int64_t timeNs, bool running);
+
+    /**
+     * Returns the number of silent frames rendered from device frame start until end.
+     */
+    int64_t getSilentFrames(int64_t start, int64_t end) const;
+
+    /**
+     * Scales samples by gain, which is at most 1 so that no sample leaves its range.
+     */
+    void applyVolume(uint8_t *samples, int sampleCount, float gain) const;
+
+    /**
+     * Silence rendered in one callback, in device frames.
+     */
+    struct Gap {
+        std::atomic<int64_t> start{0};
+        std::atomic<int64_t> length{0};
+    };
+
+    // Gaps that can be in flight at once. Only the ones after the presented frame are read,
+    // which are a few callbacks' worth.
+    static const int kGapCount = 32;
+
+    PcmRing ring;
+    int channelCount = 0;
+    int sampleRate = 0;
+    int encoding = 0;
+    int frameSize = 0;
+    // Frames rendered by the device callback, media and silence, since configure().
+    alignas(64) std::atomic<int64_t> deviceFrames{0};
+    std::atomic<int64_t> underruns{0};
+    // Log of the last kGapCount gaps, written by render().
+    Gap gaps[kGapCount];
+    std::atomic<int64_t> gapCount{0};
+    std::atomic<float> volume{1};
+    std::atomic<bool> endOfStream{false};
+    // Player thread state. The device frame presented at anchorTimeNs, which advances with
+    // time while anchorRunning.
+    int64_t anchorFrame = 0;
+    int64_t anchorTimeNs = 0;
+    bool anchorRunning = false;
+    bool playing = false;
+    // Value of deviceFrames when the device last restarted its own count or was flushed.
+    int64_t deviceBase = 0;
+};
+
+#endif //NEXTPLAYER_FFPCMSINK_H
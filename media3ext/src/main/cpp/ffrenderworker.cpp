@@ -0,0 +1,103 @@
+#include "ffrenderworker.h"
+
+RenderWorker::RenderWorker(RenderFunction render)
+        : render(std::move(render)), worker(&RenderWorker::workerLoop, this) {}
+
+RenderWorker::~RenderWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    worker.join();
+    for (Job &job : slots) {
+        releaseJob(job);
+    }
+}
+
+void RenderWorker::releaseJob(Job &job) {
+    av_frame_free(&job.frame);
+    if (job.window) {
+        ANativeWindow_release(job.window);
+    }
+    job = Job();
+}
+
+void RenderWorker::completeJob(Job &job) {
+    releaseJob(job);
+    completedFrames++;
+    presented.notify_all();
+}
+
+void RenderWorker::queue(ANativeWindow *window, AVFrame *frame, int surfaceWidth, int surfaceHeight) {
+    ANativeWindow_acquire(window);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[freeSlot] = {window, frame, surfaceWidth, surfaceHeight};
+        queuedFrames++;
+        std::swap(freeSlot, pendingSlot);
+        if (hasPending) {
+            // The frame it replaced is back in the free slot.
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            completeJob(slots[freeSlot]);
+        }
+        hasPending = true;
+    }
+    wakeUp.notify_one();
+}
+
+void RenderWorker::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hasPending) {
+        completeJob(slots[pendingSlot]);
+        hasPending = false;
+    }
+}
+
+void RenderWorker::flushAndRun(const std::function<void()> &task) {
+    flush();
+    std::unique_lock<std::mutex> lock(mutex);
+    pendingTask = &task;
+    wakeUp.notify_one();
+    taskDone.wait(lock, [this] { return pendingTask == nullptr; });
+}
+
+size_t RenderWorker::queueDepth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (hasPending ? 1 : 0) + (presenting ? 1 : 0);
+}
+
+bool RenderWorker::awaitPresentation(int64_t timeoutUs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    int64_t target = queuedFrames;
+    return presented.wait_for(lock, std::chrono::microseconds(timeoutUs),
+                              [this, target] { return completedFrames >= target; });
+}
+
+void RenderWorker::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeUp.wait(lock, [this] { return stopping || pendingTask || hasPending; });
+        if (pendingTask) {
+            (*pendingTask)();
+            pendingTask = nullptr;
+            taskDone.notify_all();
+            continue;
+        }
+        if (stopping) {
+            return;
+        }
+        std::swap(pendingSlot, presentingSlot);
+        hasPending = false;
+        presenting = true;
+        Job &job = slots[presentingSlot];
+        lock.unlock();
+        // queue() only touches the free and pending slots, so the job stays put.
+        if (!render(job.window, job.frame, job.surfaceWidth, job.surfaceHeight)) {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.lock();
+        presenting = false;
+        completeJob(job);
+    }
+}
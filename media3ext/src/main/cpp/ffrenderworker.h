@@ -0,0 +1,115 @@
+#ifndef NEXTPLAYER_FFRENDERWORKER_H
+#define NEXTPLAYER_FFRENDERWORKER_H
+
+#include <android/native_window.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/**
+ * Thread that presents decoded frames to a window off the renderer thread.
+ *
+ * Frames are handed over through a triple buffer of three slots: the free slot, which queue()
+ * fills and publishes by swapping it with the pending slot, and the presenting slot, which the
+ * worker swaps with the pending slot and draws from with the render function. Neither side
+ * ever waits for the other. A frame that is still pending when the next one is queued was not
+ * going to be on time and is dropped, so at most one frame waits and the latest one wins.
+ * Every queued frame completes, posted or dropped, which awaitPresentation() waits for.
+ */
+class RenderWorker {
+public:
+    /**
+     * Draws frame into window. Returns whether the frame was posted to the window.
+     * Only ever called on the worker thread.
+     */
+    using RenderFunction = std::function<bool(ANativeWindow *window, AVFrame *frame,
+                                              int surfaceWidth, int surfaceHeight)>;
+
+    explicit RenderWorker(RenderFunction render);
+
+    ~RenderWorker();
+
+    /**
+     * Queues frame for presentation on window. Takes ownership of frame and acquires its
+     * own reference to window.
+     */
+    void queue(ANativeWindow *window, AVFrame *frame, int surfaceWidth, int surfaceHeight);
+
+    /**
+     * Drops the pending frame. A frame that is being drawn is still posted.
+     */
+    void flush();
+
+    /**
+     * Drops the pending frame and runs task on the worker thread once the frame that is being
+     * drawn, if any, is done. Returns after task has run.
+     */
+    void flushAndRun(const std::function<void()> &task);
+
+    /**
+     * Returns the number of frames queued and not presented yet: the pending one and the one
+     * being drawn.
+     */
+    size_t queueDepth();
+
+    /**
+     * Waits up to timeoutUs for every frame queued so far to be posted or dropped. Returns
+     * whether they all were.
+     */
+    bool awaitPresentation(int64_t timeoutUs);
+
+    /**
+     * Returns how many frames were dropped because a newer one replaced them or drawing failed.
+     */
+    int64_t droppedCount() const { return droppedFrames.load(std::memory_order_relaxed); }
+
+private:
+    struct Job {
+        ANativeWindow *window = nullptr;
+        AVFrame *frame = nullptr;
+        int surfaceWidth = 0;
+        int surfaceHeight = 0;
+    };
+
+    static const int kSlotCount = 3;
+
+    static void releaseJob(Job &job);
+
+    /**
+     * Releases job and counts it as completed. Called with the mutex held.
+     */
+    void completeJob(Job &job);
+
+    void workerLoop();
+
+    RenderFunction render;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable taskDone;
+    std::condition_variable presented;
+    // The triple buffer, see the class comment. The free slot is always empty between calls.
+    Job slots[kSlotCount];
+    int freeSlot = 0;
+    int pendingSlot = 1;
+    int presentingSlot = 2;
+    bool hasPending = false;
+    bool presenting = false;
+    // Frames queued and frames posted or dropped, for awaitPresentation().
+    int64_t queuedFrames = 0;
+    int64_t completedFrames = 0;
+    const std::function<void()> *pendingTask = nullptr;
+    bool stopping = false;
+    std::atomic<int64_t> droppedFrames{0};
+    std::thread worker;
+};
+
+#endif //NEXTPLAYER_FFRENDERWORKER_H
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include "ffsamplefmt.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FF_SAMPLEFMT_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_SAMPLEFMT_SSE2 1
+#if defined(__SSSE3__)
+// Always available on Android x86 and x86_64, used for the byte shuffle of packing 24-bit.
+#include <tmmintrin.h>
+#define FF_SAMPLEFMT_SSSE3 1
+#endif
+#endif
+
+namespace {
+    // Planes are converted in chunks of this many samples before they are interleaved, so
+    // that the converted samples are still in L1 when they are read back.
+    const int kChunkSamples = 256;
+
+    inline int16_t toS16(float sample) {
+        float scaled = sample * 32768.0f;
+        if (scaled >= 32767.0f) {
+            return 32767;
+        }
+        // Also takes NaN.
+        if (!(scaled > -32768.0f)) {
+            return -32768;
+        }
+        return (int16_t) lrintf(scaled);
+    }
+
+    inline int16_t toS16(int32_t sample) {
+        return (int16_t) (sample >> 16);
+    }
+
+    inline float toFloat(int32_t sample) {
+        return (float) sample * (1.0f / 2147483648.0f);
+    }
+
+    void convert(const float *in, int16_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        const float32x4_t scale = vdupq_n_f32(32768.0f);
+        for (; i + 8 <= count; i += 8) {
+            float32x4_t low = vmulq_f32(vld1q_f32(in + i), scale);
+            float32x4_t high = vmulq_f32(vld1q_f32(in + i + 4), scale);
+#if defined(__aarch64__)
+            int32x4_t lowInt = vcvtnq_s32_f32(low);
+            int32x4_t highInt = vcvtnq_s32_f32(high);
+#else
+            // ARMv7 only truncates, round half away from zero instead.
+            const float32x4_t half = vdupq_n_f32(0.5f);
+            const float32x4_t minusHalf = vdupq_n_f32(-0.5f);
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            int32x4_t lowInt = vcvtq_s32_f32(
+                    vaddq_f32(low, vbslq_f32(vcltq_f32(low, zero), minusHalf, half)));
+            int32x4_t highInt = vcvtq_s32_f32(
+                    vaddq_f32(high, vbslq_f32(vcltq_f32(high, zero), minusHalf, half)));
+#endif
+            // The conversions and narrowing saturate.
+            vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lowInt), vqmovn_s32(highInt)));
+        }
+#elif FF_SAMPLEFMT_SSE2
+        const __m128 scale = _mm_set1_ps(32768.0f);
+        const __m128 min = _mm_set1_ps(-32768.0f);
+        const __m128 max = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= count; i += 8) {
+            // Clamped first, _mm_cvtps_epi32 turns anything out of range into INT32_MIN.
+            __m128 low = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), min), max);
+            __m128 high = _mm_min_ps(
+                    _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), min), max);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                             _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = toS16(in[i]);
+        }
+    }
+
+    void convert(const int32_t *in, int16_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        for (; i + 8 <= count; i += 8) {
+            vst1q_s16(out + i, vcombine_s16(vshrn_n_s32(vld1q_s32(in + i), 16),
+                                            vshrn_n_s32(vld1q_s32(in + i + 4), 16)));
+        }
+#elif FF_SAMPLEFMT_SSE2
+        for (; i + 8 <= count; i += 8) {
+            __m128i low = _mm_srai_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), 16);
+            __m128i high = _mm_srai_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 4)), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(low, high));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = toS16(in[i]);
+        }
+    }
+
+    void convert(const int32_t *in, float *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        const float32x4_t scale = vdupq_n_f32(1.0f / 2147483648.0f);
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(in + i)), scale));
+        }
+#elif FF_SAMPLEFMT_SSE2
+        const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+        for (; i + 4 <= count; i += 4) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scale));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = toFloat(in[i]);
+        }
+    }
+
+    void convert(const int16_t *in, float *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t samples = vld1q_s16(in + i);
+            vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), scale));
+            vst1q_f32(out + i + 4,
+                      vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), scale));
+        }
+#elif FF_SAMPLEFMT_SSE2
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+        for (; i + 8 <= count; i += 8) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            // Sign extended by unpacking into the high halves and shifting back.
+            __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+            __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = (float) in[i] * (1.0f / 32768.0f);
+        }
+    }
+
+    inline int32_t toS32(float sample) {
+        // Clamped to 2^31 - 128, the largest float below 2^31, like the SSE2 kernel.
+        float scaled = sample * 2147483648.0f;
+        if (scaled >= 2147483520.0f) {
+            return 2147483520;
+        }
+        if (!(scaled > -2147483648.0f)) {
+            return INT32_MIN;
+        }
+        return (int32_t) lrintf(scaled);
+    }
+
+    void convert(const float *in, int32_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON && defined(__aarch64__)
+        const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+        for (; i + 4 <= count; i += 4) {
+            // Saturates, unlike the ARMv7 conversion, which also only truncates.
+            vst1q_s32(out + i, vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale)));
+        }
+#elif FF_SAMPLEFMT_SSE2
+        const __m128 scale = _mm_set1_ps(2147483648.0f);
+        const __m128 min = _mm_set1_ps(-2147483648.0f);
+        const __m128 max = _mm_set1_ps(2147483520.0f);
+        for (; i + 4 <= count; i += 4) {
+            __m128 samples = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), min),
+                                        max);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_cvtps_epi32(samples));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = toS32(in[i]);
+        }
+    }
+
+    /**
+     * Packs the upper 24 bits of each sample into three little endian bytes. out may be the
+     * same buffer as in: each group of samples is read before the bytes it overlaps are written.
+     */
+    void pack(const int32_t *in, uint8_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        for (; i + 16 <= count; i += 16) {
+            uint8x16x4_t bytes = vld4q_u8(reinterpret_cast<const uint8_t *>(in + i));
+            uint8x16x3_t packed = {{bytes.val[1], bytes.val[2], bytes.val[3]}};
+            vst3q_u8(out + 3 * i, packed);
+        }
+#elif FF_SAMPLEFMT_SSSE3
+        const __m128i shuffle = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15,
+                                              -1, -1, -1, -1);
+        // Each store writes 16 bytes for 12, so stop while the next group covers the rest.
+        for (; i + 8 <= count; i += 4) {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 3 * i),
+                             _mm_shuffle_epi8(samples, shuffle));
+        }
+#endif
+        for (; i < count; i++) {
+            int32_t sample = in[i];
+            out[3 * i] = (uint8_t) (sample >> 8);
+            out[3 * i + 1] = (uint8_t) (sample >> 16);
+            out[3 * i + 2] = (uint8_t) (sample >> 24);
+        }
+    }
+
+    template<typename T>
+    void convert(const T *in, T *out, int count) {
+        memcpy(out, in, count * sizeof(T));
+    }
+
+    void zip(const float *left, const float *right, float *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        for (; i + 4 <= count; i += 4) {
+            float32x4x2_t pair = {{vld1q_f32(left + i), vld1q_f32(right + i)}};
+            vst2q_f32(out + 2 * i, pair);
+        }
+#elif FF_SAMPLEFMT_SSE2
+        for (; i + 4 <= count; i += 4) {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#endif
+        for (; i < count; i++) {
+            out[2 * i] = left[i];
+            out[2 * i + 1] = right[i];
+        }
+    }
+
+    void zip(const int32_t *left, const int32_t *right, int32_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        for (; i + 4 <= count; i += 4) {
+            int32x4x2_t pair = {{vld1q_s32(left + i), vld1q_s32(right + i)}};
+            vst2q_s32(out + 2 * i, pair);
+        }
+#elif FF_SAMPLEFMT_SSE2
+        for (; i + 4 <= count; i += 4) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(left + i));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(right + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi32(l, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 4),
+                             _mm_unpackhi_epi32(l, r));
+        }
+#endif
+        for (; i < count; i++) {
+            out[2 * i] = left[i];
+            out[2 * i + 1] = right[i];
+        }
+    }
+
+    void zip(const int16_t *left, const int16_t *right, int16_t *out, int count) {
+        int i = 0;
+#if FF_SAMPLEFMT_NEON
+        for (; i + 8 <= count; i += 8) {
+            int16x8x2_t pair = {{vld1q_s16(left + i), vld1q_s16(right + i)}};
+            vst2q_s16(out + 2 * i, pair);
+        }
+#elif FF_SAMPLEFMT_SSE2
+        for (; i + 8 <= count; i += 8) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(left + i));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(right + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi16(l, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 8),
+                             _mm_unpackhi_epi16(l, r));
+        }
+#endif
+        for (; i < count; i++) {
+            out[2 * i] = left[i];
+            out[2 * i + 1] = right[i];
+        }
+    }
+
+    /**
+     * Converts each plane of a chunk with the vector kernels and interleaves the chunk, with
+     * the vector zip for stereo. Formats that only differ in layout skip the conversion.
+     */
+    template<typename In, typename Out, int kChannels>
+    void interleave(const uint8_t *const *planes, int sampleCount, uint8_t *output) {
+        auto *out = reinterpret_cast<Out *>(output);
+        if (kChannels == 1) {
+            convert(reinterpret_cast<const In *>(planes[0]), out, sampleCount);
+            return;
+        }
+        constexpr bool kConvert = !std::is_same<In, Out>::value;
+        Out chunk[kConvert ? kChannels : 1][kConvert ? kChunkSamples : 1];
+        const Out *source[kChannels];
+        for (int start = 0; start < sampleCount; start += kChunkSamples) {
+            int count = std::min(kChunkSamples, sampleCount - start);
+            for (int channel = 0; channel < kChannels; channel++) {
+                const In *in = reinterpret_cast<const In *>(planes[channel]) + start;
+                if constexpr (kConvert) {
+                    convert(in, chunk[channel], count);
+                    source[channel] = chunk[channel];
+                } else {
+                    source[channel] = in;
+                }
+            }
+            Out *dst = out + start * kChannels;
+            if constexpr (kChannels == 2) {
+                zip(source[0], source[1], dst, count);
+            } else {
+                for (int i = 0; i < count; i++) {
+                    for (int channel = 0; channel < kChannels; channel++) {
+                        dst[i * kChannels + channel] = source[channel][i];
+                    }
+                }
+            }
+        }
+    }
+
+    // Output type of the kernels that write packed 24-bit samples.
+    struct PackedS24 {};
+
+    /**
+     * Interleaves a chunk of S32 samples and packs it while it is in L1.
+     */
+    template<int kChannels>
+    void interleavePacked(const uint8_t *const *planes, int sampleCount, uint8_t *output) {
+        int32_t chunk[kChannels * kChunkSamples];
+        const uint8_t *chunkPlanes[kChannels];
+        for (int start = 0; start < sampleCount; start += kChunkSamples) {
+            int count = std::min(kChunkSamples, sampleCount - start);
+            for (int channel = 0; channel < kChannels; channel++) {
+                chunkPlanes[channel] = planes[channel] + start * sizeof(int32_t);
+            }
+            interleave<int32_t, int32_t, kChannels>(chunkPlanes, count,
+                                                    reinterpret_cast<uint8_t *>(chunk));
+            pack(chunk, output + 3 * start * kChannels, count * kChannels);
+        }
+    }
+
+    template<typename In, typename Out, int kChannels>
+    constexpr InterleaveFunction kernel() {
+        if constexpr (std::is_same<Out, PackedS24>::value) {
+            return interleavePacked<kChannels>;
+        } else {
+            return interleave<In, Out, kChannels>;
+        }
+    }
+
+    template<typename In, typename Out>
+    InterleaveFunction forChannelCount(int channelCount) {
+        switch (channelCount) {
+            case 1:
+                return kernel<In, Out, 1>();
+            case 2:
+                return kernel<In, Out, 2>();
+            case 3:
+                return kernel<In, Out, 3>();
+            case 4:
+                return kernel<In, Out, 4>();
+            case 5:
+                return kernel<In, Out, 5>();
+            case 6:
+                return kernel<In, Out, 6>();
+            case 7:
+                return kernel<In, Out, 7>();
+            case 8:
+                return kernel<In, Out, 8>();
+            default:
+                return nullptr;
+        }
+    }
+}
+
+InterleaveFunction findInterleaveFunction(AVSampleFormat inFormat, AVSampleFormat outFormat,
+                                          int channelCount) {
+    if (inFormat == AV_SAMPLE_FMT_FLTP && outFormat == AV_SAMPLE_FMT_FLT) {
+        return forChannelCount<float, float>(channelCount);
+    }
+    if (inFormat == AV_SAMPLE_FMT_FLTP && outFormat == AV_SAMPLE_FMT_S16) {
+        return forChannelCount<float, int16_t>(channelCount);
+    }
+    if (inFormat == AV_SAMPLE_FMT_S16P && outFormat == AV_SAMPLE_FMT_S16) {
+        return forChannelCount<int16_t, int16_t>(channelCount);
+    }
+    if (inFormat == AV_SAMPLE_FMT_S32P && outFormat == AV_SAMPLE_FMT_S16) {
+        return forChannelCount<int32_t, int16_t>(channelCount);
+    }
+    if (inFormat == AV_SAMPLE_FMT_S32P && outFormat == AV_SAMPLE_FMT_FLT) {
+        return forChannelCount<int32_t, float>(channelCount);
+    }
+    if (inFormat == AV_SAMPLE_FMT_S32P && outFormat == AV_SAMPLE_FMT_S32) {
+        return forChannelCount<int32_t, int32_t>(channelCount);
+    }
+    return nullptr;
+}
+
+InterleaveFunction findPackedS24InterleaveFunction(AVSampleFormat inFormat, int channelCount) {
+    return inFormat == AV_SAMPLE_FMT_S32P ? forChannelCount<int32_t, PackedS24>(channelCount)
+                                          : nullptr;
+}
+
+void packS24(const int32_t *in, uint8_t *out, int count) {
+    pack(in, out, count);
+}
+
+void convertFloatToS16(const float *in, int16_t *out, int count) {
+    convert(in, out, count);
+}
+
+void convertS16ToFloat(const int16_t *in, float *out, int count) {
+    convert(in, out, count);
+}
+
+void convertFloatToS32(const float *in, int32_t *out, int count) {
+    convert(in, out, count);
+}
+
+void convertS32ToFloat(const int32_t *in, float *out, int count) {
+    convert(in, out, count);
+}
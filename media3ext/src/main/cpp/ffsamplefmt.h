@@ -0,0 +1,59 @@
+#ifndef NEXTPLAYER_FFSAMPLEFMT_H
+#define NEXTPLAYER_FFSAMPLEFMT_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+/**
+ * Converts sampleCount samples of each of the planes to interleaved samples in output.
+ */
+using InterleaveFunction = void (*)(const uint8_t *const *planes, int sampleCount,
+                                    uint8_t *output);
+
+/**
+ * Returns a NEON/SSE2 kernel that converts planar inFormat samples of channelCount channels
+ * to interleaved outFormat samples, or nullptr if swresample has to be used. Covers FLTP to
+ * FLT and S16, S16P to S16, and S32P to S16, S32 and FLT, for 1 to 8 channels. The results
+ * match swr_convert without dithering.
+ */
+InterleaveFunction findInterleaveFunction(AVSampleFormat inFormat, AVSampleFormat outFormat,
+                                          int channelCount);
+
+/**
+ * Returns a kernel that interleaves S32P samples of channelCount channels into packed 24-bit
+ * samples, the upper three bytes of each, or nullptr for other formats.
+ */
+InterleaveFunction findPackedS24InterleaveFunction(AVSampleFormat inFormat, int channelCount);
+
+/**
+ * Packs the upper 24 bits of count S32 samples into three little endian bytes each, as
+ * AudioFormat.ENCODING_PCM_24BIT_PACKED takes them. out may be the memory of in, to pack in
+ * place.
+ */
+void packS24(const int32_t *in, uint8_t *out, int count);
+
+/**
+ * Converts count float samples to S16 with the vector kernels, rounding and saturating as
+ * the interleave functions do.
+ */
+void convertFloatToS16(const float *in, int16_t *out, int count);
+
+/**
+ * Converts count S16 samples to float with the vector kernels.
+ */
+void convertS16ToFloat(const int16_t *in, float *out, int count);
+
+/**
+ * Converts count float samples to S32, rounding and saturating.
+ */
+void convertFloatToS32(const float *in, int32_t *out, int count);
+
+/**
+ * Converts count S32 samples to float.
+ */
+void convertS32ToFloat(const int32_t *in, float *out, int count);
+
+#endif //NEXTPLAYER_FFSAMPLEFMT_H
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ffspectrum.h"
+#include "ffutil.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+namespace {
+    // Output is decimated to at most this rate, which leaves the bands up to 12 kHz.
+    const int kMaxAnalysisRate = 24000;
+    // Lower edge of the first band, if the FFT resolves it.
+    const double kMinBandFrequency = 30;
+
+    // Marks the middle snapshot as written since the reader last took it.
+    const int kFresh = 4;
+    const int kIndexMask = 3;
+
+    float sumS16(const int16_t *samples, int count) {
+        int sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += samples[i];
+        }
+        return (float) sum * (1.0f / 32768);
+    }
+
+    float sumS32(const int32_t *samples, int count) {
+        int64_t sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += samples[i];
+        }
+        return (float) sum * (1.0f / 2147483648.0f);
+    }
+
+    float sumFloat(const float *samples, int count) {
+        float sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += samples[i];
+        }
+        return sum;
+    }
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    av_tx_uninit(&tx);
+    av_freep(&input);
+    av_freep(&bins);
+}
+
+bool SpectrumAnalyzer::configure(int fftSize, int bandCount, int intervalMs) {
+    if (fftSize < SPECTRUM_MIN_FFT_SIZE || fftSize > SPECTRUM_MAX_FFT_SIZE
+        || (fftSize & (fftSize - 1)) || bandCount < 1 || bandCount > fftSize / 2
+        || intervalMs < 1) {
+        LOGE("Invalid spectrum parameters: FFT size %d, %d bands, every %d ms.", fftSize,
+             bandCount, intervalMs);
+        return false;
+    }
+    float scale = 1;
+    int result = av_tx_init(&tx, &transform, AV_TX_FLOAT_RDFT, 0, fftSize, &scale, 0);
+    if (result < 0) {
+        logError("av_tx_init", result);
+        return false;
+    }
+    input = (float *) av_malloc_array(fftSize, sizeof(float));
+    bins = (AVComplexFloat *) av_malloc_array(fftSize / 2 + 1, sizeof(AVComplexFloat));
+    if (!input || !bins) {
+        LOGE("Failed to allocate the FFT buffers.");
+        return false;
+    }
+    this->fftSize = fftSize;
+    this->bandCount = bandCount;
+    this->intervalMs = intervalMs;
+    window.resize(fftSize);
+    for (int i = 0; i < fftSize; i++) {
+        window[i] = (float) (0.5 - 0.5 * cos(2 * M_PI * i / fftSize));
+    }
+    // The Hann window halves the amplitude and the bins of a real signal hold half of it.
+    magnitudeScale = 4.0f / (float) fftSize;
+    samples.resize(fftSize);
+    for (Snapshot &snapshot : snapshots) {
+        snapshot.bands.assign(bandCount, 0);
+    }
+    return true;
+}
+
+void SpectrumAnalyzer::prepare(int channelCount, int sampleRate) {
+    preparedChannelCount = channelCount;
+    preparedSampleRate = sampleRate;
+    decimation = (sampleRate + kMaxAnalysisRate - 1) / kMaxAnalysisRate;
+    double analysisRate = (double) sampleRate / decimation;
+    hopSize = std::max(1, (int) (analysisRate * intervalMs / 1000));
+
+    int lastBin = fftSize / 2;
+    double binWidth = analysisRate / fftSize;
+    double minFrequency = std::max(kMinBandFrequency, binWidth);
+    double maxFrequency = analysisRate / 2;
+    bandStarts.resize(bandCount + 1);
+    for (int i = 0; i <= bandCount; i++) {
+        double frequency = minFrequency * pow(maxFrequency / minFrequency, (double) i / bandCount);
+        int bin = (int) lround(frequency / binWidth);
+        // Every band gets bins of its own while there are enough of them.
+        if (i > 0) {
+            bin = std::max(bin, bandStarts[i - 1] + 1);
+        }
+        bandStarts[i] = std::clamp(bin, 1, lastBin + 1);
+    }
+    bandStarts[bandCount] = lastBin + 1;
+    sampleCount = 0;
+    pendingSum = 0;
+    pendingCount = 0;
+    skipFrames = 0;
+}
+
+void SpectrumAnalyzer::feed(const uint8_t *data, int frameCount, int channelCount,
+                            int sampleRate, AVSampleFormat format) {
+    if (!tx || channelCount <= 0 || sampleRate <= 0
+        || (format != AV_SAMPLE_FMT_S16 && format != AV_SAMPLE_FMT_S32
+            && format != AV_SAMPLE_FMT_FLT)) {
+        return;
+    }
+    if (busy.test_and_set(std::memory_order_acquire)) {
+        // Another decoder is feeding, e.g. one being released while its successor starts.
+        return;
+    }
+    if (channelCount != preparedChannelCount || sampleRate != preparedSampleRate) {
+        prepare(channelCount, sampleRate);
+    }
+    float sampleScale = 1.0f / (float) (decimation * channelCount);
+    int frame = 0;
+    while (frame < frameCount) {
+        if (skipFrames > 0) {
+            int skip = (int) std::min(skipFrames, (int64_t) (frameCount - frame));
+            frame += skip;
+            skipFrames -= skip;
+            continue;
+        }
+        int offset = frame * channelCount;
+        if (format == AV_SAMPLE_FMT_FLT) {
+            pendingSum += sumFloat((const float *) data + offset, channelCount);
+        } else if (format == AV_SAMPLE_FMT_S32) {
+            pendingSum += sumS32((const int32_t *) data + offset, channelCount);
+        } else {
+            pendingSum += sumS16((const int16_t *) data + offset, channelCount);
+        }
+        frame++;
+        if (++pendingCount < decimation) {
+            continue;
+        }
+        samples[sampleCount++] = pendingSum * sampleScale;
+        pendingSum = 0;
+        pendingCount = 0;
+        if (sampleCount < fftSize) {
+            continue;
+        }
+        analyze();
+        if (hopSize < fftSize) {
+            // Windows overlap, keep the samples the next one shares with this one.
+            sampleCount = fftSize - hopSize;
+            memmove(samples.data(), samples.data() + hopSize, sampleCount * sizeof(float));
+        } else {
+            sampleCount = 0;
+            skipFrames = (int64_t) (hopSize - fftSize) * decimation;
+        }
+    }
+    busy.clear(std::memory_order_release);
+}
+
+void SpectrumAnalyzer::analyze() {
+    for (int i = 0; i < fftSize; i++) {
+        input[i] = samples[i] * window[i];
+    }
+    transform(tx, bins, input, sizeof(float));
+    Snapshot &snapshot = snapshots[back];
+    for (int band = 0; band < bandCount; band++) {
+        int start = std::min(bandStarts[band], fftSize / 2);
+        int end = std::max(bandStarts[band + 1], start + 1);
+        float peak = 0;
+        for (int bin = start; bin < end; bin++) {
+            peak = std::max(peak, bins[bin].re * bins[bin].re + bins[bin].im * bins[bin].im);
+        }
+        snapshot.bands[band] = sqrtf(peak) * magnitudeScale;
+    }
+    snapshot.sequence = ++sequence;
+    publish();
+}
+
+void SpectrumAnalyzer::publish() {
+    back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndexMask;
+}
+
+void SpectrumAnalyzer::reset() {
+    if (busy.test_and_set(std::memory_order_acquire)) {
+        return;
+    }
+    sampleCount = 0;
+    pendingSum = 0;
+    pendingCount = 0;
+    skipFrames = 0;
+    busy.clear(std::memory_order_release);
+}
+
+int64_t SpectrumAnalyzer::read(float *bands) {
+    if (middle.load(std::memory_order_relaxed) & kFresh) {
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+    }
+    const Snapshot &snapshot = snapshots[front];
+    if (snapshot.sequence == 0) {
+        return 0;
+    }
+    std::copy(snapshot.bands.begin(), snapshot.bands.end(), bands);
+    return snapshot.sequence;
+}
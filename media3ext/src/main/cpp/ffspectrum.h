@@ -0,0 +1,118 @@
+#ifndef NEXTPLAYER_FFSPECTRUM_H
+#define NEXTPLAYER_FFSPECTRUM_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavutil/tx.h>
+}
+
+// Limits of the FFT size, which must be a power of two. Must match FfmpegSpectrumAnalyzer.
+static const int SPECTRUM_MIN_FFT_SIZE = 64;
+static const int SPECTRUM_MAX_FFT_SIZE = 16384;
+
+/**
+ * Magnitude bands of the decoded audio for visualizers, computed on the decoder thread.
+ *
+ * The decoder output is mixed to mono and decimated to at most 24 kHz by averaging, which is
+ * enough to draw but not to measure. Analyses are rate limited to one per interval, and when
+ * that is longer than the window only the samples of each window are collected, so between
+ * windows the tap costs no more than a branch per output buffer. Each analysis applies a Hann
+ * window, runs a real FFT with av_tx and reduces the bins to bandCount logarithmically spaced
+ * bands, which are published through a triple buffer: the reader never blocks the decoder and
+ * always gets the latest complete set of bands.
+ *
+ * feed() and reset() may be called from several decoders, only one of them is analysed at a
+ * time; read() must only be called from one thread at a time.
+ */
+class SpectrumAnalyzer {
+public:
+    SpectrumAnalyzer() = default;
+
+    ~SpectrumAnalyzer();
+
+    SpectrumAnalyzer(const SpectrumAnalyzer &) = delete;
+
+    SpectrumAnalyzer &operator=(const SpectrumAnalyzer &) = delete;
+
+    /**
+     * Prepares analysing fftSize samples every intervalMs milliseconds of audio into
+     * bandCount bands. Must be called once, before anything else. Returns false if the
+     * parameters are invalid or the transform cannot be created.
+     */
+    bool configure(int fftSize, int bandCount, int intervalMs);
+
+    /**
+     * Takes frameCount interleaved frames of decoder output, in S16, S32 or FLT.
+     */
+    void feed(const uint8_t *data, int frameCount, int channelCount, int sampleRate,
+              AVSampleFormat format);
+
+    /**
+     * Drops the samples collected for the next analysis, e.g. after a seek.
+     */
+    void reset();
+
+    /**
+     * Copies the latest bands to bands, bandCount values where a full scale sine has a
+     * magnitude of 1, and returns their sequence number, which starts at 1 and grows with
+     * every analysis. Returns 0 and leaves bands unchanged before the first analysis.
+     */
+    int64_t read(float *bands);
+
+    int getBandCount() const { return bandCount; }
+
+private:
+    struct Snapshot {
+        std::vector<float> bands;
+        int64_t sequence = 0;
+    };
+
+    void prepare(int channelCount, int sampleRate);
+
+    void analyze();
+
+    void publish();
+
+    int fftSize = 0;
+    int bandCount = 0;
+    int intervalMs = 0;
+    AVTXContext *tx = nullptr;
+    av_tx_fn transform = nullptr;
+    // Aligned for av_tx: windowed input and fftSize / 2 + 1 bins.
+    float *input = nullptr;
+    AVComplexFloat *bins = nullptr;
+    std::vector<float> window;
+    float magnitudeScale = 0;
+
+    // Set while a decoder feeds the analyzer.
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    // Output format the decimation and bands below were prepared for.
+    int preparedChannelCount = 0;
+    int preparedSampleRate = 0;
+    int decimation = 1;
+    // Bins [bandStarts[i], bandStarts[i + 1]) make up band i.
+    std::vector<int> bandStarts;
+    // Decimated mono samples collected for the next analysis, and the sum and count of the
+    // input frames averaged into the next one.
+    std::vector<float> samples;
+    int sampleCount = 0;
+    float pendingSum = 0;
+    int pendingCount = 0;
+    // Input frames to skip before collecting, and decimated samples between analyses.
+    int64_t skipFrames = 0;
+    int hopSize = 0;
+
+    // Triple buffer: the writer fills snapshots[back], then swaps it with the middle one and
+    // marks that fresh; the reader swaps a fresh middle one with snapshots[front].
+    Snapshot snapshots[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle{2};
+    int64_t sequence = 0;
+};
+
+#endif //NEXTPLAYER_FFSPECTRUM_H
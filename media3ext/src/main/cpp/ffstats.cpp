@@ -0,0 +1,47 @@
+#include "ffstats.h"
+
+namespace {
+    // Bumped whenever the layout written by DecoderStats::writeTo changes.
+    const int64_t kStatsVersion = 1;
+}
+
+void LatencyHistogram::record(int64_t durationUs) {
+    if (durationUs < 0) {
+        durationUs = 0;
+    }
+    int bucket = 0;
+    for (int64_t value = durationUs >> 1; value && bucket < kBucketCount - 1; value >>= 1) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalUs.fetch_add(durationUs, std::memory_order_relaxed);
+    int64_t max = maxUs.load(std::memory_order_relaxed);
+    while (durationUs > max &&
+           !maxUs.compare_exchange_weak(max, durationUs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::writeTo(int64_t *out) const {
+    out[0] = count.load(std::memory_order_relaxed);
+    out[1] = totalUs.load(std::memory_order_relaxed);
+    out[2] = maxUs.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBucketCount; i++) {
+        out[3 + i] = buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+void DecoderStats::writeTo(int64_t *out) const {
+    // Header: version, counter count, timer count, bucket count. The counters and the
+    // serialized timers follow, in enum order.
+    out[0] = kStatsVersion;
+    out[1] = COUNTER_COUNT;
+    out[2] = TIMER_COUNT;
+    out[3] = LatencyHistogram::kBucketCount;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        out[kHeaderSize + i] = counters[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        timers[i].writeTo(out + kHeaderSize + COUNTER_COUNT + i * LatencyHistogram::kSerializedSize);
+    }
+}
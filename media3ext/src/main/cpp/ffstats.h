@@ -0,0 +1,122 @@
+#ifndef NEXTPLAYER_FFSTATS_H
+#define NEXTPLAYER_FFSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include "fftrace.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+/**
+ * Latency histogram with power-of-two buckets. Bucket i counts durations in
+ * [2^i, 2^(i+1)) microseconds; the first bucket also takes anything shorter and the last
+ * one anything longer. Safe to update from several threads.
+ */
+class LatencyHistogram {
+public:
+    static const int kBucketCount = 16;
+    // count, total, max and the buckets.
+    static const int kSerializedSize = 3 + kBucketCount;
+
+    void record(int64_t durationUs);
+
+    /**
+     * Writes kSerializedSize values to out.
+     */
+    void writeTo(int64_t *out) const;
+
+private:
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> totalUs{0};
+    std::atomic<int64_t> maxUs{0};
+    std::atomic<int64_t> buckets[kBucketCount]{};
+};
+
+// Counters and timers of DecoderStats. Must match FfmpegDecoderStats.
+enum DecoderCounter {
+    COUNTER_PACKETS_SENT,
+    COUNTER_BYTES_SENT,
+    COUNTER_FRAMES_DECODED,
+    COUNTER_FRAMES_DROPPED,
+    COUNTER_FRAMES_STASHED,
+    COUNTER_FRAMES_RENDERED,
+    COUNTER_BYTES_COPIED,
+    COUNTER_ALLOCATIONS,
+    COUNTER_TRIMS,
+    COUNTER_TRIM_BYTES_FREED,
+    COUNTER_CORRUPT_PACKETS,
+    COUNTER_PACKETS_DISCARDED,
+    COUNTER_COUNT
+};
+
+enum DecoderTimer {
+    TIMER_SEND_PACKET,
+    TIMER_RECEIVE_FRAME,
+    TIMER_DEINTERLACE,
+    TIMER_SCALE,
+    TIMER_WINDOW_LOCK,
+    TIMER_RENDER,
+    TIMER_RESAMPLE,
+    TIMER_RESUME,
+    TIMER_COUNT
+};
+
+/**
+ * Per-decoder performance counters and latency histograms.
+ */
+struct DecoderStats {
+    void add(DecoderCounter counter, int64_t value = 1) {
+        counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram &timer(DecoderTimer timer) { return timers[timer]; }
+
+    // Version, counter count, timer count and bucket count.
+    static const int kHeaderSize = 4;
+    // Header, counters and the serialized timers.
+    static const int kSerializedSize =
+            kHeaderSize + COUNTER_COUNT + TIMER_COUNT * LatencyHistogram::kSerializedSize;
+
+    /**
+     * Writes kSerializedSize values in the layout parsed by FfmpegDecoderStats to out.
+     */
+    void writeTo(int64_t *out) const;
+
+    std::atomic<int64_t> counters[COUNTER_COUNT]{};
+    LatencyHistogram timers[TIMER_COUNT];
+};
+
+/**
+ * Records the time spent in the enclosing scope into a histogram and, if a name is
+ * given, traces it as an ATrace section.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram &histogram, const char *traceName = nullptr)
+            : histogram(histogram), trace(traceName && fftrace::isEnabled()),
+              startUs(av_gettime_relative()) {
+        if (trace) {
+            fftrace::beginSection(traceName);
+        }
+    }
+
+    ~ScopedTimer() {
+        if (trace) {
+            fftrace::endSection();
+        }
+        histogram.record(av_gettime_relative() - startUs);
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    LatencyHistogram &histogram;
+    const bool trace;
+    const int64_t startUs;
+};
+
+#endif //NEXTPLAYER_FFSTATS_H
@@ -0,0 +1,400 @@
+#include <jni.h>
+#include <android/bitmap.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "ffcommon.h"
+#include "ffdiag.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define FF_SUBTITLE_NEON 1
+#endif
+
+// Must match FfmpegSubtitleParser.
+static const int SUBTITLE_INFO_HEADER_SIZE = 5;
+static const int SUBTITLE_INFO_RECT_SIZE = 5;
+
+namespace {
+    const int kPaletteSize = 256;
+#if FF_SUBTITLE_NEON
+    // vqtbl4q_u8 looks up 64 entries, so each channel of up to 64 colors fits four registers.
+    const int kNeonMaxColors = 64;
+#endif
+
+    /**
+     * A rect as it is composited on the canvas. The indices and the palette are kept to tell
+     * whether the next subtitle shows the same rect again.
+     */
+    struct ShownRect {
+        int x;
+        int y;
+        int width;
+        int height;
+        std::vector<uint8_t> indices;
+        uint32_t palette[kPaletteSize];
+    };
+
+    /**
+     * Decoder and the RGBA canvas of the subtitle plane. Only rects that differ from the
+     * previous subtitle are expanded into the canvas; the rest of it is kept as it is.
+     */
+    struct SubtitleContext {
+        AVCodecContext *codecContext = nullptr;
+        std::vector<uint8_t> packetData;
+        std::vector<uint32_t> canvas;
+        int canvasWidth = 0;
+        int canvasHeight = 0;
+        std::vector<ShownRect> shownRects;
+    };
+
+    /**
+     * Converts a palette of native endian 0xAARRGGBB entries to premultiplied RGBA as
+     * Android bitmaps store it.
+     */
+    void ConvertPalette(const uint32_t *argb, int colorCount, uint32_t *rgba) {
+        for (int i = 0; i < kPaletteSize; i++) {
+            uint32_t color = i < colorCount ? argb[i] : 0;
+            uint32_t a = color >> 24;
+            uint32_t r = ((color >> 16 & 0xFF) * a + 127) / 255;
+            uint32_t g = ((color >> 8 & 0xFF) * a + 127) / 255;
+            uint32_t b = ((color & 0xFF) * a + 127) / 255;
+            rgba[i] = r | g << 8 | b << 16 | a << 24;
+        }
+    }
+
+    void ExpandRowScalar(uint32_t *dst, const uint8_t *src, int count, const uint32_t *palette) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = palette[src[i]];
+        }
+    }
+
+#if FF_SUBTITLE_NEON
+    uint8_t MaxIndex(const uint8_t *src, int width, int height, int stride) {
+        uint8x16_t maxVector = vdupq_n_u8(0);
+        uint8_t maxScalar = 0;
+        for (int y = 0; y < height; y++) {
+            const uint8_t *row = src + y * stride;
+            int x = 0;
+            for (; x + 16 <= width; x += 16) {
+                maxVector = vmaxq_u8(maxVector, vld1q_u8(row + x));
+            }
+            for (; x < width; x++) {
+                maxScalar = std::max(maxScalar, row[x]);
+            }
+        }
+        return std::max(maxScalar, vmaxvq_u8(maxVector));
+    }
+
+    /**
+     * Expands 16 pixels per iteration with one table lookup per channel and an interleaving
+     * store. Requires all indices to be below kNeonMaxColors.
+     */
+    void ExpandRowNeon(uint32_t *dst, const uint8_t *src, int count, const uint8x16x4_t tables[4],
+                       const uint32_t *palette) {
+        int i = 0;
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t index = vld1q_u8(src + i);
+            uint8x16x4_t rgba;
+            rgba.val[0] = vqtbl4q_u8(tables[0], index);
+            rgba.val[1] = vqtbl4q_u8(tables[1], index);
+            rgba.val[2] = vqtbl4q_u8(tables[2], index);
+            rgba.val[3] = vqtbl4q_u8(tables[3], index);
+            vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), rgba);
+        }
+        ExpandRowScalar(dst + i, src + i, count - i, palette);
+    }
+#endif
+
+    /**
+     * Expands a rect of palette indices into the canvas.
+     */
+    void ExpandRect(SubtitleContext *context, const ShownRect &rect) {
+        uint32_t *dst = context->canvas.data() + rect.y * context->canvasWidth + rect.x;
+        const uint8_t *src = rect.indices.data();
+#if FF_SUBTITLE_NEON
+        if (MaxIndex(src, rect.width, rect.height, rect.width) < kNeonMaxColors) {
+            uint8_t planes[4][kNeonMaxColors];
+            for (int i = 0; i < kNeonMaxColors; i++) {
+                for (int channel = 0; channel < 4; channel++) {
+                    planes[channel][i] = rect.palette[i] >> (8 * channel);
+                }
+            }
+            uint8x16x4_t tables[4];
+            for (int channel = 0; channel < 4; channel++) {
+                tables[channel] = vld1q_u8_x4(planes[channel]);
+            }
+            for (int y = 0; y < rect.height; y++) {
+                ExpandRowNeon(dst + y * context->canvasWidth, src + y * rect.width, rect.width,
+                              tables, rect.palette);
+            }
+            return;
+        }
+#endif
+        for (int y = 0; y < rect.height; y++) {
+            ExpandRowScalar(dst + y * context->canvasWidth, src + y * rect.width, rect.width,
+                            rect.palette);
+        }
+    }
+
+    void ClearRect(SubtitleContext *context, const ShownRect &rect) {
+        for (int y = 0; y < rect.height; y++) {
+            uint32_t *row = context->canvas.data() + (rect.y + y) * context->canvasWidth + rect.x;
+            memset(row, 0, rect.width * sizeof(uint32_t));
+        }
+    }
+
+    bool Intersects(const ShownRect &a, const ShownRect &b) {
+        return a.x < b.x + b.width && b.x < a.x + a.width &&
+               a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    bool IsSameRect(const ShownRect &a, const ShownRect &b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height &&
+               a.indices == b.indices && !memcmp(a.palette, b.palette, sizeof(a.palette));
+    }
+
+    /**
+     * Copies the bitmap rects of subtitle, clipped to the canvas, into rects.
+     */
+    void CollectRects(const SubtitleContext *context, const AVSubtitle &subtitle,
+                      std::vector<ShownRect> *rects) {
+        for (unsigned int i = 0; i < subtitle.num_rects; i++) {
+            const AVSubtitleRect *source = subtitle.rects[i];
+            if (source->type != SUBTITLE_BITMAP || !source->data[0] || !source->data[1]) {
+                continue;
+            }
+            int left = std::max(source->x, 0);
+            int top = std::max(source->y, 0);
+            int right = std::min(source->x + source->w, context->canvasWidth);
+            int bottom = std::min(source->y + source->h, context->canvasHeight);
+            if (right <= left || bottom <= top) {
+                continue;
+            }
+            rects->emplace_back();
+            ShownRect &rect = rects->back();
+            rect.x = left;
+            rect.y = top;
+            rect.width = right - left;
+            rect.height = bottom - top;
+            rect.indices.resize(static_cast<size_t>(rect.width) * rect.height);
+            for (int y = 0; y < rect.height; y++) {
+                memcpy(rect.indices.data() + y * rect.width,
+                       source->data[0] + (top - source->y + y) * source->linesize[0] + (left - source->x),
+                       rect.width);
+            }
+            ConvertPalette(reinterpret_cast<const uint32_t *>(source->data[1]),
+                           std::min(source->nb_colors, kPaletteSize), rect.palette);
+        }
+    }
+
+    /**
+     * Returns the size of the subtitle plane. Decoders that do not know it leave the codec
+     * context size at 0, then the rects have to fit.
+     */
+    void GetPlaneSize(const AVCodecContext *codecContext, const AVSubtitle &subtitle,
+                      int *width, int *height) {
+        *width = codecContext->width;
+        *height = codecContext->height;
+        if (*width > 0 && *height > 0) {
+            return;
+        }
+        *width = *height = 0;
+        for (unsigned int i = 0; i < subtitle.num_rects; i++) {
+            const AVSubtitleRect *rect = subtitle.rects[i];
+            *width = std::max(*width, rect->x + rect->w);
+            *height = std::max(*height, rect->y + rect->h);
+        }
+    }
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSubtitleParser_ffmpegInitialize(
+        JNIEnv *env, jobject thiz, jstring codec_name, jbyteArray extra_data) {
+    AVCodec *codec = getCodecByName(env, codec_name);
+    if (!codec) {
+        LOGE("Codec not found.");
+        return 0L;
+    }
+    AVCodecContext *codecContext = avcodec_alloc_context3(codec);
+    if (!codecContext) {
+        LOGE("Failed to allocate context.");
+        return 0L;
+    }
+    if (extra_data) {
+        jsize size = env->GetArrayLength(extra_data);
+        codecContext->extradata_size = size;
+        codecContext->extradata = (uint8_t *) av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!codecContext->extradata) {
+            LOGE("Failed to allocate extra data.");
+            releaseContext(&codecContext);
+            return 0L;
+        }
+        env->GetByteArrayRegion(extra_data, 0, size, (jbyte *) codecContext->extradata);
+    }
+    int result = avcodec_open2(codecContext, codec, nullptr);
+    if (result < 0) {
+        logError("avcodec_open2", result);
+        releaseContext(&codecContext);
+        return 0L;
+    }
+    auto *context = new SubtitleContext();
+    context->codecContext = codecContext;
+    return reinterpret_cast<jlong>(context);
+}
+
+/**
+ * Decodes one subtitle packet. Returns null if it did not complete a subtitle, otherwise the
+ * plane width and height, the rect count and the start and end display times in milliseconds
+ * from the packet time (the end is -1 if the subtitle stays until the next one), followed by x,
+ * y, width, height and the index of the identical rect of the previous subtitle (or -1) for
+ * every rect.
+ */
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSubtitleParser_ffmpegDecode(
+        JNIEnv *env, jobject thiz, jlong jContext, jbyteArray data, jint offset, jint length) {
+    auto *context = reinterpret_cast<SubtitleContext *>(jContext);
+    context->packetData.resize(length + AV_INPUT_BUFFER_PADDING_SIZE);
+    env->GetByteArrayRegion(data, offset, length, reinterpret_cast<jbyte *>(context->packetData.data()));
+    memset(context->packetData.data() + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        LOGE("Failed to allocate packet.");
+        return nullptr;
+    }
+    packet->data = context->packetData.data();
+    packet->size = length;
+    AVSubtitle subtitle{};
+    int gotSubtitle = 0;
+    int result = avcodec_decode_subtitle2(context->codecContext, &subtitle, &gotSubtitle, packet);
+    av_packet_free(&packet);
+    if (result < 0) {
+        logError("avcodec_decode_subtitle2", result);
+        return nullptr;
+    }
+    if (!gotSubtitle) {
+        return nullptr;
+    }
+
+    int planeWidth;
+    int planeHeight;
+    GetPlaneSize(context->codecContext, subtitle, &planeWidth, &planeHeight);
+    if (planeWidth != context->canvasWidth || planeHeight != context->canvasHeight) {
+        context->canvasWidth = planeWidth;
+        context->canvasHeight = planeHeight;
+        context->canvas.assign(static_cast<size_t>(planeWidth) * planeHeight, 0);
+        context->shownRects.clear();
+    }
+    std::vector<ShownRect> rects;
+    CollectRects(context, subtitle, &rects);
+    uint32_t startDisplayTime = subtitle.start_display_time;
+    // PGS has no end time and leaves UINT32_MAX; DVB and VobSub set their timeouts.
+    uint32_t endDisplayTime = subtitle.end_display_time;
+    avsubtitle_free(&subtitle);
+
+    // Match the new rects against the shown ones, clear the shown rects that are gone and
+    // expand the new rects that changed or were partly cleared.
+    std::vector<int> previousIndices(rects.size(), -1);
+    std::vector<bool> kept(context->shownRects.size(), false);
+    for (size_t i = 0; i < rects.size(); i++) {
+        for (size_t j = 0; j < context->shownRects.size(); j++) {
+            if (!kept[j] && IsSameRect(rects[i], context->shownRects[j])) {
+                previousIndices[i] = static_cast<int>(j);
+                kept[j] = true;
+                break;
+            }
+        }
+    }
+    for (size_t j = 0; j < context->shownRects.size(); j++) {
+        if (kept[j]) {
+            continue;
+        }
+        ClearRect(context, context->shownRects[j]);
+        for (size_t i = 0; i < rects.size(); i++) {
+            if (previousIndices[i] >= 0 && Intersects(rects[i], context->shownRects[j])) {
+                previousIndices[i] = -1;
+            }
+        }
+    }
+    int expandedRects = 0;
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (previousIndices[i] < 0) {
+            ExpandRect(context, rects[i]);
+            expandedRects++;
+        }
+    }
+    DIAGV(DIAG_SUBTITLE_DECODED, rects.size(), expandedRects);
+
+    std::vector<jint> info(SUBTITLE_INFO_HEADER_SIZE + rects.size() * SUBTITLE_INFO_RECT_SIZE);
+    info[0] = planeWidth;
+    info[1] = planeHeight;
+    info[2] = static_cast<jint>(rects.size());
+    info[3] = static_cast<jint>(std::min<uint32_t>(startDisplayTime, INT32_MAX));
+    info[4] = endDisplayTime > startDisplayTime && endDisplayTime <= INT32_MAX
+              ? static_cast<jint>(endDisplayTime) : -1;
+    for (size_t i = 0; i < rects.size(); i++) {
+        jint *rectInfo = info.data() + SUBTITLE_INFO_HEADER_SIZE + i * SUBTITLE_INFO_RECT_SIZE;
+        rectInfo[0] = rects[i].x;
+        rectInfo[1] = rects[i].y;
+        rectInfo[2] = rects[i].width;
+        rectInfo[3] = rects[i].height;
+        rectInfo[4] = previousIndices[i];
+    }
+    context->shownRects.swap(rects);
+
+    jintArray infoArray = env->NewIntArray(static_cast<jsize>(info.size()));
+    if (!infoArray) {
+        return nullptr;
+    }
+    env->SetIntArrayRegion(infoArray, 0, static_cast<jsize>(info.size()), info.data());
+    return infoArray;
+}
+
+/**
+ * Copies rect index of the last decoded subtitle from the canvas into bitmap, which must be
+ * an RGBA_8888 bitmap of the size of the rect.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSubtitleParser_ffmpegCopyRect(
+        JNIEnv *env, jobject thiz, jlong jContext, jint index, jobject bitmap) {
+    auto *context = reinterpret_cast<SubtitleContext *>(jContext);
+    if (index < 0 || index >= static_cast<int>(context->shownRects.size())) {
+        return false;
+    }
+    const ShownRect &rect = context->shownRects[index];
+    AndroidBitmapInfo bitmapInfo;
+    if (AndroidBitmap_getInfo(env, bitmap, &bitmapInfo) != ANDROID_BITMAP_RESULT_SUCCESS ||
+        bitmapInfo.format != ANDROID_BITMAP_FORMAT_RGBA_8888 ||
+        static_cast<int>(bitmapInfo.width) != rect.width ||
+        static_cast<int>(bitmapInfo.height) != rect.height) {
+        LOGE("Unexpected subtitle bitmap.");
+        return false;
+    }
+    void *pixels;
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) {
+        LOGE("AndroidBitmap_lockPixels failed.");
+        return false;
+    }
+    for (int y = 0; y < rect.height; y++) {
+        memcpy(static_cast<uint8_t *>(pixels) + y * bitmapInfo.stride,
+               context->canvas.data() + (rect.y + y) * context->canvasWidth + rect.x,
+               rect.width * sizeof(uint32_t));
+    }
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return true;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegSubtitleParser_ffmpegRelease(
+        JNIEnv *env, jobject thiz, jlong jContext) {
+    auto *context = reinterpret_cast<SubtitleContext *>(jContext);
+    if (context) {
+        releaseContext(&context->codecContext);
+        delete context;
+    }
+}
@@ -0,0 +1,64 @@
+#include "ffthreadpool.h"
+
+SliceThreadPool::SliceThreadPool(int workerCount) {
+    for (int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&SliceThreadPool::workerLoop, this);
+    }
+}
+
+SliceThreadPool::~SliceThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void SliceThreadPool::run(int count, const std::function<void(int)> &job) {
+    if (count <= 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    currentJob = &job;
+    nextSlice = 0;
+    sliceCount = count;
+    pendingSlices = count;
+    generation++;
+    if (count > 1) {
+        wakeUp.notify_all();
+    }
+    runPendingSlices(lock);
+    finished.wait(lock, [this] { return pendingSlices == 0; });
+    currentJob = nullptr;
+}
+
+void SliceThreadPool::workerLoop() {
+    uint64_t seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeUp.wait(lock, [&] {
+            return stopping || (generation != seenGeneration && nextSlice < sliceCount);
+        });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+        runPendingSlices(lock);
+    }
+}
+
+void SliceThreadPool::runPendingSlices(std::unique_lock<std::mutex> &lock) {
+    while (nextSlice < sliceCount) {
+        int slice = nextSlice++;
+        const std::function<void(int)> &job = *currentJob;
+        lock.unlock();
+        job(slice);
+        lock.lock();
+        if (--pendingSlices == 0) {
+            finished.notify_all();
+        }
+    }
+}
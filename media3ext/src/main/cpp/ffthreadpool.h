@@ -0,0 +1,53 @@
+#ifndef NEXTPLAYER_FFTHREADPOOL_H
+#define NEXTPLAYER_FFTHREADPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size pool of worker threads that runs one job split into slices at a time.
+ * The calling thread takes part in the work, so a pool with N workers processes
+ * up to N + 1 slices concurrently.
+ */
+class SliceThreadPool {
+public:
+    explicit SliceThreadPool(int workerCount);
+
+    ~SliceThreadPool();
+
+    /**
+     * Returns how many slices can run at the same time, including the calling thread.
+     */
+    int concurrency() const { return static_cast<int>(workers.size()) + 1; }
+
+    /**
+     * Runs job(i) for every i in [0, sliceCount) and returns once all slices are done.
+     * Must not be called concurrently from several threads.
+     */
+    void run(int sliceCount, const std::function<void(int)> &job);
+
+private:
+    void workerLoop();
+
+    /**
+     * Runs slices of the current job until none are left. Called with the mutex held.
+     */
+    void runPendingSlices(std::unique_lock<std::mutex> &lock);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    const std::function<void(int)> *currentJob = nullptr;
+    uint64_t generation = 0;
+    int nextSlice = 0;
+    int sliceCount = 0;
+    int pendingSlices = 0;
+    bool stopping = false;
+};
+
+#endif //NEXTPLAYER_FFTHREADPOOL_H
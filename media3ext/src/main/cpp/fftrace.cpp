@@ -0,0 +1,52 @@
+#include <dlfcn.h>
+#include <mutex>
+#include "fftrace.h"
+
+namespace {
+    struct ATraceFunctions {
+        void (*beginSection)(const char *sectionName) = nullptr;
+        void (*endSection)() = nullptr;
+        bool (*isEnabled)() = nullptr;
+    };
+
+    const ATraceFunctions &getATrace() {
+        static ATraceFunctions functions;
+        static std::once_flag loaded;
+        std::call_once(loaded, [] {
+            // libandroid is already loaded by the process, this only takes another reference.
+            void *library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+            if (!library) {
+                return;
+            }
+            auto beginSection = reinterpret_cast<void (*)(const char *)>(
+                    dlsym(library, "ATrace_beginSection"));
+            auto endSection = reinterpret_cast<void (*)()>(dlsym(library, "ATrace_endSection"));
+            auto isEnabled = reinterpret_cast<bool (*)()>(dlsym(library, "ATrace_isEnabled"));
+            if (beginSection && endSection && isEnabled) {
+                functions.beginSection = beginSection;
+                functions.endSection = endSection;
+                functions.isEnabled = isEnabled;
+            }
+        });
+        return functions;
+    }
+}
+
+bool fftrace::isEnabled() {
+    const ATraceFunctions &atrace = getATrace();
+    return atrace.isEnabled && atrace.isEnabled();
+}
+
+void fftrace::beginSection(const char *sectionName) {
+    const ATraceFunctions &atrace = getATrace();
+    if (atrace.beginSection) {
+        atrace.beginSection(sectionName);
+    }
+}
+
+void fftrace::endSection() {
+    const ATraceFunctions &atrace = getATrace();
+    if (atrace.endSection) {
+        atrace.endSection();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef NEXTPLAYER_FFTRACE_H
+#define NEXTPLAYER_FFTRACE_H
+
+/**
+ * Systrace/Perfetto sections from native code. The ATrace_* functions exist from API 23
+ * on while we support API 21, so they are looked up from libandroid at runtime and the
+ * calls do nothing where they are missing.
+ */
+namespace fftrace {
+    bool isEnabled();
+
+    void beginSection(const char *sectionName);
+
+    void endSection();
+}
+
+/**
+ * Traces the enclosing scope as a section with the given name. The name must outlive the
+ * object, which string literals do.
+ */
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char *sectionName) : active(fftrace::isEnabled()) {
+        if (active) {
+            fftrace::beginSection(sectionName);
+        }
+    }
+
+    ~ScopedTrace() {
+        if (active) {
+            fftrace::endSection();
+        }
+    }
+
+    ScopedTrace(const ScopedTrace &) = delete;
+
+    ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+private:
+    const bool active;
+};
+
+#endif //NEXTPLAYER_FFTRACE_H
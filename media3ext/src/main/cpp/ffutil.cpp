@@ -0,0 +1,22 @@
+#include "ffutil.h"
+#include "ffdiag.h"
+
+void releaseContext(AVCodecContext **context) {
+    if (!context || !*context) {
+        return;
+    }
+    SwrContext *swrContext = reinterpret_cast<SwrContext *>((*context)->opaque);
+    if (swrContext) {
+        swr_free(&swrContext);
+        (*context)->opaque = nullptr;
+    }
+    av_freep(&(*context)->extradata);
+    avcodec_free_context(context);
+}
+
+void logError(const char *functionName, int errorNumber) {
+    char buffer[ERROR_STRING_BUFFER_LENGTH];
+    av_strerror(errorNumber, buffer, ERROR_STRING_BUFFER_LENGTH);
+    LOGE("Error in %s: %s", functionName, buffer);
+    DIAGE(DIAG_AV_ERROR, functionName, errorNumber, 0);
+}
@@ -0,0 +1,51 @@
+#ifndef NEXTPLAYER_FFUTIL_H
+#define NEXTPLAYER_FFUTIL_H
+
+/**
+ * Logging and libavcodec helpers without JNI, shared by the JNI code and the host tools.
+ * Logs go to logcat on Android and to stderr elsewhere.
+ */
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include "libswresample/swresample.h"
+};
+
+#define LOG_TAG "ffmpeg_jni"
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGE(...) \
+  ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
+#ifndef NDEBUG
+# define LOGV(...)  __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+# define LOGI(...)  __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+# define LOGW(...)  __android_log_print(ANDROID_LOG_WARNING, LOG_TAG, __VA_ARGS__)
+#endif
+#else
+#include <cstdio>
+#define FF_HOST_LOG(...) ((void)fprintf(stderr, LOG_TAG ": " __VA_ARGS__), (void)fputc('\n', stderr))
+#define LOGE(...) FF_HOST_LOG(__VA_ARGS__)
+#ifndef NDEBUG
+# define LOGV(...)  FF_HOST_LOG(__VA_ARGS__)
+# define LOGI(...)  FF_HOST_LOG(__VA_ARGS__)
+# define LOGW(...)  FF_HOST_LOG(__VA_ARGS__)
+#endif
+#endif
+#ifdef NDEBUG
+# define LOGV(...)  (void)0
+# define LOGI(...)  (void)0
+# define LOGW(...)  (void)0
+#endif
+#define ERROR_STRING_BUFFER_LENGTH 256
+
+/**
+ * Releases the specified context.
+ */
+void releaseContext(AVCodecContext **context);
+
+/**
+ * Outputs a log message describing the avcodec error number.
+ */
+void logError(const char *functionName, int errorNumber);
+
+#endif //NEXTPLAYER_FFUTIL_H
@@ -2,11 +2,21 @@
 #include <android/log.h>
 #include <jni.h>
 #include <cstdlib>
+#include <dlfcn.h>
+#include <malloc.h>
 #include <android/native_window_jni.h>
+#include <android/bitmap.h>
 #include <algorithm>
 #include "ffcommon.h"
+#include "ffdeinterlace.h"
+#include "ffrenderworker.h"
+#include "ffdiag.h"
+#include "ffstats.h"
 #include <mutex>
 #include <deque>
+#include <memory>
+#include <atomic>
+#include <vector>
 extern "C" {
 #ifdef __cplusplus
 #define __STDC_CONSTANT_MACROS
@@ -30,6 +40,7 @@ static const int VIDEO_DECODER_NEED_MORE_FRAME = -1;
 static const int VIDEO_DECODER_ERROR_OTHER = -2;
 static const int VIDEO_DECODER_ERROR_READ_FRAME = -3;
 static const int VIDEO_DECODER_ERROR_INVALID_DATA = -4;
+static const int VIDEO_DECODER_PACKET_DISCARDED = -5;
 static const int VIDEO_DECODER_DROP_FRAME = 1;
 
 namespace {
@@ -43,15 +54,43 @@ namespace {
 // https://developer.android.com/reference/android/graphics/ImageFormat.html#YV12.
     const int kImageFormatYV12 = 0x32315659;
     constexpr int AlignTo16(int value) { return (value + 15) & (~15); }
+
+// ANativeWindow_lock result for a window whose surface was abandoned (-ENODEV).
+    const int kWindowAbandoned = -19;
+
+// Marks the clone of an interlaced frame that shows its second field (double-rate mode).
+    const char kSecondFieldMarker = 0;
+// Field duration used when the stream doesn't report a frame rate, in microseconds (50i).
+    const int64_t kDefaultFieldDurationUs = 20000;
+
+// Fits width x height into the window, keeping the aspect ratio. Never scales up and
+// returns even dimensions so the chroma planes of the YV12 buffer line up.
+    void FitToWindow(int width, int height, int window_width, int window_height,
+                     int *out_width, int *out_height) {
+        *out_width = width;
+        *out_height = height;
+        if (window_width <= 0 || window_height <= 0 ||
+            (width <= window_width && height <= window_height)) {
+            return;
+        }
+        double scale = std::min((double) window_width / width, (double) window_height / height);
+        *out_width = std::max(2, static_cast<int>(width * scale) & ~1);
+        *out_height = std::max(2, static_cast<int>(height * scale) & ~1);
+    }
 }
 struct JniContext {
     ~JniContext() {
         LOGI("~JniContext()");
+        render_worker.reset();
         clear_frames();
         if (native_window) {
             LOGI("Release native_window");
             ANativeWindow_release(native_window);
         }
+        if (geometry_window) {
+            ANativeWindow_release(geometry_window);
+        }
+        av_frame_free(&last_rendered_frame);
     }
 
     bool MaybeAcquireNativeWindow(JNIEnv *env, jobject new_surface) {
@@ -79,8 +118,6 @@ struct JniContext {
             surface = nullptr;
         }
         LOGI("New Surface");
-        native_window_width = 0;
-        native_window_height = 0;
         native_window = ANativeWindow_fromSurface(env, new_surface);
         if (native_window == nullptr) {
             LOGE("kJniStatusANativeWindowError");
@@ -110,14 +147,78 @@ struct JniContext {
     jmethodID isAtLeastOutputStartTimeUs_method{};
     jmethodID add_skip_buffer_count_method{};
 
+    // Null after a trim until the next packet reopens it.
     AVCodecContext *codecContext{};
     SwsContext *swsContext{};
+    // What the codec context was opened with, to reopen it after a trim.
+    const AVCodec *codec = nullptr;
+    std::vector<uint8_t> extra_data;
+    int threads = 0;
+    int lowres = 0;
+    // Time the codec context was reopened after a trim, until its first frame is decoded.
+    int64_t resume_start_us = AV_NOPTS_VALUE;
+    // Set after corrupt input or a trim: packets are discarded until the next keyframe.
+    bool awaiting_keyframe = false;
+    int64_t discarded_since_resync = 0;
 
     ANativeWindow *native_window = nullptr;
     jobject surface = nullptr;
     int rotate_degree = 0;
+    // State below is owned by the thread that renders: the renderer thread, or the
+    // render worker when there is one.
+    // Window the buffer geometry was set on, holding a reference.
+    ANativeWindow *geometry_window = nullptr;
     int native_window_width = 0;
     int native_window_height = 0;
+    int native_window_natural_width = 0;
+    int native_window_natural_height = 0;
+    // Source size and format the swsContext was created for.
+    int scale_source_width = 0;
+    int scale_source_height = 0;
+    int scale_source_format = AV_PIX_FMT_NONE;
+
+    int deinterlace_mode = DEINTERLACE_MODE_OFF;
+    std::unique_ptr<Deinterlacer> deinterlacer;
+    // Set on flush, the rendering thread resets the deinterlacer before the next frame.
+    std::atomic<bool> deinterlacer_reset_pending{false};
+
+    std::unique_ptr<RenderWorker> render_worker;
+    // Set by the render worker when the window's surface is gone and has to be reacquired.
+    std::atomic<bool> window_abandoned{false};
+    std::atomic<int64_t> last_presented_pts{AV_NOPTS_VALUE};
+
+    DecoderStats stats;
+
+    /**
+     * Keeps a reference to frame as the one currently on screen.
+     */
+    void set_last_rendered(const AVFrame *frame) {
+        std::lock_guard<std::mutex> lock(last_rendered_mutex);
+        if (!last_rendered_frame) {
+            last_rendered_frame = av_frame_alloc();
+            if (!last_rendered_frame) return;
+        }
+        av_frame_unref(last_rendered_frame);
+        if (av_frame_ref(last_rendered_frame, frame) < 0) {
+            av_frame_unref(last_rendered_frame);
+        }
+    }
+
+    void release_last_rendered() {
+        std::lock_guard<std::mutex> lock(last_rendered_mutex);
+        av_frame_free(&last_rendered_frame);
+    }
+
+    /**
+     * Returns a new reference to the frame currently on screen, or nullptr. Free with
+     * av_frame_free.
+     */
+    AVFrame *ref_last_rendered() {
+        std::lock_guard<std::mutex> lock(last_rendered_mutex);
+        if (!last_rendered_frame || !last_rendered_frame->buf[0]) return nullptr;
+        return av_frame_clone(last_rendered_frame);
+    }
+
     void push_frame(AVFrame* frame) {
         std::lock_guard<std::mutex> lock(mutex_);
         stashed_frames.push_back(frame);
@@ -148,29 +249,33 @@ struct JniContext {
 private:
     std::deque<AVFrame*> stashed_frames;
     std::mutex mutex_;
+    AVFrame *last_rendered_frame = nullptr;
+    std::mutex last_rendered_mutex;
 };
 
-JniContext *createVideoContext(JNIEnv *env,
-                               AVCodec *codec,
-                               jbyteArray extraData,
-                               jint threads,
-                               jint degree) {
+static int RenderToWindow(JniContext *jniContext, ANativeWindow *window, AVFrame *frame,
+                          int surface_width, int surface_height);
+
+/**
+ * Allocates and opens a decoder context. Returns nullptr on failure.
+ */
+static AVCodecContext *OpenCodecContext(const AVCodec *codec, const std::vector<uint8_t> &extraData,
+                                        int threads, int lowres) {
     AVCodecContext *codecContext = avcodec_alloc_context3(codec);
     if (!codecContext) {
         LOGE("Failed to allocate context.");
         return nullptr;
     }
 
-    if (extraData) {
-        jsize size = env->GetArrayLength(extraData);
-        codecContext->extradata_size = size;
-        codecContext->extradata = (uint8_t *) av_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!extraData.empty()) {
+        codecContext->extradata_size = static_cast<int>(extraData.size());
+        codecContext->extradata = (uint8_t *) av_mallocz(extraData.size() + AV_INPUT_BUFFER_PADDING_SIZE);
         if (!codecContext->extradata) {
             LOGE("Failed to allocate extradata.");
             releaseContext(&codecContext);
             return nullptr;
         }
-        env->GetByteArrayRegion(extraData, 0, size, (jbyte *) codecContext->extradata);
+        memcpy(codecContext->extradata, extraData.data(), extraData.size());
     }
 
     // opt decode speed.
@@ -179,12 +284,84 @@ JniContext *createVideoContext(JNIEnv *env,
     codecContext->thread_count = threads;
     codecContext->thread_type = FF_THREAD_FRAME;
     codecContext->err_recognition = AV_EF_IGNORE_ERR;
+    // Decode at 1/2^lowres of the coded size, for codecs that support it.
+    codecContext->lowres = std::min<int>(std::max(lowres, 0), codec->max_lowres);
+    if (codecContext->lowres) {
+        LOGI("Decoding %s with lowres %d", codec->name, codecContext->lowres);
+    }
     int result = avcodec_open2(codecContext, codec, nullptr);
     if (result < 0) {
         logError("avcodec_open2", result);
         releaseContext(&codecContext);
         return nullptr;
     }
+    return codecContext;
+}
+
+/**
+ * Reopens the codec context if it was freed by a trim. Returns whether there is one.
+ */
+static bool EnsureCodecContext(JniContext *jniContext) {
+    if (jniContext->codecContext) {
+        return true;
+    }
+    jniContext->resume_start_us = av_gettime_relative();
+    jniContext->codecContext = OpenCodecContext(jniContext->codec, jniContext->extra_data,
+                                                jniContext->threads, jniContext->lowres);
+    jniContext->stats.add(COUNTER_ALLOCATIONS);
+    return jniContext->codecContext != nullptr;
+}
+
+/**
+ * Counts a decoded frame and, for the first frame after a trim, records how long resuming
+ * took.
+ */
+static void OnFrameDecoded(JniContext *jniContext) {
+    jniContext->stats.add(COUNTER_FRAMES_DECODED);
+    if (jniContext->resume_start_us != AV_NOPTS_VALUE) {
+        jniContext->stats.timer(TIMER_RESUME).record(av_gettime_relative() - jniContext->resume_start_us);
+        jniContext->resume_start_us = AV_NOPTS_VALUE;
+    }
+}
+
+/**
+ * Returns whether a packet has to be discarded because the decoder is waiting for a keyframe
+ * to resync on. Only packets are dropped, the codec is not flushed: its frame threads and the
+ * frames already in flight are kept, so decoding picks up within one GOP.
+ */
+static bool ShouldDiscardPacket(JniContext *jniContext, bool keyFrame, int64_t pts) {
+    if (!jniContext->awaiting_keyframe) {
+        return false;
+    }
+    if (!keyFrame) {
+        jniContext->discarded_since_resync++;
+        jniContext->stats.add(COUNTER_PACKETS_DISCARDED);
+        return true;
+    }
+    DIAGI(DIAG_RESYNC, jniContext->discarded_since_resync, pts);
+    jniContext->awaiting_keyframe = false;
+    jniContext->discarded_since_resync = 0;
+    return false;
+}
+
+JniContext *createVideoContext(JNIEnv *env,
+                               AVCodec *codec,
+                               jbyteArray extraData,
+                               jint threads,
+                               jint degree,
+                               jint deinterlaceMode,
+                               jint lowres,
+                               jboolean asyncRender) {
+    std::vector<uint8_t> extraDataCopy;
+    if (extraData) {
+        extraDataCopy.resize(env->GetArrayLength(extraData));
+        env->GetByteArrayRegion(extraData, 0, static_cast<jsize>(extraDataCopy.size()),
+                                reinterpret_cast<jbyte *>(extraDataCopy.data()));
+    }
+    AVCodecContext *codecContext = OpenCodecContext(codec, extraDataCopy, threads, lowres);
+    if (!codecContext) {
+        return nullptr;
+    }
 
     auto *jniContext = new JniContext();
     if (!jniContext) {
@@ -195,8 +372,13 @@ JniContext *createVideoContext(JNIEnv *env,
 
     // rotate
     jniContext->rotate_degree = degree;
+    jniContext->deinterlace_mode = deinterlaceMode;
 
     jniContext->codecContext = codecContext;
+    jniContext->codec = codec;
+    jniContext->extra_data.swap(extraDataCopy);
+    jniContext->threads = threads;
+    jniContext->lowres = lowres;
 
     // Populate JNI References.
     jclass outputBufferClass = env->FindClass("androidx/media3/decoder/VideoDecoderOutputBuffer");
@@ -238,6 +420,17 @@ JniContext *createVideoContext(JNIEnv *env,
         return nullptr;
     }
 
+    if (asyncRender) {
+        jniContext->render_worker.reset(new RenderWorker(
+                [jniContext](ANativeWindow *window, AVFrame *frame, int surfaceWidth, int surfaceHeight) {
+                    int result = RenderToWindow(jniContext, window, frame, surfaceWidth, surfaceHeight);
+                    if (result == kWindowAbandoned) {
+                        jniContext->window_abandoned = true;
+                    }
+                    return result == VIDEO_DECODER_SUCCESS;
+                }));
+    }
+
     return jniContext;
 }
 
@@ -249,14 +442,18 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
                                                                                  jstring codec_name,
                                                                                  jbyteArray extra_data,
                                                                                  jint threads,
-                                                                                 jint degree) {
+                                                                                 jint degree,
+                                                                                 jint deinterlace_mode,
+                                                                                 jint lowres,
+                                                                                 jboolean async_render) {
     AVCodec *codec = getCodecByName(env, codec_name);
     if (!codec) {
         LOGE("Codec not found.");
         return 0L;
     }
 
-    return (jlong) createVideoContext(env, codec, extra_data, threads ,degree);
+    return (jlong) createVideoContext(env, codec, extra_data, threads, degree, deinterlace_mode, lowres,
+                                      async_render);
 }
 
 extern "C"
@@ -268,13 +465,17 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
     }
     auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
     jniContext->clear_frames();
+    if (jniContext->render_worker) {
+        jniContext->render_worker->flush();
+    }
+    jniContext->deinterlacer_reset_pending = true;
+    jniContext->awaiting_keyframe = false;
+    jniContext->discarded_since_resync = 0;
     AVCodecContext *context = jniContext->codecContext;
-    if (!context) {
-        LOGE("Tried to reset without a context.");
-        return 0L;
+    if (context) {
+        // Without a context the decoder is trimmed and starts afresh anyway.
+        avcodec_flush_buffers(context);
     }
-
-    avcodec_flush_buffers(context);
     return (jlong) jniContext;
 }
 
@@ -286,6 +487,8 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
         return;
     }
     auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    // Stop the render worker first, it uses the scaler.
+    jniContext->render_worker.reset();
     AVCodecContext *context = jniContext->codecContext;
     SwsContext *swsContext = jniContext->swsContext;
     auto surface = jniContext->surface;
@@ -303,88 +506,157 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
     delete jniContext;
 }
 
-extern "C"
-JNIEXPORT jint JNICALL
-Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegRenderFrame(JNIEnv *env,
-                                                                                  jobject thiz,
-                                                                                  jlong jContext,
-                                                                                  jobject surface,
-                                                                                  jobject output_buffer) {
-    if (jContext == 0){
-        return VIDEO_DECODER_ERROR_OTHER;
+/**
+ * Points src and src_stride at the planes of frame, deinterlaced if it is interlaced and
+ * deinterlacing is on. The clone made by PushSecondField is built from its second field.
+ */
+static void DeinterlaceFrame(JniContext *jniContext, const AVFrame *frame, uint8_t *src[4],
+                             int src_stride[4]) {
+    if (jniContext->deinterlacer_reset_pending.exchange(false) && jniContext->deinterlacer) {
+        jniContext->deinterlacer->reset();
     }
-    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
-    AVFrame* frame = reinterpret_cast<AVFrame*>(
-            env->GetLongField(output_buffer, jniContext->decoder_private_field));
-    if (frame == nullptr) {
-        LOGE("Failed to get frame.");
-        return VIDEO_DECODER_SUCCESS;
+    for (int i = 0; i < 4; i++) {
+        src[i] = frame->data[i];
+        src_stride[i] = frame->linesize[i];
+    }
+    if (jniContext->deinterlace_mode == DEINTERLACE_MODE_OFF ||
+        !(frame->flags & AV_FRAME_FLAG_INTERLACED)) {
+        return;
+    }
+    if (!jniContext->deinterlacer) {
+        jniContext->deinterlacer.reset(new Deinterlacer());
     }
+    int field = (frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) ? 0 : 1;
+    if (frame->opaque == &kSecondFieldMarker) {
+        field ^= 1;
+    }
+    ScopedTimer timer(jniContext->stats.timer(TIMER_DEINTERLACE), "Deinterlace");
+    Deinterlacer *deinterlacer = jniContext->deinterlacer.get();
+    if (deinterlacer->process(frame, field, src, src_stride) &&
+        deinterlacer->frameCount() % 300 == 1) {
+        DIAGI(DIAG_DEINTERLACE_COST, deinterlacer->frameCount(), deinterlacer->averageCostUs());
+    }
+}
 
-    auto displayed_width = env->GetIntField(output_buffer, jniContext->display_width_field);
-    auto displayed_height = env->GetIntField(output_buffer, jniContext->display_height_field);
-    retry_acquire:
-    if (!jniContext->MaybeAcquireNativeWindow(env, surface)) {
-        return VIDEO_DECODER_ERROR_OTHER;
+/**
+ * Stashes a copy of an interlaced frame that is output from its second field, half a frame
+ * later, in double-rate mode.
+ */
+static void PushSecondField(JniContext *jniContext, const AVFrame *first) {
+    if (jniContext->deinterlace_mode != DEINTERLACE_MODE_DOUBLE_RATE ||
+        !(first->flags & AV_FRAME_FLAG_INTERLACED) || first->pts == AV_NOPTS_VALUE ||
+        !Deinterlacer::supportsFormat(first->format)) {
+        return;
     }
-    if (jniContext->native_window_width != displayed_width ||
-        jniContext->native_window_height != displayed_height) {
-        LOGI("ANativeWindow_setBuffersGeometry width: %d height %d\nCurrent window: width: %d height: %d"
-             ,displayed_width,displayed_height,jniContext->native_window_width,jniContext->native_window_height);
-        if (ANativeWindow_setBuffersGeometry(
-                jniContext->native_window,
-                displayed_width,
-                displayed_height,
-                kImageFormatYV12)) {
-            LOGE("kJniStatusANativeWindowError");
-            return VIDEO_DECODER_ERROR_OTHER;
-        }
+    AVFrame *second = av_frame_clone(first);
+    jniContext->stats.add(COUNTER_ALLOCATIONS);
+    if (!second) {
+        return;
+    }
+    AVRational frameRate = jniContext->codecContext->framerate;
+    second->opaque = (void *) &kSecondFieldMarker;
+    second->pts += frameRate.num > 0 && frameRate.den > 0
+                   ? av_rescale(1000000, frameRate.den, 2LL * frameRate.num)
+                   : kDefaultFieldDurationUs;
+    jniContext->push_frame(second);
+    jniContext->stats.add(COUNTER_FRAMES_STASHED);
+}
 
-        jniContext->native_window_width = displayed_width;
-        jniContext->native_window_height = displayed_height;
+/**
+ * Deinterlaces and scales frame into the next buffer of window and posts it. Runs on the
+ * renderer thread, or on the render worker if the context has one. Returns
+ * VIDEO_DECODER_SUCCESS, VIDEO_DECODER_ERROR_OTHER or kWindowAbandoned.
+ */
+static int RenderToWindow(JniContext *jniContext, ANativeWindow *window, AVFrame *frame,
+                          int surface_width, int surface_height) {
+    ScopedTimer renderTimer(jniContext->stats.timer(TIMER_RENDER), "RenderToWindow");
+    auto displayed_width = frame->width;
+    auto displayed_height = frame->height;
+
+    // Deinterlace before locking the window so the buffer is held only for the copy.
+    uint8_t *src[4];
+    int src_stride[4];
+    DeinterlaceFrame(jniContext, frame, src, src_stride);
+
+    if (window != jniContext->geometry_window) {
+        if (jniContext->geometry_window) {
+            ANativeWindow_release(jniContext->geometry_window);
+        }
+        ANativeWindow_acquire(window);
+        jniContext->geometry_window = window;
+        // Before setBuffersGeometry the window reports the size of the surface itself.
+        jniContext->native_window_natural_width = ANativeWindow_getWidth(window);
+        jniContext->native_window_natural_height = ANativeWindow_getHeight(window);
+        jniContext->native_window_width = 0;
+        jniContext->native_window_height = 0;
+    }
+    {
+        // Scale straight down to the size the window is shown at, as reported by the player
+        // or read from the window when it was acquired.
+        int window_width = surface_width > 0 ? surface_width : jniContext->native_window_natural_width;
+        int window_height = surface_height > 0 ? surface_height : jniContext->native_window_natural_height;
+        if (jniContext->rotate_degree % 180 != 0) {
+            std::swap(window_width, window_height);
+        }
+        int target_width;
+        int target_height;
+        FitToWindow(displayed_width, displayed_height, window_width, window_height,
+                    &target_width, &target_height);
+
+        if (jniContext->native_window_width != target_width ||
+            jniContext->native_window_height != target_height) {
+            DIAGI(DIAG_WINDOW_GEOMETRY, target_width, target_height);
+            if (ANativeWindow_setBuffersGeometry(
+                    window,
+                    target_width,
+                    target_height,
+                    kImageFormatYV12)) {
+                LOGE("kJniStatusANativeWindowError");
+                return VIDEO_DECODER_ERROR_OTHER;
+            }
+            jniContext->native_window_width = target_width;
+            jniContext->native_window_height = target_height;
+            jniContext->scale_source_format = AV_PIX_FMT_NONE;
+        }
+    }
 
+    if (jniContext->scale_source_width != displayed_width ||
+        jniContext->scale_source_height != displayed_height ||
+        jniContext->scale_source_format != frame->format) {
         // Initializing swsContext with AV_PIX_FMT_YUV420P, which is equivalent to YV12.
         // The only difference is the order of the u and v planes.
         SwsContext *swsContext = sws_getCachedContext(jniContext->swsContext,
                                                       displayed_width, displayed_height,
-                                                jniContext->codecContext->pix_fmt,
-                                                displayed_width, displayed_height,
-                                                AV_PIX_FMT_YUV420P,
-                                                SWS_BILINEAR, nullptr, nullptr, nullptr);
+                                                      static_cast<AVPixelFormat>(frame->format),
+                                                      jniContext->native_window_width,
+                                                      jniContext->native_window_height,
+                                                      AV_PIX_FMT_YUV420P,
+                                                      SWS_BILINEAR, nullptr, nullptr, nullptr);
 
         if (!swsContext) {
             LOGE("Failed to allocate swsContext.");
+            jniContext->swsContext = nullptr;
+            jniContext->scale_source_format = AV_PIX_FMT_NONE;
             return VIDEO_DECODER_ERROR_OTHER;
         }
         jniContext->swsContext = swsContext;
+        jniContext->scale_source_width = displayed_width;
+        jniContext->scale_source_height = displayed_height;
+        jniContext->scale_source_format = frame->format;
     }
 
     ANativeWindow_Buffer native_window_buffer;
-    int result = ANativeWindow_lock(jniContext->native_window, &native_window_buffer, nullptr);
-    if (result == -19) {
-        if (jniContext->native_window != nullptr) {
-            ANativeWindow_release(jniContext->native_window);
-        }
-        jniContext->native_window = nullptr;
-        if (jniContext->surface != nullptr) {
-            env->DeleteGlobalRef(jniContext->surface);
-        }
-        jniContext->surface = nullptr;
-        goto retry_acquire;
+    int result;
+    {
+        ScopedTimer timer(jniContext->stats.timer(TIMER_WINDOW_LOCK), "ANativeWindow_lock");
+        result = ANativeWindow_lock(window, &native_window_buffer, nullptr);
+    }
+    if (result == kWindowAbandoned) {
+        return kWindowAbandoned;
     } else if (result || native_window_buffer.bits == nullptr) {
         LOGE("kJniStatusANativeWindowError");
         return VIDEO_DECODER_ERROR_OTHER;
     }
-    // 直接用AVFrame的数据和linesize
-    auto *planeY = frame->data[0];
-    auto *planeU = frame->data[1];
-    auto *planeV = frame->data[2];
-
-    int strideY = frame->linesize[0];
-    int strideU = frame->linesize[1];
-    int strideV = frame->linesize[2];
-
-
     // source planes from VideoDecoderOutputBuffer
 //    jobject yuvPlanes_object = env->GetObjectField(output_buffer, jniContext->yuvPlanes_field);
 //    auto yuvPlanes_array = jobjectArray(yuvPlanes_object);
@@ -409,17 +681,11 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
     const int32_t native_window_buffer_uv_height = (native_window_buffer.height + 1) / 2;
     auto native_window_buffer_bits = reinterpret_cast<uint8_t *>(native_window_buffer.bits);
     const int native_window_buffer_uv_stride = AlignTo16(native_window_buffer.stride / 2);
-    const int v_plane_height = std::min(native_window_buffer_uv_height, displayed_height);
+    const int v_plane_height = std::min(native_window_buffer_uv_height, jniContext->native_window_height);
 
     const int y_plane_size = native_window_buffer.stride * native_window_buffer.height;
     const int v_plane_size = v_plane_height * native_window_buffer_uv_stride;
 
-    // source data
-    uint8_t *src[3] = {planeY, planeU, planeV};
-
-    // source strides
-    int src_stride[3] = {strideY, strideU, strideV};
-
     // destination data with u and v swapped
     uint8_t *dest[3] = {native_window_buffer_bits,
                         native_window_buffer_bits + y_plane_size + v_plane_size,
@@ -434,21 +700,187 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
     //Perform color space conversion using sws_scale.
     //Convert the source data (src) with specified strides (src_stride) and displayed height,
     //and store the result in the destination data (dest) with corresponding strides (dest_stride).
-    sws_scale(jniContext->swsContext,
-              src, src_stride,
-              0, displayed_height,
-              dest, dest_stride);
+    {
+        ScopedTimer timer(jniContext->stats.timer(TIMER_SCALE), "sws_scale");
+        sws_scale(jniContext->swsContext,
+                  src, src_stride,
+                  0, displayed_height,
+                  dest, dest_stride);
+    }
+    jniContext->stats.add(COUNTER_BYTES_COPIED, y_plane_size + 2 * v_plane_size);
 
 //    env->ReleaseIntArrayElements(*yuvStrides_array, yuvStrides, 0);
 
-    if (ANativeWindow_unlockAndPost(jniContext->native_window)) {
+    if (ANativeWindow_unlockAndPost(window)) {
         LOGE("kJniStatusANativeWindowError");
         return VIDEO_DECODER_ERROR_OTHER;
     }
+    jniContext->stats.add(COUNTER_FRAMES_RENDERED);
+    jniContext->last_presented_pts.store(frame->pts, std::memory_order_relaxed);
+    jniContext->set_last_rendered(frame);
 
     return VIDEO_DECODER_SUCCESS;
 }
 
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegRenderFrame(JNIEnv *env,
+                                                                                  jobject thiz,
+                                                                                  jlong jContext,
+                                                                                  jobject surface,
+                                                                                  jobject output_buffer,
+                                                                                  jint surface_width,
+                                                                                  jint surface_height) {
+    if (jContext == 0){
+        return VIDEO_DECODER_ERROR_OTHER;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    AVFrame* frame = reinterpret_cast<AVFrame*>(
+            env->GetLongField(output_buffer, jniContext->decoder_private_field));
+    if (frame == nullptr) {
+        LOGE("Failed to get frame.");
+        return VIDEO_DECODER_SUCCESS;
+    }
+
+    if (jniContext->window_abandoned.exchange(false)) {
+        // Drop the window so that it is recreated from the surface below.
+        jniContext->MaybeAcquireNativeWindow(env, nullptr);
+    }
+    retry_acquire:
+    if (!jniContext->MaybeAcquireNativeWindow(env, surface)) {
+        return VIDEO_DECODER_ERROR_OTHER;
+    }
+    if (jniContext->render_worker) {
+        // The output buffer is released once this returns, the worker keeps its own reference.
+        AVFrame *queued = av_frame_clone(frame);
+        jniContext->stats.add(COUNTER_ALLOCATIONS);
+        if (!queued) {
+            LOGE("Failed to reference frame for the render worker.");
+            return VIDEO_DECODER_ERROR_OTHER;
+        }
+        jniContext->render_worker->queue(jniContext->native_window, queued,
+                                         surface_width, surface_height);
+        return VIDEO_DECODER_SUCCESS;
+    }
+
+    int result = RenderToWindow(jniContext, jniContext->native_window, frame,
+                                surface_width, surface_height);
+    if (result == kWindowAbandoned) {
+        jniContext->MaybeAcquireNativeWindow(env, nullptr);
+        goto retry_acquire;
+    }
+    return result;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegGetRenderStats(JNIEnv *env,
+                                                                                     jobject thiz,
+                                                                                     jlong jContext,
+                                                                                     jlongArray stats) {
+    if (jContext == 0) {
+        return;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    RenderWorker *worker = jniContext->render_worker.get();
+    // Layout must match FfmpegVideoDecoder.getRenderStats().
+    jlong values[4] = {
+            worker ? (jlong) worker->queueDepth() : 0,
+            jniContext->stats.counters[COUNTER_FRAMES_RENDERED].load(std::memory_order_relaxed),
+            worker ? worker->droppedCount() : 0,
+            jniContext->last_presented_pts.load(std::memory_order_relaxed),
+    };
+    env->SetLongArrayRegion(stats, 0, std::min<jsize>(4, env->GetArrayLength(stats)), values);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegAwaitPresentation(JNIEnv *env,
+                                                                                        jobject thiz,
+                                                                                        jlong jContext,
+                                                                                        jlong timeoutMs) {
+    if (jContext == 0) {
+        return JNI_TRUE;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    RenderWorker *worker = jniContext->render_worker.get();
+    // Without the worker frames are posted before ffmpegRenderFrame returns.
+    return !worker || worker->awaitPresentation(timeoutMs * 1000) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegGetSnapshotSize(JNIEnv *env,
+                                                                                      jobject thiz,
+                                                                                      jlong jContext,
+                                                                                      jintArray size) {
+    if (jContext == 0) {
+        return JNI_FALSE;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    AVFrame *frame = jniContext->ref_last_rendered();
+    if (!frame) {
+        return JNI_FALSE;
+    }
+    jint values[2] = {frame->width, frame->height};
+    av_frame_free(&frame);
+    env->SetIntArrayRegion(size, 0, 2, values);
+    return JNI_TRUE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegSnapshot(JNIEnv *env,
+                                                                               jobject thiz,
+                                                                               jlong jContext,
+                                                                               jobject bitmap) {
+    if (jContext == 0) {
+        return JNI_FALSE;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    AndroidBitmapInfo bitmapInfo;
+    if (AndroidBitmap_getInfo(env, bitmap, &bitmapInfo) != ANDROID_BITMAP_RESULT_SUCCESS ||
+        bitmapInfo.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        LOGE("Snapshot needs an ARGB_8888 bitmap.");
+        return JNI_FALSE;
+    }
+    // Work on our own reference so rendering can move on while we convert.
+    AVFrame *frame = jniContext->ref_last_rendered();
+    if (!frame) {
+        return JNI_FALSE;
+    }
+
+    // A one-off context: snapshots are rare and must not touch the render path's scaler.
+    SwsContext *scalingContext = sws_getContext(frame->width, frame->height,
+                                                static_cast<AVPixelFormat>(frame->format),
+                                                (int) bitmapInfo.width, (int) bitmapInfo.height,
+                                                AV_PIX_FMT_RGBA,
+                                                SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (!scalingContext) {
+        LOGE("Failed to allocate swsContext for snapshot.");
+        av_frame_free(&frame);
+        return JNI_FALSE;
+    }
+    sws_setColorspaceDetails(scalingContext,
+                             sws_getCoefficients(frame->colorspace),
+                             frame->color_range == AVCOL_RANGE_JPEG,
+                             sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                             0, 1 << 16, 1 << 16);
+
+    bool success = false;
+    void *pixels;
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) == ANDROID_BITMAP_RESULT_SUCCESS) {
+        uint8_t *dest[4] = {static_cast<uint8_t *>(pixels), nullptr, nullptr, nullptr};
+        int dest_stride[4] = {(int) bitmapInfo.stride, 0, 0, 0};
+        success = sws_scale(scalingContext, frame->data, frame->linesize, 0, frame->height,
+                            dest, dest_stride) > 0;
+        AndroidBitmap_unlockPixels(env, bitmap);
+    }
+    sws_freeContext(scalingContext);
+    av_frame_free(&frame);
+    return success;
+}
+
 extern "C"
 JNIEXPORT jint JNICALL
 Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegSendPacket(JNIEnv *env,
@@ -457,29 +889,47 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
                                                                                  jobject encoded_data,
                                                                                  jint offset,
                                                                                  jint length,
-                                                                                 jlong input_time) {
+                                                                                 jlong input_time,
+                                                                                 jboolean key_frame) {
     if (jContext == 0){
         return VIDEO_DECODER_ERROR_OTHER;
     }
     auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    if (ShouldDiscardPacket(jniContext, key_frame, input_time)) {
+        return VIDEO_DECODER_PACKET_DISCARDED;
+    }
+    if (!EnsureCodecContext(jniContext)) {
+        return VIDEO_DECODER_ERROR_OTHER;
+    }
     AVCodecContext *avContext = jniContext->codecContext;
 
     auto *inputBuffer = (uint8_t *) env->GetDirectBufferAddress(encoded_data);
     AVPacket *packet = av_packet_alloc();
+    jniContext->stats.add(COUNTER_ALLOCATIONS);
     packet->data = inputBuffer+offset;
     packet->size = length;
     packet->pts = input_time;
 
     // Queue input data.
-    int result = avcodec_send_packet(avContext, packet);
+    int result;
+    {
+        ScopedTimer timer(jniContext->stats.timer(TIMER_SEND_PACKET), "avcodec_send_packet");
+        result = avcodec_send_packet(avContext, packet);
+    }
     av_packet_free(&packet);
+    if (result == 0) {
+        jniContext->stats.add(COUNTER_PACKETS_SENT);
+        jniContext->stats.add(COUNTER_BYTES_SENT, length);
+    }
     if (result == AVERROR(EAGAIN)){
         return VIDEO_DECODER_ERROR_READ_FRAME;
     }
     if (result) {
         logError("avcodec_send_packet-video", result);
         if (result == AVERROR_INVALIDDATA) {
-            // need more data
+            // Corrupt input, skip ahead to the next keyframe.
+            jniContext->stats.add(COUNTER_CORRUPT_PACKETS);
+            jniContext->awaiting_keyframe = true;
             return VIDEO_DECODER_ERROR_INVALID_DATA;
         } else {
             return VIDEO_DECODER_ERROR_OTHER;
@@ -498,31 +948,52 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
                                                                                    jboolean decode_only) {
     auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
     AVCodecContext *avContext = jniContext->codecContext;
+    if (!avContext) {
+        return VIDEO_DECODER_NEED_MORE_FRAME;
+    }
 
-    AVFrame *frame = av_frame_alloc();
+    // The second field of the last frame goes out before the next frame is decoded.
+    AVFrame *frame = jniContext->pop_frame();
+    int result = 0;
     if (!frame) {
-        LOGE("Failed to allocate output frame.");
-        return VIDEO_DECODER_ERROR_OTHER;
-    }
-    int result = avcodec_receive_frame(avContext, frame);
+        frame = av_frame_alloc();
+        jniContext->stats.add(COUNTER_ALLOCATIONS);
+        if (!frame) {
+            LOGE("Failed to allocate output frame.");
+            return VIDEO_DECODER_ERROR_OTHER;
+        }
+        {
+            ScopedTimer timer(jniContext->stats.timer(TIMER_RECEIVE_FRAME),
+                              "avcodec_receive_frame");
+            result = avcodec_receive_frame(avContext, frame);
+        }
 
-    // fail
-    if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
-        // This is not an error. The input data was decode-only or no displayable
-        // frames are available.
-        av_frame_free(&frame);
-        return VIDEO_DECODER_NEED_MORE_FRAME;
-    }
-    if (result) {
-        av_frame_free(&frame);
-        logError("avcodec_receive_frame", result);
-        return VIDEO_DECODER_ERROR_OTHER;
+        // fail
+        if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
+            // This is not an error. The input data was decode-only or no displayable
+            // frames are available.
+            av_frame_free(&frame);
+            return VIDEO_DECODER_NEED_MORE_FRAME;
+        }
+        if (result) {
+            av_frame_free(&frame);
+            logError("avcodec_receive_frame", result);
+            return VIDEO_DECODER_ERROR_OTHER;
+        }
+        OnFrameDecoded(jniContext);
     }
     auto shouldKeep = env->CallBooleanMethod(thiz, jniContext->isAtLeastOutputStartTimeUs_method,frame->pts);
     if(!shouldKeep || decode_only){
         av_frame_free(&frame);
+        jniContext->stats.add(COUNTER_FRAMES_DROPPED);
         return VIDEO_DECODER_DROP_FRAME;
     }
+    if (frame->opaque != &kSecondFieldMarker) {
+        PushSecondField(jniContext, frame);
+    }
+    uint8_t *src[4];
+    int src_stride[4];
+    DeinterlaceFrame(jniContext, frame, src, src_stride);
     // success
     // init time and mode
     env->CallVoidMethod(output_buffer, jniContext->init_method, frame->pts, output_mode, nullptr);
@@ -532,217 +1003,36 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
             output_buffer, jniContext->init_for_yuv_frame_method,
             frame->width,
             frame->height,
-            frame->linesize[0], frame->linesize[1],
+            src_stride[0], src_stride[1],
             0);
     if (env->ExceptionCheck()) {
         // Exception is thrown in Java when returning from the native call.
+        av_frame_free(&frame);
         return VIDEO_DECODER_ERROR_OTHER;
     }
     if (!init_result) {
+        av_frame_free(&frame);
         return VIDEO_DECODER_ERROR_OTHER;
     }
 
     jobject data_object = env->GetObjectField(output_buffer, jniContext->data_field);
     auto *data = reinterpret_cast<jbyte *>(env->GetDirectBufferAddress(data_object));
     const int32_t uvHeight = (frame->height + 1) / 2;
-    const uint64_t yLength = frame->linesize[0] * frame->height;
-    const uint64_t uvLength = frame->linesize[1] * uvHeight;
+    const uint64_t yLength = src_stride[0] * frame->height;
+    const uint64_t uvLength = src_stride[1] * uvHeight;
 
     // TODO: Support rotate YUV data
 
-    memcpy(data, frame->data[0], yLength);
-    memcpy(data + yLength, frame->data[1], uvLength);
-    memcpy(data + yLength + uvLength, frame->data[2], uvLength);
+    memcpy(data, src[0], yLength);
+    memcpy(data + yLength, src[1], uvLength);
+    memcpy(data + yLength + uvLength, src[2], uvLength);
+    jniContext->stats.add(COUNTER_BYTES_COPIED, yLength + 2 * uvLength);
 
     av_frame_free(&frame);
 
     return result;
 }
 
-extern "C"
-JNIEXPORT jint JNICALL
-Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegDecode(
-        JNIEnv *env,
-        jobject thiz,
-        jlong jContext,
-        jobject encoded_data,
-        jint offset,
-        jint length,
-        jlong input_time,
-        jint output_mode,
-        jobject output_buffer,
-        jboolean decodeOnly,
-        jboolean readOnly) {
-    LOGI("Calling Native decodeOnly %d",decodeOnly);
-    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
-    AVCodecContext *avContext = jniContext->codecContext;
-    // 1. Prepare packet if input exists
-    AVPacket *packet = nullptr;
-    if(!readOnly) {
-        if (encoded_data != nullptr && length > 0) {
-            auto *inputBuffer = (uint8_t *) env->GetDirectBufferAddress(encoded_data);
-            if (!inputBuffer) {
-                logError("GetDirectBufferAddress failed", -1);
-                return VIDEO_DECODER_NEED_MORE_FRAME;
-            }
-
-            packet = av_packet_alloc();
-            if (!packet) {
-                logError("Failed to allocate AVPacket", -1);
-                return VIDEO_DECODER_ERROR_OTHER;
-            }
-            packet->data = inputBuffer + offset;
-            packet->size = length;
-            packet->pts = input_time;
-        } else {
-            logError("Input data is null or zero", -1);
-            return VIDEO_DECODER_NEED_MORE_FRAME;
-        }
-    }
-    // Helper lambda: try receive frames until no more
-    auto maybe_receive_all_frames = [&](bool decode_Only) -> int {
-        int ret;
-        AVFrame *frame = av_frame_alloc();
-        if (!frame) {
-            logError("Failed to allocate AVFrame", -1);
-            return VIDEO_DECODER_ERROR_OTHER;
-        }
-        int dropFrameCount = 0;
-        while (true) {
-            ret = avcodec_receive_frame(avContext, frame);
-            auto frameTime = frame->pts;
-            if(frameTime<0) frameTime = input_time;
-            auto shouldKeep = env->CallBooleanMethod(thiz,
-                                                     jniContext->isAtLeastOutputStartTimeUs_method,
-                                                     frameTime);
-            LOGI("Input time %lld Frame Time %lld shouldKeep:%d dropFrameCount: %d", input_time, frame->pts,
-                 shouldKeep,dropFrameCount);
-            if (ret == AVERROR(EAGAIN)) {
-                av_frame_free(&frame);
-                LOGI("Drop Frame AVERROR(EAGAIN) Count: %d",dropFrameCount);
-                if (!dropFrameCount) return VIDEO_DECODER_NEED_MORE_FRAME;
-                return dropFrameCount;
-            }
-            if (ret) {
-                av_frame_free(&frame);
-                LOGE("Error in Read Frame");
-                return ret;
-            }
-            if (!shouldKeep || decode_Only) {
-                LOGI("Drop Frame Time");
-                av_frame_unref(frame);
-                dropFrameCount++;
-                continue;
-            }
-            // 填充Java output_buffer数据
-            env->CallVoidMethod(output_buffer, jniContext->init_method, frameTime, output_mode,
-                                nullptr);
-            jboolean init_result = env->CallBooleanMethod(
-                    output_buffer, jniContext->init_for_yuv_frame_method,
-                    frame->width, frame->height,
-                    frame->linesize[0], frame->linesize[1],
-                    0);
-            if (env->ExceptionCheck() || !init_result) {
-                av_frame_free(&frame);
-                return VIDEO_DECODER_ERROR_OTHER;
-            }
-
-            jobject data_object = env->GetObjectField(output_buffer, jniContext->data_field);
-            auto *data = (jbyte *) env->GetDirectBufferAddress(data_object);
-
-            int uvHeight = (frame->height + 1) / 2;
-            size_t yLength = frame->linesize[0] * frame->height;
-            size_t uvLength = frame->linesize[1] * uvHeight;
-
-            memcpy(data, frame->data[0], yLength);
-            memcpy(data + yLength, frame->data[1], uvLength);
-            memcpy(data + yLength + uvLength, frame->data[2], uvLength);
-
-            av_frame_free(&frame);
-            return 0;
-        }
-        
-    };
-    auto maybe_receive_all_frames_test = [&](bool decode_Only) -> int {
-        int ret;
-        AVFrame *frame = av_frame_alloc();
-        if (!frame) {
-            logError("Failed to allocate AVFrame", -1);
-            return VIDEO_DECODER_ERROR_OTHER;
-        }
-        int dropFrameCount = 0;
-        do{
-            ret = avcodec_receive_frame(avContext, frame);
-            auto frameTime = frame->pts;
-            if(frameTime<0) frameTime = input_time;
-            auto shouldKeep = env->CallBooleanMethod(thiz,
-                                                     jniContext->isAtLeastOutputStartTimeUs_method,
-                                                     frameTime);
-            LOGI("Input time %lld Frame Time %lld shouldKeep:%d dropFrameCount: %d", input_time, frame->pts,
-                 shouldKeep,dropFrameCount);
-            if (ret == AVERROR(EAGAIN)) {
-                av_frame_free(&frame);
-                LOGI("Drop Frame AVERROR(EAGAIN) Count: %d",dropFrameCount);
-                if (!dropFrameCount) return VIDEO_DECODER_NEED_MORE_FRAME;
-                return dropFrameCount;
-            }
-            if (ret) {
-                av_frame_free(&frame);
-                LOGE("Error in Read Frame");
-                return ret;
-            }
-            if (!shouldKeep || decode_Only) {
-                LOGI("Drop Frame Time");
-                av_frame_unref(frame);
-                dropFrameCount++;
-                continue;
-            }
-            env->CallVoidMethod(output_buffer, jniContext->init_method, frameTime, output_mode,
-                                nullptr);
-            env->SetLongField(output_buffer, jniContext->decoder_private_field,
-                              (uint64_t)frame);
-            env->CallVoidMethod(output_buffer, jniContext->init_for_private_frame_method,
-                                frame->width, frame->height);
-            return 0;
-        } while (true);
-    };
-    if (readOnly) return maybe_receive_all_frames_test(decodeOnly);
-    // 2. 发送包，如果失败是EAGAIN，先拉帧释放缓冲再重试
-
-    int result;
-    // 缓冲区满，先拉帧释放
-    result = avcodec_send_packet(avContext, packet);
-    if(result) {
-        av_packet_free(&packet);
-        if(result == AVERROR(EAGAIN)){
-            logError("avcodec_send_packet -error -need reed frame", result);
-            return VIDEO_DECODER_ERROR_READ_FRAME;
-        }else if(result == AVERROR_INVALIDDATA){
-            logError("avcodec_send_packet -error -Invalid data", result);
-            return VIDEO_DECODER_ERROR_INVALID_DATA;
-        }
-        else{
-            logError("avcodec_send_packet -error", result);
-            return VIDEO_DECODER_ERROR_OTHER;
-        }
-    }
-    int rec_ret;
-    rec_ret = maybe_receive_all_frames_test(decodeOnly);
-    av_packet_free(&packet);
-    if (rec_ret > 0) {
-        LOGI("Drop Frame");
-        return rec_ret;
-    }
-    if (rec_ret == -1) {
-        LOGI("need more frame");
-        return -1;
-    }
-    if (rec_ret) {
-        logError("avcodec_send_packet-video-readframe", rec_ret);
-        return VIDEO_DECODER_ERROR_OTHER;
-    }
-    return 0;
-}
 extern "C"
 JNIEXPORT void JNICALL
         Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegReleaseFrame(JNIEnv *env,
@@ -770,6 +1060,9 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
     }
     JniContext* const jniContext = reinterpret_cast<JniContext*>(jContext);
     AVCodecContext *avContext = jniContext->codecContext;
+    if (!avContext) {
+        return decodeOnly ? -1 : jniContext->remain_frame_count();
+    }
     AVFrame *frame = nullptr;
     size_t drop_frame_count = 0;
     if (!decodeOnly) {
@@ -784,17 +1077,23 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
             return jniContext->remain_frame_count();
         }
     } else{
-        drop_frame_count +=jniContext->clear_frames();
+        size_t cleared = jniContext->clear_frames();
+        drop_frame_count += cleared;
+        jniContext->stats.add(COUNTER_FRAMES_DROPPED, cleared);
     }
 
     int ret;
     int read_count = 0;
     frame = av_frame_alloc();
+    jniContext->stats.add(COUNTER_ALLOCATIONS);
     do {
-        ret = avcodec_receive_frame(avContext, frame);
+        {
+            ScopedTimer timer(jniContext->stats.timer(TIMER_RECEIVE_FRAME), "avcodec_receive_frame");
+            ret = avcodec_receive_frame(avContext, frame);
+        }
         if (ret == AVERROR(EAGAIN)) {
             av_frame_free(&frame);
-            LOGI("read_count: %d\ndrop_frame_count: %d decodeOnly: %d",read_count,drop_frame_count,decodeOnly);
+            DIAGV(DIAG_RECEIVE_DONE, read_count, drop_frame_count);
             if (decodeOnly) {
                 if (drop_frame_count > 0) {
                     env->CallVoidMethod(thiz, jniContext->add_skip_buffer_count_method,
@@ -809,9 +1108,11 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
             return -2;
         }
 
-        LOGI("time: %lld",frame->pts);
+        DIAGV(DIAG_FRAME_RECEIVED, frame->pts, !decodeOnly);
+        OnFrameDecoded(jniContext);
         if (decodeOnly){
             drop_frame_count++;
+            jniContext->stats.add(COUNTER_FRAMES_DROPPED);
             av_frame_unref(frame);
             continue;
         }
@@ -824,8 +1125,77 @@ Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpe
                                 frame->width, frame->height);
         } else {
             jniContext->push_frame(frame);
+            jniContext->stats.add(COUNTER_FRAMES_STASHED);
         }
+        PushSecondField(jniContext, frame);
         read_count++;
         frame = av_frame_alloc();
+        jniContext->stats.add(COUNTER_ALLOCATIONS);
     } while (true);
-}
\ No newline at end of file
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegGetStats(JNIEnv *env,
+                                                                               jobject thiz,
+                                                                               jlong jContext) {
+    if (!jContext) {
+        return nullptr;
+    }
+    return statsToJava(env, reinterpret_cast<JniContext *>(jContext)->stats);
+}
+
+/**
+ * Frees everything the decoder can rebuild on demand: stashed and queued frames, the frame kept
+ * for snapshots, the scaler, the deinterlacer and the codec context with its frame pools and
+ * frame threads. The next packet reopens the codec with the same settings and has to be a
+ * keyframe. Must be called on the decode thread while no output buffer is out for rendering.
+ * The heap bytes freed are added to the stats.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_github_anilbeesetti_nextlib_media3ext_ffdecoder_FfmpegVideoDecoder_ffmpegTrim(JNIEnv *env,
+                                                                           jobject thiz,
+                                                                           jlong jContext) {
+    if (!jContext) {
+        return;
+    }
+    auto *const jniContext = reinterpret_cast<JniContext *>(jContext);
+    ScopedTrace trace("ffmpegTrim");
+    size_t allocatedBefore = mallinfo().uordblks;
+
+    jniContext->clear_frames();
+    // The scaler and the deinterlacer belong to the rendering thread.
+    auto trimRenderState = [jniContext] {
+        sws_freeContext(jniContext->swsContext);
+        jniContext->swsContext = nullptr;
+        jniContext->scale_source_format = AV_PIX_FMT_NONE;
+        jniContext->deinterlacer.reset();
+    };
+    if (jniContext->render_worker) {
+        jniContext->render_worker->flushAndRun(trimRenderState);
+    } else {
+        trimRenderState();
+    }
+    // Holds on to a buffer of the codec's pool, which would otherwise outlive the context.
+    jniContext->release_last_rendered();
+    releaseContext(&jniContext->codecContext);
+    jniContext->resume_start_us = AV_NOPTS_VALUE;
+    jniContext->awaiting_keyframe = true;
+
+#ifdef M_PURGE
+    // Hands the freed pages back to the system. mallopt is API 26+, so it is looked up.
+    using MalloptFunction = int (*)(int, int);
+    static auto mallopt_function =
+            reinterpret_cast<MalloptFunction>(dlsym(RTLD_DEFAULT, "mallopt"));
+    if (mallopt_function) {
+        mallopt_function(M_PURGE, 0);
+    }
+#endif
+
+    size_t allocatedAfter = mallinfo().uordblks;
+    auto freed = static_cast<int64_t>(allocatedBefore > allocatedAfter ? allocatedBefore - allocatedAfter : 0);
+    jniContext->stats.add(COUNTER_TRIMS);
+    jniContext->stats.add(COUNTER_TRIM_BYTES_FREED, freed);
+    DIAGI(DIAG_DECODER_TRIMMED, freed, 0);
+}
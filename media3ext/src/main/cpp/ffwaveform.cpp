@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include "ffaudiocore.h"
+#include "ffthreadpool.h"
+#include "ffutil.h"
+#include "ffwaveform.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FF_WAVEFORM_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_WAVEFORM_SSE2 1
+#endif
+
+namespace {
+    // Shorter segments are not worth a thread and a seek.
+    const int64_t kMinSegmentUs = 30 * (int64_t) AV_TIME_BASE;
+    // Decoded before each segment and discarded, so that decoders that carry state between
+    // packets have settled when the segment starts.
+    const int64_t kSegmentPrerollUs = AV_TIME_BASE / 2;
+    const int kInitialOutputSize = 64 * 1024;
+    // Channel counts above this are reduced without SIMD.
+    const int kMaxSimdChannels = 8;
+    // Floats per step of the SIMD reduction: lcm(channelCount, 4) for up to kMaxSimdChannels.
+    const int kMaxLanes = 28;
+
+    struct Bucket {
+        float min = std::numeric_limits<float>::infinity();
+        float max = -std::numeric_limits<float>::infinity();
+        double sumSquares = 0;
+        int64_t count = 0;
+
+        void merge(const Bucket &other) {
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            sumSquares += other.sumSquares;
+            count += other.count;
+        }
+    };
+
+    struct Input {
+        int streamIndex = -1;
+        int64_t startTime = 0;
+        int64_t durationUs = 0;
+        int bucketCount = 0;
+        int channelCount = 0;
+    };
+
+    /**
+     * A time range of the input, in microseconds from its start, and its buckets from
+     * firstBucket on.
+     */
+    struct Segment {
+        int64_t startUs = 0;
+        int64_t endUs = 0;
+        int firstBucket = 0;
+        std::vector<Bucket> buckets;
+        int result = 0;
+    };
+
+    /**
+     * Adds frameCount interleaved frames of channelCount channels to buckets[0, channelCount).
+     * Channels map to fixed lanes of a run of lcm(channelCount, 4) floats, so any channel
+     * count up to kMaxSimdChannels is reduced four samples at a time.
+     */
+    void reduce(const float *samples, int frameCount, int channelCount, Bucket *buckets) {
+        int total = frameCount * channelCount;
+        int i = 0;
+#if FF_WAVEFORM_NEON || FF_WAVEFORM_SSE2
+        if (channelCount <= kMaxSimdChannels) {
+            int lanes = std::lcm(channelCount, 4);
+            int vectors = lanes / 4;
+            float laneMin[kMaxLanes];
+            float laneMax[kMaxLanes];
+            float laneSum[kMaxLanes];
+#if FF_WAVEFORM_NEON
+            float32x4_t minimum[kMaxLanes / 4];
+            float32x4_t maximum[kMaxLanes / 4];
+            float32x4_t sum[kMaxLanes / 4];
+            for (int v = 0; v < vectors; v++) {
+                minimum[v] = vdupq_n_f32(std::numeric_limits<float>::infinity());
+                maximum[v] = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+                sum[v] = vdupq_n_f32(0);
+            }
+            for (; i + lanes <= total; i += lanes) {
+                for (int v = 0; v < vectors; v++) {
+                    float32x4_t x = vld1q_f32(samples + i + v * 4);
+                    minimum[v] = vminq_f32(minimum[v], x);
+                    maximum[v] = vmaxq_f32(maximum[v], x);
+                    sum[v] = vmlaq_f32(sum[v], x, x);
+                }
+            }
+            for (int v = 0; v < vectors; v++) {
+                vst1q_f32(laneMin + v * 4, minimum[v]);
+                vst1q_f32(laneMax + v * 4, maximum[v]);
+                vst1q_f32(laneSum + v * 4, sum[v]);
+            }
+#else
+            __m128 minimum[kMaxLanes / 4];
+            __m128 maximum[kMaxLanes / 4];
+            __m128 sum[kMaxLanes / 4];
+            for (int v = 0; v < vectors; v++) {
+                minimum[v] = _mm_set1_ps(std::numeric_limits<float>::infinity());
+                maximum[v] = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+                sum[v] = _mm_setzero_ps();
+            }
+            for (; i + lanes <= total; i += lanes) {
+                for (int v = 0; v < vectors; v++) {
+                    __m128 x = _mm_loadu_ps(samples + i + v * 4);
+                    minimum[v] = _mm_min_ps(minimum[v], x);
+                    maximum[v] = _mm_max_ps(maximum[v], x);
+                    sum[v] = _mm_add_ps(sum[v], _mm_mul_ps(x, x));
+                }
+            }
+            for (int v = 0; v < vectors; v++) {
+                _mm_storeu_ps(laneMin + v * 4, minimum[v]);
+                _mm_storeu_ps(laneMax + v * 4, maximum[v]);
+                _mm_storeu_ps(laneSum + v * 4, sum[v]);
+            }
+#endif
+            for (int lane = 0; lane < lanes; lane++) {
+                Bucket &bucket = buckets[lane % channelCount];
+                bucket.min = std::min(bucket.min, laneMin[lane]);
+                bucket.max = std::max(bucket.max, laneMax[lane]);
+                bucket.sumSquares += laneSum[lane];
+            }
+        }
+#endif
+        // i is a multiple of channelCount here.
+        for (; i < total; i++) {
+            Bucket &bucket = buckets[i % channelCount];
+            float sample = samples[i];
+            bucket.min = std::min(bucket.min, sample);
+            bucket.max = std::max(bucket.max, sample);
+            bucket.sumSquares += (double) sample * sample;
+        }
+        for (int channel = 0; channel < channelCount; channel++) {
+            buckets[channel].count += frameCount;
+        }
+    }
+
+    /**
+     * Opens url and returns the index of its default audio stream, with the other streams
+     * discarded, or a negative AVERROR.
+     */
+    int openInput(const char *url, AVFormatContext **formatContext) {
+        int result = avformat_open_input(formatContext, url, nullptr, nullptr);
+        if (result < 0) {
+            logError("avformat_open_input", result);
+            return result;
+        }
+        result = avformat_find_stream_info(*formatContext, nullptr);
+        if (result < 0) {
+            logError("avformat_find_stream_info", result);
+            return result;
+        }
+        int streamIndex = av_find_best_stream(*formatContext, AVMEDIA_TYPE_AUDIO, -1, -1,
+                                              nullptr, 0);
+        if (streamIndex < 0) {
+            logError("av_find_best_stream", streamIndex);
+            return streamIndex;
+        }
+        for (unsigned int i = 0; i < (*formatContext)->nb_streams; i++) {
+            if ((int) i != streamIndex) {
+                (*formatContext)->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        return streamIndex;
+    }
+
+    /**
+     * Returns the bucket that the time falls in.
+     */
+    int bucketAt(const Input &input, int64_t timeUs) {
+        int64_t bucket = av_rescale(std::max<int64_t>(timeUs, 0), input.bucketCount,
+                                    input.durationUs);
+        return (int) std::min<int64_t>(bucket, input.bucketCount - 1);
+    }
+
+    /**
+     * Reduces frameCount frames of channelCount channels that start at position, in samples
+     * from the start of the input, into the buckets of segment. Returns false once the
+     * frames reach the end of the segment.
+     */
+    bool addFrames(const Input &input, const float *samples, int frameCount, int channelCount,
+                   int sampleRate, int64_t position, std::vector<Bucket> *scratch,
+                   Segment *segment) {
+        int64_t totalSamples = std::max<int64_t>(
+                av_rescale(input.durationUs, sampleRate, AV_TIME_BASE), 1);
+        int64_t start = av_rescale(segment->startUs, sampleRate, AV_TIME_BASE);
+        int64_t end = av_rescale(segment->endUs, sampleRate, AV_TIME_BASE);
+        int lastBucket = segment->firstBucket
+                         + (int) segment->buckets.size() / input.channelCount - 1;
+        int outChannels = std::min(channelCount, input.channelCount);
+        scratch->resize(channelCount);
+        int offset = (int) std::clamp<int64_t>(start - position, 0, frameCount);
+        position += offset;
+        while (offset < frameCount) {
+            if (position >= end) {
+                return false;
+            }
+            auto bucket = (int) std::min<int64_t>(position * input.bucketCount / totalSamples,
+                                                  input.bucketCount - 1);
+            int64_t bucketEnd = bucket == input.bucketCount - 1
+                                ? end
+                                : ((bucket + 1) * totalSamples + input.bucketCount - 1)
+                                  / input.bucketCount;
+            auto count = (int) std::min<int64_t>({frameCount - offset, bucketEnd - position,
+                                                  end - position});
+            std::fill(scratch->begin(), scratch->end(), Bucket());
+            reduce(samples + (size_t) offset * channelCount, count, channelCount,
+                   scratch->data());
+            // Rounding may put the first and last frames of the segment one bucket out.
+            bucket = std::clamp(bucket, segment->firstBucket, lastBucket);
+            Bucket *buckets = &segment->buckets[(size_t) (bucket - segment->firstBucket)
+                                                * input.channelCount];
+            for (int channel = 0; channel < outChannels; channel++) {
+                buckets[channel].merge((*scratch)[channel]);
+            }
+            offset += count;
+            position += count;
+        }
+        return position < end;
+    }
+
+    /**
+     * Decodes the segment from the keyframe before its start into its buckets. The input is
+     * read through formatContext, which is closed, or opened again from url if it is null.
+     */
+    int decodeSegment(const char *url, const Input &input, AVFormatContext *formatContext,
+                      Segment *segment) {
+        int streamIndex = input.streamIndex;
+        if (!formatContext) {
+            streamIndex = openInput(url, &formatContext);
+            if (streamIndex < 0) {
+                avformat_close_input(&formatContext);
+                return streamIndex;
+            }
+        }
+        AVStream *stream = formatContext->streams[streamIndex];
+        const AVCodecParameters *parameters = stream->codecpar;
+        if (segment->startUs > 0) {
+            int64_t seekUs = std::max<int64_t>(segment->startUs - kSegmentPrerollUs, 0);
+            int64_t timestamp = input.startTime
+                                + av_rescale_q(seekUs, AV_TIME_BASE_Q, stream->time_base);
+            // Inputs that cannot seek are decoded from the start, the frames before the
+            // segment are skipped either way.
+            int result = avformat_seek_file(formatContext, streamIndex, INT64_MIN, timestamp,
+                                            timestamp, 0);
+            if (result < 0) {
+                logError("avformat_seek_file", result);
+            }
+        }
+        const AVCodec *codec = avcodec_find_decoder(parameters->codec_id);
+        AudioContext audioContext(codec ? createContext(
+                codec, parameters->extradata, parameters->extradata_size,
+                OUTPUT_ENCODING_PCM_FLOAT, parameters->sample_rate,
+                parameters->ch_layout.nb_channels) : nullptr);
+        if (!audioContext.codecContext) {
+            avformat_close_input(&formatContext);
+            return AVERROR_DECODER_NOT_FOUND;
+        }
+        if (input.channelCount < parameters->ch_layout.nb_channels) {
+            audioContext.downmixChannelCount = input.channelCount;
+        }
+
+        std::vector<uint8_t> output(kInitialOutputSize);
+        GrowOutputBuffer growBuffer = [&output](int requiredSize) {
+            output.resize(requiredSize);
+            return output.data();
+        };
+        std::vector<Bucket> scratch;
+        AVPacket *packet = av_packet_alloc();
+        // Start of the next decoded frame in samples from the start of the input, taken from
+        // the first packet with a timestamp.
+        int64_t firstPacketUs = -1;
+        int64_t position = -1;
+        int result = packet ? 0 : AVERROR(ENOMEM);
+        bool endOfInput = false;
+        while (result == 0 && !endOfInput) {
+            if (av_read_frame(formatContext, packet) < 0) {
+                // Drains the frames that the decoder and the resampler still hold.
+                endOfInput = true;
+            } else if (packet->stream_index != streamIndex) {
+                av_packet_unref(packet);
+                continue;
+            }
+            if (!endOfInput && firstPacketUs < 0) {
+                int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+                if (timestamp == AV_NOPTS_VALUE && segment->startUs > 0) {
+                    av_packet_unref(packet);
+                    continue;
+                }
+                firstPacketUs = timestamp == AV_NOPTS_VALUE ? 0 : std::max<int64_t>(
+                        av_rescale_q(timestamp - input.startTime, stream->time_base,
+                                     AV_TIME_BASE_Q), 0);
+            }
+            int size = decodePacket(&audioContext, endOfInput ? nullptr : packet, output.data(),
+                                    (int) output.size(), growBuffer);
+            av_packet_unref(packet);
+            if (size == AUDIO_DECODER_ERROR_INVALID_DATA || size == 0) {
+                continue;
+            }
+            if (size < 0) {
+                result = AVERROR_EXTERNAL;
+                break;
+            }
+            int channelCount = audioContext.outputChannelCount;
+            int sampleRate = audioContext.outputSampleRate;
+            if (position < 0) {
+                position = av_rescale(firstPacketUs, sampleRate, AV_TIME_BASE);
+            }
+            int frameCount = size / (channelCount * (int) sizeof(float));
+            if (!addFrames(input, reinterpret_cast<const float *>(output.data()), frameCount,
+                           channelCount, sampleRate, position, &scratch, segment)) {
+                break;
+            }
+            position += frameCount;
+        }
+        av_packet_free(&packet);
+        avformat_close_input(&formatContext);
+        return result;
+    }
+}
+
+int computeWaveform(const char *url, int bucketCount, int channelCount, int parallelism,
+                    std::vector<float> *output) {
+    if (bucketCount <= 0 || channelCount < 0) {
+        return AVERROR(EINVAL);
+    }
+    Input input;
+    input.bucketCount = bucketCount;
+    // Kept open for the first segment: opening the input again reads a pipe from where the
+    // probe stopped.
+    AVFormatContext *formatContext = nullptr;
+    bool seekable;
+    {
+        int streamIndex = openInput(url, &formatContext);
+        if (streamIndex < 0) {
+            avformat_close_input(&formatContext);
+            return streamIndex;
+        }
+        // The other segments open the input again and seek.
+        seekable = formatContext->pb && (formatContext->pb->seekable & AVIO_SEEKABLE_NORMAL);
+        input.streamIndex = streamIndex;
+        const AVStream *stream = formatContext->streams[streamIndex];
+        int streamChannels = stream->codecpar->ch_layout.nb_channels;
+        input.channelCount = channelCount > 0 ? std::min(channelCount, streamChannels)
+                                              : streamChannels;
+        input.startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        if (stream->duration != AV_NOPTS_VALUE) {
+            input.durationUs = av_rescale_q(stream->duration, stream->time_base,
+                                            AV_TIME_BASE_Q);
+        } else if (formatContext->duration != AV_NOPTS_VALUE) {
+            input.durationUs = formatContext->duration;
+        }
+    }
+    if (input.durationUs <= 0 || input.channelCount <= 0) {
+        avformat_close_input(&formatContext);
+        LOGE("Cannot compute a waveform without duration and channel count.");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (!seekable) {
+        parallelism = 1;
+    } else if (parallelism <= 0) {
+        parallelism = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    auto segmentCount = (int) std::clamp<int64_t>(input.durationUs / kMinSegmentUs, 1,
+                                                   std::min(parallelism, bucketCount));
+    std::vector<Segment> segments(segmentCount);
+    for (int i = 0; i < segmentCount; i++) {
+        Segment &segment = segments[i];
+        segment.startUs = input.durationUs * i / segmentCount;
+        // The last segment takes whatever the duration estimate missed.
+        segment.endUs = i == segmentCount - 1 ? INT64_MAX / AV_TIME_BASE
+                                              : input.durationUs * (i + 1) / segmentCount;
+        segment.firstBucket = std::max(bucketAt(input, segment.startUs) - 1, 0);
+        int lastBucket = i == segmentCount - 1
+                         ? bucketCount - 1
+                         : std::min(bucketAt(input, segment.endUs) + 1, bucketCount - 1);
+        segment.buckets.resize((size_t) (lastBucket - segment.firstBucket + 1)
+                               * input.channelCount);
+    }
+    SliceThreadPool pool(segmentCount - 1);
+    pool.run(segmentCount, [&](int i) {
+        segments[i].result = decodeSegment(url, input, i == 0 ? formatContext : nullptr,
+                                           &segments[i]);
+    });
+
+    std::vector<Bucket> buckets((size_t) bucketCount * input.channelCount);
+    for (const Segment &segment : segments) {
+        if (segment.result < 0) {
+            return segment.result;
+        }
+        for (size_t i = 0; i < segment.buckets.size(); i++) {
+            buckets[(size_t) segment.firstBucket * input.channelCount + i].merge(
+                    segment.buckets[i]);
+        }
+    }
+    output->resize(buckets.size() * WAVEFORM_VALUES_PER_BUCKET);
+    float *values = output->data();
+    for (const Bucket &bucket : buckets) {
+        bool empty = bucket.count == 0;
+        values[0] = empty ? 0 : bucket.min;
+        values[1] = empty ? 0 : bucket.max;
+        values[2] = empty ? 0 : (float) std::sqrt(bucket.sumSquares / (double) bucket.count);
+        values += WAVEFORM_VALUES_PER_BUCKET;
+    }
+    return input.channelCount;
+}
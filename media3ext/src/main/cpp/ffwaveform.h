@@ -0,0 +1,24 @@
+#ifndef NEXTPLAYER_FFWAVEFORM_H
+#define NEXTPLAYER_FFWAVEFORM_H
+
+#include <vector>
+
+// Values written per bucket and channel by computeWaveform(): minimum, maximum and RMS.
+static const int WAVEFORM_VALUES_PER_BUCKET = 3;
+
+/**
+ * Decodes the default audio stream of url, which may be any input libavformat opens including
+ * video files, and reduces it to bucketCount buckets of equal duration.
+ *
+ * For each bucket and channel in turn, output receives the minimum, the maximum and the RMS of
+ * the samples as floats, 0 for buckets without samples. Audio with more than channelCount
+ * channels is mixed down first, 0 keeps the channels of the stream.
+ *
+ * Long inputs are split at keyframes into up to parallelism segments, 0 for one per CPU, that
+ * are decoded at the same time with a context each. Returns the channel count of the output,
+ * or a negative AVERROR.
+ */
+int computeWaveform(const char *url, int bucketCount, int channelCount, int parallelism,
+                    std::vector<float> *output);
+
+#endif //NEXTPLAYER_FFWAVEFORM_H
@@ -0,0 +1,450 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkNotNull;
+import static androidx.media3.common.util.Assertions.checkState;
+
+import android.os.Build;
+import android.os.SystemClock;
+import androidx.annotation.Nullable;
+import androidx.media3.common.AudioAttributes;
+import androidx.media3.common.AuxEffectInfo;
+import androidx.media3.common.C;
+import androidx.media3.common.Format;
+import androidx.media3.common.MimeTypes;
+import androidx.media3.common.PlaybackParameters;
+import androidx.media3.common.util.Log;
+import androidx.media3.common.util.UnstableApi;
+import androidx.media3.common.util.Util;
+import androidx.media3.exoplayer.audio.AudioSink;
+import java.nio.ByteBuffer;
+
+/**
+ * An {@link AudioSink} that plays PCM through an AAudio stream instead of an {@code AudioTrack},
+ * for low latency playback with an {@link FfmpegAudioRenderer}.
+ *
+ * <p>Each buffer from the decoder is copied once into a native lock-free ring, from which the
+ * AAudio data callback renders directly. The playback position is taken from the AAudio
+ * timestamps and the frames still queued in the device. When the output device changes, the
+ * stream is reopened on the new default device.
+ *
+ * <p>Only 16-bit and float PCM, and from Android 12 24-bit and 32-bit PCM, are supported.
+ * Playback speed, skipping silence, tunneling and audio effects are not; use a {@code
+ * DefaultAudioSink} for these. Requires Android 8.1, see {@link #isSupported()}.
+ */
+@UnstableApi
+public final class AAudioSink implements AudioSink {
+
+  private static final String TAG = "AAudioSink";
+
+  // AAUDIO_PERFORMANCE_MODE values of AAudio.
+  private static final int PERFORMANCE_MODE_NONE = 10;
+  private static final int PERFORMANCE_MODE_LOW_LATENCY = 12;
+
+  /** The ring duration if the renderer does not specify a buffer size. */
+  private static final int DEFAULT_BUFFER_MS = 250;
+  /** Deviation of the buffer timestamps from the written duration that is taken as a jump. */
+  private static final long MAX_TIMESTAMP_DEVIATION_US = 200_000;
+
+  private final boolean lowLatency;
+  private long nativeContext;
+
+  @Nullable private Listener listener;
+  @Nullable private AudioAttributes audioAttributes;
+  private float volume = 1f;
+
+  @Nullable private Format pendingFormat;
+  private int pendingBufferSize;
+  @Nullable private Format format;
+  private int frameSize;
+  private int bufferSize;
+  private boolean outputOpen;
+
+  private boolean playing;
+  private boolean started;
+  private boolean handledEndOfStream;
+  private boolean startMediaTimeUsNeedsInit;
+  private boolean startMediaTimeUsNeedsSync;
+  private long startMediaTimeUs;
+  private long writtenFrames;
+  @Nullable private ByteBuffer inputBuffer;
+  private long underrunCount;
+  private long lastFeedElapsedRealtimeMs;
+
+  /** Returns whether AAudio output is available on this device. */
+  public static boolean isSupported() {
+    // AAudio streams are unreliable on Android 8.0.
+    return Build.VERSION.SDK_INT >= 27 && FfmpegLibrary.isAvailable() && ffmpegIsAvailable();
+  }
+
+  /**
+   * Creates a sink.
+   *
+   * @param lowLatency Whether to request a low latency stream, which keeps only two bursts
+   *     queued in the device. Otherwise the device picks a latency that saves power.
+   */
+  public AAudioSink(boolean lowLatency) {
+    checkState(isSupported());
+    this.lowLatency = lowLatency;
+    nativeContext = ffmpegInitialize();
+  }
+
+  @Override
+  public void setListener(Listener listener) {
+    this.listener = listener;
+  }
+
+  @Override
+  public boolean supportsFormat(Format format) {
+    return getFormatSupport(format) != SINK_FORMAT_UNSUPPORTED;
+  }
+
+  @Override
+  public @SinkFormatSupport int getFormatSupport(Format format) {
+    if (!MimeTypes.AUDIO_RAW.equals(format.sampleMimeType)
+        || format.channelCount < 1
+        || format.channelCount > 8) {
+      return SINK_FORMAT_UNSUPPORTED;
+    }
+    switch (format.pcmEncoding) {
+      case C.ENCODING_PCM_16BIT:
+      case C.ENCODING_PCM_FLOAT:
+        return SINK_FORMAT_SUPPORTED_DIRECTLY;
+      case C.ENCODING_PCM_24BIT:
+      case C.ENCODING_PCM_32BIT:
+        return Build.VERSION.SDK_INT >= 31
+            ? SINK_FORMAT_SUPPORTED_DIRECTLY
+            : SINK_FORMAT_UNSUPPORTED;
+      default:
+        return SINK_FORMAT_UNSUPPORTED;
+    }
+  }
+
+  @Override
+  public long getCurrentPositionUs(boolean sourceEnded) {
+    if (!outputOpen || startMediaTimeUsNeedsInit) {
+      return CURRENT_POSITION_NOT_SET;
+    }
+    long positionFrames = Math.min(ffmpegGetPositionFrames(nativeContext), writtenFrames);
+    return startMediaTimeUs + framesToDurationUs(positionFrames);
+  }
+
+  @Override
+  public void configure(Format inputFormat, int specifiedBufferSize, @Nullable int[] outputChannels)
+      throws ConfigurationException {
+    if (getFormatSupport(inputFormat) == SINK_FORMAT_UNSUPPORTED) {
+      throw new ConfigurationException("Unsupported format: " + inputFormat, inputFormat);
+    }
+    if (outputChannels != null) {
+      throw new ConfigurationException("Channel mapping is not supported.", inputFormat);
+    }
+    Format format = this.format;
+    if (outputOpen
+        && format != null
+        && format.pcmEncoding == inputFormat.pcmEncoding
+        && format.channelCount == inputFormat.channelCount
+        && format.sampleRate == inputFormat.sampleRate
+        && (specifiedBufferSize == 0 || specifiedBufferSize == bufferSize)) {
+      // The stream fits already, e.g. for a new decoder after a seek.
+      pendingFormat = null;
+      return;
+    }
+    // Applied once the audio of the current format has played out, see handleBuffer.
+    pendingFormat = inputFormat;
+    pendingBufferSize = specifiedBufferSize;
+  }
+
+  @Override
+  public void play() {
+    playing = true;
+    if (outputOpen && !started && writtenFrames > 0) {
+      start();
+    }
+  }
+
+  @Override
+  public void handleDiscontinuity() {
+    startMediaTimeUsNeedsSync = true;
+  }
+
+  @Override
+  public boolean handleBuffer(
+      ByteBuffer buffer, long presentationTimeUs, int encodedAccessUnitCount)
+      throws InitializationException, WriteException {
+    if (pendingFormat != null) {
+      if (outputOpen && hasPendingData()) {
+        // Let the previous format play out first.
+        playToEndOfStream();
+        return false;
+      }
+      openOutput(checkNotNull(pendingFormat));
+    }
+    if (!buffer.isDirect()) {
+      throw new WriteException(C.LENGTH_UNSET, checkNotNull(format), /* isRecoverable= */ false);
+    }
+    if (buffer != inputBuffer) {
+      inputBuffer = buffer;
+      syncStartMediaTime(presentationTimeUs);
+    }
+    int size = buffer.remaining();
+    int written = ffmpegWrite(nativeContext, buffer, buffer.position(), size);
+    if (written < 0) {
+      // The stream was lost and could not be reopened.
+      throw new WriteException(written, checkNotNull(format), /* isRecoverable= */ true);
+    }
+    buffer.position(buffer.position() + written);
+    writtenFrames += written / frameSize;
+    handledEndOfStream = false;
+    lastFeedElapsedRealtimeMs = SystemClock.elapsedRealtime();
+    if (playing && !started && writtenFrames > 0) {
+      start();
+    }
+    reportUnderruns();
+    if (written < size) {
+      return false;
+    }
+    inputBuffer = null;
+    return true;
+  }
+
+  @Override
+  public void playToEndOfStream() {
+    if (outputOpen && !handledEndOfStream) {
+      ffmpegSetEndOfStream(nativeContext);
+      handledEndOfStream = true;
+      if (playing && !started && writtenFrames > 0) {
+        start();
+      }
+    }
+  }
+
+  @Override
+  public boolean isEnded() {
+    return !outputOpen || (handledEndOfStream && !hasPendingData());
+  }
+
+  @Override
+  public boolean hasPendingData() {
+    return outputOpen && ffmpegGetPositionFrames(nativeContext) < writtenFrames;
+  }
+
+  /** Playback speed is not supported, the parameters are ignored. */
+  @Override
+  public void setPlaybackParameters(PlaybackParameters playbackParameters) {}
+
+  @Override
+  public PlaybackParameters getPlaybackParameters() {
+    return PlaybackParameters.DEFAULT;
+  }
+
+  /** Skipping silence is not supported. */
+  @Override
+  public void setSkipSilenceEnabled(boolean skipSilenceEnabled) {}
+
+  @Override
+  public boolean getSkipSilenceEnabled() {
+    return false;
+  }
+
+  @Override
+  public void setAudioAttributes(AudioAttributes audioAttributes) {
+    this.audioAttributes = audioAttributes;
+  }
+
+  @Nullable
+  @Override
+  public AudioAttributes getAudioAttributes() {
+    return audioAttributes;
+  }
+
+  @Override
+  public void setAudioSessionId(int audioSessionId) {}
+
+  @Override
+  public void setAuxEffectInfo(AuxEffectInfo auxEffectInfo) {}
+
+  @Override
+  public void enableTunnelingV21() {}
+
+  @Override
+  public void disableTunneling() {}
+
+  @Override
+  public void setVolume(float volume) {
+    this.volume = volume;
+    if (outputOpen) {
+      ffmpegSetVolume(nativeContext, volume);
+    }
+  }
+
+  @Override
+  public void pause() {
+    playing = false;
+    if (started) {
+      ffmpegPause(nativeContext);
+      started = false;
+    }
+  }
+
+  @Override
+  public void flush() {
+    if (outputOpen) {
+      ffmpegFlush(nativeContext);
+    }
+    started = false;
+    resetPosition();
+  }
+
+  @Override
+  public void reset() {
+    flush();
+    closeOutput();
+    playing = false;
+    pendingFormat = null;
+  }
+
+  @Override
+  public void release() {
+    closeOutput();
+    if (nativeContext != 0) {
+      ffmpegRelease(nativeContext);
+      nativeContext = 0;
+    }
+  }
+
+  private void openOutput(Format format) throws InitializationException {
+    closeOutput();
+    frameSize = Util.getPcmFrameSize(format.pcmEncoding, format.channelCount);
+    int bufferFrames =
+        pendingBufferSize > 0
+            ? pendingBufferSize / frameSize
+            : format.sampleRate * DEFAULT_BUFFER_MS / 1000;
+    bufferSize = bufferFrames * frameSize;
+    if (!ffmpegOpen(
+        nativeContext,
+        format.channelCount,
+        format.sampleRate,
+        format.pcmEncoding,
+        bufferFrames,
+        lowLatency ? PERFORMANCE_MODE_LOW_LATENCY : PERFORMANCE_MODE_NONE,
+        volume)) {
+      throw new InitializationException(
+          C.LENGTH_UNSET,
+          format.sampleRate,
+          format.channelCount,
+          bufferSize,
+          format,
+          /* isRecoverable= */ false,
+          /* audioTrackException= */ null);
+    }
+    this.format = format;
+    pendingFormat = null;
+    outputOpen = true;
+    resetPosition();
+  }
+
+  private void closeOutput() {
+    if (outputOpen) {
+      ffmpegClose(nativeContext);
+      outputOpen = false;
+      started = false;
+    }
+  }
+
+  private void start() {
+    if (ffmpegStart(nativeContext)) {
+      started = true;
+    } else {
+      Log.w(TAG, "Failed to start the AAudio stream.");
+    }
+  }
+
+  private void resetPosition() {
+    writtenFrames = 0;
+    handledEndOfStream = false;
+    startMediaTimeUsNeedsInit = true;
+    startMediaTimeUsNeedsSync = false;
+    inputBuffer = null;
+    underrunCount = outputOpen ? ffmpegGetUnderrunCount(nativeContext) : 0;
+  }
+
+  /**
+   * Anchors the media time to the first buffer, and moves it if a buffer does not follow on from
+   * the audio written before it.
+   */
+  private void syncStartMediaTime(long presentationTimeUs) {
+    if (startMediaTimeUsNeedsInit) {
+      startMediaTimeUs = Math.max(0, presentationTimeUs);
+      startMediaTimeUsNeedsInit = false;
+      startMediaTimeUsNeedsSync = false;
+      return;
+    }
+    long expectedPresentationTimeUs = startMediaTimeUs + framesToDurationUs(writtenFrames);
+    long adjustmentUs = presentationTimeUs - expectedPresentationTimeUs;
+    if (!startMediaTimeUsNeedsSync && Math.abs(adjustmentUs) > MAX_TIMESTAMP_DEVIATION_US) {
+      Log.w(
+          TAG,
+          "Discontinuity detected [expected "
+              + expectedPresentationTimeUs
+              + ", got "
+              + presentationTimeUs
+              + "]");
+      startMediaTimeUsNeedsSync = true;
+    }
+    if (startMediaTimeUsNeedsSync) {
+      startMediaTimeUs += adjustmentUs;
+      startMediaTimeUsNeedsSync = false;
+      if (adjustmentUs != 0 && listener != null) {
+        listener.onPositionDiscontinuity();
+      }
+    }
+  }
+
+  private void reportUnderruns() {
+    long count = ffmpegGetUnderrunCount(nativeContext);
+    if (count > underrunCount && listener != null) {
+      Format format = checkNotNull(this.format);
+      listener.onUnderrun(
+          bufferSize,
+          (long) bufferSize / frameSize * 1000 / format.sampleRate,
+          SystemClock.elapsedRealtime() - lastFeedElapsedRealtimeMs);
+    }
+    underrunCount = count;
+  }
+
+  private long framesToDurationUs(long frames) {
+    return Util.scaleLargeTimestamp(frames, C.MICROS_PER_SECOND, checkNotNull(format).sampleRate);
+  }
+
+  private static native boolean ffmpegIsAvailable();
+
+  private native long ffmpegInitialize();
+
+  private native boolean ffmpegOpen(
+      long context,
+      int channelCount,
+      int sampleRate,
+      int encoding,
+      int bufferFrames,
+      int performanceMode,
+      float volume);
+
+  private native int ffmpegWrite(long context, ByteBuffer buffer, int offset, int size);
+
+  private native boolean ffmpegStart(long context);
+
+  private native boolean ffmpegPause(long context);
+
+  private native boolean ffmpegFlush(long context);
+
+  private native void ffmpegSetEndOfStream(long context);
+
+  private native void ffmpegSetVolume(long context, float volume);
+
+  private native long ffmpegGetPositionFrames(long context);
+
+  private native long ffmpegGetUnderrunCount(long context);
+
+  private native void ffmpegClose(long context);
+
+  private native void ffmpegRelease(long context);
+}
@@ -0,0 +1,143 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+import static androidx.media3.common.util.Assertions.checkNotNull;
+import static androidx.media3.common.util.Assertions.checkState;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.C;
+import androidx.media3.common.Format;
+import androidx.media3.common.util.UnstableApi;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Decodes audio in batches of packets, for offline work such as waveforms, export or
+ * transcription where the packets are available ahead of time.
+ *
+ * <p>Unlike the decoder of {@link FfmpegAudioRenderer}, which crosses JNI once per access unit
+ * and may call back into Java to grow its output buffer, each call to {@link #decode} decodes
+ * many packets into one native output buffer. For codecs with small packets such as Opus, AMR
+ * or MP3 that removes most of the per-packet overhead.
+ *
+ * <p>Instances are not thread safe.
+ */
+@UnstableApi
+public final class FfmpegAudioBatchDecoder {
+
+  @Nullable private final byte[] extraData;
+  private final @C.PcmEncoding int encoding;
+  private long nativeContext;
+
+  /**
+   * @param format The format of the packets.
+   * @param outputFloat Whether to output float instead of 16-bit PCM.
+   * @throws FfmpegDecoderException If the decoder could not be created.
+   */
+  public FfmpegAudioBatchDecoder(Format format, boolean outputFloat)
+      throws FfmpegDecoderException {
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    checkNotNull(format.sampleMimeType);
+    String codecName = checkNotNull(FfmpegLibrary.getCodecName(format.sampleMimeType));
+    extraData = FfmpegAudioDecoder.getExtraData(format.sampleMimeType, format.initializationData);
+    encoding = outputFloat ? C.ENCODING_PCM_FLOAT : C.ENCODING_PCM_16BIT;
+    nativeContext =
+        ffmpegInitialize(codecName, extraData, outputFloat, format.sampleRate, format.channelCount);
+    if (nativeContext == 0) {
+      throw new FfmpegDecoderException("Initialization failed.");
+    }
+  }
+
+  /**
+   * Decodes {@code packetCount} packets that are stored back to back from the start of {@code
+   * input}.
+   *
+   * <p>Packets with invalid data are skipped and produce no output, like in the decoder of
+   * {@link FfmpegAudioRenderer}.
+   *
+   * @param input A direct buffer holding the packets, padded by {@link
+   *     FfmpegLibrary#getInputBufferPaddingSize()} bytes.
+   * @param packetSizes The size of each packet.
+   * @param timesUs The timestamp of each packet.
+   * @param packetCount The number of packets to decode.
+   * @param outputEnds Receives, for each packet, the end offset of its output in the returned
+   *     buffer.
+   * @return The decoded audio of all packets. The buffer is owned by the decoder and is only
+   *     valid until the next call to any method of this decoder.
+   * @throws FfmpegDecoderException If decoding failed.
+   */
+  public ByteBuffer decode(
+      ByteBuffer input, int[] packetSizes, long[] timesUs, int packetCount, int[] outputEnds)
+      throws FfmpegDecoderException {
+    checkState(nativeContext != 0);
+    checkArgument(input.isDirect());
+    @Nullable
+    ByteBuffer output =
+        ffmpegDecode(nativeContext, input, packetSizes, timesUs, packetCount, outputEnds);
+    if (output == null) {
+      throw new FfmpegDecoderException("Error decoding (see logcat).");
+    }
+    return output.order(ByteOrder.nativeOrder());
+  }
+
+  /** Discards the decoder state, e.g. before decoding packets after a seek. */
+  public void flush() throws FfmpegDecoderException {
+    checkState(nativeContext != 0);
+    nativeContext = ffmpegReset(nativeContext, extraData);
+    if (nativeContext == 0) {
+      throw new FfmpegDecoderException("Error resetting (see logcat).");
+    }
+  }
+
+  /** Returns the channel count of the output, valid once audio has been decoded. */
+  public int getChannelCount() {
+    checkState(nativeContext != 0);
+    return ffmpegGetChannelCount(nativeContext);
+  }
+
+  /** Returns the sample rate of the output, valid once audio has been decoded. */
+  public int getSampleRate() {
+    checkState(nativeContext != 0);
+    return ffmpegGetSampleRate(nativeContext);
+  }
+
+  /** Returns the encoding of the output. */
+  public @C.PcmEncoding int getEncoding() {
+    return encoding;
+  }
+
+  /** Releases the decoder. It must not be used afterwards. */
+  public void release() {
+    if (nativeContext != 0) {
+      ffmpegRelease(nativeContext);
+      nativeContext = 0;
+    }
+  }
+
+  private native long ffmpegInitialize(
+      String codecName,
+      @Nullable byte[] extraData,
+      boolean outputFloat,
+      int rawSampleRate,
+      int rawChannelCount);
+
+  @Nullable
+  private native ByteBuffer ffmpegDecode(
+      long context,
+      ByteBuffer input,
+      int[] packetSizes,
+      long[] timesUs,
+      int packetCount,
+      int[] outputEnds);
+
+  private native int ffmpegGetChannelCount(long context);
+
+  private native int ffmpegGetSampleRate(long context);
+
+  private native long ffmpegReset(long context, @Nullable byte[] extraData);
+
+  private native void ffmpegRelease(long context);
+}
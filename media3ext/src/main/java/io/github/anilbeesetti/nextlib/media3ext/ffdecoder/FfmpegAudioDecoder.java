@@ -36,7 +36,7 @@ final class FfmpegAudioDecoder
   private final @C.PcmEncoding int encoding;
   private int outputBufferSize;
 
-  private long nativeContext; // May be reassigned on resetting the codec.
+  private volatile long nativeContext; // May be reassigned on resetting the codec.
   private boolean hasOutputFormat;
   private volatile int channelCount;
   private volatile int sampleRate;
@@ -46,7 +46,13 @@ final class FfmpegAudioDecoder
       int numInputBuffers,
       int numOutputBuffers,
       int initialInputBufferSize,
-      boolean outputFloat)
+      @C.PcmEncoding int outputEncoding,
+      int downmixChannelCount,
+      int downmixMode,
+      int targetSampleRate,
+      int resampleQuality,
+      @Nullable FfmpegAudioEffects audioEffects,
+      @Nullable FfmpegSpectrumAnalyzer spectrumAnalyzer)
       throws FfmpegDecoderException {
     super(new DecoderInputBuffer[numInputBuffers], new SimpleDecoderOutputBuffer[numOutputBuffers]);
     if (!FfmpegLibrary.isAvailable()) {
@@ -55,10 +61,25 @@ final class FfmpegAudioDecoder
     checkNotNull(format.sampleMimeType);
     codecName = checkNotNull(FfmpegLibrary.getCodecName(format.sampleMimeType));
     extraData = getExtraData(format.sampleMimeType, format.initializationData);
-    encoding = outputFloat ? C.ENCODING_PCM_FLOAT : C.ENCODING_PCM_16BIT;
-    outputBufferSize = outputFloat ? INITIAL_OUTPUT_BUFFER_SIZE_32BIT : INITIAL_OUTPUT_BUFFER_SIZE_16BIT;
+    encoding = outputEncoding;
+    // 24-bit output is decoded to 32-bit samples and packed in the same buffer.
+    outputBufferSize =
+        outputEncoding == C.ENCODING_PCM_16BIT
+            ? INITIAL_OUTPUT_BUFFER_SIZE_16BIT
+            : INITIAL_OUTPUT_BUFFER_SIZE_32BIT;
     nativeContext =
-        ffmpegInitialize(codecName, extraData, outputFloat, format.sampleRate, format.channelCount);
+        ffmpegInitialize(
+            codecName,
+            extraData,
+            outputEncoding,
+            format.sampleRate,
+            format.channelCount,
+            downmixChannelCount,
+            downmixMode,
+            targetSampleRate,
+            resampleQuality,
+            audioEffects != null ? audioEffects.getNativeContext() : 0,
+            spectrumAnalyzer != null ? spectrumAnalyzer.getNativeContext() : 0);
     if (nativeContext == 0) {
       throw new FfmpegDecoderException("Initialization failed.");
     }
@@ -147,8 +168,19 @@ final class FfmpegAudioDecoder
   @Override
   public void release() {
     super.release();
-    ffmpegRelease(nativeContext);
+    long context = nativeContext;
     nativeContext = 0;
+    ffmpegRelease(context);
+  }
+
+  /**
+   * Returns the native counters and latency histograms of this decoder, or {@code null} once it
+   * has been released.
+   */
+  @Nullable
+  public FfmpegDecoderStats getDecoderStats() {
+    long context = nativeContext;
+    return context != 0 ? FfmpegDecoderStats.fromNative(ffmpegGetStats(context)) : null;
   }
 
   /** Returns the channel count of output audio. */
@@ -171,7 +203,7 @@ final class FfmpegAudioDecoder
    * not required.
    */
   @Nullable
-  private static byte[] getExtraData(String mimeType, List<byte[]> initializationData) {
+  /* package */ static byte[] getExtraData(String mimeType, List<byte[]> initializationData) {
     if (initializationData.isEmpty()) return null;
     return switch (mimeType) {
       case MimeTypes.AUDIO_AAC, MimeTypes.AUDIO_OPUS -> initializationData.get(0);
@@ -216,9 +248,15 @@ final class FfmpegAudioDecoder
   private native long ffmpegInitialize(
       String codecName,
       @Nullable byte[] extraData,
-      boolean outputFloat,
+      int outputEncoding,
       int rawSampleRate,
-      int rawChannelCount);
+      int rawChannelCount,
+      int downmixChannelCount,
+      int downmixMode,
+      int targetSampleRate,
+      int resampleQuality,
+      long audioEffects,
+      long spectrumAnalyzer);
 
   private native int ffmpegDecode(
       long context, ByteBuffer inputData, int inputSize, SimpleDecoderOutputBuffer decoderOutputBuffer, ByteBuffer outputData, int outputSize);
@@ -230,4 +268,7 @@ final class FfmpegAudioDecoder
   private native long ffmpegReset(long context, @Nullable byte[] extraData);
 
   private native void ffmpegRelease(long context);
+
+  @Nullable
+  private native long[] ffmpegGetStats(long context);
 }
@@ -0,0 +1,145 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+import static androidx.media3.common.util.Assertions.checkState;
+
+import androidx.media3.common.util.UnstableApi;
+
+import java.util.List;
+
+/**
+ * Gain, ReplayGain and a parametric equalizer applied natively to the output of an {@link
+ * FfmpegAudioRenderer}'s decoder, replacing {@link androidx.media3.common.audio.AudioProcessor}s
+ * that would each make another pass over the PCM.
+ *
+ * <p>The effects run on every decoded frame right after it has been converted to the output
+ * format, while it is still in cache, and cost nothing while they are neutral. Every setter
+ * replaces all parameters at once, so a decoder never applies half an update. Gain changes are
+ * ramped over 20 ms. Setters may be called from any thread.
+ *
+ * <p>With 16-bit output, boosts that exceed full scale are clipped; prefer float output, see
+ * {@link androidx.media3.exoplayer.audio.DefaultAudioSink.Builder#setEnableFloatOutput}.
+ */
+@UnstableApi
+public final class FfmpegAudioEffects {
+
+  // LINT.IfChange
+  /** A peaking band, boosting or cutting around its frequency. */
+  public static final int FILTER_PEAKING = 0;
+  /** A low shelf, boosting or cutting below its frequency. */
+  public static final int FILTER_LOW_SHELF = 1;
+  /** A high shelf, boosting or cutting above its frequency. */
+  public static final int FILTER_HIGH_SHELF = 2;
+
+  /** The maximum number of equalizer bands. */
+  public static final int MAX_EQ_BANDS = 10;
+  // LINT.ThenChange(../../../../../../../cpp/ffdsp.h)
+
+  /** An equalizer band. */
+  public static final class EqBand {
+
+    /** One of the {@code FILTER_*} constants. */
+    public final int type;
+    /** The centre or corner frequency in Hz. Bands at or above half the sample rate are skipped. */
+    public final float frequencyHz;
+    /** The gain in dB. */
+    public final float gainDb;
+    /** The quality factor, or the shelf slope for shelves. 0.707 is a Butterworth response. */
+    public final float q;
+
+    public EqBand(int type, float frequencyHz, float gainDb, float q) {
+      checkArgument(type >= FILTER_PEAKING && type <= FILTER_HIGH_SHELF);
+      checkArgument(frequencyHz > 0 && q > 0);
+      this.type = type;
+      this.frequencyHz = frequencyHz;
+      this.gainDb = gainDb;
+      this.q = q;
+    }
+  }
+
+  private long nativeContext;
+  private float gainDb;
+  private float replayGainDb;
+  private float replayGainPeak;
+  private final int[] eqTypes = new int[MAX_EQ_BANDS];
+  private final float[] eqValues = new float[MAX_EQ_BANDS * 3];
+  private int eqBandCount;
+
+  /**
+   * Creates neutral effects.
+   *
+   * @throws FfmpegDecoderException If the native libraries are not available.
+   */
+  public FfmpegAudioEffects() throws FfmpegDecoderException {
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    nativeContext = ffmpegInitialize();
+  }
+
+  /** Sets a gain in dB, e.g. for volume normalisation. */
+  public synchronized void setGain(float gainDb) {
+    this.gainDb = gainDb;
+    publish();
+  }
+
+  /**
+   * Sets the ReplayGain of the track or album.
+   *
+   * @param gainDb The gain in dB, including any preamp.
+   * @param peak The linear peak of the track or album, to limit the gain so that the peak does
+   *     not clip, or 0 to not limit it.
+   */
+  public synchronized void setReplayGain(float gainDb, float peak) {
+    checkArgument(peak >= 0);
+    replayGainDb = gainDb;
+    replayGainPeak = peak;
+    publish();
+  }
+
+  /** Replaces the equalizer bands, which are applied in order. An empty list disables it. */
+  public synchronized void setEqualizer(List<EqBand> bands) {
+    checkArgument(bands.size() <= MAX_EQ_BANDS);
+    for (int i = 0; i < bands.size(); i++) {
+      EqBand band = bands.get(i);
+      eqTypes[i] = band.type;
+      eqValues[i * 3] = band.frequencyHz;
+      eqValues[i * 3 + 1] = band.gainDb;
+      eqValues[i * 3 + 2] = band.q;
+    }
+    eqBandCount = bands.size();
+    publish();
+  }
+
+  /** Releases the effects. They must not be used afterwards. */
+  public synchronized void release() {
+    if (nativeContext != 0) {
+      ffmpegRelease(nativeContext);
+      nativeContext = 0;
+    }
+  }
+
+  /* package */ synchronized long getNativeContext() {
+    checkState(nativeContext != 0);
+    return nativeContext;
+  }
+
+  private void publish() {
+    checkState(nativeContext != 0);
+    ffmpegSetParameters(
+        nativeContext, gainDb, replayGainDb, replayGainPeak, eqTypes, eqValues, eqBandCount);
+  }
+
+  private native long ffmpegInitialize();
+
+  private native void ffmpegSetParameters(
+      long context,
+      float gainDb,
+      float replayGainDb,
+      float replayGainPeak,
+      int[] eqTypes,
+      float[] eqValues,
+      int eqBandCount);
+
+  private native void ffmpegRelease(long context);
+}
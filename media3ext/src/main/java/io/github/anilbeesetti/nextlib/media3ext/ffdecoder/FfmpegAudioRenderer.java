@@ -26,6 +26,26 @@ import androidx.media3.exoplayer.audio.DefaultAudioSink;
 @UnstableApi
 public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioDecoder> {
 
+  // LINT.IfChange
+  /** ITU-R BS.775 levels: centre and surround channels at -3 dB, the LFE channel dropped. */
+  public static final int DOWNMIX_MODE_STANDARD = 0;
+  /** As {@link #DOWNMIX_MODE_STANDARD}, with the LFE channel mixed in at -3 dB. */
+  public static final int DOWNMIX_MODE_WITH_LFE = 1;
+  /** Dolby Surround compatible stereo. Other channel counts use the standard levels. */
+  public static final int DOWNMIX_MODE_DOLBY = 2;
+  /** Dolby Pro Logic II compatible stereo. Other channel counts use the standard levels. */
+  public static final int DOWNMIX_MODE_DPLII = 3;
+  // LINT.ThenChange(../../../../../../../cpp/ffdownmix.h)
+
+  // LINT.IfChange
+  /** Short resampling filter, for low-end devices. */
+  public static final int RESAMPLE_QUALITY_FAST = 0;
+  /** The swresample default filter. */
+  public static final int RESAMPLE_QUALITY_DEFAULT = 1;
+  /** Long resampling filter with a steep cutoff, for hi-res content. */
+  public static final int RESAMPLE_QUALITY_HIGH = 2;
+  // LINT.ThenChange(../../../../../../../cpp/ffaudiocore.h)
+
   private static final String TAG = "FfmpegAudioRenderer";
 
   /** The number of input and output buffers. */
@@ -33,6 +53,15 @@ public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioD
   /** The default input buffer size. */
   private static final int DEFAULT_INPUT_BUFFER_SIZE = 960 * 6;
 
+  @Nullable private volatile FfmpegAudioDecoder decoder;
+  private volatile int downmixChannelCount;
+  private volatile int downmixMode = DOWNMIX_MODE_STANDARD;
+  private volatile int targetSampleRate;
+  private volatile int resampleQuality = RESAMPLE_QUALITY_DEFAULT;
+  @Nullable private volatile FfmpegAudioEffects audioEffects;
+  @Nullable private volatile FfmpegSpectrumAnalyzer spectrumAnalyzer;
+  private volatile boolean enableIntegerOutput;
+
   public FfmpegAudioRenderer(Context context) {
     this(/* eventHandler= */ null, /* eventListener= */ null, /* context= */ context);
   }
@@ -71,6 +100,71 @@ public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioD
     super(eventHandler, eventListener, audioSink);
   }
 
+  /**
+   * Mixes audio with more than {@code channelCount} channels down in the decoder, so that the
+   * sink receives at most {@code channelCount} channels. The mix is done natively in the same
+   * pass as the sample format conversion. Takes effect for decoders created afterwards, e.g.
+   * after the next format change.
+   *
+   * @param channelCount The maximum channel count to output, or 0 to output all channels.
+   * @param mode How the channels are mixed, one of the {@code DOWNMIX_MODE_*} constants.
+   */
+  public void setDownmix(int channelCount, int mode) {
+    Assertions.checkArgument(channelCount >= 0 && channelCount <= 8);
+    downmixChannelCount = channelCount;
+    downmixMode = mode;
+  }
+
+  /**
+   * Converts decoded audio to {@code sampleRate} in the decoder, in the same pass as the sample
+   * format conversion, instead of leaving it to the platform mixer. Pass the device output rate,
+   * {@code AudioManager.getProperty(AudioManager.PROPERTY_OUTPUT_SAMPLE_RATE)}, to avoid a
+   * second resampling step. Takes effect for decoders created afterwards.
+   *
+   * @param sampleRate The output sample rate in Hz, or 0 to output the decoded rate.
+   * @param quality The resampler preset, one of the {@code RESAMPLE_QUALITY_*} constants.
+   */
+  public void setOutputSampleRate(int sampleRate, int quality) {
+    Assertions.checkArgument(sampleRate >= 0);
+    targetSampleRate = sampleRate;
+    resampleQuality = quality;
+  }
+
+  /**
+   * Applies {@code audioEffects} natively to the decoded audio, in place of gain and equalizer
+   * {@link AudioProcessor}s. Their parameters can be changed at any time, but setting or
+   * clearing the effects takes effect for decoders created afterwards, so set them before
+   * preparing the player.
+   *
+   * @param audioEffects The effects, or {@code null} to apply none.
+   */
+  public void setAudioEffects(@Nullable FfmpegAudioEffects audioEffects) {
+    this.audioEffects = audioEffects;
+  }
+
+  /**
+   * Feeds decoded audio to {@code spectrumAnalyzer}, which computes magnitude bands natively
+   * for a visualizer. Takes effect for decoders created afterwards, so set it before preparing
+   * the player.
+   *
+   * @param spectrumAnalyzer The analyzer, or {@code null} to stop analysing.
+   */
+  public void setSpectrumAnalyzer(@Nullable FfmpegSpectrumAnalyzer spectrumAnalyzer) {
+    this.spectrumAnalyzer = spectrumAnalyzer;
+  }
+
+  /**
+   * Outputs lossless formats (FLAC, ALAC and TrueHD) of more than 16 bits as packed 24-bit PCM,
+   * or as 32-bit PCM if the sink only takes that, instead of float or 16-bit PCM. The samples
+   * reach the sink bit-exact, with a quarter less data than float for 24-bit output. Only used
+   * if the sink supports the encoding directly. Takes effect for decoders created afterwards.
+   *
+   * @param enableIntegerOutput Whether to output high-resolution integer PCM.
+   */
+  public void setEnableIntegerOutput(boolean enableIntegerOutput) {
+    this.enableIntegerOutput = enableIntegerOutput;
+  }
+
   @Override
   public String getName() {
     return TAG;
@@ -110,11 +204,32 @@ public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioD
         format.maxInputSize != Format.NO_VALUE ? format.maxInputSize : DEFAULT_INPUT_BUFFER_SIZE;
     FfmpegAudioDecoder decoder =
         new FfmpegAudioDecoder(
-            format, NUM_BUFFERS, NUM_BUFFERS, initialInputBufferSize, shouldOutputFloat(format));
+            format,
+            NUM_BUFFERS,
+            NUM_BUFFERS,
+            initialInputBufferSize,
+            getOutputEncoding(format),
+            downmixChannelCount,
+            downmixMode,
+            targetSampleRate,
+            resampleQuality,
+            audioEffects,
+            spectrumAnalyzer);
     TraceUtil.endSection();
+    this.decoder = decoder;
     return decoder;
   }
 
+  /**
+   * Returns the native counters and latency histograms of the current decoder, or {@code null}
+   * if there is no decoder.
+   */
+  @Nullable
+  public FfmpegDecoderStats getDecoderStats() {
+    FfmpegAudioDecoder decoder = this.decoder;
+    return decoder != null ? decoder.getDecoderStats() : null;
+  }
+
   /**
    * {@inheritDoc}
    *
@@ -137,7 +252,53 @@ public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioD
    */
   private boolean sinkSupportsFormat(Format inputFormat, @C.PcmEncoding int pcmEncoding) {
     return sinkSupportsFormat(
-        Util.getPcmFormat(pcmEncoding, inputFormat.channelCount, inputFormat.sampleRate));
+        Util.getPcmFormat(
+            pcmEncoding, getOutputChannelCount(inputFormat), getOutputSampleRate(inputFormat)));
+  }
+
+  /** Returns the channel count the decoder will output for the given input format. */
+  private int getOutputChannelCount(Format inputFormat) {
+    int downmixChannelCount = this.downmixChannelCount;
+    return downmixChannelCount > 0 && inputFormat.channelCount > downmixChannelCount
+        ? downmixChannelCount
+        : inputFormat.channelCount;
+  }
+
+  /** Returns the sample rate the decoder will output for the given input format. */
+  private int getOutputSampleRate(Format inputFormat) {
+    int targetSampleRate = this.targetSampleRate;
+    return targetSampleRate > 0 ? targetSampleRate : inputFormat.sampleRate;
+  }
+
+  private @C.PcmEncoding int getOutputEncoding(Format inputFormat) {
+    if (enableIntegerOutput && isHighResolutionLossless(inputFormat)) {
+      if (sinkSupportsFormatDirectly(inputFormat, C.ENCODING_PCM_24BIT)) {
+        return C.ENCODING_PCM_24BIT;
+      }
+      if (sinkSupportsFormatDirectly(inputFormat, C.ENCODING_PCM_32BIT)) {
+        return C.ENCODING_PCM_32BIT;
+      }
+    }
+    return shouldOutputFloat(inputFormat) ? C.ENCODING_PCM_FLOAT : C.ENCODING_PCM_16BIT;
+  }
+
+  /**
+   * Returns whether the input format is lossless and may have more than 16 bits per sample.
+   * Containers that do not report the sample depth are assumed to.
+   */
+  private static boolean isHighResolutionLossless(Format inputFormat) {
+    String mimeType = inputFormat.sampleMimeType;
+    return (MimeTypes.AUDIO_FLAC.equals(mimeType)
+            || MimeTypes.AUDIO_ALAC.equals(mimeType)
+            || MimeTypes.AUDIO_TRUEHD.equals(mimeType))
+        && inputFormat.pcmEncoding != C.ENCODING_PCM_16BIT;
+  }
+
+  private boolean sinkSupportsFormatDirectly(Format inputFormat, @C.PcmEncoding int pcmEncoding) {
+    return getSinkFormatSupport(
+            Util.getPcmFormat(
+                pcmEncoding, getOutputChannelCount(inputFormat), getOutputSampleRate(inputFormat)))
+        == SINK_FORMAT_SUPPORTED_DIRECTLY;
   }
 
   private boolean shouldOutputFloat(Format inputFormat) {
@@ -150,7 +311,9 @@ public final class FfmpegAudioRenderer extends DecoderAudioRenderer<FfmpegAudioD
     int formatSupport =
         getSinkFormatSupport(
             Util.getPcmFormat(
-                C.ENCODING_PCM_FLOAT, inputFormat.channelCount, inputFormat.sampleRate));
+                C.ENCODING_PCM_FLOAT,
+                getOutputChannelCount(inputFormat),
+                getOutputSampleRate(inputFormat)));
     switch (formatSupport) {
       case SINK_FORMAT_SUPPORTED_DIRECTLY:
         // AC-3 is always 16-bit, so there's no point using floating point. Assume that it's worth
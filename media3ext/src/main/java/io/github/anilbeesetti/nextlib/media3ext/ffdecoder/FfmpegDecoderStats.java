@@ -0,0 +1,187 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Snapshot of the native performance counters and latency histograms of an FFmpeg decoder.
+ * All values are totals since the decoder was created.
+ */
+@UnstableApi
+public final class FfmpegDecoderStats {
+
+    /**
+     * Latency histogram of one native operation. Bucket {@code i} counts durations in
+     * [2^i, 2^(i+1)) microseconds, the first bucket also counts anything shorter and the last one
+     * anything longer.
+     */
+    public static final class Histogram {
+        public final long count;
+        public final long totalUs;
+        public final long maxUs;
+        public final long[] buckets;
+
+        Histogram(long count, long totalUs, long maxUs, long[] buckets) {
+            this.count = count;
+            this.totalUs = totalUs;
+            this.maxUs = maxUs;
+            this.buckets = buckets;
+        }
+
+        /** Returns the mean duration in microseconds, or 0 if nothing was recorded. */
+        public long getAverageUs() {
+            return count > 0 ? totalUs / count : 0;
+        }
+
+        /**
+         * Returns an upper bound of the given percentile in microseconds, accurate to the bucket
+         * width. {@code percentile} is in [0, 100].
+         */
+        public long getPercentileUs(double percentile) {
+            if (count == 0) {
+                return 0;
+            }
+            long target = (long) Math.ceil(count * Math.min(Math.max(percentile, 0), 100) / 100);
+            long seen = 0;
+            for (int i = 0; i < buckets.length - 1; i++) {
+                seen += buckets[i];
+                if (seen >= target) {
+                    return Math.min(1L << (i + 1), maxUs);
+                }
+            }
+            return maxUs;
+        }
+    }
+
+    // LINT.IfChange
+    private static final int VERSION = 1;
+    private static final int HEADER_SIZE = 4;
+    private static final int HISTOGRAM_HEADER_SIZE = 3;
+
+    private static final int COUNTER_PACKETS_SENT = 0;
+    private static final int COUNTER_BYTES_SENT = 1;
+    private static final int COUNTER_FRAMES_DECODED = 2;
+    private static final int COUNTER_FRAMES_DROPPED = 3;
+    private static final int COUNTER_FRAMES_STASHED = 4;
+    private static final int COUNTER_FRAMES_RENDERED = 5;
+    private static final int COUNTER_BYTES_COPIED = 6;
+    private static final int COUNTER_ALLOCATIONS = 7;
+    private static final int COUNTER_TRIMS = 8;
+    private static final int COUNTER_TRIM_BYTES_FREED = 9;
+    private static final int COUNTER_CORRUPT_PACKETS = 10;
+    private static final int COUNTER_PACKETS_DISCARDED = 11;
+
+    private static final int TIMER_SEND_PACKET = 0;
+    private static final int TIMER_RECEIVE_FRAME = 1;
+    private static final int TIMER_DEINTERLACE = 2;
+    private static final int TIMER_SCALE = 3;
+    private static final int TIMER_WINDOW_LOCK = 4;
+    private static final int TIMER_RENDER = 5;
+    private static final int TIMER_RESAMPLE = 6;
+    private static final int TIMER_RESUME = 7;
+    // LINT.ThenChange(../../../../../../../cpp/ffstats.h)
+
+    /** Packets passed to the decoder. */
+    public final long packetsSent;
+    /** Bytes of the packets passed to the decoder. */
+    public final long bytesSent;
+    /** Frames returned by the decoder. */
+    public final long framesDecoded;
+    /** Decoded frames that were never output. */
+    public final long framesDropped;
+    /** Frames kept back by the video decoder until an output buffer was available. */
+    public final long framesStashed;
+    /** Video frames drawn to a surface. */
+    public final long framesRendered;
+    /** Bytes copied into output buffers, surfaces and resampled audio. */
+    public final long bytesCopied;
+    /** Frames, packets and contexts allocated on the decode path. */
+    public final long allocations;
+    /** Times the decoder memory was trimmed. */
+    public final long trims;
+    /** Heap bytes freed by all trims. */
+    public final long trimBytesFreed;
+    /** Packets the decoder rejected as corrupt, each starting a resync to the next keyframe. */
+    public final long corruptPackets;
+    /** Packets discarded while waiting for a keyframe after corrupt input or a trim. */
+    public final long packetsDiscarded;
+
+    /** avcodec_send_packet. */
+    @Nullable public final Histogram sendPacket;
+    /** avcodec_receive_frame. */
+    @Nullable public final Histogram receiveFrame;
+    /** Deinterlacing of one frame or field. */
+    @Nullable public final Histogram deinterlace;
+    /** sws_scale into the window buffer. */
+    @Nullable public final Histogram scale;
+    /** ANativeWindow_lock, which blocks while the compositor holds all buffers. */
+    @Nullable public final Histogram windowLock;
+    /** Drawing one frame to a surface, end to end. */
+    @Nullable public final Histogram render;
+    /** swr_convert of one audio frame. */
+    @Nullable public final Histogram resample;
+    /** Reopening the codec after a trim until its first decoded frame. */
+    @Nullable public final Histogram resume;
+
+    private FfmpegDecoderStats(long[] counters, Histogram[] timers) {
+        packetsSent = counter(counters, COUNTER_PACKETS_SENT);
+        bytesSent = counter(counters, COUNTER_BYTES_SENT);
+        framesDecoded = counter(counters, COUNTER_FRAMES_DECODED);
+        framesDropped = counter(counters, COUNTER_FRAMES_DROPPED);
+        framesStashed = counter(counters, COUNTER_FRAMES_STASHED);
+        framesRendered = counter(counters, COUNTER_FRAMES_RENDERED);
+        bytesCopied = counter(counters, COUNTER_BYTES_COPIED);
+        allocations = counter(counters, COUNTER_ALLOCATIONS);
+        trims = counter(counters, COUNTER_TRIMS);
+        trimBytesFreed = counter(counters, COUNTER_TRIM_BYTES_FREED);
+        corruptPackets = counter(counters, COUNTER_CORRUPT_PACKETS);
+        packetsDiscarded = counter(counters, COUNTER_PACKETS_DISCARDED);
+        sendPacket = timer(timers, TIMER_SEND_PACKET);
+        receiveFrame = timer(timers, TIMER_RECEIVE_FRAME);
+        deinterlace = timer(timers, TIMER_DEINTERLACE);
+        scale = timer(timers, TIMER_SCALE);
+        windowLock = timer(timers, TIMER_WINDOW_LOCK);
+        render = timer(timers, TIMER_RENDER);
+        resample = timer(timers, TIMER_RESAMPLE);
+        resume = timer(timers, TIMER_RESUME);
+    }
+
+    /**
+     * Parses the array written by the native DecoderStats, or returns {@code null} if it is
+     * missing or has an unknown layout.
+     */
+    @Nullable
+    /* package */ static FfmpegDecoderStats fromNative(@Nullable long[] values) {
+        if (values == null || values.length < HEADER_SIZE || values[0] != VERSION) {
+            return null;
+        }
+        int counterCount = (int) values[1];
+        int timerCount = (int) values[2];
+        int bucketCount = (int) values[3];
+        int histogramSize = HISTOGRAM_HEADER_SIZE + bucketCount;
+        if (counterCount < 0 || timerCount < 0 || bucketCount < 0
+                || values.length != HEADER_SIZE + counterCount + (long) timerCount * histogramSize) {
+            return null;
+        }
+        long[] counters = new long[counterCount];
+        System.arraycopy(values, HEADER_SIZE, counters, 0, counterCount);
+        Histogram[] timers = new Histogram[timerCount];
+        int offset = HEADER_SIZE + counterCount;
+        for (int i = 0; i < timerCount; i++) {
+            long[] buckets = new long[bucketCount];
+            System.arraycopy(values, offset + HISTOGRAM_HEADER_SIZE, buckets, 0, bucketCount);
+            timers[i] = new Histogram(values[offset], values[offset + 1], values[offset + 2], buckets);
+            offset += histogramSize;
+        }
+        return new FfmpegDecoderStats(counters, timers);
+    }
+
+    private static long counter(long[] counters, int index) {
+        return index < counters.length ? counters[index] : 0;
+    }
+
+    @Nullable
+    private static Histogram timer(Histogram[] timers, int index) {
+        return index < timers.length ? timers[index] : null;
+    }
+}
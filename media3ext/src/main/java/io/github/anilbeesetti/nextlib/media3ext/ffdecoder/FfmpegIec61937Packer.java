@@ -0,0 +1,120 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+import static androidx.media3.common.util.Assertions.checkNotNull;
+import static androidx.media3.common.util.Assertions.checkState;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.Format;
+import androidx.media3.common.MimeTypes;
+import androidx.media3.common.util.UnstableApi;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Packs AC-3, E-AC-3, DTS, DTS-HD and TrueHD frames into IEC 61937 bursts without decoding
+ * them, for passthrough to an HDMI or S/PDIF receiver.
+ *
+ * <p>The bursts are 16-bit stereo or 8-channel PCM words at {@link #getSampleRate()}, to be
+ * written to an {@link android.media.AudioTrack} with {@link
+ * android.media.AudioFormat#ENCODING_IEC61937}. E-AC-3 frames are sent in bursts of six audio
+ * blocks and TrueHD access units in MAT frames of 24 units at 48 kHz, so {@link #pack} returns
+ * an empty buffer for the inputs that do not complete a burst.
+ *
+ * <p>Instances are not thread safe.
+ */
+@UnstableApi
+public final class FfmpegIec61937Packer {
+
+  /** The DTS-HD rate for 8 channels at 192 kHz, which carries DTS-HD Master Audio. */
+  public static final int DTS_HD_RATE_DEFAULT = 768000;
+
+  private long nativeContext;
+
+  /**
+   * @param format The format of the frames.
+   * @param dtsHdRate The IEC 60958 frame rate at which DTS-HD frames are sent whole, or 0 to send
+   *     only their DTS core. Ignored for other formats.
+   * @throws FfmpegDecoderException If the format cannot be packed.
+   */
+  public FfmpegIec61937Packer(Format format, int dtsHdRate) throws FfmpegDecoderException {
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    String mimeType = checkNotNull(format.sampleMimeType);
+    if (!supportsFormat(mimeType)) {
+      throw new FfmpegDecoderException("Cannot pack " + mimeType);
+    }
+    checkArgument(dtsHdRate >= 0);
+    String codecName = checkNotNull(FfmpegLibrary.getCodecName(mimeType));
+    nativeContext = ffmpegInitialize(codecName, dtsHdRate);
+    if (nativeContext == 0) {
+      throw new FfmpegDecoderException("Initialization failed.");
+    }
+  }
+
+  /** Returns whether frames of the given MIME type can be packed. */
+  public static boolean supportsFormat(String mimeType) {
+    return switch (mimeType) {
+      case MimeTypes.AUDIO_AC3, MimeTypes.AUDIO_E_AC3, MimeTypes.AUDIO_E_AC3_JOC -> true;
+      case MimeTypes.AUDIO_DTS, MimeTypes.AUDIO_DTS_HD, MimeTypes.AUDIO_TRUEHD -> true;
+      default -> false;
+    };
+  }
+
+  /**
+   * Packs the frames in {@code input}.
+   *
+   * <p>Frames that cannot be parsed are dropped, like undecodable packets in the decoders.
+   *
+   * @param input A direct buffer holding the frames of one sample from its start.
+   * @param size The size of the sample.
+   * @return The bursts completed by this sample, possibly none. The buffer is owned by the packer
+   *     and is only valid until the next call to any method of this packer.
+   */
+  public ByteBuffer pack(ByteBuffer input, int size) {
+    checkState(nativeContext != 0);
+    checkArgument(input.isDirect());
+    return checkNotNull(ffmpegPack(nativeContext, input, size)).order(ByteOrder.nativeOrder());
+  }
+
+  /** Discards buffered frames, e.g. before packing frames after a seek. */
+  public void flush() {
+    checkState(nativeContext != 0);
+    ffmpegReset(nativeContext);
+  }
+
+  /** Returns the channel count of the PCM link, valid once a frame has been packed. */
+  public int getChannelCount() {
+    checkState(nativeContext != 0);
+    return ffmpegGetChannelCount(nativeContext);
+  }
+
+  /** Returns the sample rate of the PCM link, valid once a frame has been packed. */
+  public int getSampleRate() {
+    checkState(nativeContext != 0);
+    return ffmpegGetSampleRate(nativeContext);
+  }
+
+  /** Releases the packer. It must not be used afterwards. */
+  public void release() {
+    if (nativeContext != 0) {
+      ffmpegRelease(nativeContext);
+      nativeContext = 0;
+    }
+  }
+
+  private native long ffmpegInitialize(String codecName, int dtsHdRate);
+
+  @Nullable
+  private native ByteBuffer ffmpegPack(long context, ByteBuffer input, int size);
+
+  private native int ffmpegGetChannelCount(long context);
+
+  private native int ffmpegGetSampleRate(long context);
+
+  private native void ffmpegReset(long context);
+
+  private native void ffmpegRelease(long context);
+}
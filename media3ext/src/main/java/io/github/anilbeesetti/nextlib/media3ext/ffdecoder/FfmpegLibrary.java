@@ -74,6 +74,19 @@ public final class FfmpegLibrary {
     return inputBufferPaddingSize;
   }
 
+  /**
+   * Returns the native diagnostic events recorded since the previous call as text, one event per
+   * line, or null if the underlying library is not available. Which events are recorded is fixed
+   * at build time by {@code FF_DIAG_LEVEL}; release builds record decoder errors only.
+   */
+  @Nullable
+  public static String drainDiagnostics() {
+    if (!isAvailable()) {
+      return null;
+    }
+    return ffmpegDrainDiagnostics();
+  }
+
   /**
    * Returns whether the underlying library supports the specified MIME type.
    *
@@ -126,6 +139,11 @@ public final class FfmpegLibrary {
       case MimeTypes.VIDEO_VP9 -> "libvpx-vp9";
       case MimeTypes.VIDEO_AV1 -> "libdav1d";
       case MimeTypes.VIDEO_MP4V -> "mpeg4";
+
+      // Subtitle codecs
+      case MimeTypes.APPLICATION_PGS -> "pgssub";
+      case MimeTypes.APPLICATION_DVBSUBS -> "dvbsub";
+      case MimeTypes.APPLICATION_VOBSUB -> "dvdsub";
       default -> null;
     };
   }
@@ -135,4 +153,6 @@ public final class FfmpegLibrary {
   private static native int ffmpegGetInputBufferPaddingSize();
 
   private static native boolean ffmpegHasDecoder(String codecName);
+
+  private static native String ffmpegDrainDiagnostics();
 }
@@ -0,0 +1,112 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+
+import android.os.ParcelFileDescriptor;
+import androidx.annotation.Nullable;
+import androidx.media3.common.C;
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Decodes the audio of a file to a WAV or raw PCM file as fast as possible, for audio
+ * extraction, export and transcription preprocessing.
+ *
+ * <p>Decoding and writing are native. Long seekable files are split into segments that are
+ * decoded in parallel and joined at the packet where one ends and the next starts, so the
+ * output is the same as when the file is decoded in one pass. Segments are written in order as
+ * they complete, which bounds the memory used. An export blocks for as long as decoding takes
+ * and must not be done on the main thread.
+ */
+@UnstableApi
+public final class FfmpegPcmExport {
+
+  // LINT.IfChange
+  /** Headerless interleaved PCM. */
+  public static final int CONTAINER_RAW = 0;
+  /** A WAV file, with the sizes filled in if the output can seek. */
+  public static final int CONTAINER_WAV = 1;
+  // LINT.ThenChange(../../../../../../../cpp/ffexport.h)
+
+  /** The number of channels written, after mixing down. */
+  public final int channelCount;
+
+  /** The sample rate written, the one of the audio stream. */
+  public final int sampleRate;
+
+  /** The number of frames written. */
+  public final long frameCount;
+
+  private FfmpegPcmExport(int channelCount, int sampleRate, long frameCount) {
+    this.channelCount = channelCount;
+    this.sampleRate = sampleRate;
+    this.frameCount = frameCount;
+  }
+
+  /**
+   * Decodes the default audio stream of a file, which may also be a video file, to output.
+   *
+   * @param path The path or URL of the file.
+   * @param output The file to write to, from its current offset.
+   * @param container {@link #CONTAINER_WAV} or {@link #CONTAINER_RAW}.
+   * @param encoding The {@link C.PcmEncoding} to write: {@link C#ENCODING_PCM_16BIT}, {@link
+   *     C#ENCODING_PCM_24BIT}, {@link C#ENCODING_PCM_32BIT} or {@link C#ENCODING_PCM_FLOAT}.
+   * @param channelCount The number of channels to mix down to, or 0 to keep the channels of the
+   *     stream.
+   * @param parallelism The number of segments to decode at the same time, 0 for one per CPU or 1
+   *     to decode in one pass.
+   * @throws FfmpegDecoderException If the file could not be decoded or written.
+   */
+  public static FfmpegPcmExport export(
+      String path,
+      ParcelFileDescriptor output,
+      int container,
+      @C.PcmEncoding int encoding,
+      int channelCount,
+      int parallelism)
+      throws FfmpegDecoderException {
+    checkArgument(container == CONTAINER_RAW || container == CONTAINER_WAV);
+    checkArgument(
+        encoding == C.ENCODING_PCM_16BIT
+            || encoding == C.ENCODING_PCM_24BIT
+            || encoding == C.ENCODING_PCM_32BIT
+            || encoding == C.ENCODING_PCM_FLOAT);
+    checkArgument(channelCount >= 0);
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    @Nullable
+    long[] values =
+        ffmpegExport(path, output.getFd(), container, encoding, channelCount, parallelism);
+    if (values == null) {
+      throw new FfmpegDecoderException("Error exporting audio (see logcat).");
+    }
+    return new FfmpegPcmExport((int) values[0], (int) values[1], values[2]);
+  }
+
+  /**
+   * Decodes the audio of a file opened for reading, such as a content URI.
+   *
+   * @see #export(String, ParcelFileDescriptor, int, int, int, int)
+   */
+  public static FfmpegPcmExport export(
+      ParcelFileDescriptor input,
+      ParcelFileDescriptor output,
+      int container,
+      @C.PcmEncoding int encoding,
+      int channelCount,
+      int parallelism)
+      throws FfmpegDecoderException {
+    // Each segment opens the file again through procfs, with a file offset of its own.
+    return export(
+        "/proc/self/fd/" + input.getFd(), output, container, encoding, channelCount, parallelism);
+  }
+
+  /** Returns the duration written in microseconds. */
+  public long getDurationUs() {
+    return frameCount * C.MICROS_PER_SECOND / sampleRate;
+  }
+
+  @Nullable
+  private static native long[] ffmpegExport(
+      String url, int fd, int container, int encoding, int channelCount, int parallelism);
+}
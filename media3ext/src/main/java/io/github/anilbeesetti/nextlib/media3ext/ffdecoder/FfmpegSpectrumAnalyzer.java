@@ -0,0 +1,92 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+import static androidx.media3.common.util.Assertions.checkState;
+
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Magnitude bands of the audio decoded by an {@link FfmpegAudioRenderer}, for visualizers.
+ *
+ * <p>The analysis runs natively in the decoder: the output is mixed to mono, decimated to at
+ * most 24 kHz and transformed with a Hann-windowed FFT every {@code intervalMs} of audio, and
+ * the bins are reduced to logarithmically spaced bands from 30 Hz up. No PCM is copied to
+ * Java. The decoder runs ahead of playback by the audio sink's buffer, so the bands lead what
+ * is heard by up to that duration.
+ *
+ * <p>{@link #getBands} never blocks decoding and must be called from one thread at a time,
+ * e.g. the thread that draws the visualizer. Clear it from the renderer before releasing it;
+ * decoders already feeding it keep it alive natively until they are released.
+ */
+@UnstableApi
+public final class FfmpegSpectrumAnalyzer {
+
+  // LINT.IfChange
+  /** The smallest supported FFT size. */
+  public static final int MIN_FFT_SIZE = 64;
+  /** The largest supported FFT size. */
+  public static final int MAX_FFT_SIZE = 16384;
+  // LINT.ThenChange(../../../../../../../cpp/ffspectrum.h)
+
+  /** The number of bands. */
+  public final int bandCount;
+
+  private long nativeContext;
+
+  /**
+   * @param fftSize The number of decimated samples per analysis, a power of two between {@link
+   *     #MIN_FFT_SIZE} and {@link #MAX_FFT_SIZE}. 2048 resolves about 12 Hz.
+   * @param bandCount The number of bands, at most half of {@code fftSize}.
+   * @param intervalMs The interval between analyses in milliseconds of audio, for example 16
+   *     to update at 60 fps.
+   * @throws FfmpegDecoderException If the native analyzer could not be created.
+   */
+  public FfmpegSpectrumAnalyzer(int fftSize, int bandCount, int intervalMs)
+      throws FfmpegDecoderException {
+    checkArgument(
+        fftSize >= MIN_FFT_SIZE && fftSize <= MAX_FFT_SIZE && (fftSize & (fftSize - 1)) == 0);
+    checkArgument(bandCount > 0 && bandCount <= fftSize / 2 && intervalMs > 0);
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    this.bandCount = bandCount;
+    nativeContext = ffmpegInitialize(fftSize, bandCount, intervalMs);
+    if (nativeContext == 0) {
+      throw new FfmpegDecoderException("Initialization failed.");
+    }
+  }
+
+  /**
+   * Copies the latest bands to {@code bands}, as linear magnitudes where a full scale sine has a
+   * magnitude of 1.
+   *
+   * @param bands An array of at least {@link #bandCount} values.
+   * @return The sequence number of the bands, which grows with every analysis, so that
+   *     unchanged bands can be skipped. 0 before the first analysis, leaving {@code bands}
+   *     unchanged.
+   */
+  public long getBands(float[] bands) {
+    checkState(nativeContext != 0);
+    checkArgument(bands.length >= bandCount);
+    return ffmpegRead(nativeContext, bands);
+  }
+
+  /** Releases the analyzer. It must not be used afterwards. */
+  public void release() {
+    if (nativeContext != 0) {
+      ffmpegRelease(nativeContext);
+      nativeContext = 0;
+    }
+  }
+
+  /* package */ long getNativeContext() {
+    checkState(nativeContext != 0);
+    return nativeContext;
+  }
+
+  private native long ffmpegInitialize(int fftSize, int bandCount, int intervalMs);
+
+  private native long ffmpegRead(long context, float[] bands);
+
+  private native void ffmpegRelease(long context);
+}
@@ -0,0 +1,157 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import android.graphics.Bitmap;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.C;
+import androidx.media3.common.Format;
+import androidx.media3.common.MimeTypes;
+import androidx.media3.common.text.Cue;
+import androidx.media3.common.util.Consumer;
+import androidx.media3.common.util.UnstableApi;
+import androidx.media3.extractor.text.CuesWithTiming;
+import androidx.media3.extractor.text.SubtitleParser;
+
+import com.google.common.collect.ImmutableList;
+
+/**
+ * Parses PGS, DVB and VobSub bitmap subtitles with FFmpeg.
+ *
+ * <p>The native side keeps the whole subtitle plane as one RGBA canvas and only expands the
+ * rectangles that changed since the previous subtitle. Rectangles that are shown again keep the
+ * {@link Bitmap} of their previous cue, the others get a bitmap of their own size.
+ *
+ * <p>The native decoder is freed by {@link #reset()}, which Media3 calls on seeks, and by
+ * {@link #release()}; the next {@link #parse} creates a new one.
+ */
+@UnstableApi
+public final class FfmpegSubtitleParser implements SubtitleParser {
+
+    // LINT.IfChange
+    private static final int SUBTITLE_INFO_HEADER_SIZE = 5;
+    private static final int SUBTITLE_INFO_RECT_SIZE = 5;
+    // LINT.ThenChange(../../../../../../../cpp/ffsubtitle.cpp)
+
+    private final String codecName;
+    @Nullable private final byte[] extraData;
+    private long nativeContext;
+    private Bitmap[] bitmaps;
+
+    /**
+     * Returns whether the format is a bitmap subtitle format that the FFmpeg build can decode.
+     */
+    public static boolean supportsFormat(Format format) {
+        return format.sampleMimeType != null
+                && isBitmapSubtitle(format.sampleMimeType)
+                && FfmpegLibrary.supportsFormat(format.sampleMimeType);
+    }
+
+    /**
+     * @param format The subtitle format, see {@link #supportsFormat(Format)}.
+     * @throws IllegalArgumentException If the format is not supported.
+     */
+    public FfmpegSubtitleParser(Format format) {
+        if (!supportsFormat(format)) {
+            throw new IllegalArgumentException("Unsupported subtitle format: " + format.sampleMimeType);
+        }
+        codecName = FfmpegLibrary.getCodecName(format.sampleMimeType);
+        extraData = format.initializationData.isEmpty() ? null : format.initializationData.get(0);
+        initialize();
+        bitmaps = new Bitmap[0];
+    }
+
+    @Override
+    public void parse(byte[] data, int offset, int length, OutputOptions outputOptions,
+                      Consumer<CuesWithTiming> output) {
+        if (nativeContext == 0) {
+            initialize();
+        }
+        @Nullable int[] info = ffmpegDecode(nativeContext, data, offset, length);
+        if (info == null) {
+            return;
+        }
+        float planeWidth = info[0];
+        float planeHeight = info[1];
+        int rectCount = info[2];
+        long startTimeUs = info[3] * 1000L;
+        long durationUs = info[4] >= 0 ? (info[4] - info[3]) * 1000L : C.TIME_UNSET;
+        Bitmap[] newBitmaps = new Bitmap[rectCount];
+        ImmutableList.Builder<Cue> cues = ImmutableList.builder();
+        for (int i = 0; i < rectCount; i++) {
+            int base = SUBTITLE_INFO_HEADER_SIZE + i * SUBTITLE_INFO_RECT_SIZE;
+            int x = info[base];
+            int y = info[base + 1];
+            int width = info[base + 2];
+            int height = info[base + 3];
+            int previousIndex = info[base + 4];
+            @Nullable Bitmap bitmap =
+                    previousIndex >= 0 && previousIndex < bitmaps.length ? bitmaps[previousIndex] : null;
+            if (bitmap == null) {
+                bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
+                if (!ffmpegCopyRect(nativeContext, i, bitmap)) {
+                    continue;
+                }
+            }
+            newBitmaps[i] = bitmap;
+            cues.add(new Cue.Builder()
+                    .setBitmap(bitmap)
+                    .setPosition(x / planeWidth)
+                    .setPositionAnchor(Cue.ANCHOR_TYPE_START)
+                    .setLine(y / planeHeight, Cue.LINE_TYPE_FRACTION)
+                    .setLineAnchor(Cue.ANCHOR_TYPE_START)
+                    .setSize(width / planeWidth)
+                    .setBitmapHeight(height / planeHeight)
+                    .build());
+        }
+        bitmaps = newBitmaps;
+        output.accept(new CuesWithTiming(cues.build(), startTimeUs, durationUs));
+    }
+
+    @Override
+    public @Format.CueReplacementBehavior int getCueReplacementBehavior() {
+        return Format.CUE_REPLACEMENT_BEHAVIOR_REPLACE;
+    }
+
+    /** Frees the native decoder and its canvas, which are created again by the next parse. */
+    @Override
+    public void reset() {
+        release();
+    }
+
+    /**
+     * Frees the native decoder and its canvas. SubtitleParser has no release of its own, so
+     * owners that drop a parser without resetting it should call this.
+     */
+    public void release() {
+        if (nativeContext != 0) {
+            ffmpegRelease(nativeContext);
+            nativeContext = 0;
+        }
+        bitmaps = new Bitmap[0];
+    }
+
+    private void initialize() {
+        nativeContext = ffmpegInitialize(codecName, extraData);
+        if (nativeContext == 0) {
+            throw new IllegalStateException("Failed to initialize " + codecName + " decoder");
+        }
+    }
+
+    private static boolean isBitmapSubtitle(String mimeType) {
+        return switch (mimeType) {
+            case MimeTypes.APPLICATION_PGS,
+                 MimeTypes.APPLICATION_DVBSUBS,
+                 MimeTypes.APPLICATION_VOBSUB -> true;
+            default -> false;
+        };
+    }
+
+    private native long ffmpegInitialize(String codecName, @Nullable byte[] extraData);
+
+    @Nullable
+    private native int[] ffmpegDecode(long context, byte[] data, int offset, int length);
+
+    private native boolean ffmpegCopyRect(long context, int index, Bitmap bitmap);
+
+    private native void ffmpegRelease(long context);
+}
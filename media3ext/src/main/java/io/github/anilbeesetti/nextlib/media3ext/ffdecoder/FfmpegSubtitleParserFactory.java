@@ -0,0 +1,51 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import androidx.media3.common.Format;
+import androidx.media3.common.util.UnstableApi;
+import androidx.media3.extractor.text.DefaultSubtitleParserFactory;
+import androidx.media3.extractor.text.SubtitleParser;
+
+/**
+ * Creates {@link FfmpegSubtitleParser}s for bitmap subtitles and leaves every other format to
+ * another factory.
+ *
+ * <pre>{@code
+ * new DefaultMediaSourceFactory(context)
+ *         .setSubtitleParserFactory(new FfmpegSubtitleParserFactory())
+ * }</pre>
+ */
+@UnstableApi
+public final class FfmpegSubtitleParserFactory implements SubtitleParser.Factory {
+
+    private final SubtitleParser.Factory fallbackFactory;
+
+    public FfmpegSubtitleParserFactory() {
+        this(new DefaultSubtitleParserFactory());
+    }
+
+    /**
+     * @param fallbackFactory Provides the parsers for the formats FFmpeg does not handle.
+     */
+    public FfmpegSubtitleParserFactory(SubtitleParser.Factory fallbackFactory) {
+        this.fallbackFactory = fallbackFactory;
+    }
+
+    @Override
+    public boolean supportsFormat(Format format) {
+        return FfmpegSubtitleParser.supportsFormat(format) || fallbackFactory.supportsFormat(format);
+    }
+
+    @Override
+    public @Format.CueReplacementBehavior int getCueReplacementBehavior(Format format) {
+        return FfmpegSubtitleParser.supportsFormat(format)
+                ? Format.CUE_REPLACEMENT_BEHAVIOR_REPLACE
+                : fallbackFactory.getCueReplacementBehavior(format);
+    }
+
+    @Override
+    public SubtitleParser create(Format format) {
+        return FfmpegSubtitleParser.supportsFormat(format)
+                ? new FfmpegSubtitleParser(format)
+                : fallbackFactory.create(format);
+    }
+}
@@ -1,5 +1,7 @@
 package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
 
+import android.graphics.Bitmap;
+import android.graphics.Matrix;
 import android.os.Build;
 import android.view.Surface;
 
@@ -38,20 +40,40 @@ final class FfmpegVideoDecoder
     private static final int VIDEO_DECODER_ERROR_OTHER = -2;
     private static final int VIDEO_DECODER_ERROR_READ_FRAME = -3;
     private static final int VIDEO_DECODER_ERROR_INVAILD_DATA = -4;
+    private static final int VIDEO_DECODER_PACKET_DISCARDED = -5;
     // LINT.ThenChange(../../../../../../../jni/ffmpeg_jni.cc)
 
+    // LINT.IfChange
+    /** Interlaced frames are rendered as they are. */
+    public static final int DEINTERLACE_MODE_OFF = 0;
+    /** Interlaced frames are deinterlaced, one output frame per decoded frame. */
+    public static final int DEINTERLACE_MODE_AUTO = 1;
+    /** Interlaced frames are deinterlaced, one output frame per field. */
+    public static final int DEINTERLACE_MODE_DOUBLE_RATE = 2;
+    // LINT.ThenChange(../../../../../../../cpp/ffdeinterlace.h)
+
     private final String codecName;
-    private long nativeContext;
+    private volatile long nativeContext;
     @Nullable
     private final byte[] extraData;
     private Format format;
     private int degree;
+    private final int deinterlaceMode;
+    private final int lowres;
+    private final boolean asyncRender;
+    private volatile int surfaceWidth;
+    private volatile int surfaceHeight;
 
     @C.VideoOutputMode
     private volatile int outputMode;
     private final Thread decodeThread;
 
     private final Object lock;
+    /**
+     * Held by the native calls that may come from other threads, such as {@link #snapshot} and
+     * the stats, and by the release of the native context, which clears it first.
+     */
+    private final Object contextLock = new Object();
 
     @GuardedBy("lock")
     private final ArrayDeque<DecoderInputBuffer> queuedInputBuffers;
@@ -92,6 +114,12 @@ final class FfmpegVideoDecoder
     @GuardedBy("lock")
     @Nullable
     private DecoderInputBuffer stashInput;
+
+    @GuardedBy("lock")
+    private boolean trimRequested;
+    /** Whether input is held back after a trim until {@link #resumeInput()}. */
+    @GuardedBy("lock")
+    private boolean inputHeld;
     /**
      * Creates a Ffmpeg video Decoder.
      *
@@ -99,10 +127,15 @@ final class FfmpegVideoDecoder
      * @param numOutputBuffers       Number of output buffers.
      * @param initialInputBufferSize The initial size of each input buffer, in bytes.
      * @param threads                Number of threads libgav1 will use to decode.
+     * @param deinterlaceMode        One of the {@code DEINTERLACE_MODE_*} constants.
+     * @param lowres                 Decode at 1/2^lowres of the coded size if the codec supports
+     *                               it, 0 for full resolution.
+     * @param asyncRender            Whether frames are drawn to the surface on a native render
+     *                               thread instead of the caller of {@link #renderToSurface}.
      * @throws FfmpegDecoderException Thrown if an exception occurs when initializing the
      *                                decoder.
      */
-    public FfmpegVideoDecoder(int numInputBuffers, int numOutputBuffers, int initialInputBufferSize, int threads, Format format) throws FfmpegDecoderException {
+    public FfmpegVideoDecoder(int numInputBuffers, int numOutputBuffers, int initialInputBufferSize, int threads, Format format, int deinterlaceMode, int lowres, boolean asyncRender) throws FfmpegDecoderException {
         if (!FfmpegLibrary.isAvailable()) {
             throw new FfmpegDecoderException("Failed to load decoder native library.");
         }
@@ -127,23 +160,25 @@ final class FfmpegVideoDecoder
         extraData = getExtraData(format.sampleMimeType, format.initializationData);
         this.format = format;
         this.degree = format.rotationDegrees;
+        this.deinterlaceMode = deinterlaceMode;
+        this.lowres = lowres;
+        this.asyncRender = asyncRender;
         decodeThread =
                 new Thread("ExoPlayer:FfmpegVideoDecoder") {
                     @Override
                     public void run() {
                         FfmpegVideoDecoder.this.nativeContext =
-                                ffmpegInitialize(codecName, extraData, threads, degree);
+                                ffmpegInitialize(codecName, extraData, threads, degree, deinterlaceMode, lowres, asyncRender);
                         if (nativeContext == 0) {
                             synchronized (lock) {
                                 FfmpegVideoDecoder.this.exception =
                                         new FfmpegDecoderException(
                                                 "Failed to initialize decoder. Error: ");
                             }
-                            ffmpegRelease(FfmpegVideoDecoder.this.nativeContext);
                             return;
                         }
                         FfmpegVideoDecoder.this.run();
-                        ffmpegRelease(FfmpegVideoDecoder.this.nativeContext);
+                        releaseNativeContext();
                     }
                 };
         decodeThread.start();
@@ -196,7 +231,7 @@ final class FfmpegVideoDecoder
             maybeThrowException();
             Assertions.checkState(dequeuedInputBuffer == null || flushed);
             dequeuedInputBuffer =
-                    availableInputBufferCount == 0 || flushed
+                    availableInputBufferCount == 0 || flushed || inputHeld
                             ? null
                             : availableInputBuffers[--availableInputBufferCount];
             return dequeuedInputBuffer;
@@ -234,6 +269,32 @@ final class FfmpegVideoDecoder
         }
     }
 
+    /**
+     * Frees the native memory this decoder can rebuild: decoded frames, the scaler, the
+     * deinterlacer and the codec context with its frame pools and threads. The decoder must have
+     * been flushed with no output buffer held, and no input is taken until {@link #resumeInput()}.
+     * The codec is reopened with the first packet after that, and input is dropped until the next
+     * keyframe. The trim happens asynchronously on the decode thread, its effect is reported by
+     * {@link FfmpegDecoderStats#trimBytesFreed} and {@link FfmpegDecoderStats#resume}.
+     */
+    public void trimMemory() {
+        synchronized (lock) {
+            trimRequested = true;
+            inputHeld = true;
+            flushed = true;
+            lock.notify();
+        }
+    }
+
+    /**
+     * Takes input again after {@link #trimMemory()}.
+     */
+    public void resumeInput() {
+        synchronized (lock) {
+            inputHeld = false;
+        }
+    }
+
     @Override
     public final void setOutputStartTimeUs(long outputStartTimeUs) {
         synchronized (lock) {
@@ -283,211 +344,6 @@ final class FfmpegVideoDecoder
         return new FfmpegDecoderException("Unexpected decode error", error);
     }
 
-//    @Nullable
-//    FfmpegDecoderException decode(DecoderInputBuffer inputBuffer, VideoDecoderOutputBuffer outputBuffer, boolean reset) {
-//        if (reset) {
-//            nativeContext = ffmpegReset(nativeContext);
-//            if (nativeContext == 0) {
-//                return new FfmpegDecoderException("Error resetting (see logcat).");
-//            }
-//        }
-//
-//        // send packet
-//        ByteBuffer inputData = Util.castNonNull(inputBuffer.data);
-//        int inputSize = inputData.limit();
-//        // enqueue origin data
-////        int sendPacketResult = ffmpegSendPacket(nativeContext, inputData, inputSize, inputBuffer.timeUs);
-////        if (sendPacketResult == VIDEO_DECODER_NEED_MORE_FRAME) {
-////            outputBuffer.shouldBeSkipped = true;
-////            return null;
-////        } else if (sendPacketResult == VIDEO_DECODER_ERROR_READ_FRAME) {
-////            // need read frame
-////            Log.d(TAG, "VIDEO_DECODER_ERROR_READ_FRAME: " + "timeUs=" + inputBuffer.timeUs);
-////        } else if (sendPacketResult == VIDEO_DECODER_ERROR_OTHER) {
-////            return new FfmpegDecoderException("ffmpegDecode error: (see logcat)");
-////        }
-//
-//        // receive frame
-//        boolean decodeOnly = !isAtLeastOutputStartTimeUs(inputBuffer.timeUs);
-//        // We need to dequeue the decoded frame from the decoder even when the input data is
-//        // decode-only.
-////        int getFrameResult = ffmpegReceiveFrame(nativeContext, outputMode, outputBuffer, decodeOnly);
-//        int getFrameResult = ffmpegDecode(
-//                nativeContext,
-//                inputBuffer.data,
-//                inputSize,
-//                inputBuffer.timeUs,
-//                outputMode,
-//                outputBuffer,
-//                decodeOnly
-//        );
-//        if (getFrameResult == VIDEO_DECODER_ERROR_OTHER) {
-//            return new FfmpegDecoderException("ffmpegDecode error: (see logcat)");
-//        }
-//
-//        if (getFrameResult == VIDEO_DECODER_NEED_MORE_FRAME) {
-//            outputBuffer.shouldBeSkipped = true;
-//        }
-//
-//        if (getFrameResult == 0) {
-//            outputBuffer.format = inputBuffer.format;
-//        }
-//
-//        return null;
-//    }
-    private boolean decode() throws InterruptedException {
-        DecoderInputBuffer inputBuffer;
-        VideoDecoderOutputBuffer outputBuffer;
-        // Wait until we have an input buffer to decode, and an output buffer to decode into.
-        synchronized (lock) {
-            if (flushed) {
-                flushInternal();
-            }
-            while (!released && !(canDecodeInputBuffer() && canDecodeOutputBuffer()) && !flushed) {
-                lock.wait();
-            }
-            if (released) {
-                flushInternal();
-                return false;
-            }
-            if (flushed) {
-                // Flushed may have changed after lock.wait() is finished.
-                flushInternal();
-                // Queued Input Buffers have been cleared, there is no data to decode.
-                return true;
-            }
-            inputBuffer = queuedInputBuffers.removeFirst();
-            outputBuffer = availableOutputBuffers[--availableOutputBufferCount];
-        }
-
-        if (inputBuffer.isEndOfStream()) {
-            outputBuffer.addFlag(C.BUFFER_FLAG_END_OF_STREAM);
-            releaseInputBuffer(inputBuffer);
-            synchronized (lock) {
-                if (flushed) {
-                    outputBuffer.release();
-                    flushInternal();
-                } else {
-                    outputBuffer.skippedOutputBufferCount = skippedOutputBufferCount;
-                    skippedOutputBufferCount = 0;
-                    queuedOutputBuffers.addLast(outputBuffer);
-                }
-            }
-        } else {
-            outputBuffer.timeUs = inputBuffer.timeUs;
-            if (inputBuffer.isFirstSample()) {
-                outputBuffer.addFlag(C.BUFFER_FLAG_FIRST_SAMPLE);
-            }
-            if (!isAtLeastOutputStartTimeUs(inputBuffer.timeUs)) {
-                outputBuffer.shouldBeSkipped = true;
-            }
-            @Nullable FfmpegDecoderException exception = null;
-            try {
-
-                // send packet
-                ByteBuffer inputData = Util.castNonNull(inputBuffer.data);
-                int inputOffset = inputData.position();
-                int inputSize = inputData.remaining();
-                boolean readOnly = false;
-                boolean hasInput = false;
-                int status;
-
-                while ((status = ffmpegDecode(
-                        nativeContext,
-                        inputBuffer.data,
-                        inputOffset,
-                        inputSize,
-                        inputBuffer.timeUs,
-                        outputMode,
-                        outputBuffer,
-                        !isAtLeastOutputStartTimeUs(inputBuffer.timeUs),
-                        readOnly
-                ) )== VIDEO_DECODER_SUCCESS
-                        || status ==VIDEO_DECODER_ERROR_READ_FRAME || status >= VIDEO_DECODER_DROP_FRAME || (hasInput && status == VIDEO_DECODER_NEED_MORE_FRAME)) {
-                    readOnly = true;
-                    if (status == VIDEO_DECODER_ERROR_READ_FRAME){
-                        hasInput = true;
-                        continue;
-                    }
-                    if(status >= VIDEO_DECODER_DROP_FRAME){
-                        outputBuffer.shouldBeSkipped = true;
-                    }
-                    synchronized (lock) {
-                        if (flushed) {
-                            outputBuffer.release();
-                            releaseInputBufferInternal(inputBuffer);
-                            flushInternal();
-                            return true;
-                        } if(status == VIDEO_DECODER_NEED_MORE_FRAME){
-                            outputBuffer.release();
-                        }else if (!isAtLeastOutputStartTimeUs(outputBuffer.timeUs)
-                                || outputBuffer.shouldBeSkipped) {
-                            if (status >= VIDEO_DECODER_DROP_FRAME){
-                                skippedOutputBufferCount+=status;
-                            }else{
-                                skippedOutputBufferCount++;
-                            }
-                            outputBuffer.release();
-                        } else {
-                            outputBuffer.format = FfmpegVideoDecoder.this.format;
-                            outputBuffer.skippedOutputBufferCount = skippedOutputBufferCount;
-                            skippedOutputBufferCount = 0;
-                            queuedOutputBuffers.addLast(outputBuffer);
-                        }
-                        if(status >=VIDEO_DECODER_DROP_FRAME || status==VIDEO_DECODER_NEED_MORE_FRAME){
-                            if(hasInput){
-                                hasInput = false;
-                                readOnly = false;
-                            }else break;
-                        }
-                        while (!released && !canDecodeOutputBuffer() && !flushed) {
-                            lock.wait();
-                        }
-                        if (released) {
-                            releaseInputBufferInternal(inputBuffer);
-                            flushInternal();
-                            return false;
-                        }
-                        if (flushed) {
-                            releaseInputBufferInternal(inputBuffer);
-                            flushInternal();
-                            return true;
-                        }
-                        outputBuffer = availableOutputBuffers[--availableOutputBufferCount];
-                    }
-                }
-                if (status == VIDEO_DECODER_ERROR_OTHER) {
-                    throw new FfmpegDecoderException("ffmpegDecode error: when read frame");
-                } else if (status == VIDEO_DECODER_NEED_MORE_FRAME) {
-                    outputBuffer.release();
-                }else if(status==VIDEO_DECODER_ERROR_INVAILD_DATA){
-                    Log.e(TAG,"VIDEO_DECODER_ERROR_INVAILD_DATA");
-                    outputBuffer.release();
-                    ffmpegReset(nativeContext);
-                }else if(status < 0) throw new FfmpegDecoderException("Not Expect error");
-            } catch (RuntimeException e) {
-                // This can occur if a sample is malformed in a way that the decoder is not robust against.
-                // We don't want the process to die in this case, but we do want to propagate the error.
-                exception = createUnexpectedDecodeException(e);
-            } catch (OutOfMemoryError e) {
-                // This can occur if a sample is malformed in a way that causes the decoder to think it
-                // needs to allocate a large amount of memory. We don't want the process to die in this
-                // case, but we do want to propagate the error.
-                exception = createUnexpectedDecodeException(e);
-            }catch (FfmpegDecoderException e){
-                exception = e;
-            }
-            if (exception != null) {
-                synchronized (lock) {
-                    this.exception = exception;
-                }
-                return false;
-            }
-            releaseInputBuffer(inputBuffer);
-        }
-
-        return true;
-    }
     private boolean decodeTest() throws InterruptedException {
         synchronized (lock) {
             if (flushed) {
@@ -541,9 +397,11 @@ final class FfmpegVideoDecoder
             ByteBuffer inputData = Util.castNonNull(stashInput.data);
             int inputOffset = inputData.position();
             int inputSize = inputData.remaining();
-            int status = ffmpegSendPacket(nativeContext, inputData, inputOffset, inputSize, stashInput.timeUs);
+            int status = ffmpegSendPacket(nativeContext, inputData, inputOffset, inputSize,
+                    stashInput.timeUs, stashInput.isKeyFrame());
             decodeOnly = !isAtLeastOutputStartTimeUs(stashInput.timeUs);
-            if (status == VIDEO_DECODER_ERROR_INVAILD_DATA) {
+            // The native side skips ahead to the next keyframe by itself, without a flush.
+            if (status == VIDEO_DECODER_ERROR_INVAILD_DATA || status == VIDEO_DECODER_PACKET_DISCARDED) {
                 synchronized (lock) {
                     if (released){
                         flushInternal();
@@ -553,7 +411,6 @@ final class FfmpegVideoDecoder
                         flushInternal();
                         return true;
                     }
-                    ffmpegReset(nativeContext);
                     skippedOutputBufferCount++;
                     if (stashInput != null) {
                         releaseInputBufferInternal(stashInput);
@@ -734,6 +591,10 @@ final class FfmpegVideoDecoder
             queuedOutputBuffers.removeFirst().release();
         }
         ffmpegReset(nativeContext);
+        if (trimRequested) {
+            trimRequested = false;
+            ffmpegTrim(nativeContext);
+        }
         flushed = false;
     }
 
@@ -748,6 +609,119 @@ final class FfmpegVideoDecoder
         }
     }
 
+    /**
+     * Releases the native context on the decode thread once it stops. The handle is cleared
+     * first, under {@link #contextLock}, so that calls from other threads see 0 instead of a
+     * freed context.
+     */
+    private void releaseNativeContext() {
+        synchronized (contextLock) {
+            long context = nativeContext;
+            nativeContext = 0;
+            ffmpegRelease(context);
+        }
+    }
+
+    /**
+     * Sets the size of the output surface in pixels. Frames are scaled down to fit it when
+     * rendered. Non-positive values fall back to the size of the surface's window.
+     */
+    public void setOutputResolution(int width, int height) {
+        surfaceWidth = width;
+        surfaceHeight = height;
+    }
+
+    /**
+     * Returns the current state of surface rendering. With async rendering enabled the frames
+     * passed to {@link #renderToSurface} are presented later on a native thread, and this is how
+     * their presentation is reported back.
+     */
+    public VideoRenderStats getRenderStats() {
+        long[] stats = new long[4];
+        synchronized (contextLock) {
+            if (nativeContext != 0) {
+                ffmpegGetRenderStats(nativeContext, stats);
+            }
+        }
+        return new VideoRenderStats((int) stats[0], stats[1], stats[2], stats[3]);
+    }
+
+    /**
+     * Waits up to {@code timeoutMs} until every frame passed to {@link #renderToSurface} so far
+     * has been posted to the surface or dropped for a newer one. Returns whether it was.
+     *
+     * <p>Without async rendering frames are posted before {@link #renderToSurface} returns, so
+     * this returns {@code true} right away.
+     */
+    public boolean awaitPresentation(long timeoutMs) {
+        synchronized (contextLock) {
+            return nativeContext == 0 || ffmpegAwaitPresentation(nativeContext, timeoutMs);
+        }
+    }
+
+    /**
+     * Returns the native counters and latency histograms of this decoder, or {@code null} once
+     * it has been released.
+     */
+    @Nullable
+    public FfmpegDecoderStats getDecoderStats() {
+        synchronized (contextLock) {
+            long context = nativeContext;
+            return context != 0 ? FfmpegDecoderStats.fromNative(ffmpegGetStats(context)) : null;
+        }
+    }
+
+    /**
+     * Returns the frame currently shown on the surface, scaled down to fit {@code maxWidth} x
+     * {@code maxHeight} and rotated upright, or {@code null} if no frame has been rendered yet.
+     * The frame is converted from the reference the decoder already holds, without any decoding,
+     * so this can be called from any thread while playback continues.
+     *
+     * @param maxWidth  The maximum width of the bitmap, or 0 for no limit.
+     * @param maxHeight The maximum height of the bitmap, or 0 for no limit.
+     */
+    @Nullable
+    public Bitmap snapshot(int maxWidth, int maxHeight) {
+        Bitmap bitmap;
+        int width;
+        int height;
+        synchronized (contextLock) {
+            long context = nativeContext;
+            if (context == 0) {
+                return null;
+            }
+            int[] size = new int[2];
+            if (!ffmpegGetSnapshotSize(context, size)) {
+                return null;
+            }
+            boolean swapped = degree % 180 != 0;
+            float scale = 1f;
+            if (maxWidth > 0) {
+                scale = Math.min(scale, (float) maxWidth / (swapped ? size[1] : size[0]));
+            }
+            if (maxHeight > 0) {
+                scale = Math.min(scale, (float) maxHeight / (swapped ? size[0] : size[1]));
+            }
+            width = Math.max(1, Math.round(size[0] * scale));
+            height = Math.max(1, Math.round(size[1] * scale));
+            bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
+            if (!ffmpegSnapshot(context, bitmap)) {
+                bitmap.recycle();
+                return null;
+            }
+        }
+        if (degree % 360 == 0) {
+            return bitmap;
+        }
+        Matrix matrix = new Matrix();
+        matrix.postRotate(degree);
+        Bitmap rotated = Bitmap.createBitmap(bitmap, 0, 0, width, height, matrix, true);
+        if (rotated != bitmap) {
+            bitmap.recycle();
+        }
+        return rotated;
+    }
+
     /**
      * Renders output buffer to the given surface. Must only be called when in {@link
      * C#VIDEO_OUTPUT_MODE_SURFACE_YUV} mode.
@@ -764,19 +738,33 @@ final class FfmpegVideoDecoder
         }
         if (ffmpegRenderFrame(
                 nativeContext, surface,
-                outputBuffer) == VIDEO_DECODER_ERROR_OTHER) {
+                outputBuffer, surfaceWidth, surfaceHeight) == VIDEO_DECODER_ERROR_OTHER) {
             throw new FfmpegDecoderException("Buffer render error: ");
         }
     }
 
-    private native long ffmpegInitialize(String codecName, @Nullable byte[] extraData, int threads, int degree);
+    private native long ffmpegInitialize(String codecName, @Nullable byte[] extraData, int threads, int degree, int deinterlaceMode, int lowres, boolean asyncRender);
 
     private native long ffmpegReset(long context);
 
     private native void ffmpegRelease(long context);
 
+    private native void ffmpegTrim(long context);
+
     private native int ffmpegRenderFrame(
-            long context, Surface surface, VideoDecoderOutputBuffer outputBuffer);
+            long context, Surface surface, VideoDecoderOutputBuffer outputBuffer,
+            int surfaceWidth, int surfaceHeight);
+
+    private native void ffmpegGetRenderStats(long context, long[] stats);
+
+    private native boolean ffmpegAwaitPresentation(long context, long timeoutMs);
+
+    @Nullable
+    private native long[] ffmpegGetStats(long context);
+
+    private native boolean ffmpegGetSnapshotSize(long context, int[] size);
+
+    private native boolean ffmpegSnapshot(long context, Bitmap bitmap);
 
     /**
      * Decodes the encoded data passed.
@@ -788,7 +776,7 @@ final class FfmpegVideoDecoder
      * error occurred.
      */
     private native int ffmpegSendPacket(long context, ByteBuffer encodedData,int offset, int length,
-                                        long inputTime);
+                                        long inputTime, boolean keyFrame);
 
     /**
      * Gets the decoded frame.
@@ -802,7 +790,6 @@ final class FfmpegVideoDecoder
     private native int ffmpegReceiveFrame(
             long context, int outputMode, VideoDecoderOutputBuffer outputBuffer, boolean decodeOnly);
     private native void ffmpegReleaseFrame(long context,VideoDecoderOutputBuffer outputBuffer);
-    private native int ffmpegDecode(long context,ByteBuffer encodedData,int offset,int length,long inputTime,int outputMode, VideoDecoderOutputBuffer outputBuffer ,boolean decodeOnly,boolean readOnly);
     private native int ffmpegReceiveAllFrame(long context,@Nullable VideoDecoderOutputBuffer outputBuffer,int outputMode,boolean decodeOnly);
 
-}
\ No newline at end of file
+}
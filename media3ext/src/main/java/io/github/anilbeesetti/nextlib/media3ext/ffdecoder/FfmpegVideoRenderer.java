@@ -2,6 +2,8 @@ package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
 
 import static java.lang.Runtime.getRuntime;
 
+import android.content.ComponentCallbacks2;
+import android.graphics.Bitmap;
 import android.os.Handler;
 import android.view.Surface;
 import androidx.annotation.Nullable;
@@ -9,6 +11,7 @@ import androidx.media3.common.C;
 import androidx.media3.common.Format;
 import androidx.media3.common.MimeTypes;
 import androidx.media3.common.util.Assertions;
+import androidx.media3.common.util.Size;
 import androidx.media3.common.util.TraceUtil;
 import androidx.media3.common.util.UnstableApi;
 import androidx.media3.common.util.Util;
@@ -17,6 +20,7 @@ import androidx.media3.decoder.Decoder;
 import androidx.media3.decoder.DecoderException;
 import androidx.media3.decoder.DecoderInputBuffer;
 import androidx.media3.decoder.VideoDecoderOutputBuffer;
+import androidx.media3.exoplayer.ExoPlaybackException;
 import androidx.media3.exoplayer.RendererCapabilities;
 import androidx.media3.exoplayer.video.DecoderVideoRenderer;
 import androidx.media3.exoplayer.video.VideoRendererEventListener;
@@ -25,10 +29,42 @@ import androidx.media3.exoplayer.video.VideoRendererEventListener;
 @UnstableApi
 public final class FfmpegVideoRenderer extends DecoderVideoRenderer {
     public static final int FLAG_ENABLE_HEVC = 1;
+    /** Renders interlaced frames without deinterlacing them. */
+    public static final int FLAG_DISABLE_DEINTERLACE = 1 << 1;
+    /** Deinterlaces to one frame per field, doubling the frame rate of interlaced content. */
+    public static final int FLAG_DEINTERLACE_DOUBLE_RATE = 1 << 2;
+    /**
+     * Decodes at ½ or ¼ resolution when the output surface is that much smaller than the video.
+     * Only used by codecs that support reduced resolution decoding, e.g. MPEG-2 and MJPEG.
+     */
+    public static final int FLAG_ENABLE_LOWRES = 1 << 3;
+    /**
+     * Draws frames to the surface on a native render thread, so a slow window lock or conversion
+     * doesn't stall the render loop. Frames are handed over through a triple buffer: if the
+     * thread is still drawing when a newer frame arrives, the waiting frame is dropped for it.
+     * Use {@link #awaitPresentation} to wait for the frames to reach the surface.
+     */
+    public static final int FLAG_ENABLE_ASYNC_RENDER = 1 << 4;
+    /**
+     * Message type that frees the native memory of the decoder while playback is paused and the
+     * app is in the background. The payload is the level passed to {@link
+     * ComponentCallbacks2#onTrimMemory}: send it from there with {@code
+     * player.createMessage(renderer).setType(MSG_TRIM_MEMORY).setPayload(level).send()}. It is
+     * ignored below {@link ComponentCallbacks2#TRIM_MEMORY_UI_HIDDEN} and while the renderer is
+     * started.
+     *
+     * <p>The decoder takes input again when playback starts or seeks. Without a seek it resumes at
+     * the next keyframe, so the video stalls on the last frame until then; seek to the current
+     * position before resuming to avoid that. See {@link FfmpegDecoderStats#trimBytesFreed} and
+     * {@link FfmpegDecoderStats#resume}.
+     */
+    public static final int MSG_TRIM_MEMORY = MSG_CUSTOM_BASE;
     private static final String TAG = "FfmpegVideoRenderer";
 
     private static final int DEFAULT_NUM_OF_INPUT_BUFFERS = 4;
     private static final int DEFAULT_NUM_OF_OUTPUT_BUFFERS = 4;
+    /** The largest lowres factor used, as a power of two. */
+    private static final int MAX_LOWRES = 2;
     /* Default size based on 720p resolution video compressed by a factor of two. */
     private static final int DEFAULT_INPUT_BUFFER_SIZE =
             Util.ceilDivide(1280, 64) * Util.ceilDivide(720, 64) * (64 * 64 * 3 / 2) / 2;
@@ -45,7 +81,10 @@ public final class FfmpegVideoRenderer extends DecoderVideoRenderer {
 
     private final int formatEnableFlags;
 
-    @Nullable private FfmpegVideoDecoder decoder;
+    /** Size of the output surface in pixels, or {@link Size#UNKNOWN} if not reported yet. */
+    private Size outputResolution = Size.UNKNOWN;
+
+    @Nullable private volatile FfmpegVideoDecoder decoder;
 
     /**
      * Creates a new instance.
@@ -133,6 +172,105 @@ public final class FfmpegVideoRenderer extends DecoderVideoRenderer {
     }
 
 
+    /**
+     * Returns the state of surface rendering for the current decoder, or {@code null} if there is
+     * no decoder.
+     */
+    @Nullable
+    public VideoRenderStats getRenderStats() {
+        FfmpegVideoDecoder decoder = this.decoder;
+        return decoder != null ? decoder.getRenderStats() : null;
+    }
+
+    /**
+     * Waits up to {@code timeoutMs} until every frame rendered so far has been posted to the
+     * surface or dropped for a newer one. Returns whether it was, or {@code true} if there is no
+     * decoder.
+     */
+    public boolean awaitPresentation(long timeoutMs) {
+        FfmpegVideoDecoder decoder = this.decoder;
+        return decoder == null || decoder.awaitPresentation(timeoutMs);
+    }
+
+    /**
+     * Returns the native counters and latency histograms of the current decoder, or {@code null}
+     * if there is no decoder.
+     */
+    @Nullable
+    public FfmpegDecoderStats getDecoderStats() {
+        FfmpegVideoDecoder decoder = this.decoder;
+        return decoder != null ? decoder.getDecoderStats() : null;
+    }
+
+    /**
+     * Returns the frame currently shown on the surface as a bitmap, or {@code null} if there is
+     * none. No decoding is done, see {@link FfmpegVideoDecoder#snapshot(int, int)}. Can be called
+     * from any thread.
+     *
+     * @param maxWidth  The maximum width of the bitmap, or 0 for no limit.
+     * @param maxHeight The maximum height of the bitmap, or 0 for no limit.
+     */
+    @Nullable
+    public Bitmap snapshot(int maxWidth, int maxHeight) {
+        FfmpegVideoDecoder decoder = this.decoder;
+        return decoder != null ? decoder.snapshot(maxWidth, maxHeight) : null;
+    }
+
+    @Override
+    public void handleMessage(@MessageType int messageType, @Nullable Object message)
+            throws ExoPlaybackException {
+        if (messageType == MSG_SET_VIDEO_OUTPUT_RESOLUTION) {
+            outputResolution = (Size) Assertions.checkNotNull(message);
+            if (decoder != null) {
+                decoder.setOutputResolution(outputResolution.getWidth(), outputResolution.getHeight());
+            }
+        } else if (messageType == MSG_TRIM_MEMORY) {
+            if (message instanceof Integer
+                    && (Integer) message >= ComponentCallbacks2.TRIM_MEMORY_UI_HIDDEN) {
+                trimMemory();
+            }
+        }
+        super.handleMessage(messageType, message);
+    }
+
+    @Override
+    protected void onStarted() {
+        super.onStarted();
+        resumeDecoderInput();
+    }
+
+    @Override
+    protected void onDisabled() {
+        // The decoder is released here, from now on the getters return null without it.
+        decoder = null;
+        super.onDisabled();
+    }
+
+    @Override
+    protected void onPositionReset(long positionUs, boolean joining) throws ExoPlaybackException {
+        super.onPositionReset(positionUs, joining);
+        resumeDecoderInput();
+    }
+
+    private void trimMemory() throws ExoPlaybackException {
+        if (decoder == null || getState() == STATE_STARTED) {
+            return;
+        }
+        // Drop the buffers the renderer holds first, the decoder can only trim when flushed.
+        flushDecoder();
+        FfmpegVideoDecoder decoder = this.decoder;
+        if (decoder != null) {
+            decoder.trimMemory();
+        }
+    }
+
+    private void resumeDecoderInput() {
+        FfmpegVideoDecoder decoder = this.decoder;
+        if (decoder != null) {
+            decoder.resumeInput();
+        }
+    }
+
     @Override
     protected void renderOutputBufferToSurface(VideoDecoderOutputBuffer outputBuffer, Surface surface)
             throws FfmpegDecoderException {
@@ -152,12 +290,48 @@ public final class FfmpegVideoRenderer extends DecoderVideoRenderer {
         TraceUtil.beginSection("createFfmpegVideoDecoder");
         int initialInputBufferSize = format.maxInputSize != Format.NO_VALUE ? format.maxInputSize : DEFAULT_INPUT_BUFFER_SIZE;
         int t = Math.min(Math.max(threads/2,2),6);
-        FfmpegVideoDecoder decoder = new FfmpegVideoDecoder(numInputBuffers, numOutputBuffers, initialInputBufferSize, t, format);
+        int deinterlaceMode;
+        if ((formatEnableFlags & FLAG_DISABLE_DEINTERLACE) != 0) {
+            deinterlaceMode = FfmpegVideoDecoder.DEINTERLACE_MODE_OFF;
+        } else if ((formatEnableFlags & FLAG_DEINTERLACE_DOUBLE_RATE) != 0) {
+            deinterlaceMode = FfmpegVideoDecoder.DEINTERLACE_MODE_DOUBLE_RATE;
+        } else {
+            deinterlaceMode = FfmpegVideoDecoder.DEINTERLACE_MODE_AUTO;
+        }
+        int lowres = (formatEnableFlags & FLAG_ENABLE_LOWRES) != 0 ? getLowres(format) : 0;
+        FfmpegVideoDecoder decoder = new FfmpegVideoDecoder(numInputBuffers, numOutputBuffers, initialInputBufferSize, t, format, deinterlaceMode, lowres,
+                (formatEnableFlags & FLAG_ENABLE_ASYNC_RENDER) != 0);
+        decoder.setOutputResolution(outputResolution.getWidth(), outputResolution.getHeight());
         this.decoder = decoder;
         TraceUtil.endSection();
         return decoder;
     }
 
+    /**
+     * Returns the largest lowres factor for which the decoded picture still covers the output
+     * surface. The factor is fixed when the decoder is created.
+     */
+    private int getLowres(Format format) {
+        int surfaceWidth = outputResolution.getWidth();
+        int surfaceHeight = outputResolution.getHeight();
+        if (surfaceWidth <= 0 || surfaceHeight <= 0
+                || format.width == Format.NO_VALUE || format.height == Format.NO_VALUE) {
+            return 0;
+        }
+        if (format.rotationDegrees % 180 != 0) {
+            int swap = surfaceWidth;
+            surfaceWidth = surfaceHeight;
+            surfaceHeight = swap;
+        }
+        int lowres = 0;
+        while (lowres < MAX_LOWRES
+                && (format.width >> (lowres + 1)) >= surfaceWidth
+                && (format.height >> (lowres + 1)) >= surfaceHeight) {
+            lowres++;
+        }
+        return lowres;
+    }
+
     @Override
     protected void setDecoderOutputMode(@C.VideoOutputMode int outputMode) {
         if (decoder != null) {
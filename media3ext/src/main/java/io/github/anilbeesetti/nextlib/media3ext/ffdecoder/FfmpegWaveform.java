@@ -0,0 +1,105 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import static androidx.media3.common.util.Assertions.checkArgument;
+
+import android.os.ParcelFileDescriptor;
+import androidx.annotation.Nullable;
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Minimum, maximum and RMS of the audio of a file in buckets of equal duration, for seek bar
+ * waveforms and editor timelines.
+ *
+ * <p>The audio is decoded and reduced natively, in segments that are decoded in parallel for
+ * long files, so nothing but the result crosses into Java. Computing a waveform blocks for as
+ * long as decoding takes and must not be done on the main thread.
+ */
+@UnstableApi
+public final class FfmpegWaveform {
+
+  /** Values stored per bucket and channel in {@link #getValues()}: minimum, maximum and RMS. */
+  public static final int VALUES_PER_BUCKET = 3;
+
+  /** The number of buckets. */
+  public final int bucketCount;
+
+  /** The number of channels, after mixing down. */
+  public final int channelCount;
+
+  private final float[] values;
+
+  private FfmpegWaveform(int bucketCount, int channelCount, float[] values) {
+    this.bucketCount = bucketCount;
+    this.channelCount = channelCount;
+    this.values = values;
+  }
+
+  /**
+   * Computes the waveform of the default audio stream of a file, which may also be a video file.
+   *
+   * @param path The path or URL of the file.
+   * @param bucketCount The number of buckets, for example the width of the seek bar in pixels.
+   * @param channelCount The number of channels to mix down to, or 0 to keep the channels of the
+   *     stream.
+   * @param parallelism The number of segments to decode at the same time, or 0 for one per CPU.
+   * @throws FfmpegDecoderException If the file could not be decoded.
+   */
+  public static FfmpegWaveform compute(
+      String path, int bucketCount, int channelCount, int parallelism)
+      throws FfmpegDecoderException {
+    checkArgument(bucketCount > 0 && channelCount >= 0);
+    if (!FfmpegLibrary.isAvailable()) {
+      throw new FfmpegDecoderException("Failed to load decoder native libraries.");
+    }
+    @Nullable float[] values = ffmpegCompute(path, bucketCount, channelCount, parallelism);
+    if (values == null) {
+      throw new FfmpegDecoderException("Error computing waveform (see logcat).");
+    }
+    return new FfmpegWaveform(
+        bucketCount, values.length / (bucketCount * VALUES_PER_BUCKET), values);
+  }
+
+  /**
+   * Computes the waveform of a file opened for reading, such as a content URI.
+   *
+   * @see #compute(String, int, int, int)
+   */
+  public static FfmpegWaveform compute(
+      ParcelFileDescriptor descriptor, int bucketCount, int channelCount, int parallelism)
+      throws FfmpegDecoderException {
+    // Each segment opens the file again through procfs, with a file offset of its own.
+    return compute(
+        "/proc/self/fd/" + descriptor.getFd(), bucketCount, channelCount, parallelism);
+  }
+
+  /** Returns the smallest sample of the channel in the bucket, in [-1, 1]. */
+  public float getMin(int bucket, int channel) {
+    return values[index(bucket, channel)];
+  }
+
+  /** Returns the largest sample of the channel in the bucket, in [-1, 1]. */
+  public float getMax(int bucket, int channel) {
+    return values[index(bucket, channel) + 1];
+  }
+
+  /** Returns the RMS of the samples of the channel in the bucket. */
+  public float getRms(int bucket, int channel) {
+    return values[index(bucket, channel) + 2];
+  }
+
+  /**
+   * Returns all values, {@link #VALUES_PER_BUCKET} per channel for each bucket in turn. The array
+   * is not copied and must not be modified.
+   */
+  public float[] getValues() {
+    return values;
+  }
+
+  private int index(int bucket, int channel) {
+    return (bucket * channelCount + channel) * VALUES_PER_BUCKET;
+  }
+
+  @Nullable
+  private static native float[] ffmpegCompute(
+      String url, int bucketCount, int channelCount, int parallelism);
+}
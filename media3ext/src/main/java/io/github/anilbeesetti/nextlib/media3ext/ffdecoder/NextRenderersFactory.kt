@@ -21,6 +21,10 @@ open class NextRenderersFactory(context: Context) : DefaultRenderersFactory(cont
         companion object {
             val FLAG_ENABLE_HEVC = Flags(1)
             val FLAG_DISABLE_FFMPEG_AUDIO_DECODER = Flags(1 shl 1)
+            val FLAG_DISABLE_DEINTERLACE = Flags(1 shl 2)
+            val FLAG_DEINTERLACE_DOUBLE_RATE = Flags(1 shl 3)
+            val FLAG_ENABLE_LOWRES = Flags(1 shl 4)
+            val FLAG_ENABLE_ASYNC_RENDER = Flags(1 shl 5)
             // 更多 flag...
         }
 
@@ -109,7 +113,11 @@ open class NextRenderersFactory(context: Context) : DefaultRenderersFactory(cont
         }
 
         try {
-            val flag = if (Flags.FLAG_ENABLE_HEVC in enabledFlags) FfmpegVideoRenderer.FLAG_ENABLE_HEVC else 0
+            var flag = if (Flags.FLAG_ENABLE_HEVC in enabledFlags) FfmpegVideoRenderer.FLAG_ENABLE_HEVC else 0
+            if (Flags.FLAG_DISABLE_DEINTERLACE in enabledFlags) flag = flag or FfmpegVideoRenderer.FLAG_DISABLE_DEINTERLACE
+            if (Flags.FLAG_DEINTERLACE_DOUBLE_RATE in enabledFlags) flag = flag or FfmpegVideoRenderer.FLAG_DEINTERLACE_DOUBLE_RATE
+            if (Flags.FLAG_ENABLE_LOWRES in enabledFlags) flag = flag or FfmpegVideoRenderer.FLAG_ENABLE_LOWRES
+            if (Flags.FLAG_ENABLE_ASYNC_RENDER in enabledFlags) flag = flag or FfmpegVideoRenderer.FLAG_ENABLE_ASYNC_RENDER
             val renderer = FfmpegVideoRenderer(allowedVideoJoiningTimeMs, eventHandler, eventListener
                 , MAX_DROPPED_VIDEO_FRAME_COUNT_TO_NOTIFY,flag)
             out.add(extensionRendererIndex++, renderer)
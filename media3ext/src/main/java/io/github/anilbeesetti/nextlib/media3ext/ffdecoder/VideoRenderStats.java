@@ -0,0 +1,32 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffdecoder;
+
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Snapshot of the surface render path of {@link FfmpegVideoRenderer}.
+ */
+@UnstableApi
+public final class VideoRenderStats {
+    /**
+     * Frames handed to the native render worker and not posted yet, at most 2: the one being
+     * drawn and the one waiting for it. Always 0 without async rendering.
+     */
+    public final int queueDepth;
+    /** Frames posted to the surface. */
+    public final long presentedFrameCount;
+    /**
+     * Frames the render worker dropped because a newer frame replaced them before they were
+     * drawn, or drawing failed.
+     */
+    public final long droppedFrameCount;
+    /** Timestamp of the last frame posted to the surface, in microseconds. */
+    public final long lastPresentedTimeUs;
+
+    VideoRenderStats(int queueDepth, long presentedFrameCount, long droppedFrameCount,
+                     long lastPresentedTimeUs) {
+        this.queueDepth = queueDepth;
+        this.presentedFrameCount = presentedFrameCount;
+        this.droppedFrameCount = droppedFrameCount;
+        this.lastPresentedTimeUs = lastPresentedTimeUs;
+    }
+}
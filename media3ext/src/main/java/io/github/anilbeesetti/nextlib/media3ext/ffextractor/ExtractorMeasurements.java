@@ -0,0 +1,67 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffextractor;
+
+import androidx.media3.common.C;
+import androidx.media3.common.util.UnstableApi;
+
+/**
+ * Timings of one extractor over the life of a media source, taken the same way for every
+ * extractor so that {@link FfmpegExtractor} can be compared with the stock ones on the same
+ * files. See {@link FfmpegExtractorsFactory#setMeasurementListener}.
+ */
+@UnstableApi
+public final class ExtractorMeasurements {
+    /** Simple class name of the extractor that was used. */
+    public final String extractorName;
+    /** Time spent in {@code sniff} of this extractor, in microseconds. */
+    public final long sniffUs;
+    /** Time from {@code init} to the first sample, in microseconds, or {@link C#TIME_UNSET}. */
+    public final long startupUs;
+    /** Number of seeks that produced a sample afterwards. */
+    public final int seekCount;
+    /** Sum of the times from {@code seek} to the next sample, in microseconds. */
+    public final long totalSeekUs;
+    /** Longest time from {@code seek} to the next sample, in microseconds. */
+    public final long maxSeekUs;
+    /** Time spent in {@code read}, in microseconds. */
+    public final long readUs;
+    /** Number of samples output. */
+    public final long sampleCount;
+    /** Bytes of sample data output. */
+    public final long sampleBytes;
+
+    ExtractorMeasurements(String extractorName, long sniffUs, long startupUs, int seekCount,
+                          long totalSeekUs, long maxSeekUs, long readUs, long sampleCount,
+                          long sampleBytes) {
+        this.extractorName = extractorName;
+        this.sniffUs = sniffUs;
+        this.startupUs = startupUs;
+        this.seekCount = seekCount;
+        this.totalSeekUs = totalSeekUs;
+        this.maxSeekUs = maxSeekUs;
+        this.readUs = readUs;
+        this.sampleCount = sampleCount;
+        this.sampleBytes = sampleBytes;
+    }
+
+    /** Returns the mean seek latency in microseconds, or {@link C#TIME_UNSET} without seeks. */
+    public long getAverageSeekUs() {
+        return seekCount > 0 ? totalSeekUs / seekCount : C.TIME_UNSET;
+    }
+
+    /** Returns the demuxing throughput in bytes of sample data per second of {@code read}. */
+    public long getThroughputBytesPerSecond() {
+        return readUs > 0 ? sampleBytes * 1_000_000 / readUs : 0;
+    }
+
+    @Override
+    public String toString() {
+        return extractorName
+                + " sniff=" + sniffUs + "us"
+                + " startup=" + startupUs + "us"
+                + " seeks=" + seekCount
+                + " avgSeek=" + getAverageSeekUs() + "us"
+                + " maxSeek=" + maxSeekUs + "us"
+                + " samples=" + sampleCount
+                + " throughput=" + getThroughputBytesPerSecond() / 1024 + "KiB/s";
+    }
+}
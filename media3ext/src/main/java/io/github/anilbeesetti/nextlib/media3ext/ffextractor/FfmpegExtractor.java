@@ -0,0 +1,646 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffextractor;
+
+import static androidx.media3.common.util.Assertions.checkNotNull;
+
+import android.content.ContentResolver;
+import android.content.Context;
+import android.net.Uri;
+import android.os.ParcelFileDescriptor;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.C;
+import androidx.media3.common.DataReader;
+import androidx.media3.common.Format;
+import androidx.media3.common.MimeTypes;
+import androidx.media3.common.ParserException;
+import androidx.media3.common.util.Log;
+import androidx.media3.common.util.ParsableByteArray;
+import androidx.media3.common.util.UnstableApi;
+import androidx.media3.common.util.Util;
+import androidx.media3.extractor.AvcConfig;
+import androidx.media3.extractor.Extractor;
+import androidx.media3.extractor.ExtractorInput;
+import androidx.media3.extractor.ExtractorOutput;
+import androidx.media3.extractor.HevcConfig;
+import androidx.media3.extractor.OpusUtil;
+import androidx.media3.extractor.PositionHolder;
+import androidx.media3.extractor.SeekMap;
+import androidx.media3.extractor.SeekPoint;
+import androidx.media3.extractor.TrackOutput;
+
+import java.io.File;
+import java.io.FileNotFoundException;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.List;
+import java.util.Locale;
+
+import io.github.anilbeesetti.nextlib.media3ext.ffdecoder.FfmpegLibrary;
+
+/**
+ * Extracts Matroska, AVI and MPEG-TS files with libavformat.
+ *
+ * <p>The demuxer reads the file through its own descriptor with {@code pread}, so it can seek
+ * without reopening anything. The {@link ExtractorInput} is only used for sniffing, and is
+ * skipped along behind the demuxer, so that loading progress and the buffering checks of the
+ * player keep working. It is only reopened at the position of the demuxer after a seek, or when
+ * the demuxer jumps more than {@link #MAX_INPUT_SKIP_BYTES} away. Only local files ({@code
+ * file://} and {@code content://}) can be extracted.
+ *
+ * <p>SubRip, SSA, PGS, DVB and VobSub subtitle tracks are output in the sample format of {@code
+ * MatroskaExtractor}, so the usual subtitle parsers handle them.
+ *
+ * <p>H.264 and HEVC samples are converted to Annex-B and ADTS headers are stripped from AAC in
+ * place in native code, so a sample is copied once, straight into the sample queue.
+ */
+@UnstableApi
+public final class FfmpegExtractor implements Extractor {
+
+    private static final String TAG = "FfmpegExtractor";
+
+    // LINT.IfChange
+    private static final int EXTRACTOR_RESULT_END_OF_INPUT = -1;
+    private static final int STREAM_PARAM_COUNT = 11;
+    private static final int PACKET_INFO_COUNT = 5;
+    // LINT.ThenChange(../../../../../../../cpp/ffextractor.cpp)
+
+    private static final int PARAM_MEDIA_TYPE = 0;
+    private static final int PARAM_WIDTH = 1;
+    private static final int PARAM_HEIGHT = 2;
+    private static final int PARAM_ROTATION = 3;
+    private static final int PARAM_SAMPLE_RATE = 4;
+    private static final int PARAM_CHANNEL_COUNT = 5;
+    private static final int PARAM_FRAME_RATE_NUM = 6;
+    private static final int PARAM_FRAME_RATE_DEN = 7;
+    private static final int PARAM_BIT_RATE = 8;
+    private static final int PARAM_ASPECT_RATIO_NUM = 9;
+    private static final int PARAM_ASPECT_RATIO_DEN = 10;
+
+    // AVMediaType values.
+    private static final int AVMEDIA_TYPE_VIDEO = 0;
+    private static final int AVMEDIA_TYPE_AUDIO = 1;
+    private static final int AVMEDIA_TYPE_SUBTITLE = 3;
+
+    private static final int SNIFF_BYTES = 4096;
+    /** How far the demuxer may run ahead of the extractor input before the input is skipped. */
+    private static final long INPUT_SKIP_BYTES = 64 * 1024;
+    /** How far the input is skipped at most, it is reopened at the demuxer position instead. */
+    private static final long MAX_INPUT_SKIP_BYTES = 4 * 1024 * 1024;
+    private static final List<String> SUPPORTED_FORMATS =
+            Arrays.asList("matroska,webm", "avi", "mpegts");
+    // Length of a bare FLAC STREAMINFO block, as AVI and some Matroska muxers store it.
+    private static final int FLAC_STREAM_INFO_SIZE = 34;
+    // Text subtitle samples as MatroskaExtractor writes them: a cue starting at the sample time.
+    private static final String SUBRIP_PREFIX_FORMAT = "1\n00:00:00,000 --> %02d:%02d:%02d,%03d\n";
+    private static final String SSA_PREFIX_FORMAT = "Dialogue: 0:00:00:00,%01d:%02d:%02d:%02d,";
+    private static final byte[] SSA_DIALOGUE_FORMAT = Util.getUtf8Bytes("Format: Start, End, "
+            + "ReadOrder, Layer, Style, Name, MarginL, MarginR, MarginV, Effect, Text");
+
+    private final Context context;
+    private final Uri uri;
+    private final long[] packetInfo = new long[PACKET_INFO_COUNT];
+    private final int[] streamParams = new int[STREAM_PARAM_COUNT];
+    private final PacketReader packetReader = new PacketReader();
+    private final ParsableByteArray textSample = new ParsableByteArray();
+
+    private long nativeContext;
+    @Nullable private ExtractorOutput extractorOutput;
+    @Nullable private TrackOutput[] trackOutputs;
+    @Nullable private String[] trackMimeTypes;
+    private boolean inputSyncPending;
+
+    /**
+     * Creates an extractor for the file at {@code uri}, which must be supported according to
+     * {@link #isSupportedUri(Uri)}.
+     */
+    public FfmpegExtractor(Context context, Uri uri) {
+        this.context = context.getApplicationContext();
+        this.uri = uri;
+    }
+
+    /** Returns whether files at {@code uri} can be opened by this extractor. */
+    public static boolean isSupportedUri(Uri uri) {
+        String scheme = uri.getScheme();
+        return scheme == null
+                || ContentResolver.SCHEME_FILE.equals(scheme)
+                || ContentResolver.SCHEME_CONTENT.equals(scheme);
+    }
+
+    @Override
+    public boolean sniff(ExtractorInput input) throws IOException {
+        if (!FfmpegLibrary.isAvailable()) {
+            return false;
+        }
+        byte[] header = new byte[SNIFF_BYTES];
+        int length = 0;
+        while (length < SNIFF_BYTES) {
+            int result = input.peek(header, length, SNIFF_BYTES - length);
+            if (result == C.RESULT_END_OF_INPUT) {
+                break;
+            }
+            length += result;
+        }
+        // Only the peeked bytes are probed; the file is opened by the first read.
+        @Nullable String format = ffmpegProbe(header, length);
+        return format != null && SUPPORTED_FORMATS.contains(format);
+    }
+
+    @Override
+    public void init(ExtractorOutput output) {
+        extractorOutput = output;
+    }
+
+    @Override
+    public int read(ExtractorInput input, PositionHolder seekPosition) throws IOException {
+        @Nullable TrackOutput[] trackOutputs = this.trackOutputs;
+        if (trackOutputs == null) {
+            if (!open()) {
+                throw ParserException.createForUnsupportedContainerFeature(
+                        "FFmpeg could not open " + uri);
+            }
+            trackOutputs = setUpTracks(input.getLength());
+            this.trackOutputs = trackOutputs;
+        }
+        int streamIndex = ffmpegReadPacket(nativeContext, packetInfo);
+        if (streamIndex == EXTRACTOR_RESULT_END_OF_INPUT) {
+            return RESULT_END_OF_INPUT;
+        }
+        if (streamIndex < 0) {
+            throw new IOException("av_read_frame failed for " + uri);
+        }
+        // Streams can appear after the header in MPEG-TS; they are ignored.
+        @Nullable TrackOutput trackOutput =
+                streamIndex < trackOutputs.length ? trackOutputs[streamIndex] : null;
+        if (trackOutput != null) {
+            int size = (int) packetInfo[2];
+            @Nullable String mimeType = checkNotNull(trackMimeTypes)[streamIndex];
+            if (MimeTypes.APPLICATION_SUBRIP.equals(mimeType)
+                    || MimeTypes.TEXT_SSA.equals(mimeType)) {
+                outputTextSample(trackOutput, mimeType, size);
+            } else {
+                packetReader.reset(size);
+                while (packetReader.remaining() > 0) {
+                    trackOutput.sampleData(packetReader, packetReader.remaining(), false);
+                }
+                boolean keyFrame = packetInfo[1] != 0 || MimeTypes.isText(mimeType);
+                trackOutput.sampleMetadata(
+                        packetInfo[0], keyFrame ? C.BUFFER_FLAG_KEY_FRAME : 0, size, 0, null);
+            }
+        }
+
+        long demuxerPosition = packetInfo[3];
+        long lag = demuxerPosition - input.getPosition();
+        boolean diverged = inputSyncPending ? lag != 0 : lag < 0 || lag > MAX_INPUT_SKIP_BYTES;
+        inputSyncPending = false;
+        if (!diverged) {
+            if (lag >= INPUT_SKIP_BYTES) {
+                // The demuxer has just read these bytes, so they come from the page cache.
+                input.skipFully((int) lag);
+            }
+            return RESULT_CONTINUE;
+        }
+        // The demuxer seeked, or jumped to an index; reopening is cheaper than skipping there.
+        seekPosition.position = demuxerPosition;
+        return RESULT_SEEK;
+    }
+
+    @Override
+    public void seek(long position, long timeUs) {
+        if (nativeContext != 0 && trackOutputs != null) {
+            ffmpegSeek(nativeContext, timeUs);
+            // The input was moved to an estimated position, move it to the demuxer's instead.
+            inputSyncPending = true;
+        }
+    }
+
+    @Override
+    public void release() {
+        if (nativeContext != 0) {
+            ffmpegClose(nativeContext);
+            nativeContext = 0;
+        }
+    }
+
+    private boolean open() {
+        if (nativeContext != 0) {
+            return true;
+        }
+        try (ParcelFileDescriptor fileDescriptor = openFileDescriptor()) {
+            // The native side keeps a duplicate of the descriptor.
+            nativeContext = ffmpegOpen(fileDescriptor.getFd());
+        } catch (IOException | SecurityException e) {
+            Log.w(TAG, "Failed to open " + uri, e);
+            return false;
+        }
+        return nativeContext != 0;
+    }
+
+    private ParcelFileDescriptor openFileDescriptor() throws IOException {
+        if (ContentResolver.SCHEME_CONTENT.equals(uri.getScheme())) {
+            @Nullable ParcelFileDescriptor fileDescriptor =
+                    context.getContentResolver().openFileDescriptor(uri, "r");
+            if (fileDescriptor == null) {
+                throw new FileNotFoundException(uri.toString());
+            }
+            return fileDescriptor;
+        }
+        @Nullable String path = uri.getPath();
+        if (path == null) {
+            throw new FileNotFoundException(uri.toString());
+        }
+        return ParcelFileDescriptor.open(new File(path), ParcelFileDescriptor.MODE_READ_ONLY);
+    }
+
+    private TrackOutput[] setUpTracks(long inputLength) throws ParserException {
+        ExtractorOutput output = extractorOutput;
+        if (output == null) {
+            throw new IllegalStateException("read() called before init()");
+        }
+        int streamCount = ffmpegGetStreamCount(nativeContext);
+        TrackOutput[] outputs = new TrackOutput[streamCount];
+        String[] mimeTypes = new String[streamCount];
+        for (int i = 0; i < streamCount; i++) {
+            @Nullable Format format = buildFormat(i);
+            if (format == null) {
+                // Skip the packets of the stream in the demuxer already.
+                ffmpegSetStreamEnabled(nativeContext, i, false);
+                continue;
+            }
+            mimeTypes[i] = format.sampleMimeType;
+            outputs[i] = output.track(i, MimeTypes.getTrackType(format.sampleMimeType));
+            outputs[i].format(format);
+        }
+        trackMimeTypes = mimeTypes;
+        output.endTracks();
+        long durationUs = ffmpegGetDurationUs(nativeContext);
+        output.seekMap(durationUs > 0
+                ? new FfmpegSeekMap(durationUs, inputLength)
+                : new SeekMap.Unseekable(C.TIME_UNSET));
+        return outputs;
+    }
+
+    @Nullable
+    private Format buildFormat(int streamIndex) throws ParserException {
+        String codecName = ffmpegGetStreamCodecName(nativeContext, streamIndex);
+        ffmpegGetStreamParams(nativeContext, streamIndex, streamParams);
+        @Nullable byte[] extraData = ffmpegGetStreamExtraData(nativeContext, streamIndex);
+        Format.Builder builder = new Format.Builder()
+                .setId(streamIndex)
+                .setLanguage(ffmpegGetStreamLanguage(nativeContext, streamIndex));
+        if (streamParams[PARAM_BIT_RATE] > 0) {
+            builder.setAverageBitrate(streamParams[PARAM_BIT_RATE]);
+        }
+        switch (streamParams[PARAM_MEDIA_TYPE]) {
+            case AVMEDIA_TYPE_VIDEO:
+                return buildVideoFormat(builder, codecName, extraData);
+            case AVMEDIA_TYPE_AUDIO:
+                return buildAudioFormat(builder, codecName, extraData);
+            case AVMEDIA_TYPE_SUBTITLE:
+                return buildSubtitleFormat(builder, codecName, extraData);
+            default:
+                return null;
+        }
+    }
+
+    @Nullable
+    private Format buildVideoFormat(
+            Format.Builder builder, String codecName, @Nullable byte[] extraData)
+            throws ParserException {
+        @Nullable String mimeType = getVideoMimeType(codecName);
+        if (mimeType == null) {
+            return null;
+        }
+        builder.setSampleMimeType(mimeType)
+                .setWidth(streamParams[PARAM_WIDTH])
+                .setHeight(streamParams[PARAM_HEIGHT])
+                .setRotationDegrees(streamParams[PARAM_ROTATION]);
+        if (streamParams[PARAM_FRAME_RATE_NUM] > 0 && streamParams[PARAM_FRAME_RATE_DEN] > 0) {
+            builder.setFrameRate(
+                    (float) streamParams[PARAM_FRAME_RATE_NUM] / streamParams[PARAM_FRAME_RATE_DEN]);
+        }
+        if (streamParams[PARAM_ASPECT_RATIO_NUM] > 0 && streamParams[PARAM_ASPECT_RATIO_DEN] > 0) {
+            builder.setPixelWidthHeightRatio(
+                    (float) streamParams[PARAM_ASPECT_RATIO_NUM] / streamParams[PARAM_ASPECT_RATIO_DEN]);
+        }
+        if (extraData == null) {
+            return builder.build();
+        }
+        // avcC and hvcC records start with configurationVersion 1; anything else is Annex-B.
+        if (MimeTypes.VIDEO_H264.equals(mimeType) && extraData[0] == 1) {
+            AvcConfig config = AvcConfig.parse(new ParsableByteArray(extraData));
+            builder.setInitializationData(config.initializationData).setCodecs(config.codecs);
+        } else if (MimeTypes.VIDEO_H265.equals(mimeType) && extraData[0] == 1) {
+            HevcConfig config = HevcConfig.parse(new ParsableByteArray(extraData));
+            builder.setInitializationData(config.initializationData).setCodecs(config.codecs);
+        } else {
+            builder.setInitializationData(Collections.singletonList(extraData));
+        }
+        return builder.build();
+    }
+
+    @Nullable
+    private Format buildAudioFormat(
+            Format.Builder builder, String codecName, @Nullable byte[] extraData) {
+        @Nullable String mimeType = getAudioMimeType(codecName);
+        if (mimeType == null) {
+            return null;
+        }
+        builder.setSampleMimeType(mimeType)
+                .setSampleRate(streamParams[PARAM_SAMPLE_RATE])
+                .setChannelCount(streamParams[PARAM_CHANNEL_COUNT]);
+        switch (mimeType) {
+            case MimeTypes.AUDIO_RAW:
+                builder.setPcmEncoding(getPcmEncoding(codecName));
+                break;
+            case MimeTypes.AUDIO_VORBIS:
+                @Nullable List<byte[]> headers = extraData != null ? splitVorbisHeaders(extraData) : null;
+                if (headers == null) {
+                    Log.w(TAG, "Unsupported Vorbis setup data, skipping the track.");
+                    return null;
+                }
+                builder.setInitializationData(headers);
+                break;
+            case MimeTypes.AUDIO_OPUS:
+                if (extraData != null) {
+                    builder.setInitializationData(OpusUtil.buildInitializationData(extraData));
+                }
+                break;
+            case MimeTypes.AUDIO_FLAC:
+                if (extraData != null) {
+                    builder.setInitializationData(
+                            Collections.singletonList(toFlacHeader(extraData)));
+                }
+                break;
+            default:
+                if (extraData != null) {
+                    builder.setInitializationData(Collections.singletonList(extraData));
+                }
+                break;
+        }
+        return builder.build();
+    }
+
+    @Nullable
+    private static Format buildSubtitleFormat(
+            Format.Builder builder, String codecName, @Nullable byte[] extraData) {
+        @Nullable String mimeType = getSubtitleMimeType(codecName);
+        if (mimeType == null) {
+            return null;
+        }
+        builder.setSampleMimeType(mimeType);
+        switch (mimeType) {
+            case MimeTypes.TEXT_SSA:
+                if (extraData == null) {
+                    Log.w(TAG, "SSA track without a header, skipping the track.");
+                    return null;
+                }
+                builder.setInitializationData(Arrays.asList(SSA_DIALOGUE_FORMAT, extraData));
+                break;
+            case MimeTypes.APPLICATION_DVBSUBS:
+                // The composition and ancillary page ids.
+                if (extraData != null && extraData.length >= 4) {
+                    builder.setInitializationData(
+                            Collections.singletonList(Arrays.copyOf(extraData, 4)));
+                }
+                break;
+            case MimeTypes.APPLICATION_VOBSUB:
+                // The .idx header with the palette and the frame size.
+                if (extraData != null) {
+                    builder.setInitializationData(Collections.singletonList(extraData));
+                }
+                break;
+            default:
+                break;
+        }
+        return builder.build();
+    }
+
+    /**
+     * Writes a SubRip or SSA packet behind the timing line {@code MatroskaExtractor} gives such
+     * samples, which the parsers of these formats expect.
+     */
+    private void outputTextSample(TrackOutput trackOutput, String mimeType, int size) {
+        long durationUs = Math.max(0, packetInfo[4]);
+        long hours = durationUs / 3_600_000_000L;
+        long minutes = durationUs / 60_000_000L % 60;
+        long seconds = durationUs / 1_000_000L % 60;
+        String prefix = MimeTypes.TEXT_SSA.equals(mimeType)
+                ? String.format(Locale.US, SSA_PREFIX_FORMAT,
+                        hours, minutes, seconds, durationUs / 10_000 % 100)
+                : String.format(Locale.US, SUBRIP_PREFIX_FORMAT,
+                        hours, minutes, seconds, durationUs / 1_000 % 1_000);
+        byte[] prefixBytes = Util.getUtf8Bytes(prefix);
+        byte[] sample = Arrays.copyOf(prefixBytes, prefixBytes.length + size);
+        ffmpegCopyPacketData(nativeContext, 0, sample, prefixBytes.length, size);
+        textSample.reset(sample);
+        trackOutput.sampleData(textSample, sample.length);
+        trackOutput.sampleMetadata(packetInfo[0], C.BUFFER_FLAG_KEY_FRAME, sample.length, 0, null);
+    }
+
+    @Nullable
+    private static String getSubtitleMimeType(String codecName) {
+        return switch (codecName) {
+            case "subrip" -> MimeTypes.APPLICATION_SUBRIP;
+            case "ass" -> MimeTypes.TEXT_SSA;
+            case "hdmv_pgs_subtitle" -> MimeTypes.APPLICATION_PGS;
+            case "dvb_subtitle" -> MimeTypes.APPLICATION_DVBSUBS;
+            case "dvd_subtitle" -> MimeTypes.APPLICATION_VOBSUB;
+            default -> null;
+        };
+    }
+
+    @Nullable
+    private static String getVideoMimeType(String codecName) {
+        return switch (codecName) {
+            case "h264" -> MimeTypes.VIDEO_H264;
+            case "hevc" -> MimeTypes.VIDEO_H265;
+            case "mpeg1video" -> MimeTypes.VIDEO_MPEG;
+            case "mpeg2video" -> MimeTypes.VIDEO_MPEG2;
+            case "mpeg4" -> MimeTypes.VIDEO_MP4V;
+            case "h263" -> MimeTypes.VIDEO_H263;
+            case "vp8" -> MimeTypes.VIDEO_VP8;
+            case "vp9" -> MimeTypes.VIDEO_VP9;
+            case "av1" -> MimeTypes.VIDEO_AV1;
+            case "vc1" -> MimeTypes.VIDEO_VC1;
+            case "mjpeg" -> MimeTypes.VIDEO_MJPEG;
+            default -> null;
+        };
+    }
+
+    @Nullable
+    private static String getAudioMimeType(String codecName) {
+        if (getPcmEncoding(codecName) != C.ENCODING_INVALID) {
+            return MimeTypes.AUDIO_RAW;
+        }
+        return switch (codecName) {
+            case "aac" -> MimeTypes.AUDIO_AAC;
+            case "mp1" -> MimeTypes.AUDIO_MPEG_L1;
+            case "mp2" -> MimeTypes.AUDIO_MPEG_L2;
+            case "mp3" -> MimeTypes.AUDIO_MPEG;
+            case "ac3" -> MimeTypes.AUDIO_AC3;
+            case "eac3" -> MimeTypes.AUDIO_E_AC3;
+            case "truehd" -> MimeTypes.AUDIO_TRUEHD;
+            case "dts" -> MimeTypes.AUDIO_DTS;
+            case "vorbis" -> MimeTypes.AUDIO_VORBIS;
+            case "opus" -> MimeTypes.AUDIO_OPUS;
+            case "flac" -> MimeTypes.AUDIO_FLAC;
+            case "alac" -> MimeTypes.AUDIO_ALAC;
+            case "pcm_mulaw" -> MimeTypes.AUDIO_MLAW;
+            case "pcm_alaw" -> MimeTypes.AUDIO_ALAW;
+            case "amr_nb" -> MimeTypes.AUDIO_AMR_NB;
+            case "amr_wb" -> MimeTypes.AUDIO_AMR_WB;
+            default -> null;
+        };
+    }
+
+    private static @C.PcmEncoding int getPcmEncoding(String codecName) {
+        return switch (codecName) {
+            case "pcm_u8" -> C.ENCODING_PCM_8BIT;
+            case "pcm_s16le" -> C.ENCODING_PCM_16BIT;
+            case "pcm_s16be" -> C.ENCODING_PCM_16BIT_BIG_ENDIAN;
+            case "pcm_s24le" -> C.ENCODING_PCM_24BIT;
+            case "pcm_s32le" -> C.ENCODING_PCM_32BIT;
+            case "pcm_f32le" -> C.ENCODING_PCM_FLOAT;
+            default -> C.ENCODING_INVALID;
+        };
+    }
+
+    /**
+     * Splits Xiph laced Vorbis setup data into the identification and setup headers, dropping
+     * the comment header. Returns {@code null} if the data is not laced.
+     */
+    @Nullable
+    private static List<byte[]> splitVorbisHeaders(byte[] data) {
+        if (data.length < 3 || data[0] != 2) {
+            return null;
+        }
+        int offset = 1;
+        int[] sizes = new int[2];
+        for (int i = 0; i < sizes.length; i++) {
+            while (offset < data.length && (data[offset] & 0xFF) == 0xFF) {
+                sizes[i] += 0xFF;
+                offset++;
+            }
+            if (offset >= data.length) {
+                return null;
+            }
+            sizes[i] += data[offset++] & 0xFF;
+        }
+        int commentOffset = offset + sizes[0];
+        int setupOffset = commentOffset + sizes[1];
+        if (setupOffset >= data.length) {
+            return null;
+        }
+        return Arrays.asList(
+                Arrays.copyOfRange(data, offset, commentOffset),
+                Arrays.copyOfRange(data, setupOffset, data.length));
+    }
+
+    /** Returns FLAC setup data with the stream marker and block header the decoders expect. */
+    private static byte[] toFlacHeader(byte[] data) {
+        if (data.length != FLAC_STREAM_INFO_SIZE) {
+            return data;
+        }
+        byte[] header = new byte[8 + FLAC_STREAM_INFO_SIZE];
+        header[0] = 'f';
+        header[1] = 'L';
+        header[2] = 'a';
+        header[3] = 'C';
+        // Last metadata block, type STREAMINFO, 34 bytes.
+        header[4] = (byte) 0x80;
+        header[7] = FLAC_STREAM_INFO_SIZE;
+        System.arraycopy(data, 0, header, 8, FLAC_STREAM_INFO_SIZE);
+        return header;
+    }
+
+    /** Copies the current packet into the sample queue. */
+    private final class PacketReader implements DataReader {
+        private int size;
+        private int position;
+
+        void reset(int size) {
+            this.size = size;
+            position = 0;
+        }
+
+        int remaining() {
+            return size - position;
+        }
+
+        @Override
+        public int read(byte[] buffer, int offset, int length) {
+            if (position == size) {
+                return C.RESULT_END_OF_INPUT;
+            }
+            int count = Math.min(length, size - position);
+            ffmpegCopyPacketData(nativeContext, position, buffer, offset, count);
+            position += count;
+            return count;
+        }
+    }
+
+    /**
+     * Seeking is done by the demuxer from its own index, the positions here only tell the player
+     * where to reopen the input and are estimated from the average bitrate.
+     */
+    private static final class FfmpegSeekMap implements SeekMap {
+        private final long durationUs;
+        private final long inputLength;
+
+        FfmpegSeekMap(long durationUs, long inputLength) {
+            this.durationUs = durationUs;
+            this.inputLength = inputLength;
+        }
+
+        @Override
+        public boolean isSeekable() {
+            return true;
+        }
+
+        @Override
+        public long getDurationUs() {
+            return durationUs;
+        }
+
+        @Override
+        public SeekPoints getSeekPoints(long timeUs) {
+            long position = 0;
+            if (inputLength != C.LENGTH_UNSET) {
+                double fraction = Math.max(0, Math.min(1, (double) timeUs / durationUs));
+                position = (long) (fraction * inputLength);
+            }
+            return new SeekPoints(new SeekPoint(timeUs, position));
+        }
+    }
+
+    @Nullable
+    private static native String ffmpegProbe(byte[] data, int length);
+
+    private native long ffmpegOpen(int fd);
+
+    private native void ffmpegClose(long context);
+
+    private native int ffmpegGetStreamCount(long context);
+
+    private native long ffmpegGetDurationUs(long context);
+
+    private native String ffmpegGetStreamCodecName(long context, int index);
+
+    @Nullable
+    private native String ffmpegGetStreamLanguage(long context, int index);
+
+    private native void ffmpegGetStreamParams(long context, int index, int[] params);
+
+    @Nullable
+    private native byte[] ffmpegGetStreamExtraData(long context, int index);
+
+    private native void ffmpegSetStreamEnabled(long context, int index, boolean enabled);
+
+    private native int ffmpegReadPacket(long context, long[] info);
+
+    private native void ffmpegCopyPacketData(
+            long context, int packetOffset, byte[] target, int targetOffset, int length);
+
+    private native boolean ffmpegSeek(long context, long timeUs);
+}
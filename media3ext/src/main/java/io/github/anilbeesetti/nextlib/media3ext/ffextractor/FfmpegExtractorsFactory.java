@@ -0,0 +1,136 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffextractor;
+
+import android.content.Context;
+import android.net.Uri;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.util.UnstableApi;
+import androidx.media3.extractor.DefaultExtractorsFactory;
+import androidx.media3.extractor.Extractor;
+import androidx.media3.extractor.ExtractorsFactory;
+import androidx.media3.extractor.text.DefaultSubtitleParserFactory;
+import androidx.media3.extractor.text.SubtitleParser;
+import androidx.media3.extractor.text.SubtitleTranscodingExtractor;
+
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Puts {@link FfmpegExtractor} in front of the extractors of another factory for local files.
+ * Files that FFmpeg does not recognize as Matroska, AVI or MPEG-TS, and all remote media, are
+ * left to the other extractors.
+ *
+ * <pre>{@code
+ * new DefaultMediaSourceFactory(context, new FfmpegExtractorsFactory(context))
+ * }</pre>
+ */
+@UnstableApi
+public final class FfmpegExtractorsFactory implements ExtractorsFactory {
+
+    /** Receives the measurements of every extractor that was used, see {@link ExtractorMeasurements}. */
+    public interface MeasurementListener {
+        /** Called on the loading thread when the extractor of a media source is released. */
+        void onExtractorReleased(ExtractorMeasurements measurements);
+    }
+
+    private final Context context;
+    private final ExtractorsFactory fallbackFactory;
+    private boolean ffmpegExtractorEnabled = true;
+    private SubtitleParser.Factory subtitleParserFactory = new DefaultSubtitleParserFactory();
+    private boolean textTrackTranscodingEnabled = true;
+    @Nullable private MeasurementListener measurementListener;
+
+    public FfmpegExtractorsFactory(Context context) {
+        this(context, new DefaultExtractorsFactory());
+    }
+
+    /**
+     * @param context         A context to open {@code content://} URIs with.
+     * @param fallbackFactory Provides the extractors for everything FFmpeg does not handle.
+     */
+    public FfmpegExtractorsFactory(Context context, ExtractorsFactory fallbackFactory) {
+        this.context = context.getApplicationContext();
+        this.fallbackFactory = fallbackFactory;
+    }
+
+    /**
+     * Sets whether {@link FfmpegExtractor} is tried at all. Disabling it while measurements are
+     * enabled gives the numbers of the fallback extractors for the same files.
+     */
+    public synchronized FfmpegExtractorsFactory setFfmpegExtractorEnabled(boolean enabled) {
+        ffmpegExtractorEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * Sets a listener for the timings of the extractors created from now on, or {@code null} to
+     * stop measuring.
+     */
+    public synchronized FfmpegExtractorsFactory setMeasurementListener(
+            @Nullable MeasurementListener listener) {
+        measurementListener = listener;
+        return this;
+    }
+
+    /**
+     * Sets the parsers of the subtitle tracks of {@link FfmpegExtractor}, and forwards them to
+     * the fallback factory, so that bitmap subtitles of either can be parsed with {@code
+     * FfmpegSubtitleParserFactory}.
+     */
+    @Override
+    public synchronized FfmpegExtractorsFactory setSubtitleParserFactory(
+            SubtitleParser.Factory subtitleParserFactory) {
+        this.subtitleParserFactory = subtitleParserFactory;
+        fallbackFactory.setSubtitleParserFactory(subtitleParserFactory);
+        return this;
+    }
+
+    /**
+     * Sets whether the subtitle tracks of {@link FfmpegExtractor} are parsed during extraction,
+     * which is the default, and forwards the setting to the fallback factory.
+     */
+    @SuppressWarnings("deprecation")
+    @Override
+    public synchronized FfmpegExtractorsFactory experimentalSetTextTrackTranscodingEnabled(
+            boolean textTrackTranscodingEnabled) {
+        this.textTrackTranscodingEnabled = textTrackTranscodingEnabled;
+        fallbackFactory.experimentalSetTextTrackTranscodingEnabled(textTrackTranscodingEnabled);
+        return this;
+    }
+
+    @Override
+    public synchronized Extractor[] createExtractors() {
+        return wrap(fallbackFactory.createExtractors(), null);
+    }
+
+    @Override
+    public synchronized Extractor[] createExtractors(Uri uri, Map<String, List<String>> responseHeaders) {
+        Extractor[] extractors = fallbackFactory.createExtractors(uri, responseHeaders);
+        @Nullable Extractor ffmpegExtractor = null;
+        if (ffmpegExtractorEnabled && FfmpegExtractor.isSupportedUri(uri)) {
+            ffmpegExtractor = new FfmpegExtractor(context, uri);
+            if (textTrackTranscodingEnabled) {
+                // As the stock extractors do, so subtitles reach the text renderer as cues.
+                ffmpegExtractor =
+                        new SubtitleTranscodingExtractor(ffmpegExtractor, subtitleParserFactory);
+            }
+        }
+        return wrap(extractors, ffmpegExtractor);
+    }
+
+    private Extractor[] wrap(Extractor[] extractors, @Nullable Extractor first) {
+        int offset = first != null ? 1 : 0;
+        Extractor[] result = new Extractor[extractors.length + offset];
+        if (first != null) {
+            result[0] = first;
+        }
+        System.arraycopy(extractors, 0, result, offset, extractors.length);
+        @Nullable MeasurementListener listener = measurementListener;
+        if (listener != null) {
+            for (int i = 0; i < result.length; i++) {
+                result[i] = new MeasuringExtractor(result[i], listener);
+            }
+        }
+        return result;
+    }
+}
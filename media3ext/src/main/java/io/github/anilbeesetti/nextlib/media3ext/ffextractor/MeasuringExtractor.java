@@ -0,0 +1,167 @@
+package io.github.anilbeesetti.nextlib.media3ext.ffextractor;
+
+import android.os.SystemClock;
+
+import androidx.annotation.Nullable;
+import androidx.media3.common.C;
+import androidx.media3.common.DataReader;
+import androidx.media3.common.Format;
+import androidx.media3.common.util.ParsableByteArray;
+import androidx.media3.extractor.Extractor;
+import androidx.media3.extractor.ExtractorInput;
+import androidx.media3.extractor.ExtractorOutput;
+import androidx.media3.extractor.PositionHolder;
+import androidx.media3.extractor.SeekMap;
+import androidx.media3.extractor.TrackOutput;
+
+import java.io.IOException;
+
+/**
+ * Wraps an extractor and times it: sniffing, the first sample, every seek until the next
+ * sample, and the time spent reading. The measurements are reported on release if the
+ * extractor was used.
+ */
+/* package */ final class MeasuringExtractor implements Extractor {
+
+    private final Extractor extractor;
+    private final FfmpegExtractorsFactory.MeasurementListener listener;
+
+    private long sniffUs;
+    private long initTimeUs = C.TIME_UNSET;
+    private long startupUs = C.TIME_UNSET;
+    private long seekTimeUs = C.TIME_UNSET;
+    private int seekCount;
+    private long totalSeekUs;
+    private long maxSeekUs;
+    private long readUs;
+    private long sampleCount;
+    private long sampleBytes;
+
+    MeasuringExtractor(Extractor extractor, FfmpegExtractorsFactory.MeasurementListener listener) {
+        this.extractor = extractor;
+        this.listener = listener;
+    }
+
+    @Override
+    public boolean sniff(ExtractorInput input) throws IOException {
+        long startUs = nowUs();
+        try {
+            return extractor.sniff(input);
+        } finally {
+            sniffUs += nowUs() - startUs;
+        }
+    }
+
+    @Override
+    public void init(ExtractorOutput output) {
+        initTimeUs = nowUs();
+        extractor.init(new MeasuringOutput(output));
+    }
+
+    @Override
+    public int read(ExtractorInput input, PositionHolder seekPosition) throws IOException {
+        long startUs = nowUs();
+        try {
+            return extractor.read(input, seekPosition);
+        } finally {
+            readUs += nowUs() - startUs;
+        }
+    }
+
+    @Override
+    public void seek(long position, long timeUs) {
+        seekTimeUs = nowUs();
+        extractor.seek(position, timeUs);
+    }
+
+    @Override
+    public void release() {
+        extractor.release();
+        if (initTimeUs != C.TIME_UNSET) {
+            listener.onExtractorReleased(new ExtractorMeasurements(
+                    extractor.getUnderlyingImplementation().getClass().getSimpleName(),
+                    sniffUs, startupUs, seekCount, totalSeekUs, maxSeekUs, readUs, sampleCount,
+                    sampleBytes));
+        }
+    }
+
+    @Override
+    public Extractor getUnderlyingImplementation() {
+        return extractor.getUnderlyingImplementation();
+    }
+
+    private void onSample(int size) {
+        long nowUs = nowUs();
+        if (startupUs == C.TIME_UNSET) {
+            startupUs = nowUs - initTimeUs;
+        }
+        if (seekTimeUs != C.TIME_UNSET) {
+            long seekUs = nowUs - seekTimeUs;
+            seekTimeUs = C.TIME_UNSET;
+            seekCount++;
+            totalSeekUs += seekUs;
+            maxSeekUs = Math.max(maxSeekUs, seekUs);
+        }
+        sampleCount++;
+        sampleBytes += size;
+    }
+
+    private static long nowUs() {
+        return SystemClock.elapsedRealtimeNanos() / 1000;
+    }
+
+    private final class MeasuringOutput implements ExtractorOutput {
+        private final ExtractorOutput output;
+
+        MeasuringOutput(ExtractorOutput output) {
+            this.output = output;
+        }
+
+        @Override
+        public TrackOutput track(int id, int type) {
+            return new MeasuringTrackOutput(output.track(id, type));
+        }
+
+        @Override
+        public void endTracks() {
+            output.endTracks();
+        }
+
+        @Override
+        public void seekMap(SeekMap seekMap) {
+            output.seekMap(seekMap);
+        }
+    }
+
+    private final class MeasuringTrackOutput implements TrackOutput {
+        private final TrackOutput output;
+
+        MeasuringTrackOutput(TrackOutput output) {
+            this.output = output;
+        }
+
+        @Override
+        public void format(Format format) {
+            output.format(format);
+        }
+
+        @Override
+        public int sampleData(DataReader input, int length, boolean allowEndOfInput,
+                              @SampleDataPart int sampleDataPart) throws IOException {
+            return output.sampleData(input, length, allowEndOfInput, sampleDataPart);
+        }
+
+        @Override
+        public void sampleData(ParsableByteArray data, int length,
+                               @SampleDataPart int sampleDataPart) {
+            output.sampleData(data, length, sampleDataPart);
+        }
+
+        @Override
+        public void sampleMetadata(long timeUs, @C.BufferFlags int flags, int size, int offset,
+                                   @Nullable CryptoData cryptoData) {
+            onSample(size);
+            output.sampleMetadata(timeUs, flags, size, offset, cryptoData);
+        }
+    }
+}
@@ -0,0 +1,4 @@
+@NonNullApi
+package io.github.anilbeesetti.nextlib.media3ext.ffextractor;
+
+import androidx.media3.common.util.NonNullApi;
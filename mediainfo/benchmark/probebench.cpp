@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include "fd_input.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Opens each file the ways MediaInfoBuilder can and prints, for each, the median time to open
+ * it and find the stream info, which is what building a MediaInfo costs, and to then seek to
+ * the middle and read a video packet, which is what loading a frame adds. Files whose index is
+ * at the end, such as MP4 files with the moov atom last, and large MKV files show the
+ * difference between reading a descriptor as a pipe, which cannot seek, and with pread or mmap.
+ * With -c the page cache of the file is dropped before each iteration, as far as the kernel
+ * allows, to measure cold opens.
+ */
+
+namespace {
+    enum Mode {
+        MODE_PIPE,
+        MODE_PATH,
+        MODE_PREAD,
+        MODE_MMAP,
+    };
+
+    const char *const kModeNames[] = {"pipe", "path", "pread", "mmap"};
+
+    struct Timing {
+        int64_t probeUs;
+        int64_t seekUs;
+    };
+
+    void usage(const char *program) {
+        fprintf(stderr, "Usage: %s [-n iterations] [-c] file...\n", program);
+        exit(2);
+    }
+
+    void dropCache(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+
+    int openInput(AVFormatContext **avFormatContext, const char *path, int fd, Mode mode) {
+        switch (mode) {
+            case MODE_PIPE: {
+                char pipe[32];
+                snprintf(pipe, sizeof(pipe), "pipe:%d", fd);
+                return avformat_open_input(avFormatContext, pipe, nullptr, nullptr);
+            }
+            case MODE_PATH:
+                return avformat_open_input(avFormatContext, path, nullptr, nullptr);
+            default:
+                return fd_input_open(avFormatContext, fd, mode == MODE_MMAP);
+        }
+    }
+
+    /**
+     * Opens path once in mode. Returns 0 or a negative AVERROR.
+     */
+    int measure(const char *path, Mode mode, Timing *timing) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return AVERROR(errno);
+        }
+        int64_t startUs = av_gettime_relative();
+        AVFormatContext *avFormatContext = nullptr;
+        int result = openInput(&avFormatContext, path, fd, mode);
+        if (result == 0) {
+            result = avformat_find_stream_info(avFormatContext, nullptr);
+        }
+        timing->probeUs = av_gettime_relative() - startUs;
+
+        timing->seekUs = -1;
+        int videoIndex = result < 0 ? -1 : av_find_best_stream(
+                avFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (videoIndex >= 0 && avFormatContext->duration > 0) {
+            startUs = av_gettime_relative();
+            AVStream *stream = avFormatContext->streams[videoIndex];
+            int64_t timestamp = av_rescale_q(avFormatContext->duration / 2, AV_TIME_BASE_Q,
+                                             stream->time_base);
+            if (av_seek_frame(avFormatContext, videoIndex, timestamp, AVSEEK_FLAG_BACKWARD) >= 0) {
+                AVPacket *packet = av_packet_alloc();
+                while (av_read_frame(avFormatContext, packet) >= 0) {
+                    bool found = packet->stream_index == videoIndex;
+                    av_packet_unref(packet);
+                    if (found) {
+                        timing->seekUs = av_gettime_relative() - startUs;
+                        break;
+                    }
+                }
+                av_packet_free(&packet);
+            }
+        }
+
+        fd_input_close(&avFormatContext);
+        close(fd);
+        return result < 0 ? result : 0;
+    }
+
+    int64_t median(std::vector<int64_t> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = 5;
+    bool cold = false;
+    int option;
+    while ((option = getopt(argc, argv, "n:c")) != -1) {
+        if (option == 'n' && atoi(optarg) > 0) {
+            iterations = atoi(optarg);
+        } else if (option == 'c') {
+            cold = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%-32s %-6s %10s %10s\n", "file", "mode", "probe ms", "seek ms");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        for (int mode = MODE_PIPE; mode <= MODE_MMAP; mode++) {
+            std::vector<int64_t> probeUs;
+            std::vector<int64_t> seekUs;
+            int result = 0;
+            for (int iteration = 0; iteration < iterations && result == 0; iteration++) {
+                if (cold) {
+                    dropCache(argv[i]);
+                }
+                Timing timing{};
+                result = measure(argv[i], static_cast<Mode>(mode), &timing);
+                probeUs.push_back(timing.probeUs);
+                seekUs.push_back(timing.seekUs);
+            }
+            if (result < 0) {
+                char error[AV_ERROR_MAX_STRING_SIZE];
+                av_strerror(result, error, sizeof(error));
+                printf("%-32s %-6s %10s (%s)\n", argv[i], kModeNames[mode], "failed", error);
+                // The pipe protocol is expected to fail on files it cannot read in order.
+                status = mode == MODE_PIPE ? status : 1;
+                continue;
+            }
+            char seek[16] = "-";
+            if (median(seekUs) >= 0) {
+                snprintf(seek, sizeof(seek), "%.1f", (double) median(seekUs) / 1000);
+            }
+            printf("%-32s %-6s %10.1f %10s\n", argv[i], kModeNames[mode],
+                   (double) median(probeUs) / 1000, seek);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,218 @@
+#include "fd_input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+// Buffer of the AVIOContext, which demuxers read through in small pieces.
+static const int kIoBufferSize = 64 * 1024;
+// Read from the file at once. Probing reads the header and, for MP4 files with the index at
+// the end, the tail, so a few large reads replace many small ones, which matters most for
+// descriptors served through FUSE or a content provider.
+static const int kReadAheadSize = 1024 * 1024;
+// Alignment of the read-ahead window in the file and in memory.
+static const int kReadAlignment = 4096;
+
+/**
+ * State of the custom IO context, its opaque pointer.
+ */
+struct FdInput {
+    int fd = -1;
+    // Size of the file, or -1 if it is not a regular file.
+    int64_t size = -1;
+    int64_t position = 0;
+    // The whole file if it is memory mapped.
+    uint8_t *map = nullptr;
+    // Read-ahead window of windowSize bytes from windowStart, if the file is read with pread.
+    uint8_t *window = nullptr;
+    int64_t windowStart = 0;
+    int windowSize = 0;
+};
+
+static void fd_input_free(FdInput *input) {
+    if (input->map) {
+        munmap(input->map, (size_t) input->size);
+    }
+    free(input->window);
+    if (input->fd >= 0) {
+        close(input->fd);
+    }
+    delete input;
+}
+
+static void fd_input_free_io(AVIOContext *avioContext) {
+    auto *input = static_cast<FdInput *>(avioContext->opaque);
+    av_freep(&avioContext->buffer);
+    avio_context_free(&avioContext);
+    fd_input_free(input);
+}
+
+/**
+ * Reads up to size bytes at position, retrying when interrupted. pread64 keeps offsets past
+ * 2 GiB on 32-bit ABIs.
+ */
+static ssize_t fd_input_pread(int fd, uint8_t *buffer, size_t size, int64_t position) {
+    ssize_t result;
+    do {
+        result = pread64(fd, buffer, size, position);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+static int fd_input_read(void *opaque, uint8_t *buffer, int size) {
+    auto *input = static_cast<FdInput *>(opaque);
+    if (!input->map && !input->window) {
+        // Not seekable, read in order like the pipe protocol.
+        ssize_t result;
+        do {
+            result = read(input->fd, buffer, size);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            return AVERROR(errno);
+        }
+        return result == 0 ? AVERROR_EOF : static_cast<int>(result);
+    }
+    if (input->position >= input->size) {
+        return AVERROR_EOF;
+    }
+    int64_t available = input->size - input->position;
+    if (input->map) {
+        int count = static_cast<int>(std::min<int64_t>(size, available));
+        memcpy(buffer, input->map + input->position, count);
+        input->position += count;
+        return count;
+    }
+    int64_t offset = input->position - input->windowStart;
+    if (offset < 0 || offset >= input->windowSize) {
+        if (size >= kReadAheadSize) {
+            // Too large to gain from the window.
+            ssize_t result = fd_input_pread(input->fd, buffer, size, input->position);
+            if (result < 0) {
+                return AVERROR(errno);
+            }
+            if (result == 0) {
+                return AVERROR_EOF;
+            }
+            input->position += result;
+            return static_cast<int>(result);
+        }
+        int64_t start = input->position & ~static_cast<int64_t>(kReadAlignment - 1);
+        ssize_t result = fd_input_pread(input->fd, input->window, kReadAheadSize, start);
+        if (result < 0) {
+            input->windowSize = 0;
+            return AVERROR(errno);
+        }
+        input->windowStart = start;
+        input->windowSize = static_cast<int>(result);
+        offset = input->position - start;
+        if (offset >= input->windowSize) {
+            // The file is shorter than it was.
+            return AVERROR_EOF;
+        }
+    }
+    int count = static_cast<int>(std::min<int64_t>(size, input->windowSize - offset));
+    memcpy(buffer, input->window + offset, count);
+    input->position += count;
+    return count;
+}
+
+static int64_t fd_input_seek(void *opaque, int64_t offset, int whence) {
+    auto *input = static_cast<FdInput *>(opaque);
+    int64_t position;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return input->size;
+        case SEEK_SET:
+            position = offset;
+            break;
+        case SEEK_CUR:
+            position = input->position + offset;
+            break;
+        case SEEK_END:
+            position = input->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (position < 0) {
+        return AVERROR(EINVAL);
+    }
+    input->position = position;
+    return position;
+}
+
+int fd_input_open(AVFormatContext **avFormatContext, int fd, bool memoryMapped) {
+    auto *input = new FdInput();
+    input->fd = dup(fd);
+    if (input->fd < 0) {
+        int result = AVERROR(errno);
+        fd_input_free(input);
+        return result;
+    }
+    struct stat fileStat{};
+    if (fstat(input->fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+        input->size = fileStat.st_size;
+    }
+    if (input->size > 0 && memoryMapped && static_cast<uint64_t>(input->size) <= SIZE_MAX) {
+        void *map = mmap(nullptr, static_cast<size_t>(input->size), PROT_READ, MAP_SHARED,
+                         input->fd, 0);
+        if (map != MAP_FAILED) {
+            input->map = static_cast<uint8_t *>(map);
+        } else {
+            LOGW("mmap failed, reading with pread: %s", strerror(errno));
+        }
+    }
+    if (input->size >= 0 && !input->map) {
+        void *window = nullptr;
+        if (posix_memalign(&window, kReadAlignment, kReadAheadSize) != 0) {
+            fd_input_free(input);
+            return AVERROR(ENOMEM);
+        }
+        input->window = static_cast<uint8_t *>(window);
+    }
+    bool seekable = input->map || input->window;
+
+    auto *buffer = static_cast<uint8_t *>(av_malloc(kIoBufferSize));
+    AVIOContext *avioContext = buffer ? avio_alloc_context(buffer, kIoBufferSize, 0, input,
+                                                           fd_input_read, nullptr,
+                                                           seekable ? fd_input_seek : nullptr)
+                                      : nullptr;
+    AVFormatContext *context = avioContext ? avformat_alloc_context() : nullptr;
+    if (!context) {
+        if (avioContext) {
+            fd_input_free_io(avioContext);
+        } else {
+            av_free(buffer);
+            fd_input_free(input);
+        }
+        return AVERROR(ENOMEM);
+    }
+    context->pb = avioContext;
+    context->flags |= AVFMT_FLAG_CUSTOM_IO;
+    int result = avformat_open_input(&context, nullptr, nullptr, nullptr);
+    if (result < 0) {
+        // The context is freed on failure, the custom IO context is left to the caller.
+        fd_input_free_io(avioContext);
+        return result;
+    }
+    *avFormatContext = context;
+    return 0;
+}
+
+void fd_input_close(AVFormatContext **avFormatContext) {
+    if (!*avFormatContext) {
+        return;
+    }
+    AVIOContext *avioContext = ((*avFormatContext)->flags & AVFMT_FLAG_CUSTOM_IO)
+                               ? (*avFormatContext)->pb : nullptr;
+    avformat_close_input(avFormatContext);
+    if (avioContext) {
+        fd_input_free_io(avioContext);
+    }
+}
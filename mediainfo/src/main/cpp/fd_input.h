@@ -0,0 +1,28 @@
+#ifndef NEXTPLAYER_FD_INPUT_H
+#define NEXTPLAYER_FD_INPUT_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * Opens a file descriptor for demuxing through a custom AVIOContext, in place of the "pipe:"
+ * protocol, which cannot seek.
+ *
+ * The descriptor is duplicated, so the caller may close it. Regular files are read with pread
+ * through a large read-ahead window at page aligned offsets, or memory mapped as a whole if
+ * memoryMapped is set and the file fits in the address space. Mapped files must not be
+ * truncated while open. Descriptors that cannot seek, such as pipes, are read sequentially.
+ *
+ * @param avFormatContext set to the opened context on success
+ * @return 0 or a negative AVERROR
+ */
+int fd_input_open(AVFormatContext **avFormatContext, int fd, bool memoryMapped);
+
+/**
+ * Closes an input opened by fd_input_open() or avformat_open_input(), releasing the custom IO
+ * context if it has one.
+ */
+void fd_input_close(AVFormatContext **avFormatContext);
+
+#endif //NEXTPLAYER_FD_INPUT_H
@@ -44,7 +44,7 @@ bool frame_extractor_load_frame(JNIEnv *env, int64_t jFrameLoaderContextHandle,
 
     auto pixelFormat = static_cast<AVPixelFormat>(frameLoaderContext->parameters->format);
     if (pixelFormat == AV_PIX_FMT_NONE) {
-        // With pipe protocol some files fail to provide pixel format info.
+        // Some files fail to provide pixel format info, e.g. when the stream could not be probed.
         // In this case we can't establish neither scaling nor even a frame extracting.
         return false;
     }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include "utils.h"
 #include "log.h"
+#include "fd_input.h"
 #include "frame_loader_context.h"
 
 extern "C" {
@@ -44,15 +45,21 @@ void onMediaInfoFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *a
                                     duration_ms);
 }
 
-void onVideoStreamFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *avFormatContext,
-                        int index) {
+/**
+ * Reports a video stream. A frame loader, which takes over the avFormatContext, is created for
+ * it if withFrameLoader is set and the stream can be decoded.
+ *
+ * @return whether a frame loader was created
+ */
+bool onVideoStreamFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *avFormatContext,
+                        int index, bool withFrameLoader) {
     AVStream *stream = avFormatContext->streams[index];
     AVCodecParameters *parameters = stream->codecpar;
 
     auto codecDescriptor = avcodec_descriptor_get(parameters->codec_id);
 
     int64_t frameLoaderContextHandle = -1;
-    auto *decoder = avcodec_find_decoder(parameters->codec_id);
+    auto *decoder = withFrameLoader ? avcodec_find_decoder(parameters->codec_id) : nullptr;
     if (decoder != nullptr) {
         auto *frameLoaderContext = (FrameLoaderContext *) malloc(sizeof(FrameLoaderContext));;
         frameLoaderContext->avFormatContext = avFormatContext;
@@ -119,6 +126,7 @@ void onVideoStreamFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext
                                     parameters->height,
                                     rotation,
                                     frameLoaderContextHandle);
+    return frameLoaderContextHandle != -1;
 }
 
 void onAudioStreamFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *avFormatContext,
@@ -203,16 +211,12 @@ void onChapterFound(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *avF
                                     end_ms);
 }
 
-void media_info_build(JNIEnv *env, jobject jMediaInfoBuilder, const char *uri) {
-    AVFormatContext *avFormatContext = nullptr;
-    if (int result = avformat_open_input(&avFormatContext, uri, nullptr, nullptr)) {
-        LOGE("ERROR Could not open file %s - %s", uri, av_err2str(result));
-        onError(env, jMediaInfoBuilder);
-        return;
-    }
-
+/**
+ * Reports the media info of an opened input and takes ownership of it.
+ */
+void media_info_build(JNIEnv *env, jobject jMediaInfoBuilder, AVFormatContext *avFormatContext) {
     if (avformat_find_stream_info(avFormatContext, nullptr) < 0) {
-        avformat_free_context(avFormatContext);
+        fd_input_close(&avFormatContext);
         LOGE("ERROR Could not get the stream info");
         onError(env, jMediaInfoBuilder);
         return;
@@ -220,12 +224,17 @@ void media_info_build(JNIEnv *env, jobject jMediaInfoBuilder, const char *uri) {
 
     onMediaInfoFound(env, jMediaInfoBuilder, avFormatContext);
 
+    // MediaInfoBuilder only keeps the first video stream, so only it gets a frame loader.
+    bool videoStreamFound = false;
+    bool frameLoaderCreated = false;
     for (int pos = 0; pos < avFormatContext->nb_streams; pos++) {
         AVCodecParameters *parameters = avFormatContext->streams[pos]->codecpar;
         AVMediaType type = parameters->codec_type;
         switch (type) {
             case AVMEDIA_TYPE_VIDEO:
-                onVideoStreamFound(env, jMediaInfoBuilder, avFormatContext, pos);
+                frameLoaderCreated |= onVideoStreamFound(env, jMediaInfoBuilder, avFormatContext,
+                                                         pos, !videoStreamFound);
+                videoStreamFound = true;
                 break;
             case AVMEDIA_TYPE_AUDIO:
                 onAudioStreamFound(env, jMediaInfoBuilder, avFormatContext, pos);
@@ -241,17 +250,26 @@ void media_info_build(JNIEnv *env, jobject jMediaInfoBuilder, const char *uri) {
     for (int pos = 0; pos < avFormatContext->nb_chapters; pos++) {
         onChapterFound(env, jMediaInfoBuilder, avFormatContext, pos);
     }
+
+    if (!frameLoaderCreated) {
+        fd_input_close(&avFormatContext);
+    }
 }
 
 extern "C"
 JNIEXPORT void JNICALL
 Java_io_github_anilbeesetti_nextlib_mediainfo_MediaInfoBuilder_nativeCreateFromFD(JNIEnv *env,
                                                                                   jobject thiz,
-                                                                                  jint file_descriptor) {
-    char pipe[32];
-    sprintf(pipe, "pipe:%d", file_descriptor);
+                                                                                  jint file_descriptor,
+                                                                                  jboolean memory_mapped) {
+    AVFormatContext *avFormatContext = nullptr;
+    if (int result = fd_input_open(&avFormatContext, file_descriptor, memory_mapped)) {
+        LOGE("ERROR Could not open file descriptor %d - %s", file_descriptor, av_err2str(result));
+        onError(env, thiz);
+        return;
+    }
 
-    media_info_build(env, thiz, pipe);
+    media_info_build(env, thiz, avFormatContext);
 }
 
 extern "C"
@@ -261,7 +279,16 @@ Java_io_github_anilbeesetti_nextlib_mediainfo_MediaInfoBuilder_nativeCreateFromP
                                                                                     jstring jFilePath) {
     const char *cFilePath = env->GetStringUTFChars(jFilePath, nullptr);
 
-    media_info_build(env, thiz, cFilePath);
-
+    AVFormatContext *avFormatContext = nullptr;
+    int result = avformat_open_input(&avFormatContext, cFilePath, nullptr, nullptr);
+    if (result) {
+        LOGE("ERROR Could not open file %s - %s", cFilePath, av_err2str(result));
+    }
     env->ReleaseStringUTFChars(jFilePath, cFilePath);
-}
\ No newline at end of file
+    if (result) {
+        onError(env, thiz);
+        return;
+    }
+
+    media_info_build(env, thiz, avFormatContext);
+}
@@ -24,8 +24,14 @@ class MediaInfoBuilder {
         nativeCreateFromPath(filePath)
     }
 
-    fun from(descriptor: ParcelFileDescriptor) = apply {
-        nativeCreateFromFD(descriptor.fd)
+    /**
+     * Reads the media info from a file descriptor, which may be closed once this returns. Files
+     * are read with pread, so the descriptor's offset is left as is, or memory mapped if
+     * [memoryMapped] is set, which saves copies but must not be used for files that may be
+     * truncated while a frame loader reads them.
+     */
+    fun from(descriptor: ParcelFileDescriptor, memoryMapped: Boolean = false) = apply {
+        nativeCreateFromFD(descriptor.fd, memoryMapped)
     }
 
     fun from(context: Context, uri: Uri) = apply {
@@ -37,8 +43,7 @@ class MediaInfoBuilder {
                     from(path)
                 } else {
                     try {
-                        val descriptor = context.contentResolver.openFileDescriptor(uri, "r")
-                        if (descriptor != null) {
+                        context.contentResolver.openFileDescriptor(uri, "r")?.use { descriptor ->
                             from(descriptor)
                         }
                     } catch (e: FileNotFoundException) {
@@ -192,7 +197,7 @@ class MediaInfoBuilder {
     }
 
     @Keep
-    private external fun nativeCreateFromFD(fileDescriptor: Int)
+    private external fun nativeCreateFromFD(fileDescriptor: Int, memoryMapped: Boolean)
 
     @Keep
     private external fun nativeCreateFromPath(filePath: String)